@@ -6,11 +6,16 @@
 
 #include <vector>
 
+extern "C" {
+#include <X11/Xatom.h>
+}
+
 #include "base/logging.h"
 #include "window_manager/util.h"
 #include "window_manager/x11/x_connection.h"
 
 using base::hash_map;
+using std::make_pair;
 using std::string;
 using std::vector;
 using window_manager::util::FindWithDefault;
@@ -30,12 +35,14 @@ static const AtomInfo kAtomInfos[] = {
   { ATOM_ATOM,                         "ATOM" },
   { ATOM_CARDINAL,                     "CARDINAL" },
   { ATOM_CHROME_GET_SERVER_TIME,       "_CHROME_GET_SERVER_TIME" },
+  { ATOM_CHROME_FRAME_STATS,           "_CHROME_FRAME_STATS" },
   { ATOM_CHROME_FREEZE_UPDATES,        "_CHROME_FREEZE_UPDATES" },
   { ATOM_CHROME_LOGGED_IN,             "_CHROME_LOGGED_IN" },
   { ATOM_CHROME_STATE,                 "_CHROME_STATE" },
   { ATOM_CHROME_STATE_COLLAPSED_PANEL, "_CHROME_STATE_COLLAPSED_PANEL" },
   { ATOM_CHROME_VIDEO_TIME,            "_CHROME_VIDEO_TIME" },
   { ATOM_CHROME_WINDOW_TYPE,           "_CHROME_WINDOW_TYPE" },
+  { ATOM_CHROME_WM_COUNTERS,           "_CHROME_WM_COUNTERS" },
   { ATOM_CHROME_WM_MESSAGE,            "_CHROME_WM_MESSAGE" },
   { ATOM_MANAGER,                      "MANAGER" },
   { ATOM_NET_ACTIVE_WINDOW,            "_NET_ACTIVE_WINDOW" },
@@ -96,6 +103,14 @@ AtomCache::AtomCache(XConnection* xconn)
   for (int i = 0; i < kNumAtoms; ++i)
     names.push_back(kAtomInfos[i].name);
 
+  // Send the requests for the predefined atoms' names before interning our
+  // atoms; the replies will have arrived by the time that GetAtoms()
+  // returns.
+  vector<XAtom> predefined_xatoms;
+  for (XAtom xatom = 1; xatom <= XA_LAST_PREDEFINED; ++xatom)
+    predefined_xatoms.push_back(xatom);
+  PrefetchNames(predefined_xatoms);
+
   CHECK(xconn_->GetAtoms(names, &xatoms));
   CHECK(xatoms.size() == kNumAtoms);
 
@@ -105,6 +120,24 @@ AtomCache::AtomCache(XConnection* xconn)
     atom_to_xatom_[kAtomInfos[i].atom] = xatoms[i];
     xatom_to_string_[xatoms[i]] = kAtomInfos[i].name;
   }
+
+  // GetAtoms() required a round trip, so the predefined atoms' name
+  // replies have already arrived and reading them won't block.
+  for (hash_map<XAtom, XConnection::RequestCookie>::const_iterator it =
+         pending_name_requests_.begin();
+       it != pending_name_requests_.end(); ++it) {
+    ReadNameReply(it->first, it->second);
+  }
+  pending_name_requests_.clear();
+}
+
+AtomCache::~AtomCache() {
+  for (hash_map<XAtom, XConnection::RequestCookie>::const_iterator it =
+         pending_name_requests_.begin();
+       it != pending_name_requests_.end(); ++it) {
+    xconn_->DiscardReply(it->second);
+  }
+  pending_name_requests_.clear();
 }
 
 XAtom AtomCache::GetXAtom(Atom atom) const {
@@ -120,13 +153,57 @@ const string& AtomCache::GetName(XAtom xatom) {
   if (it != xatom_to_string_.end())
     return it->second;
 
-  string name;
-  if (!xconn_->GetAtomName(xatom, &name)) {
+  // Use the reply to an earlier request if there is one.
+  XConnection::RequestCookie cookie;
+  hash_map<XAtom, XConnection::RequestCookie>::iterator request_it =
+      pending_name_requests_.find(xatom);
+  if (request_it != pending_name_requests_.end()) {
+    cookie = request_it->second;
+    pending_name_requests_.erase(request_it);
+  } else {
+    cookie = xconn_->SendGetAtomNameRequest(xatom);
+  }
+
+  if (!ReadNameReply(xatom, cookie)) {
     LOG(ERROR) << "Unable to look up name for atom " << XidStr(xatom);
     static const string kEmptyName = "";
     return kEmptyName;
   }
-  return xatom_to_string_.insert(make_pair(xatom, name)).first->second;
+  return xatom_to_string_[xatom];
+}
+
+void AtomCache::PrefetchNames(const vector<XAtom>& xatoms) {
+  // Discard the replies to the previous batch of requests rather than
+  // reading them: a reply that hasn't arrived yet would block us, and
+  // discarding keeps requests from piling up if GetName() is never called
+  // for these atoms.  Atoms whose names weren't read are requested again
+  // the next time that we see them.
+  for (hash_map<XAtom, XConnection::RequestCookie>::const_iterator it =
+         pending_name_requests_.begin();
+       it != pending_name_requests_.end(); ++it) {
+    xconn_->DiscardReply(it->second);
+  }
+  pending_name_requests_.clear();
+
+  for (vector<XAtom>::const_iterator it = xatoms.begin();
+       it != xatoms.end(); ++it) {
+    if (*it == 0 ||
+        xatom_to_string_.count(*it) ||
+        pending_name_requests_.count(*it)) {
+      continue;
+    }
+    pending_name_requests_.insert(
+        make_pair(*it, xconn_->SendGetAtomNameRequest(*it)));
+  }
+}
+
+bool AtomCache::ReadNameReply(XAtom xatom,
+                              const XConnection::RequestCookie& cookie) {
+  string name;
+  if (!xconn_->GetAtomNameReply(cookie, &name))
+    return false;
+  xatom_to_string_[xatom] = name;
+  return true;
 }
 
 }  // namespace window_manager
@@ -6,15 +6,15 @@
 #define WINDOW_MANAGER_ATOM_CACHE_H_
 
 #include <string>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/hash_tables.h"
+#include "window_manager/x11/x_connection.h"
 #include "window_manager/x11/x_types.h"
 
 namespace window_manager {
 
-class XConnection;  // from x_connection.h
-
 // Atom names with "_" prefixes (if any) stripped.
 //
 // When adding a new value, also insert a mapping to its actual name in
@@ -22,6 +22,7 @@ class XConnection;  // from x_connection.h
 enum Atom {
   ATOM_ATOM = 0,
   ATOM_CARDINAL,
+  ATOM_CHROME_FRAME_STATS,
   ATOM_CHROME_FREEZE_UPDATES,
   ATOM_CHROME_GET_SERVER_TIME,
   ATOM_CHROME_LOGGED_IN,
@@ -29,6 +30,7 @@ enum Atom {
   ATOM_CHROME_STATE_COLLAPSED_PANEL,
   ATOM_CHROME_VIDEO_TIME,
   ATOM_CHROME_WINDOW_TYPE,
+  ATOM_CHROME_WM_COUNTERS,
   ATOM_CHROME_WM_MESSAGE,
   ATOM_MANAGER,
   ATOM_NET_ACTIVE_WINDOW,
@@ -81,9 +83,19 @@ enum Atom {
 // safety against typos in atom strings, values from the above Atom enum
 // (rather than strings) are used to look up the X server's IDs for atoms.
 // All atoms are fetched from the server just once, in the constructor.
+//
+// The names of the core protocol's predefined atoms are also requested in
+// the constructor, in the same pipelined pass as the interning requests,
+// and the names of other atoms can be requested ahead of time using
+// PrefetchNames() so that GetName() doesn't need to block on a round trip.
 class AtomCache {
  public:
   explicit AtomCache(XConnection* xconn);
+  ~AtomCache();
+
+  size_t num_pending_name_requests() const {
+    return pending_name_requests_.size();
+  }
 
   // Get the X server's ID for a value in our Atom enum.
   XAtom GetXAtom(Atom atom) const;
@@ -94,7 +106,18 @@ class AtomCache {
   // the X server (empty strings will be returned for invalid atoms).
   const std::string& GetName(XAtom xatom);
 
+  // Asynchronously request the names of any atoms in |xatoms| that aren't
+  // already cached.  The replies are read by GetName(); replies to the
+  // previous call's requests that haven't been read yet are discarded
+  // without blocking.
+  void PrefetchNames(const std::vector<XAtom>& xatoms);
+
  private:
+  // Read the reply to a name request sent by PrefetchNames() or by the
+  // constructor and cache the name if it was found.  Returns false if the
+  // name couldn't be fetched.
+  bool ReadNameReply(XAtom xatom, const XConnection::RequestCookie& cookie);
+
   XConnection* xconn_;  // not owned
 
   // Maps from our Atom enum to the X server's atom IDs and from the
@@ -104,6 +127,9 @@ class AtomCache {
   base::hash_map<int, XAtom> atom_to_xatom_;
   base::hash_map<XAtom, std::string> xatom_to_string_;
 
+  // Name requests that have been sent but whose replies haven't been read.
+  base::hash_map<XAtom, XConnection::RequestCookie> pending_name_requests_;
+
   DISALLOW_COPY_AND_ASSIGN(AtomCache);
 };
 
@@ -0,0 +1,88 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "base/memory/scoped_ptr.h"
+#include "window_manager/atom_cache.h"
+#include "window_manager/test_lib.h"
+#include "window_manager/x11/mock_x_connection.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using std::vector;
+
+namespace window_manager {
+
+class AtomCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    xconn_.reset(new MockXConnection);
+    atom_cache_.reset(new AtomCache(xconn_.get()));
+  }
+
+  scoped_ptr<MockXConnection> xconn_;
+  scoped_ptr<AtomCache> atom_cache_;
+};
+
+TEST_F(AtomCacheTest, GetName) {
+  EXPECT_EQ("WM_STATE",
+            atom_cache_->GetName(atom_cache_->GetXAtom(ATOM_WM_STATE)));
+
+  // Looking up an atom that we haven't seen before should require a round
+  // trip.
+  const XAtom foo_xatom = xconn_->GetAtomOrDie("FOO");
+  int round_trips = xconn_->num_round_trips();
+  EXPECT_EQ("FOO", atom_cache_->GetName(foo_xatom));
+  EXPECT_EQ(round_trips + 1, xconn_->num_round_trips());
+
+  // The name should be cached after that.
+  EXPECT_EQ("FOO", atom_cache_->GetName(foo_xatom));
+  EXPECT_EQ(round_trips + 1, xconn_->num_round_trips());
+}
+
+// Check that prefetching a batch of names only costs a single round trip.
+TEST_F(AtomCacheTest, PrefetchNames) {
+  vector<XAtom> xatoms;
+  xatoms.push_back(xconn_->GetAtomOrDie("FOO"));
+  xatoms.push_back(xconn_->GetAtomOrDie("BAR"));
+  xatoms.push_back(xconn_->GetAtomOrDie("BAZ"));
+  xatoms.push_back(xatoms[0]);
+  xatoms.push_back(atom_cache_->GetXAtom(ATOM_WM_STATE));
+
+  const int round_trips = xconn_->num_round_trips();
+  atom_cache_->PrefetchNames(xatoms);
+  EXPECT_EQ(3U, atom_cache_->num_pending_name_requests());
+  EXPECT_EQ(round_trips, xconn_->num_round_trips());
+
+  EXPECT_EQ("BAR", atom_cache_->GetName(xatoms[1]));
+  EXPECT_EQ(2U, atom_cache_->num_pending_name_requests());
+  EXPECT_EQ(round_trips + 1, xconn_->num_round_trips());
+
+  // The next call should discard the remaining replies instead of
+  // blocking on them, so looking up those names requires another round
+  // trip.
+  atom_cache_->PrefetchNames(vector<XAtom>());
+  EXPECT_EQ(0U, atom_cache_->num_pending_name_requests());
+  EXPECT_EQ(0U, xconn_->num_pending_requests());
+  EXPECT_EQ("FOO", atom_cache_->GetName(xatoms[0]));
+  EXPECT_EQ(round_trips + 2, xconn_->num_round_trips());
+
+  // Replies that are never read should be discarded when the cache is
+  // destroyed.
+  atom_cache_->PrefetchNames(vector<XAtom>(1, xconn_->GetAtomOrDie("QUX")));
+  EXPECT_EQ(1U, xconn_->num_pending_requests());
+  atom_cache_.reset();
+  EXPECT_EQ(0U, xconn_->num_pending_requests());
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
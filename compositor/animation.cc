@@ -14,6 +14,134 @@ using std::vector;
 
 namespace window_manager {
 
+// static
+const float AnimationCurve::kSpringFrequency = 9.25f;
+
+// Coefficients for evaluating a one-dimensional cubic Bezier curve from 0 to
+// 1 with control points |p1| and |p2| as ((a * t + b) * t + c) * t.
+static inline void GetBezierCoefficients(float p1, float p2,
+                                         float* a, float* b, float* c) {
+  *c = 3.f * p1;
+  *b = 3.f * (p2 - p1) - *c;
+  *a = 1.f - *c - *b;
+}
+
+AnimationCurve::AnimationCurve()
+    : type_(TYPE_COSINE),
+      x1_(0.f),
+      y1_(0.f),
+      x2_(1.f),
+      y2_(1.f) {
+}
+
+// static
+AnimationCurve AnimationCurve::Linear() {
+  AnimationCurve curve;
+  curve.type_ = TYPE_LINEAR;
+  return curve;
+}
+
+// static
+AnimationCurve AnimationCurve::CubicBezier(float x1, float y1,
+                                           float x2, float y2) {
+  // The x coordinates must stay within [0, 1] for the curve to be a
+  // function of time.
+  DCHECK_GE(x1, 0.f);
+  DCHECK_LE(x1, 1.f);
+  DCHECK_GE(x2, 0.f);
+  DCHECK_LE(x2, 1.f);
+  AnimationCurve curve;
+  curve.type_ = TYPE_CUBIC_BEZIER;
+  curve.x1_ = x1;
+  curve.y1_ = y1;
+  curve.x2_ = x2;
+  curve.y2_ = y2;
+  return curve;
+}
+
+// static
+AnimationCurve AnimationCurve::EaseIn() {
+  return CubicBezier(0.42f, 0.f, 1.f, 1.f);
+}
+
+// static
+AnimationCurve AnimationCurve::EaseOut() {
+  return CubicBezier(0.f, 0.f, 0.58f, 1.f);
+}
+
+// static
+AnimationCurve AnimationCurve::EaseInOut() {
+  return CubicBezier(0.42f, 0.f, 0.58f, 1.f);
+}
+
+// static
+AnimationCurve AnimationCurve::Spring() {
+  AnimationCurve curve;
+  curve.type_ = TYPE_SPRING;
+  return curve;
+}
+
+float AnimationCurve::Evaluate(float progress) const {
+  switch (type_) {
+    case TYPE_COSINE:
+      return (1.f - cosf(static_cast<float>(M_PI) * progress)) / 2.f;
+    case TYPE_LINEAR:
+      return progress;
+    case TYPE_CUBIC_BEZIER: {
+      if (progress <= 0.f || progress >= 1.f)
+        return progress <= 0.f ? 0.f : 1.f;
+      const float t = SolveBezierX(progress);
+      float a = 0.f, b = 0.f, c = 0.f;
+      GetBezierCoefficients(y1_, y2_, &a, &b, &c);
+      return ((a * t + b) * t + c) * t;
+    }
+    case TYPE_SPRING: {
+      // The distance remaining for a critically damped spring that starts
+      // at rest is proportional to e^(-wt) * (1 + wt).
+      const float wt = kSpringFrequency * progress;
+      return 1.f - expf(-wt) * (1.f + wt);
+    }
+  }
+  NOTREACHED() << "Unknown curve type " << type_;
+  return progress;
+}
+
+float AnimationCurve::SolveBezierX(float x) const {
+  static const float kEpsilon = 1e-6f;
+  float a = 0.f, b = 0.f, c = 0.f;
+  GetBezierCoefficients(x1_, x2_, &a, &b, &c);
+
+  // Newton's method converges quickly for most curves...
+  float t = x;
+  for (int i = 0; i < 8; ++i) {
+    const float error = ((a * t + b) * t + c) * t - x;
+    if (fabsf(error) < kEpsilon)
+      return t;
+    const float slope = (3.f * a * t + 2.f * b) * t + c;
+    if (fabsf(slope) < kEpsilon)
+      break;
+    t -= error / slope;
+  }
+
+  // ... but fall back to bisection if it doesn't.
+  float low = 0.f, high = 1.f;
+  t = x;
+  while (low < high) {
+    const float current_x = ((a * t + b) * t + c) * t;
+    if (fabsf(current_x - x) < kEpsilon)
+      break;
+    if (x > current_x)
+      low = t;
+    else
+      high = t;
+    const float next_t = (high - low) / 2.f + low;
+    if (next_t == t)
+      break;
+    t = next_t;
+  }
+  return t;
+}
+
 Animation::Animation(float start_value, const TimeTicks& start_time)
     : start_keyframe_(start_value, start_time),
       end_keyframe_(start_value, start_time) {
@@ -57,10 +185,9 @@ float Animation::GetValue(const TimeTicks& now) const {
       next_keyframe->timestamp - prev_keyframe->timestamp;
   TimeDelta time_since_prev_keyframe = now - prev_keyframe->timestamp;
 
-  float ease_factor = M_PI / time_between_keyframes.InMilliseconds();
-  float fraction =
-      (1.0f - cosf(ease_factor * time_since_prev_keyframe.InMilliseconds())) /
-      2.0f;
+  float fraction = curve_.Evaluate(
+      static_cast<float>(time_since_prev_keyframe.InMilliseconds()) /
+      time_between_keyframes.InMilliseconds());
   return prev_keyframe->value +
       fraction * (next_keyframe->value - prev_keyframe->value);
 }
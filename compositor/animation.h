@@ -13,6 +13,58 @@
 
 namespace window_manager {
 
+// AnimationCurve describes how an animated value moves from one keyframe to
+// the next.  It's a small value type, so it can be passed around and stored
+// alongside each animation without allocating anything.
+class AnimationCurve {
+ public:
+  enum Type {
+    // Starts and ends slowly, following half of a cosine wave.
+    TYPE_COSINE = 0,
+    TYPE_LINEAR,
+    // A cubic Bezier curve from (0, 0) to (1, 1) with two control points, as
+    // in CSS's cubic-bezier() timing function.
+    TYPE_CUBIC_BEZIER,
+    // A critically damped spring that settles at the end value by the end of
+    // the animation.  When an animation using a spring is retargeted by
+    // another one, AnimationSystem carries the value's velocity over so that
+    // it doesn't jerk.
+    TYPE_SPRING,
+  };
+
+  // Creates a cosine curve.
+  AnimationCurve();
+
+  static AnimationCurve Cosine() { return AnimationCurve(); }
+  static AnimationCurve Linear();
+  static AnimationCurve CubicBezier(float x1, float y1, float x2, float y2);
+  static AnimationCurve EaseIn();
+  static AnimationCurve EaseOut();
+  static AnimationCurve EaseInOut();
+  static AnimationCurve Spring();
+
+  Type type() const { return type_; }
+
+  // Map |progress|, the fraction of the animation's duration that has
+  // elapsed, to the fraction of the distance between the keyframes that the
+  // value has covered.  Springs are evaluated as if they started at rest.
+  float Evaluate(float progress) const;
+
+  // Angular frequency of springs, in radians per animation duration.  This
+  // is chosen so that a spring that starts at rest is within 0.1% of its end
+  // value when the animation finishes.
+  static const float kSpringFrequency;
+
+ private:
+  // Solve for the Bezier curve's parameter at which its x coordinate is |x|.
+  float SolveBezierX(float x) const;
+
+  Type type_;
+
+  // Control points for TYPE_CUBIC_BEZIER.
+  float x1_, y1_, x2_, y2_;
+};
+
 // The Animation class takes a sequence of keyframes and computes the
 // appropriate value at a given time.  It's used by Compositor to animate
 // Actors.
@@ -36,7 +88,13 @@ class Animation {
   void AppendKeyframe(float value,
                       const base::TimeDelta& delay_from_last_keyframe);
 
+  // Curve used between each pair of keyframes.  Defaults to a cosine curve.
+  const AnimationCurve& curve() const { return curve_; }
+  void set_curve(const AnimationCurve& curve) { curve_ = curve; }
+
  private:
+  friend class AnimationSystem;  // copies keyframes
+
   struct Keyframe {
     Keyframe(float value, const base::TimeTicks& timestamp)
         : value(value), timestamp(timestamp) {
@@ -58,6 +116,8 @@ class Animation {
   // NULL until we have more keyframes than the starting and ending one.
   scoped_ptr<std::vector<Keyframe> > keyframes_;
 
+  AnimationCurve curve_;
+
   DISALLOW_COPY_AND_ASSIGN(Animation);
 };
 
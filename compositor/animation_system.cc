@@ -0,0 +1,355 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/compositor/animation_system.h"
+
+#include <cmath>
+
+#include "base/logging.h"
+#include "window_manager/compositor/animation.h"
+
+using base::TimeDelta;
+using base::TimeTicks;
+using std::vector;
+
+namespace window_manager {
+
+AnimationSystem::AnimationSystem() {}
+
+AnimationSystem::~AnimationSystem() {}
+
+bool AnimationSystem::IsAnimating(const void* target) const {
+  return FindSlot(target) >= 0;
+}
+
+void AnimationSystem::Animate(int* target,
+                              float start_value,
+                              float end_value,
+                              const TimeTicks& start_time,
+                              const TimeDelta& duration,
+                              const AnimationCurve& curve,
+                              const void* owner,
+                              bool* dirty_flag) {
+  DCHECK(target);
+  AnimateInternal(target, NULL, start_value, end_value, start_time, duration,
+                  curve, owner, dirty_flag);
+}
+
+void AnimationSystem::Animate(float* target,
+                              float start_value,
+                              float end_value,
+                              const TimeTicks& start_time,
+                              const TimeDelta& duration,
+                              const AnimationCurve& curve,
+                              const void* owner,
+                              bool* dirty_flag) {
+  DCHECK(target);
+  AnimateInternal(NULL, target, start_value, end_value, start_time, duration,
+                  curve, owner, dirty_flag);
+}
+
+void AnimationSystem::SetAnimation(int* target,
+                                   const Animation& animation,
+                                   const void* owner,
+                                   bool* dirty_flag) {
+  DCHECK(target);
+  SetAnimationInternal(target, NULL, animation, owner, dirty_flag);
+}
+
+void AnimationSystem::SetAnimation(float* target,
+                                   const Animation& animation,
+                                   const void* owner,
+                                   bool* dirty_flag) {
+  DCHECK(target);
+  SetAnimationInternal(NULL, target, animation, owner, dirty_flag);
+}
+
+bool AnimationSystem::Cancel(const void* target) {
+  const int slot = FindSlot(target);
+  if (slot < 0)
+    return false;
+  RemoveSlot(slot);
+  return true;
+}
+
+void AnimationSystem::CancelAnimationsForOwner(const void* owner) {
+  // Walk backwards so that the slots moved into removed ones have already
+  // been checked.
+  for (size_t i = owners_.size(); i > 0; --i) {
+    if (owners_[i - 1] == owner)
+      RemoveSlot(i - 1);
+  }
+}
+
+size_t AnimationSystem::Update(const TimeTicks& now) {
+  const size_t num_slots = num_animations();
+  if (!num_slots)
+    return 0;
+
+  const int64_t now_us = now.ToInternalValue();
+  progress_.resize(num_slots);
+  float* progress = &progress_[0];
+
+  // Compute how far each animation is through its current segment.
+  const int64_t* start_times_us = &start_times_us_[0];
+  const int64_t* end_times_us = &end_times_us_[0];
+  const float* inverse_durations_us = &inverse_durations_us_[0];
+  for (size_t i = 0; i < num_slots; ++i) {
+    float fraction =
+        static_cast<float>(now_us - start_times_us[i]) *
+        inverse_durations_us[i];
+    fraction = fraction < 0.f ? 0.f : (fraction > 1.f ? 1.f : fraction);
+    progress[i] = now_us >= end_times_us[i] ? 1.f : fraction;
+  }
+
+  // Compute how far springs that were retargeted mid-flight have moved due
+  // to their starting velocities.  This term decays to zero along with the
+  // rest of the spring's motion.
+  velocity_offsets_.resize(num_slots);
+  float* velocity_offsets = &velocity_offsets_[0];
+  const float* start_velocities = &start_velocities_[0];
+  for (size_t i = 0; i < num_slots; ++i) {
+    velocity_offsets[i] = start_velocities[i] == 0.f ? 0.f :
+        start_velocities[i] * (progress[i] / inverse_durations_us[i]) *
+        expf(-AnimationCurve::kSpringFrequency * progress[i]);
+  }
+
+  // Apply the easing curves.
+  const AnimationCurve* curves = &curves_[0];
+  for (size_t i = 0; i < num_slots; ++i)
+    progress[i] = curves[i].Evaluate(progress[i]);
+
+  // Interpolate between the segments' values.
+  const float* start_values = &start_values_[0];
+  const float* end_values = &end_values_[0];
+  for (size_t i = 0; i < num_slots; ++i)
+    progress[i] = start_values[i] +
+        progress[i] * (end_values[i] - start_values[i]) +
+        velocity_offsets[i];
+
+  // Write the values back to the targets.
+  for (size_t i = 0; i < num_slots; ++i) {
+    if (int_targets_[i])
+      *int_targets_[i] = static_cast<int>(roundf(progress[i]));
+    else
+      *float_targets_[i] = progress[i];
+    if (dirty_flags_[i])
+      *dirty_flags_[i] = true;
+  }
+
+  // Move finished animations on to their next keyframes or retire them.
+  // Walk backwards so that the slots moved into removed ones have already
+  // been handled.
+  for (size_t i = num_slots; i > 0; --i) {
+    const size_t slot = i - 1;
+    if (now_us < end_times_us_[slot])
+      continue;
+
+    vector<Keyframe>* queue = &queued_keyframes_[slot];
+    while (now_us >= end_times_us_[slot] && !queue->empty()) {
+      const Keyframe next = queue->back();
+      queue->pop_back();
+      SetSegment(slot, end_values_[slot], next.value,
+                 end_times_us_[slot], next.time_us);
+    }
+
+    // Make sure that finished animations end up exactly at their final
+    // values.
+    float value = end_values_[slot];
+    if (now_us < end_times_us_[slot]) {
+      const float fraction =
+          static_cast<float>(now_us - start_times_us_[slot]) *
+          inverse_durations_us_[slot];
+      value = start_values_[slot] +
+          curves_[slot].Evaluate(fraction) *
+          (end_values_[slot] - start_values_[slot]);
+    }
+    if (int_targets_[slot])
+      *int_targets_[slot] = static_cast<int>(roundf(value));
+    else
+      *float_targets_[slot] = value;
+
+    if (now_us >= end_times_us_[slot])
+      RemoveSlot(slot);
+  }
+
+  return num_slots;
+}
+
+size_t AnimationSystem::GetSlot(int* int_target,
+                                float* float_target,
+                                const void* owner,
+                                bool* dirty_flag,
+                                bool* existing_out) {
+  DCHECK(!int_target != !float_target);
+  const void* target =
+      int_target ? static_cast<const void*>(int_target) : float_target;
+
+  const int existing_slot = FindSlot(target);
+  size_t slot = 0;
+  if (existing_slot >= 0) {
+    slot = existing_slot;
+    *existing_out = true;
+  } else {
+    *existing_out = false;
+    slot = num_animations();
+    targets_.push_back(target);
+    int_targets_.push_back(int_target);
+    float_targets_.push_back(float_target);
+    owners_.push_back(NULL);
+    dirty_flags_.push_back(NULL);
+    start_values_.push_back(0.f);
+    end_values_.push_back(0.f);
+    start_times_us_.push_back(0);
+    end_times_us_.push_back(0);
+    inverse_durations_us_.push_back(0.f);
+    curves_.push_back(AnimationCurve());
+    start_velocities_.push_back(0.f);
+    queued_keyframes_.push_back(vector<Keyframe>());
+  }
+
+  owners_[slot] = owner;
+  dirty_flags_[slot] = dirty_flag;
+  queued_keyframes_[slot].clear();
+  return slot;
+}
+
+void AnimationSystem::SetSegment(size_t slot,
+                                 float start_value,
+                                 float end_value,
+                                 int64_t start_time_us,
+                                 int64_t end_time_us) {
+  DCHECK_LT(slot, num_animations());
+  start_values_[slot] = start_value;
+  end_values_[slot] = end_value;
+  start_times_us_[slot] = start_time_us;
+  end_times_us_[slot] = end_time_us;
+  inverse_durations_us_[slot] = end_time_us > start_time_us ?
+      1.f / static_cast<float>(end_time_us - start_time_us) :
+      0.f;
+  start_velocities_[slot] = 0.f;
+}
+
+void AnimationSystem::AnimateInternal(int* int_target,
+                                      float* float_target,
+                                      float start_value,
+                                      float end_value,
+                                      const TimeTicks& start_time,
+                                      const TimeDelta& duration,
+                                      const AnimationCurve& curve,
+                                      const void* owner,
+                                      bool* dirty_flag) {
+  bool existing = false;
+  const size_t slot =
+      GetSlot(int_target, float_target, owner, dirty_flag, &existing);
+  const int64_t start_time_us = start_time.ToInternalValue();
+  const int64_t end_time_us = start_time_us + duration.InMicroseconds();
+
+  // Keep a retargeted spring moving at the same speed.
+  float velocity = 0.f;
+  if (existing &&
+      curve.type() == AnimationCurve::TYPE_SPRING &&
+      curves_[slot].type() == AnimationCurve::TYPE_SPRING &&
+      end_time_us > start_time_us)
+    velocity = GetSpringVelocity(slot, start_time_us);
+
+  curves_[slot] = curve;
+  SetSegment(slot, start_value, end_value, start_time_us, end_time_us);
+  start_velocities_[slot] = velocity;
+}
+
+float AnimationSystem::GetSpringVelocity(size_t slot, int64_t now_us) const {
+  DCHECK_LT(slot, num_animations());
+  if (inverse_durations_us_[slot] <= 0.f || now_us >= end_times_us_[slot])
+    return 0.f;
+
+  // For a critically damped spring with angular frequency w, starting with
+  // displacement d0 from its end value and velocity v0, the velocity at time
+  // t is e^(-wt) * (v0 - wt * (v0 + w * d0)).
+  const float t = static_cast<float>(
+      now_us > start_times_us_[slot] ? now_us - start_times_us_[slot] : 0);
+  const float w =
+      AnimationCurve::kSpringFrequency * inverse_durations_us_[slot];
+  const float d0 = start_values_[slot] - end_values_[slot];
+  const float v0 = start_velocities_[slot];
+  return expf(-w * t) * (v0 - w * t * (v0 + w * d0));
+}
+
+void AnimationSystem::SetAnimationInternal(int* int_target,
+                                           float* float_target,
+                                           const Animation& animation,
+                                           const void* owner,
+                                           bool* dirty_flag) {
+  bool existing = false;
+  const size_t slot =
+      GetSlot(int_target, float_target, owner, dirty_flag, &existing);
+  curves_[slot] = animation.curve_;
+
+  // Gather the keyframes after the starting one.
+  vector<Keyframe> keyframes;
+  if (animation.keyframes_.get()) {
+    for (vector<Animation::Keyframe>::const_iterator it =
+           animation.keyframes_->begin();
+         it != animation.keyframes_->end(); ++it) {
+      keyframes.push_back(
+          Keyframe(it->value, it->timestamp.ToInternalValue()));
+    }
+  }
+  keyframes.push_back(
+      Keyframe(animation.end_keyframe_.value,
+               animation.end_keyframe_.timestamp.ToInternalValue()));
+
+  SetSegment(slot,
+             animation.start_keyframe_.value,
+             keyframes[0].value,
+             animation.start_keyframe_.timestamp.ToInternalValue(),
+             keyframes[0].time_us);
+  queued_keyframes_[slot].assign(keyframes.rbegin(), keyframes.rend() - 1);
+}
+
+int AnimationSystem::FindSlot(const void* target) const {
+  const size_t num_slots = targets_.size();
+  for (size_t i = 0; i < num_slots; ++i) {
+    if (targets_[i] == target)
+      return static_cast<int>(i);
+  }
+  return -1;
+}
+
+void AnimationSystem::RemoveSlot(size_t slot) {
+  const size_t last = num_animations() - 1;
+  DCHECK_LE(slot, last);
+
+  if (slot != last) {
+    targets_[slot] = targets_[last];
+    int_targets_[slot] = int_targets_[last];
+    float_targets_[slot] = float_targets_[last];
+    owners_[slot] = owners_[last];
+    dirty_flags_[slot] = dirty_flags_[last];
+    start_values_[slot] = start_values_[last];
+    end_values_[slot] = end_values_[last];
+    start_times_us_[slot] = start_times_us_[last];
+    end_times_us_[slot] = end_times_us_[last];
+    inverse_durations_us_[slot] = inverse_durations_us_[last];
+    curves_[slot] = curves_[last];
+    start_velocities_[slot] = start_velocities_[last];
+    queued_keyframes_[slot].swap(queued_keyframes_[last]);
+  }
+
+  targets_.pop_back();
+  int_targets_.pop_back();
+  float_targets_.pop_back();
+  owners_.pop_back();
+  dirty_flags_.pop_back();
+  start_values_.pop_back();
+  end_values_.pop_back();
+  start_times_us_.pop_back();
+  end_times_us_.pop_back();
+  inverse_durations_us_.pop_back();
+  curves_.pop_back();
+  start_velocities_.pop_back();
+  queued_keyframes_.pop_back();
+}
+
+}  // namespace window_manager
@@ -0,0 +1,173 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_COMPOSITOR_ANIMATION_SYSTEM_H_
+#define WINDOW_MANAGER_COMPOSITOR_ANIMATION_SYSTEM_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/time.h"
+#include "window_manager/compositor/animation.h"
+
+namespace window_manager {
+
+// AnimationSystem evaluates all of the compositor's in-progress animations.
+//
+// Each animation moves a single int or float field (its "target") between
+// two values.  Rather than giving each animation its own heap-allocated
+// object, the system stores every animation's state in parallel arrays
+// indexed by slot, so that Update() can compute all of the new values in a
+// few tight loops over contiguous memory.  Finished animations are retired
+// by moving the last slot into their place.
+//
+// Animations with more than two keyframes (see Animation) are evaluated one
+// segment at a time; the keyframes that haven't been reached yet are queued
+// in the slot.
+//
+// Slots are found by scanning the targets rather than through a map: lookups
+// only happen when an animation is started or cancelled, and the arrays keep
+// their capacity when slots are retired, so once they've grown to the
+// largest number of concurrent animations, starting a two-keyframe
+// animation doesn't allocate.  (Animations with more keyframes still
+// allocate their queues.)  Retargeting an in-progress animation reuses its
+// slot.  If both the old and new animations use spring curves, the
+// target's current velocity is carried into the new animation.
+class AnimationSystem {
+ public:
+  AnimationSystem();
+  ~AnimationSystem();
+
+  size_t num_animations() const { return int_targets_.size(); }
+
+  // Is |target| currently being animated?
+  bool IsAnimating(const void* target) const;
+
+  // Animate |target| from |start_value| at |start_time| to |end_value|
+  // |duration| later along |curve|, replacing any existing animation of
+  // |target|.
+  // |owner| identifies the object that contains |target| for
+  // CancelAnimationsForOwner().  If |dirty_flag| is non-NULL, it's set to
+  // true whenever Update() changes |target|.
+  void Animate(int* target, float start_value, float end_value,
+               const base::TimeTicks& start_time,
+               const base::TimeDelta& duration,
+               const AnimationCurve& curve,
+               const void* owner, bool* dirty_flag);
+  void Animate(float* target, float start_value, float end_value,
+               const base::TimeTicks& start_time,
+               const base::TimeDelta& duration,
+               const AnimationCurve& curve,
+               const void* owner, bool* dirty_flag);
+
+  // Like Animate(), but follows all of the keyframes in |animation| using
+  // its curve.
+  void SetAnimation(int* target, const Animation& animation,
+                    const void* owner, bool* dirty_flag);
+  void SetAnimation(float* target, const Animation& animation,
+                    const void* owner, bool* dirty_flag);
+
+  // Stop animating |target|, leaving it at its current value.  Returns false
+  // if it wasn't being animated.
+  bool Cancel(const void* target);
+
+  // Stop all animations whose targets belong to |owner|.  This must be
+  // called before the owner is destroyed.
+  void CancelAnimationsForOwner(const void* owner);
+
+  // Update all of the animations' targets to their values at |now| and
+  // retire the animations that have finished.  Returns the number of
+  // targets that were updated.
+  size_t Update(const base::TimeTicks& now);
+
+ private:
+  // A keyframe that an animation will move toward after its current
+  // segment ends.
+  struct Keyframe {
+    Keyframe(float new_value, int64_t new_time_us)
+        : value(new_value),
+          time_us(new_time_us) {}
+
+    float value;
+    int64_t time_us;
+  };
+
+  // Add a new slot for |target| (only one of |int_target| and
+  // |float_target| is non-NULL) or reuse its existing one, and return the
+  // slot's index.  The segment fields must be filled in by the caller.
+  // |existing_out| is set to true if the slot was already in use.
+  size_t GetSlot(int* int_target, float* float_target,
+                 const void* owner, bool* dirty_flag, bool* existing_out);
+
+  // Fill in the slot's current segment, starting at rest.
+  void SetSegment(size_t slot, float start_value, float end_value,
+                  int64_t start_time_us, int64_t end_time_us);
+
+  // Shared implementation of the Animate() methods.
+  void AnimateInternal(int* int_target, float* float_target,
+                       float start_value, float end_value,
+                       const base::TimeTicks& start_time,
+                       const base::TimeDelta& duration,
+                       const AnimationCurve& curve,
+                       const void* owner, bool* dirty_flag);
+
+  // Get the velocity (in units per microsecond) of a spring animation's
+  // target at |now_us|.
+  float GetSpringVelocity(size_t slot, int64_t now_us) const;
+
+  // Copy the keyframes from |animation| into a slot.
+  void SetAnimationInternal(int* int_target, float* float_target,
+                            const Animation& animation,
+                            const void* owner, bool* dirty_flag);
+
+  // Get the slot that animates |target|, or -1 if it isn't being animated.
+  int FindSlot(const void* target) const;
+
+  // Remove a slot, moving the last slot into its place.
+  void RemoveSlot(size_t slot);
+
+  // Targets of each animation, used for lookups.
+  std::vector<const void*> targets_;
+
+  // Typed targets of each animation.  For each slot, exactly one of these is
+  // non-NULL.
+  std::vector<int*> int_targets_;
+  std::vector<float*> float_targets_;
+
+  // Objects that own each target, and flags to set when they're updated.
+  std::vector<const void*> owners_;
+  std::vector<bool*> dirty_flags_;
+
+  // The current segment of each animation: its starting and ending values,
+  // when it starts (in microseconds), the reciprocal of its duration, the
+  // curve that it follows, and (for springs) the target's velocity in units
+  // per microsecond when it started.
+  std::vector<float> start_values_;
+  std::vector<float> end_values_;
+  std::vector<int64_t> start_times_us_;
+  std::vector<int64_t> end_times_us_;
+  std::vector<float> inverse_durations_us_;
+  std::vector<AnimationCurve> curves_;
+  std::vector<float> start_velocities_;
+
+  // Keyframes following the current segment, in reverse order (so the next
+  // one is at the back).  Empty for most animations.
+  std::vector<std::vector<Keyframe> > queued_keyframes_;
+
+  // Scratch space used by Update() to hold each animation's progress
+  // through its segment and then its new value.
+  std::vector<float> progress_;
+
+  // Scratch space used by Update() to hold the distance that springs have
+  // moved due to their starting velocities.
+  std::vector<float> velocity_offsets_;
+
+  DISALLOW_COPY_AND_ASSIGN(AnimationSystem);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_COMPOSITOR_ANIMATION_SYSTEM_H_
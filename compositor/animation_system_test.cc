@@ -0,0 +1,223 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cmath>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "window_manager/compositor/animation.h"
+#include "window_manager/compositor/animation_system.h"
+#include "window_manager/test_lib.h"
+#include "window_manager/util.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using base::TimeDelta;
+using base::TimeTicks;
+using window_manager::util::CreateTimeTicksFromMs;
+
+namespace window_manager {
+
+class AnimationSystemTest : public ::testing::Test {};
+
+TEST_F(AnimationSystemTest, Basic) {
+  AnimationSystem system;
+  float value = -10.f;
+  bool dirty = false;
+  system.Animate(&value, value, 10.f, CreateTimeTicksFromMs(0),
+                 TimeDelta::FromMilliseconds(20),
+                 AnimationCurve(), this, &dirty);
+  EXPECT_EQ(1U, system.num_animations());
+  EXPECT_TRUE(system.IsAnimating(&value));
+
+  EXPECT_EQ(1U, system.Update(CreateTimeTicksFromMs(5)));
+  EXPECT_FLOAT_EQ(-sqrt(50.0f), value);
+  EXPECT_TRUE(dirty);
+
+  system.Update(CreateTimeTicksFromMs(10));
+  EXPECT_NEAR(0.f, value, 1e-5);
+  EXPECT_EQ(1U, system.num_animations());
+
+  // The animation should be retired once it reaches its final value.
+  dirty = false;
+  EXPECT_EQ(1U, system.Update(CreateTimeTicksFromMs(20)));
+  EXPECT_FLOAT_EQ(10.f, value);
+  EXPECT_TRUE(dirty);
+  EXPECT_EQ(0U, system.num_animations());
+  EXPECT_FALSE(system.IsAnimating(&value));
+
+  dirty = false;
+  EXPECT_EQ(0U, system.Update(CreateTimeTicksFromMs(25)));
+  EXPECT_FALSE(dirty);
+}
+
+// Check that integer targets are rounded and that animations with other
+// easing curves work.
+TEST_F(AnimationSystemTest, IntsAndEasing) {
+  AnimationSystem system;
+  int int_value = 0;
+  float linear_value = 0.f;
+  system.Animate(&int_value, 0, 9, CreateTimeTicksFromMs(0),
+                 TimeDelta::FromMilliseconds(10),
+                 AnimationCurve::Linear(), this, NULL);
+  system.Animate(&linear_value, 0, 9, CreateTimeTicksFromMs(0),
+                 TimeDelta::FromMilliseconds(10),
+                 AnimationCurve::Linear(), this, NULL);
+
+  system.Update(CreateTimeTicksFromMs(3));
+  EXPECT_EQ(3, int_value);
+  EXPECT_FLOAT_EQ(2.7f, linear_value);
+
+  system.Update(CreateTimeTicksFromMs(5));
+  EXPECT_EQ(5, int_value);  // 4.5 rounds up
+  EXPECT_FLOAT_EQ(4.5f, linear_value);
+
+  // Nothing should happen before an animation's start time.
+  system.Animate(&linear_value, 4.5f, 0.f, CreateTimeTicksFromMs(20),
+                 TimeDelta::FromMilliseconds(10),
+                 AnimationCurve::Linear(), this, NULL);
+  system.Update(CreateTimeTicksFromMs(10));
+  EXPECT_EQ(9, int_value);
+  EXPECT_FLOAT_EQ(4.5f, linear_value);
+  EXPECT_EQ(1U, system.num_animations());
+}
+
+// Check that starting a new animation for a target replaces the old one.
+TEST_F(AnimationSystemTest, Replace) {
+  AnimationSystem system;
+  float value = 0.f;
+  system.Animate(&value, 0.f, 100.f, CreateTimeTicksFromMs(0),
+                 TimeDelta::FromMilliseconds(100),
+                 AnimationCurve::Linear(), this, NULL);
+  system.Animate(&value, 0.f, 10.f, CreateTimeTicksFromMs(0),
+                 TimeDelta::FromMilliseconds(10),
+                 AnimationCurve::Linear(), this, NULL);
+  EXPECT_EQ(1U, system.num_animations());
+  system.Update(CreateTimeTicksFromMs(10));
+  EXPECT_FLOAT_EQ(10.f, value);
+  EXPECT_EQ(0U, system.num_animations());
+}
+
+// Check that multi-keyframe animations are evaluated the same way as by
+// Animation.
+TEST_F(AnimationSystemTest, MultipleKeyframes) {
+  Animation anim(0, CreateTimeTicksFromMs(0));
+  anim.AppendKeyframe(20, TimeDelta::FromMilliseconds(10));
+  anim.AppendKeyframe(60, TimeDelta::FromMilliseconds(20));
+  anim.AppendKeyframe(30, TimeDelta::FromMilliseconds(5));
+
+  AnimationSystem system;
+  int value = 0;
+  system.SetAnimation(&value, anim, this, NULL);
+  static const int kTimesMs[] = { 0, 5, 10, 12, 20, 29, 31, 33, 40 };
+  for (size_t i = 0; i < arraysize(kTimesMs); ++i) {
+    SCOPED_TRACE(testing::Message() << "time " << kTimesMs[i]);
+    const TimeTicks now = CreateTimeTicksFromMs(kTimesMs[i]);
+    system.Update(now);
+    EXPECT_EQ(static_cast<int>(roundf(anim.GetValue(now))), value);
+    EXPECT_EQ(!anim.IsDone(now), system.IsAnimating(&value));
+  }
+
+  // Jumping over several keyframes at once should also work.
+  system.SetAnimation(&value, anim, this, NULL);
+  system.Update(CreateTimeTicksFromMs(33));
+  EXPECT_EQ(static_cast<int>(roundf(anim.GetValue(CreateTimeTicksFromMs(33)))),
+            value);
+  EXPECT_TRUE(system.IsAnimating(&value));
+}
+
+// Check that animations can be cancelled individually and by owner, and
+// that the remaining animations keep working after slots are moved around.
+TEST_F(AnimationSystemTest, Cancel) {
+  AnimationSystem system;
+  static const int kNumValues = 5;
+  float values[kNumValues];
+  int owners[kNumValues];
+  for (int i = 0; i < kNumValues; ++i) {
+    values[i] = 0.f;
+    // Alternate between two owners.
+    owners[i] = i % 2;
+    system.Animate(&values[i], 0.f, 10.f * (i + 1), CreateTimeTicksFromMs(0),
+                   TimeDelta::FromMilliseconds(10),
+                   AnimationCurve::Linear(), &owners[i % 2], NULL);
+  }
+  EXPECT_EQ(static_cast<size_t>(kNumValues), system.num_animations());
+
+  EXPECT_TRUE(system.Cancel(&values[0]));
+  EXPECT_FALSE(system.Cancel(&values[0]));
+  EXPECT_EQ(static_cast<size_t>(kNumValues - 1), system.num_animations());
+
+  // Owner 1 owns values 1 and 3.
+  system.CancelAnimationsForOwner(&owners[1]);
+  EXPECT_EQ(2U, system.num_animations());
+  EXPECT_TRUE(system.IsAnimating(&values[2]));
+  EXPECT_TRUE(system.IsAnimating(&values[4]));
+
+  system.Update(CreateTimeTicksFromMs(5));
+  EXPECT_FLOAT_EQ(0.f, values[0]);
+  EXPECT_FLOAT_EQ(0.f, values[1]);
+  EXPECT_FLOAT_EQ(15.f, values[2]);
+  EXPECT_FLOAT_EQ(0.f, values[3]);
+  EXPECT_FLOAT_EQ(25.f, values[4]);
+
+  system.Update(CreateTimeTicksFromMs(10));
+  EXPECT_FLOAT_EQ(30.f, values[2]);
+  EXPECT_FLOAT_EQ(50.f, values[4]);
+  EXPECT_EQ(0U, system.num_animations());
+}
+
+// Check that retargeting a spring animation mid-flight keeps the target
+// moving at the same speed instead of restarting from rest.
+TEST_F(AnimationSystemTest, SpringRetargeting) {
+  AnimationSystem system;
+  float value = 0.f;
+  system.Animate(&value, 0.f, 100.f, CreateTimeTicksFromMs(0),
+                 TimeDelta::FromMilliseconds(100),
+                 AnimationCurve::Spring(), this, NULL);
+
+  // Measure the velocity just before the retarget, in units per ms.
+  system.Update(TimeTicks::FromInternalValue(9900));
+  const float before_value = value;
+  system.Update(CreateTimeTicksFromMs(10));
+  const float velocity_before = (value - before_value) / 0.1f;
+  EXPECT_GT(velocity_before, 1.f);
+
+  // Move the target further away and measure the velocity just after.
+  const float retarget_value = value;
+  system.Animate(&value, value, 200.f, CreateTimeTicksFromMs(10),
+                 TimeDelta::FromMilliseconds(100),
+                 AnimationCurve::Spring(), this, NULL);
+  EXPECT_EQ(1U, system.num_animations());
+  system.Update(CreateTimeTicksFromMs(10));
+  EXPECT_FLOAT_EQ(retarget_value, value);
+  system.Update(TimeTicks::FromInternalValue(10100));
+  const float velocity_after = (value - retarget_value) / 0.1f;
+  EXPECT_NEAR(velocity_before, velocity_after, 0.2f);
+
+  // The spring should still end up exactly at its new target.
+  system.Update(CreateTimeTicksFromMs(110));
+  EXPECT_FLOAT_EQ(200.f, value);
+  EXPECT_EQ(0U, system.num_animations());
+
+  // Retargeting with a different curve starts from rest.
+  system.Animate(&value, value, 300.f, CreateTimeTicksFromMs(200),
+                 TimeDelta::FromMilliseconds(100),
+                 AnimationCurve::Spring(), this, NULL);
+  system.Update(CreateTimeTicksFromMs(210));
+  const float linear_start_value = value;
+  system.Animate(&value, value, 400.f, CreateTimeTicksFromMs(210),
+                 TimeDelta::FromMilliseconds(100),
+                 AnimationCurve::Linear(), this, NULL);
+  system.Update(CreateTimeTicksFromMs(260));
+  EXPECT_FLOAT_EQ(linear_start_value + 0.5f * (400.f - linear_start_value),
+                  value);
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
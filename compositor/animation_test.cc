@@ -78,6 +78,62 @@ TEST_F(AnimationTest, MultipleKeyframes) {
   EXPECT_FLOAT_EQ(60, anim.GetValue(now));
 }
 
+TEST_F(AnimationTest, Curves) {
+  const AnimationCurve kCurves[] = {
+    AnimationCurve::Cosine(),
+    AnimationCurve::Linear(),
+    AnimationCurve::EaseIn(),
+    AnimationCurve::EaseOut(),
+    AnimationCurve::EaseInOut(),
+    AnimationCurve::CubicBezier(0.25f, 0.1f, 0.25f, 1.f),
+    AnimationCurve::Spring(),
+  };
+
+  // Every curve should start at 0, end at (or very near) 1, and never move
+  // backwards.
+  for (size_t i = 0; i < arraysize(kCurves); ++i) {
+    SCOPED_TRACE(testing::Message() << "curve " << i);
+    EXPECT_FLOAT_EQ(0.f, kCurves[i].Evaluate(0.f));
+    EXPECT_NEAR(1.f, kCurves[i].Evaluate(1.f), 1e-3);
+    float last_value = 0.f;
+    for (int j = 1; j <= 100; ++j) {
+      const float value = kCurves[i].Evaluate(j / 100.f);
+      EXPECT_GE(value, last_value) << "progress " << j / 100.f;
+      last_value = value;
+    }
+  }
+
+  EXPECT_FLOAT_EQ(0.25f, AnimationCurve::Linear().Evaluate(0.25f));
+  EXPECT_FLOAT_EQ(0.5f, AnimationCurve::Cosine().Evaluate(0.5f));
+
+  // A Bezier curve with control points on the diagonal is linear.
+  const AnimationCurve diagonal =
+      AnimationCurve::CubicBezier(0.2f, 0.2f, 0.8f, 0.8f);
+  EXPECT_NEAR(0.3f, diagonal.Evaluate(0.3f), 1e-5);
+
+  // Ease-in starts slowly and ease-out starts quickly, mirroring each other.
+  const AnimationCurve ease_in = AnimationCurve::EaseIn();
+  const AnimationCurve ease_out = AnimationCurve::EaseOut();
+  EXPECT_LT(ease_in.Evaluate(0.5f), 0.5f);
+  EXPECT_GT(ease_out.Evaluate(0.5f), 0.5f);
+  EXPECT_NEAR(1.f - ease_in.Evaluate(0.3f), ease_out.Evaluate(0.7f), 1e-5);
+  EXPECT_NEAR(0.5f, AnimationCurve::EaseInOut().Evaluate(0.5f), 1e-5);
+
+  // A spring covers most of the distance early on.
+  EXPECT_GT(AnimationCurve::Spring().Evaluate(0.5f), 0.9f);
+}
+
+// Check that an Animation's keyframes are interpolated using its curve.
+TEST_F(AnimationTest, AnimationWithCurve) {
+  Animation anim(0, CreateTimeTicksFromMs(0));
+  anim.set_curve(AnimationCurve::Linear());
+  anim.AppendKeyframe(20, TimeDelta::FromMilliseconds(10));
+  anim.AppendKeyframe(60, TimeDelta::FromMilliseconds(20));
+  EXPECT_FLOAT_EQ(10, anim.GetValue(CreateTimeTicksFromMs(5)));
+  EXPECT_FLOAT_EQ(30, anim.GetValue(CreateTimeTicksFromMs(15)));
+  EXPECT_FLOAT_EQ(60, anim.GetValue(CreateTimeTicksFromMs(30)));
+}
+
 }  // namespace window_manager
 
 int main(int argc, char** argv) {
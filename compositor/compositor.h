@@ -12,11 +12,13 @@
 #include "window_manager/compositor/animation.h"
 #include "window_manager/geometry.h"
 #include "window_manager/image_enums.h"
+#include "window_manager/region.h"
 #include "window_manager/x11/x_types.h"
 
 namespace window_manager {
 
 class CompositionChangeListener;
+class FrameStats;
 class ImageContainer;
 class XConnection;
 
@@ -79,6 +81,17 @@ class Compositor {
 
     virtual void Scale(double scale_x, double scale_y, int anim_ms) = 0;
     virtual void SetOpacity(double opacity, int anim_ms) = 0;
+
+    // Like Move(), Scale() and SetOpacity(), but animate along |curve|
+    // instead of the default cosine curve.  Calling these repeatedly with
+    // AnimationCurve::Spring() (e.g. while the user is dragging something)
+    // retargets the in-progress animation without a jump in velocity.
+    virtual void MoveWithCurve(int x, int y, int anim_ms,
+                               const AnimationCurve& curve) = 0;
+    virtual void ScaleWithCurve(double scale_x, double scale_y, int anim_ms,
+                                const AnimationCurve& curve) = 0;
+    virtual void SetOpacityWithCurve(double opacity, int anim_ms,
+                                     const AnimationCurve& curve) = 0;
     virtual void Show() = 0;
     virtual void Hide() = 0;
 
@@ -177,6 +190,9 @@ class Compositor {
     virtual void SetPixmap(XID pixmap) = 0;
 
     // Update the texture after the contents of the pixmap have changed.
+    // Implementations may limit the update to the areas passed to
+    // MergeDamagedRegion() since the last update, so damage should be merged
+    // before this is called.
     virtual void UpdateTexture() = 0;
 
     // Add an additional texture to mask out parts of the actor.
@@ -186,17 +202,21 @@ class Compositor {
     // Clear the previously-applied alpha mask.
     virtual void ClearAlphaMask() = 0;
 
+    // Maximum number of rectangles kept in the damaged region.  Once more
+    // than this many disjoint areas are damaged, the closest ones get merged
+    // into their bounding boxes.
+    static const size_t kMaxDamagedRects = 4;
+
     // TODO(zmo@): merge this function with UpdateTexture.
     // Compute the union of the current damaged and the new region; this is
     // called at Damage event handler.
     virtual void MergeDamagedRegion(const Rect& region) = 0;
 
-    // Get the currently damaged region; if (width, height) is (0, 0), then
-    // the content is not dirty.
-    virtual const Rect& GetDamagedRegion() const = 0;
+    // Get the currently damaged region; if it's empty, then the content is
+    // not dirty.
+    virtual const Region& GetDamagedRegion() const = 0;
 
-    // Clear the previously set damaged region, i.e., set (width, height)
-    // to (0, 0).
+    // Clear the previously set damaged region.
     virtual void ResetDamagedRegion() = 0;
 
    private:
@@ -254,6 +274,13 @@ class Compositor {
   // triggered manually.
   virtual void ForceDraw() = 0;
 
+  // Get timing statistics about recently-drawn frames.  Ownership remains
+  // with the compositor.
+  virtual const FrameStats* GetFrameStats() const = 0;
+
+  // Are any actors currently being animated?
+  virtual bool HasActiveAnimations() const = 0;
+
  private:
   // This flag indicates whether the GL draw visitor should draw the frame
   // or it should skip the drawing.  The Draw() method is still invoked and
@@ -275,6 +302,11 @@ class CompositionChangeListener {
   virtual void HandleTopFullscreenActorChange(
       const Compositor::TexturePixmapActor* top_fullscreen_actor) = 0;
 
+  // This method is called after the compositor draws a frame in which its
+  // last in-progress animation finished, i.e. when HasActiveAnimations()
+  // starts returning false.
+  virtual void HandleAnimationsFinished() = 0;
+
  protected:
   ~CompositionChangeListener() {}
 };
@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/compositor/frame_clock.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+using base::TimeDelta;
+using base::TimeTicks;
+using std::max;
+
+namespace window_manager {
+
+// static
+const int64 VblankFrameClock::kDeadlineMarginUs = 2000;
+
+TimerFrameClock::TimerFrameClock(const TimeDelta& min_interval)
+    : min_interval_(min_interval) {
+}
+
+TimeTicks TimerFrameClock::GetNextDrawTime(const TimeTicks& now) {
+  if (last_draw_start_time_.is_null())
+    return now;
+  return max(now, last_draw_start_time_ + min_interval_);
+}
+
+void TimerFrameClock::HandleFrameDrawn(const TimeTicks& start_time,
+                                       const TimeTicks& swap_time) {
+  last_draw_start_time_ = start_time;
+}
+
+
+VblankFrameClock::VblankFrameClock(const TimeDelta& refresh_interval)
+    : refresh_interval_(refresh_interval) {
+  CHECK_GT(refresh_interval_.InMicroseconds(), 0);
+}
+
+TimeTicks VblankFrameClock::GetNextVblankTime(const TimeTicks& time) const {
+  if (vblank_time_.is_null())
+    return time;
+
+  const int64 interval_us = refresh_interval_.InMicroseconds();
+  const int64 delta_us = (time - vblank_time_).InMicroseconds();
+  // Round towards negative infinity so that times before |vblank_time_| work
+  // too.
+  int64 num_intervals = delta_us / interval_us;
+  if (delta_us < 0 && delta_us % interval_us != 0)
+    num_intervals--;
+  return vblank_time_ +
+      TimeDelta::FromMicroseconds((num_intervals + 1) * interval_us);
+}
+
+TimeTicks VblankFrameClock::GetNextDrawTime(const TimeTicks& now) {
+  if (vblank_time_.is_null())
+    return now;
+
+  const TimeDelta budget =
+      estimated_draw_duration_ + TimeDelta::FromMicroseconds(kDeadlineMarginUs);
+
+  // Find the first vblank that we can still make, skipping the one that the
+  // previous frame is going to be shown at.
+  TimeTicks vblank = GetNextVblankTime(now);
+  while (vblank - budget < now ||
+         (!last_presented_vblank_time_.is_null() &&
+          vblank < last_presented_vblank_time_ + refresh_interval_ / 2)) {
+    vblank += refresh_interval_;
+  }
+  return vblank - budget;
+}
+
+void VblankFrameClock::HandleFrameDrawn(const TimeTicks& start_time,
+                                        const TimeTicks& swap_time) {
+  // Jump up to slow frames immediately but only decay slowly after fast
+  // ones, so that a single quick frame doesn't make us miss the next vblank.
+  const TimeDelta duration = swap_time - start_time;
+  if (duration > estimated_draw_duration_)
+    estimated_draw_duration_ = duration;
+  else
+    estimated_draw_duration_ = (estimated_draw_duration_ * 7 + duration) / 8;
+
+  if (vblank_time_.is_null()) {
+    vblank_time_ = swap_time;
+  } else {
+    // Nudge the phase towards the vblank that's nearest to the swap time.
+    // Swaps are synced to vblank, so they should return just after one.
+    const TimeTicks next_vblank = GetNextVblankTime(swap_time);
+    TimeTicks nearest_vblank = next_vblank - refresh_interval_;
+    TimeDelta error = swap_time - nearest_vblank;
+    if (error > refresh_interval_ / 2) {
+      nearest_vblank = next_vblank;
+      error = swap_time - next_vblank;
+    }
+    vblank_time_ = nearest_vblank + error / 4;
+  }
+  last_presented_vblank_time_ = vblank_time_;
+}
+
+}  // namespace window_manager
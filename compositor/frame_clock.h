@@ -0,0 +1,104 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_COMPOSITOR_FRAME_CLOCK_H_
+#define WINDOW_MANAGER_COMPOSITOR_FRAME_CLOCK_H_
+
+#include "base/basictypes.h"
+#include "base/time.h"
+
+namespace window_manager {
+
+// FrameClock decides when RealCompositor should draw its next frame.  The
+// compositor asks for the next draw time whenever it has something to draw
+// and reports back after each frame has been drawn and swapped.
+class FrameClock {
+ public:
+  FrameClock() {}
+  virtual ~FrameClock() {}
+
+  // Get the time at which drawing should start for a frame that became
+  // dirty at |now|.  The returned time is never earlier than |now|.
+  virtual base::TimeTicks GetNextDrawTime(const base::TimeTicks& now) = 0;
+
+  // Notify the clock that a frame was drawn.  |start_time| is when Draw()
+  // began and |swap_time| is when the buffer swap returned.
+  virtual void HandleFrameDrawn(const base::TimeTicks& start_time,
+                                const base::TimeTicks& swap_time) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FrameClock);
+};
+
+// A clock that draws as soon as possible while keeping at least
+// |min_interval| between the starts of consecutive frames.  This doesn't
+// know anything about the display's refresh.
+class TimerFrameClock : public FrameClock {
+ public:
+  explicit TimerFrameClock(const base::TimeDelta& min_interval);
+  virtual ~TimerFrameClock() {}
+
+  // Begin FrameClock methods.
+  virtual base::TimeTicks GetNextDrawTime(const base::TimeTicks& now);
+  virtual void HandleFrameDrawn(const base::TimeTicks& start_time,
+                                const base::TimeTicks& swap_time);
+  // End FrameClock methods.
+
+ private:
+  base::TimeDelta min_interval_;
+
+  // Time at which we started drawing the last frame.
+  base::TimeTicks last_draw_start_time_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerFrameClock);
+};
+
+// A clock that tries to start drawing as late as possible while still
+// making it in time for the next vblank.  The vblank phase is estimated
+// from buffer swap completion times (swaps that are synced to vblank return
+// just after it), and the time that drawing takes is estimated from recent
+// frames.
+class VblankFrameClock : public FrameClock {
+ public:
+  // Time that we try to leave between the expected end of drawing and the
+  // vblank.
+  static const int64 kDeadlineMarginUs;
+
+  explicit VblankFrameClock(const base::TimeDelta& refresh_interval);
+  virtual ~VblankFrameClock() {}
+
+  const base::TimeDelta& refresh_interval() const { return refresh_interval_; }
+  const base::TimeDelta& estimated_draw_duration() const {
+    return estimated_draw_duration_;
+  }
+
+  // Get the first vblank that happens strictly after |time|.  If we
+  // haven't seen a swap yet and don't know the phase, returns |time|.
+  base::TimeTicks GetNextVblankTime(const base::TimeTicks& time) const;
+
+  // Begin FrameClock methods.
+  virtual base::TimeTicks GetNextDrawTime(const base::TimeTicks& now);
+  virtual void HandleFrameDrawn(const base::TimeTicks& start_time,
+                                const base::TimeTicks& swap_time);
+  // End FrameClock methods.
+
+ private:
+  base::TimeDelta refresh_interval_;
+
+  // Most recent estimated vblank time.  Null until the first swap.
+  base::TimeTicks vblank_time_;
+
+  // Vblank at which the last frame that we drew will be shown.  We avoid
+  // drawing a second frame for the same vblank.
+  base::TimeTicks last_presented_vblank_time_;
+
+  // Pessimistic estimate of how long it takes to draw and swap a frame.
+  base::TimeDelta estimated_draw_duration_;
+
+  DISALLOW_COPY_AND_ASSIGN(VblankFrameClock);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_COMPOSITOR_FRAME_CLOCK_H_
@@ -0,0 +1,157 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstdlib>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "window_manager/compositor/frame_clock.h"
+#include "window_manager/test_lib.h"
+#include "window_manager/util.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using base::TimeDelta;
+using base::TimeTicks;
+using window_manager::util::CreateTimeTicksFromMs;
+
+namespace window_manager {
+
+class FrameClockTest : public ::testing::Test {
+ protected:
+  // Create a TimeTicks object |time_us| microseconds after an arbitrary
+  // starting point.
+  TimeTicks CreateTimeTicksFromUs(int64 time_us) {
+    return CreateTimeTicksFromMs(1000000) +
+           TimeDelta::FromMicroseconds(time_us);
+  }
+};
+
+TEST_F(FrameClockTest, Timer) {
+  TimerFrameClock clock(TimeDelta::FromMilliseconds(16));
+
+  // Before anything has been drawn, we should draw immediately.
+  EXPECT_EQ(CreateTimeTicksFromMs(500),
+            clock.GetNextDrawTime(CreateTimeTicksFromMs(500)));
+
+  // After a frame, the next one should be held off for the interval...
+  clock.HandleFrameDrawn(CreateTimeTicksFromMs(1000),
+                         CreateTimeTicksFromMs(1004));
+  EXPECT_EQ(CreateTimeTicksFromMs(1016),
+            clock.GetNextDrawTime(CreateTimeTicksFromMs(1005)));
+
+  // ... but not any longer than that.
+  EXPECT_EQ(CreateTimeTicksFromMs(1030),
+            clock.GetNextDrawTime(CreateTimeTicksFromMs(1030)));
+}
+
+TEST_F(FrameClockTest, VblankTimes) {
+  VblankFrameClock clock(TimeDelta::FromMicroseconds(16000));
+
+  // We don't know anything about vblank before the first swap, so we should
+  // draw immediately.
+  EXPECT_EQ(CreateTimeTicksFromUs(300),
+            clock.GetNextVblankTime(CreateTimeTicksFromUs(300)));
+  EXPECT_EQ(CreateTimeTicksFromUs(300),
+            clock.GetNextDrawTime(CreateTimeTicksFromUs(300)));
+
+  // The first swap gives us the phase.  Vblank times should be strictly
+  // after the passed-in time, including for times before the swap.
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(1000),
+                         CreateTimeTicksFromUs(5000));
+  EXPECT_EQ(CreateTimeTicksFromUs(21000),
+            clock.GetNextVblankTime(CreateTimeTicksFromUs(5000)));
+  EXPECT_EQ(CreateTimeTicksFromUs(21000),
+            clock.GetNextVblankTime(CreateTimeTicksFromUs(20999)));
+  EXPECT_EQ(CreateTimeTicksFromUs(37000),
+            clock.GetNextVblankTime(CreateTimeTicksFromUs(21000)));
+  EXPECT_EQ(CreateTimeTicksFromUs(5000),
+            clock.GetNextVblankTime(CreateTimeTicksFromUs(4000)));
+  EXPECT_EQ(CreateTimeTicksFromUs(-11000),
+            clock.GetNextVblankTime(CreateTimeTicksFromUs(-27000)));
+}
+
+TEST_F(FrameClockTest, VblankDeadline) {
+  VblankFrameClock clock(TimeDelta::FromMicroseconds(16000));
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(1000),
+                         CreateTimeTicksFromUs(5000));
+  EXPECT_EQ(4000, clock.estimated_draw_duration().InMicroseconds());
+
+  // We should start drawing as late as possible while leaving enough time
+  // to draw the frame and the safety margin before the next vblank.
+  const int64 budget_us = 4000 + VblankFrameClock::kDeadlineMarginUs;
+  EXPECT_EQ(CreateTimeTicksFromUs(21000 - budget_us),
+            clock.GetNextDrawTime(CreateTimeTicksFromUs(6000)));
+
+  // If it's too late to make the next vblank, we should aim for the one
+  // after it instead.
+  const TimeTicks too_late = CreateTimeTicksFromUs(21000 - budget_us + 1);
+  EXPECT_EQ(CreateTimeTicksFromUs(37000 - budget_us),
+            clock.GetNextDrawTime(too_late));
+}
+
+TEST_F(FrameClockTest, VblankDrawDurationEstimate) {
+  VblankFrameClock clock(TimeDelta::FromMicroseconds(16000));
+  int64 vblank_us = 16000;
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(vblank_us - 2000),
+                         CreateTimeTicksFromUs(vblank_us));
+  EXPECT_EQ(2000, clock.estimated_draw_duration().InMicroseconds());
+
+  // A slow frame should raise the estimate immediately.
+  vblank_us += 16000;
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(vblank_us - 10000),
+                         CreateTimeTicksFromUs(vblank_us));
+  EXPECT_EQ(10000, clock.estimated_draw_duration().InMicroseconds());
+
+  // A fast one should only lower it a bit.
+  vblank_us += 16000;
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(vblank_us - 2000),
+                         CreateTimeTicksFromUs(vblank_us));
+  EXPECT_EQ(9000, clock.estimated_draw_duration().InMicroseconds());
+}
+
+TEST_F(FrameClockTest, VblankPhaseTracking) {
+  // Start with a swap that's 3 ms away from the real vblank phase and then
+  // report swaps that land 200 us after each real vblank.  Our estimate
+  // should converge on the real phase.
+  const int64 kIntervalUs = 16000;
+  VblankFrameClock clock(TimeDelta::FromMicroseconds(kIntervalUs));
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(0),
+                         CreateTimeTicksFromUs(3000));
+  for (int i = 1; i <= 30; ++i) {
+    const int64 swap_us = i * kIntervalUs + 200;
+    clock.HandleFrameDrawn(CreateTimeTicksFromUs(swap_us - 1000),
+                           CreateTimeTicksFromUs(swap_us));
+  }
+  const int64 next_vblank_us =
+      (clock.GetNextVblankTime(CreateTimeTicksFromUs(100 * kIntervalUs)) -
+       CreateTimeTicksFromUs(0)).InMicroseconds();
+  EXPECT_LT(std::abs(next_vblank_us - (100 * kIntervalUs + 200)), 50)
+      << "next vblank at " << next_vblank_us;
+}
+
+TEST_F(FrameClockTest, VblankDoesntDrawTwicePerVblank) {
+  VblankFrameClock clock(TimeDelta::FromMicroseconds(16000));
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(15000),
+                         CreateTimeTicksFromUs(16000));
+
+  // Report a swap that returned 4 ms before the next vblank (i.e. the swap
+  // didn't block).  The frame will be shown at that vblank, so if something
+  // changes right away, we should wait for the vblank after it rather than
+  // drawing a second frame for the same one.
+  clock.HandleFrameDrawn(CreateTimeTicksFromUs(27900),
+                         CreateTimeTicksFromUs(28000));
+  const TimeTicks next_draw =
+      clock.GetNextDrawTime(CreateTimeTicksFromUs(28050));
+  EXPECT_GT(next_draw, CreateTimeTicksFromUs(32000));
+  EXPECT_LT(next_draw, CreateTimeTicksFromUs(48000));
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
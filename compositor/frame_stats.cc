@@ -0,0 +1,151 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/compositor/frame_stats.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+
+using base::TimeDelta;
+using std::max;
+using std::min;
+using std::nth_element;
+using std::string;
+using std::vector;
+
+namespace window_manager {
+
+// static
+const size_t FrameStats::kNumFrames = 256;
+// static
+const int FrameStats::kReportedPercentiles[] = { 50, 90, 99 };
+// static
+const size_t FrameStats::kNumReportedPercentiles =
+    arraysize(FrameStats::kReportedPercentiles);
+
+FrameStats::FrameTiming::FrameTiming() {
+  for (int i = 0; i < kNumPhases; ++i)
+    durations_us[i] = 0;
+}
+
+FrameStats::FrameStats(const TimeDelta& deadline)
+    : deadline_(deadline),
+      next_index_(0),
+      num_frames_(0),
+      num_missed_deadlines_(0),
+      num_janky_frames_(0),
+      last_frame_was_animating_(false) {
+  for (int i = 0; i < kNumPhases; ++i)
+    durations_us_[i].resize(kNumFrames, -1);
+}
+
+FrameStats::~FrameStats() {}
+
+size_t FrameStats::num_recent_frames() const {
+  return static_cast<size_t>(
+      min(num_frames_, static_cast<int64_t>(kNumFrames)));
+}
+
+void FrameStats::RecordFrame(const FrameTiming& timing, bool animating) {
+  const int64_t deadline_us = deadline_.InMicroseconds();
+  for (int i = 0; i < PHASE_INTERVAL; ++i)
+    durations_us_[i][next_index_] = max(timing.durations_us[i], 0);
+
+  int interval_us = -1;
+  if (last_frame_was_animating_ && !last_start_time_.is_null()) {
+    interval_us = (timing.start_time - last_start_time_).InMicroseconds();
+    if (interval_us * 2 > deadline_us * 3)
+      num_janky_frames_++;
+  }
+  durations_us_[PHASE_INTERVAL][next_index_] = interval_us;
+
+  if (timing.durations_us[PHASE_TOTAL] > deadline_us)
+    num_missed_deadlines_++;
+
+  num_frames_++;
+  next_index_ = (next_index_ + 1) % kNumFrames;
+  last_start_time_ = timing.start_time;
+  last_frame_was_animating_ = animating;
+}
+
+int FrameStats::GetPercentileUs(Phase phase, int percentile) const {
+  DCHECK_GE(phase, 0);
+  DCHECK_LT(phase, kNumPhases);
+  vector<int> samples;
+  GetSamples(phase, &samples);
+  if (samples.empty())
+    return 0;
+
+  // Use the nearest-rank method.
+  percentile = max(min(percentile, 100), 0);
+  const size_t rank = (percentile * samples.size() + 99) / 100;
+  const size_t index = rank > 0 ? rank - 1 : 0;
+  nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+string FrameStats::GetSummary() const {
+  string summary = StringPrintf(
+      "%lld frames (%zu recent), %lld missed %lld us deadline, "
+      "%lld janky\n",
+      static_cast<long long>(num_frames_), num_recent_frames(),
+      static_cast<long long>(num_missed_deadlines_),
+      static_cast<long long>(deadline_.InMicroseconds()),
+      static_cast<long long>(num_janky_frames_));
+  for (int i = 0; i < kNumPhases; ++i) {
+    const Phase phase = static_cast<Phase>(i);
+    StringAppendF(&summary, "  %-8s", GetPhaseName(phase));
+    for (size_t j = 0; j < kNumReportedPercentiles; ++j) {
+      StringAppendF(&summary, " p%d=%d", kReportedPercentiles[j],
+                    GetPercentileUs(phase, kReportedPercentiles[j]));
+    }
+    StringAppendF(&summary, " max=%d us\n", GetPercentileUs(phase, 100));
+  }
+  return summary;
+}
+
+void FrameStats::GetPropertyValues(vector<int>* values) const {
+  DCHECK(values);
+  values->clear();
+  values->push_back(static_cast<int>(num_frames_));
+  values->push_back(static_cast<int>(num_missed_deadlines_));
+  values->push_back(static_cast<int>(num_janky_frames_));
+  values->push_back(static_cast<int>(deadline_.InMicroseconds()));
+  for (int i = 0; i < kNumPhases; ++i) {
+    const Phase phase = static_cast<Phase>(i);
+    for (size_t j = 0; j < kNumReportedPercentiles; ++j)
+      values->push_back(GetPercentileUs(phase, kReportedPercentiles[j]));
+    values->push_back(GetPercentileUs(phase, 100));
+  }
+}
+
+// static
+const char* FrameStats::GetPhaseName(Phase phase) {
+  switch (phase) {
+    case PHASE_UPDATE:      return "update";
+    case PHASE_LAYER_VISIT: return "layer";
+    case PHASE_RENDER:      return "render";
+    case PHASE_SWAP:        return "swap";
+    case PHASE_TOTAL:       return "total";
+    case PHASE_INTERVAL:    return "interval";
+    case kNumPhases:        break;
+  }
+  NOTREACHED() << "Unknown phase " << phase;
+  return "unknown";
+}
+
+void FrameStats::GetSamples(Phase phase, vector<int>* samples) const {
+  samples->clear();
+  const size_t num_samples = num_recent_frames();
+  samples->reserve(num_samples);
+  const vector<int>& durations = durations_us_[phase];
+  for (size_t i = 0; i < num_samples; ++i) {
+    if (durations[i] >= 0)
+      samples->push_back(durations[i]);
+  }
+}
+
+}  // namespace window_manager
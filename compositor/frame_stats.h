@@ -0,0 +1,123 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_COMPOSITOR_FRAME_STATS_H_
+#define WINDOW_MANAGER_COMPOSITOR_FRAME_STATS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/time.h"
+
+namespace window_manager {
+
+// FrameStats keeps timing information about the compositor's most recent
+// frames in a fixed-size ring buffer, so that frame rate regressions can be
+// spotted in production builds without needing the profiler.  Recording a
+// frame doesn't allocate; percentiles are only computed when someone asks
+// for them.
+class FrameStats {
+ public:
+  // Parts of drawing a frame that are timed separately.
+  enum Phase {
+    // Running animations and updating actors.
+    PHASE_UPDATE = 0,
+    // Computing depths, culling and damage with LayerVisitor.
+    PHASE_LAYER_VISIT,
+    // Issuing drawing commands.
+    PHASE_RENDER,
+    // Swapping buffers (or copying the back buffer to the screen).
+    PHASE_SWAP,
+    // All of the above.
+    PHASE_TOTAL,
+    // Time between the starts of consecutive frames while animating.  Only
+    // recorded for frames that directly follow an animated frame.
+    PHASE_INTERVAL,
+    kNumPhases,
+  };
+
+  // Number of frames kept in the ring buffer.
+  static const size_t kNumFrames;
+
+  // Percentiles reported by GetSummary() and GetPropertyValues().
+  static const int kReportedPercentiles[];
+  static const size_t kNumReportedPercentiles;
+
+  // Timing of a single frame.  The compositor fills in the start time and
+  // the durations of the phases up through PHASE_TOTAL; phases that didn't
+  // run should be left at 0.
+  struct FrameTiming {
+    FrameTiming();
+
+    base::TimeTicks start_time;
+    int durations_us[kNumPhases];
+  };
+
+  // |deadline| is the time that we have to draw each frame (usually the
+  // display's refresh interval).
+  explicit FrameStats(const base::TimeDelta& deadline);
+  ~FrameStats();
+
+  const base::TimeDelta& deadline() const { return deadline_; }
+  int64_t num_frames() const { return num_frames_; }
+  int64_t num_missed_deadlines() const { return num_missed_deadlines_; }
+  int64_t num_janky_frames() const { return num_janky_frames_; }
+
+  // Number of frames currently in the ring buffer.
+  size_t num_recent_frames() const;
+
+  // Record a newly-drawn frame.  |animating| should be true if an animation
+  // was still running after the frame, in which case the next frame is
+  // expected one deadline later; if it comes any later than 1.5 deadlines,
+  // the next frame is counted as janky.
+  void RecordFrame(const FrameTiming& timing, bool animating);
+
+  // Get the |percentile|th percentile (0-100) of a phase's duration in
+  // microseconds across the frames in the ring buffer.  Returns 0 if there
+  // are no samples.
+  int GetPercentileUs(Phase phase, int percentile) const;
+
+  // Get a human-readable description of the recent frames.
+  std::string GetSummary() const;
+
+  // Get the statistics as a flat list of integers for exporting through an
+  // X property: the total number of frames, missed deadlines and janky
+  // frames, the deadline in microseconds, and then, for each phase in
+  // order, each of kReportedPercentiles followed by the maximum.
+  void GetPropertyValues(std::vector<int>* values) const;
+
+  // Get the name of |phase| for logging.
+  static const char* GetPhaseName(Phase phase);
+
+ private:
+  // Copy the valid samples for |phase| into |samples|.
+  void GetSamples(Phase phase, std::vector<int>* samples) const;
+
+  base::TimeDelta deadline_;
+
+  // Durations of each phase, indexed by frame.  Missing interval samples
+  // are stored as -1.
+  std::vector<int> durations_us_[kNumPhases];
+
+  // Index in |durations_us_| where the next frame will be written.
+  size_t next_index_;
+
+  // Running totals since we were created.
+  int64_t num_frames_;
+  int64_t num_missed_deadlines_;
+  int64_t num_janky_frames_;
+
+  // Start time of the last frame, and whether it was animating.
+  base::TimeTicks last_start_time_;
+  bool last_frame_was_animating_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameStats);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_COMPOSITOR_FRAME_STATS_H_
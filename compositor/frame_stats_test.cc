@@ -0,0 +1,124 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "window_manager/compositor/frame_stats.h"
+#include "window_manager/test_lib.h"
+#include "window_manager/util.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using base::TimeDelta;
+using std::vector;
+using window_manager::util::CreateTimeTicksFromMs;
+
+namespace window_manager {
+
+class FrameStatsTest : public ::testing::Test {
+ protected:
+  // Record a frame starting at |start_ms| whose render phase takes
+  // |render_us| and whose other phases take 100 us each.
+  void RecordFrame(FrameStats* stats, int64_t start_ms, int render_us,
+                   bool animating) {
+    FrameStats::FrameTiming timing;
+    timing.start_time = CreateTimeTicksFromMs(start_ms);
+    timing.durations_us[FrameStats::PHASE_UPDATE] = 100;
+    timing.durations_us[FrameStats::PHASE_LAYER_VISIT] = 100;
+    timing.durations_us[FrameStats::PHASE_RENDER] = render_us;
+    timing.durations_us[FrameStats::PHASE_SWAP] = 100;
+    timing.durations_us[FrameStats::PHASE_TOTAL] = render_us + 300;
+    stats->RecordFrame(timing, animating);
+  }
+};
+
+TEST_F(FrameStatsTest, Percentiles) {
+  FrameStats stats(TimeDelta::FromMilliseconds(16));
+  EXPECT_EQ(0, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 50));
+
+  // Render times of 1, 2, ..., 100 us, recorded in a scrambled order.
+  for (int i = 0; i < 100; ++i)
+    RecordFrame(&stats, i * 1000, (i * 37) % 100 + 1, false);
+  EXPECT_EQ(100, stats.num_frames());
+  EXPECT_EQ(100U, stats.num_recent_frames());
+
+  EXPECT_EQ(1, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 0));
+  EXPECT_EQ(50, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 50));
+  EXPECT_EQ(90, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 90));
+  EXPECT_EQ(99, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 99));
+  EXPECT_EQ(100, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 100));
+  EXPECT_EQ(100, stats.GetPercentileUs(FrameStats::PHASE_SWAP, 50));
+  EXPECT_EQ(400, stats.GetPercentileUs(FrameStats::PHASE_TOTAL, 100));
+
+  // None of the frames followed an animated one, so there shouldn't be any
+  // intervals.
+  EXPECT_EQ(0, stats.GetPercentileUs(FrameStats::PHASE_INTERVAL, 50));
+}
+
+// Check that only the most recent frames are used for percentiles but that
+// the totals keep counting.
+TEST_F(FrameStatsTest, RingBuffer) {
+  FrameStats stats(TimeDelta::FromMilliseconds(16));
+  const int kNumFrames = static_cast<int>(FrameStats::kNumFrames);
+  for (int i = 0; i < kNumFrames; ++i)
+    RecordFrame(&stats, i * 1000, 20000, false);
+  EXPECT_EQ(kNumFrames, stats.num_missed_deadlines());
+  EXPECT_EQ(20000, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 50));
+
+  for (int i = 0; i < kNumFrames; ++i)
+    RecordFrame(&stats, (kNumFrames + i) * 1000, 1000, false);
+  EXPECT_EQ(2 * kNumFrames, stats.num_frames());
+  EXPECT_EQ(FrameStats::kNumFrames, stats.num_recent_frames());
+  EXPECT_EQ(kNumFrames, stats.num_missed_deadlines());
+  EXPECT_EQ(1000, stats.GetPercentileUs(FrameStats::PHASE_RENDER, 100));
+}
+
+// Check that late frames during animations are counted as janky.
+TEST_F(FrameStatsTest, Jank) {
+  FrameStats stats(TimeDelta::FromMilliseconds(16));
+  RecordFrame(&stats, 1000, 1000, true);
+  RecordFrame(&stats, 1016, 1000, true);
+  RecordFrame(&stats, 1040, 1000, true);   // 24 ms: exactly 1.5 deadlines
+  RecordFrame(&stats, 1073, 1000, false);  // 33 ms: janky
+  EXPECT_EQ(1, stats.num_janky_frames());
+  EXPECT_EQ(0, stats.num_missed_deadlines());
+  EXPECT_EQ(16000, stats.GetPercentileUs(FrameStats::PHASE_INTERVAL, 0));
+  EXPECT_EQ(33000, stats.GetPercentileUs(FrameStats::PHASE_INTERVAL, 100));
+
+  // A long gap after a frame that wasn't animating is just idle time.
+  RecordFrame(&stats, 6000, 1000, true);
+  EXPECT_EQ(1, stats.num_janky_frames());
+  EXPECT_EQ(33000, stats.GetPercentileUs(FrameStats::PHASE_INTERVAL, 100));
+}
+
+TEST_F(FrameStatsTest, PropertyValues) {
+  FrameStats stats(TimeDelta::FromMilliseconds(16));
+  RecordFrame(&stats, 0, 17000, true);
+  RecordFrame(&stats, 17, 1000, false);
+
+  vector<int> values;
+  stats.GetPropertyValues(&values);
+  const size_t kValuesPerPhase = FrameStats::kNumReportedPercentiles + 1;
+  ASSERT_EQ(4 + FrameStats::kNumPhases * kValuesPerPhase, values.size());
+  EXPECT_EQ(2, values[0]);      // frames
+  EXPECT_EQ(1, values[1]);      // missed deadlines
+  EXPECT_EQ(0, values[2]);      // janky frames
+  EXPECT_EQ(16000, values[3]);  // deadline
+
+  // The maximum total time should come at the end of the total phase's
+  // values.
+  EXPECT_EQ(17300,
+            values[4 + (FrameStats::PHASE_TOTAL + 1) * kValuesPerPhase - 1]);
+  EXPECT_FALSE(stats.GetSummary().empty());
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
@@ -24,6 +24,9 @@ class GLInterface : virtual public GLInterfaceBase {
   // Is GLX_EXT_texture_from_pixmap available?
   virtual bool HasTextureFromPixmapExtension() { return true; }
 
+  // Are pixel buffer objects (GL_ARB_pixel_buffer_object) available?
+  virtual bool HasPixelBufferObjectExtension() { return false; }
+
   // Use this function to free objects obtained from this interface,
   // such as from GetGlxFbConfigs and GetGlxVisualFromFbConfig.  In
   // other words, call this when you would have called "XFree" on an
@@ -80,6 +83,7 @@ class GLInterface : virtual public GLInterfaceBase {
                        GLfloat alpha) = 0;
   virtual void DeleteBuffers(GLsizei n, const GLuint* buffers) = 0;
   virtual void DeleteTextures(GLsizei n, const GLuint* textures) = 0;
+  virtual void DepthFunc(GLenum func) = 0;
   virtual void DepthMask(GLboolean flag) = 0;
   virtual void Disable(GLenum cap) = 0;
   virtual void DisableClientState(GLenum array) = 0;
@@ -88,6 +92,8 @@ class GLInterface : virtual public GLInterfaceBase {
   virtual void EnableClientState(GLenum cap) = 0;
   virtual void Finish() = 0;
   virtual void GenBuffers(GLsizei n, GLuint* buffers) = 0;
+  virtual GLvoid* MapBuffer(GLenum target, GLenum access) = 0;
+  virtual GLboolean UnmapBuffer(GLenum target) = 0;
   virtual void GenTextures(GLsizei n, GLuint* textures) = 0;
   virtual GLenum GetError() = 0;
   virtual void LoadIdentity() = 0;
@@ -115,6 +121,15 @@ class GLInterface : virtual public GLInterfaceBase {
                           GLenum format,
                           GLenum type,
                           const GLvoid* pixels) = 0;
+  virtual void TexSubImage2D(GLenum target,
+                             GLint level,
+                             GLint xoffset,
+                             GLint yoffset,
+                             GLsizei width,
+                             GLsizei height,
+                             GLenum format,
+                             GLenum type,
+                             const GLvoid* pixels) = 0;
   virtual void EnableAnisotropicFiltering() = 0;
   virtual void Translatef(GLfloat x, GLfloat y, GLfloat z) = 0;
   virtual void VertexPointer(GLint size, GLenum type, GLsizei stride,
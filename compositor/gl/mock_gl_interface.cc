@@ -4,6 +4,11 @@
 
 #include "window_manager/compositor/gl/mock_gl_interface.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
 struct __GLinterface;
 struct __GLcontextModes;
 struct __GLXscreenInfo;
@@ -96,7 +101,23 @@ MockGLInterface::MockGLInterface()
       next_glx_pixmap_id_(1),
       full_updates_count_(0),
       partial_updates_count_(0),
-      partial_updates_region_() {
+      partial_updates_region_(),
+      depth_func_(GL_LESS),
+      depth_mask_(GL_TRUE),
+      next_buffer_id_(1),
+      next_texture_id_(1),
+      texture_2d_(0),
+      array_buffer_(0),
+      pixel_unpack_buffer_(0),
+      mapped_buffer_(0),
+      vertex_pointer_buffer_(0),
+      vertex_pointer_size_(4),
+      vertex_pointer_stride_(0),
+      vertex_pointer_offset_(0),
+      num_tex_image_uploads_(0),
+      has_texture_from_pixmap_extension_(true),
+      has_pixel_buffer_object_extension_(false),
+      num_pixel_buffer_uploads_(0) {
   mock_configs_.reset(new GLXFBConfig[2]);
   kConfigRec24.depthBits = 24;
   kConfigRec24.redBits = 8;
@@ -171,4 +192,97 @@ void MockGLInterface::Viewport(GLint x, GLint y,
                                GLsizei width, GLsizei height) {
   viewport_.reset(x, y, width, height);
 }
+
+void MockGLInterface::BindTexture(GLenum target, GLuint texture) {
+  if (target == GL_TEXTURE_2D)
+    texture_2d_ = texture;
+}
+
+void MockGLInterface::BindBuffer(GLenum target, GLuint buffer) {
+  if (target == GL_ARRAY_BUFFER)
+    array_buffer_ = buffer;
+  else if (target == GL_PIXEL_UNPACK_BUFFER)
+    pixel_unpack_buffer_ = buffer;
+}
+
+void MockGLInterface::BufferData(GLenum target, GLsizeiptr size,
+                                 const GLvoid* data, GLenum usage) {
+  GLuint buffer = 0;
+  if (target == GL_ARRAY_BUFFER)
+    buffer = array_buffer_;
+  else if (target == GL_PIXEL_UNPACK_BUFFER)
+    buffer = pixel_unpack_buffer_;
+  if (!buffer)
+    return;
+  std::vector<char>& contents = buffer_data_[buffer];
+  contents.resize(size);
+  if (data && size)
+    memcpy(&contents[0], data, size);
+}
+
+GLvoid* MockGLInterface::MapBuffer(GLenum target, GLenum access) {
+  CHECK(!mapped_buffer_) << "Buffer " << mapped_buffer_ << " already mapped";
+  if (target != GL_PIXEL_UNPACK_BUFFER || !pixel_unpack_buffer_)
+    return NULL;
+  std::vector<char>& contents = buffer_data_[pixel_unpack_buffer_];
+  if (contents.empty())
+    return NULL;
+  mapped_buffer_ = pixel_unpack_buffer_;
+  return &contents[0];
+}
+
+GLboolean MockGLInterface::UnmapBuffer(GLenum target) {
+  if (target != GL_PIXEL_UNPACK_BUFFER || !mapped_buffer_ ||
+      mapped_buffer_ != pixel_unpack_buffer_)
+    return GL_FALSE;
+  mapped_buffer_ = 0;
+  return GL_TRUE;
+}
+
+const std::vector<char>* MockGLInterface::GetBufferData(GLuint buffer) const {
+  std::map<GLuint, std::vector<char> >::const_iterator it =
+      buffer_data_.find(buffer);
+  return it != buffer_data_.end() ? &(it->second) : NULL;
+}
+
+void MockGLInterface::GenBuffers(GLsizei n, GLuint* buffers) {
+  for (GLsizei i = 0; i < n; ++i)
+    buffers[i] = next_buffer_id_++;
+}
+
+void MockGLInterface::VertexPointer(GLint size, GLenum type, GLsizei stride,
+                                    const GLvoid* pointer) {
+  vertex_pointer_buffer_ = array_buffer_;
+  vertex_pointer_size_ = size;
+  vertex_pointer_stride_ = stride;
+  vertex_pointer_offset_ = reinterpret_cast<size_t>(pointer);
+}
+
+void MockGLInterface::DrawArrays(GLenum mode, GLint first, GLsizei count) {
+  DrawCall call;
+  call.mode = mode;
+  call.count = count;
+
+  std::map<GLuint, std::vector<char> >::const_iterator it =
+      buffer_data_.find(vertex_pointer_buffer_);
+  if (it != buffer_data_.end()) {
+    const size_t stride = vertex_pointer_stride_ ?
+        vertex_pointer_stride_ : vertex_pointer_size_ * sizeof(GLfloat);
+    const size_t offset = vertex_pointer_offset_ + first * stride;
+    GLfloat position[3] = { 0.f, 0.f, 0.f };
+    const int num_components = std::min(vertex_pointer_size_, 3);
+    if (offset + num_components * sizeof(GLfloat) <= it->second.size())
+      memcpy(position, &it->second[offset], num_components * sizeof(GLfloat));
+    call.x = position[0];
+    call.y = position[1];
+    call.z = position[2];
+  }
+
+  call.depth_test = IsEnabled(GL_DEPTH_TEST);
+  call.depth_mask = depth_mask_;
+  call.blend = IsEnabled(GL_BLEND);
+  call.texture = IsEnabled(GL_TEXTURE_2D) ? texture_2d_ : 0;
+  draw_calls_.push_back(call);
+}
+
 }  // namespace window_manager
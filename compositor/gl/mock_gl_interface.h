@@ -5,6 +5,10 @@
 #ifndef WINDOW_MANAGER_COMPOSITOR_GL_MOCK_GL_INTERFACE_H_
 #define WINDOW_MANAGER_COMPOSITOR_GL_MOCK_GL_INTERFACE_H_
 
+#include <map>
+#include <set>
+#include <vector>
+
 #include "base/memory/scoped_ptr.h"
 #include "window_manager/compositor/gl/gl_interface.h"
 #include "window_manager/geometry.h"
@@ -15,10 +19,43 @@ namespace window_manager {
 
 class MockGLInterface : public GLInterface {
  public:
+  // Information about a DrawArrays() call.
+  struct DrawCall {
+    DrawCall()
+        : mode(0),
+          count(0),
+          x(0.f), y(0.f), z(0.f),
+          depth_test(false),
+          depth_mask(true),
+          blend(false),
+          texture(0) {}
+
+    GLenum mode;
+    GLsizei count;
+
+    // Position of the first vertex that was drawn, read from the buffer
+    // passed to VertexPointer().
+    GLfloat x, y, z;
+
+    // Were depth testing, depth buffer writes, and blending enabled?
+    bool depth_test;
+    bool depth_mask;
+    bool blend;
+
+    // Texture bound to GL_TEXTURE_2D, or 0 if texturing was disabled.
+    GLuint texture;
+  };
+
   MockGLInterface();
   virtual ~MockGLInterface() {}
 
   // Begin GLInterface methods.
+  virtual bool HasTextureFromPixmapExtension() {
+    return has_texture_from_pixmap_extension_;
+  }
+  virtual bool HasPixelBufferObjectExtension() {
+    return has_pixel_buffer_object_extension_;
+  }
   virtual XVisualID GetVisual() { return 1; }
   virtual void GlxFree(void* item) {}
 
@@ -49,16 +86,17 @@ class MockGLInterface : public GLInterface {
                                 int height) {
     ++partial_updates_count_;
     partial_updates_region_.reset(x, y, width, height);
+    partial_updates_regions_.push_back(partial_updates_region_);
   }
 
   // GL functions we use.
   virtual void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
-  virtual void BindBuffer(GLenum target, GLuint buffer) {}
-  virtual void BindTexture(GLenum target, GLuint texture) {}
+  virtual void BindBuffer(GLenum target, GLuint buffer);
+  virtual void BindTexture(GLenum target, GLuint texture);
   virtual void BlendFunc(GLenum sfactor, GLenum dfactor) {}
   virtual void BufferData(GLenum target, GLsizeiptr size, const GLvoid* data,
-                          GLenum usage) {}
-  virtual void Clear(GLbitfield mask) {}
+                          GLenum usage);
+  virtual void Clear(GLbitfield mask) { clear_masks_.push_back(mask); }
   virtual void ClearColor(GLfloat red, GLfloat green, GLfloat blue,
                           GLfloat alpha) {
     clear_red_ = red;
@@ -70,15 +108,21 @@ class MockGLInterface : public GLInterface {
                        GLfloat alpha) {}
   virtual void DeleteBuffers(GLsizei n, const GLuint* buffers) {}
   virtual void DeleteTextures(GLsizei n, const GLuint* textures) {}
-  virtual void DepthMask(GLboolean flag) {}
-  virtual void Disable(GLenum cap) {}
+  virtual void DepthFunc(GLenum func) { depth_func_ = func; }
+  virtual void DepthMask(GLboolean flag) { depth_mask_ = flag; }
+  virtual void Disable(GLenum cap) { enabled_caps_.erase(cap); }
   virtual void DisableClientState(GLenum array) {}
-  virtual void DrawArrays(GLenum mode, GLint first, GLsizei count) {}
-  virtual void Enable(GLenum cap) {}
+  virtual void DrawArrays(GLenum mode, GLint first, GLsizei count);
+  virtual void Enable(GLenum cap) { enabled_caps_.insert(cap); }
   virtual void EnableClientState(GLenum cap) {}
   virtual void Finish() {}
-  virtual void GenBuffers(GLsizei n, GLuint* buffers) {}
-  virtual void GenTextures(GLsizei n, GLuint* textures) {}
+  virtual void GenBuffers(GLsizei n, GLuint* buffers);
+  virtual GLvoid* MapBuffer(GLenum target, GLenum access);
+  virtual GLboolean UnmapBuffer(GLenum target);
+  virtual void GenTextures(GLsizei n, GLuint* textures) {
+    for (GLsizei i = 0; i < n; ++i)
+      textures[i] = next_texture_id_++;
+  }
   virtual GLenum GetError() { return GL_NO_ERROR; }
   virtual void LoadIdentity() {}
   virtual void LoadMatrixf(const GLfloat* m) {}
@@ -104,11 +148,28 @@ class MockGLInterface : public GLInterface {
                           GLint border,
                           GLenum format,
                           GLenum type,
-                          const GLvoid* pixels) {}
+                          const GLvoid* pixels) {
+    ++num_tex_image_uploads_;
+    if (pixel_unpack_buffer_)
+      ++num_pixel_buffer_uploads_;
+  }
+  virtual void TexSubImage2D(GLenum target,
+                             GLint level,
+                             GLint xoffset,
+                             GLint yoffset,
+                             GLsizei width,
+                             GLsizei height,
+                             GLenum format,
+                             GLenum type,
+                             const GLvoid* pixels) {
+    tex_sub_image_regions_.push_back(Rect(xoffset, yoffset, width, height));
+    if (pixel_unpack_buffer_)
+      ++num_pixel_buffer_uploads_;
+  }
   virtual void EnableAnisotropicFiltering() {}
   virtual void Translatef(GLfloat x, GLfloat y, GLfloat z) {}
   virtual void VertexPointer(GLint size, GLenum type, GLsizei stride,
-                             const GLvoid* pointer) {}
+                             const GLvoid* pointer);
   virtual void ColorPointer(GLint size, GLenum type, GLsizei stride,
                             const GLvoid* pointer) {}
   // End GLInterface methods.
@@ -122,6 +183,32 @@ class MockGLInterface : public GLInterface {
   int full_updates_count() const { return full_updates_count_; }
   int partial_updates_count() const { return partial_updates_count_; }
   const Rect& partial_updates_region() const { return partial_updates_region_; }
+  const std::vector<Rect>& partial_updates_regions() const {
+    return partial_updates_regions_;
+  }
+  bool IsEnabled(GLenum cap) const { return enabled_caps_.count(cap); }
+  GLenum depth_func() const { return depth_func_; }
+  GLboolean depth_mask() const { return depth_mask_; }
+  const std::vector<GLbitfield>& clear_masks() const { return clear_masks_; }
+  const std::vector<DrawCall>& draw_calls() const { return draw_calls_; }
+  int num_tex_image_uploads() const { return num_tex_image_uploads_; }
+  const std::vector<Rect>& tex_sub_image_regions() const {
+    return tex_sub_image_regions_;
+  }
+  void set_has_texture_from_pixmap_extension(bool has_extension) {
+    has_texture_from_pixmap_extension_ = has_extension;
+  }
+  void set_has_pixel_buffer_object_extension(bool has_extension) {
+    has_pixel_buffer_object_extension_ = has_extension;
+  }
+  GLuint pixel_unpack_buffer() const { return pixel_unpack_buffer_; }
+  int num_pixel_buffer_uploads() const { return num_pixel_buffer_uploads_; }
+  // Get the contents of a buffer, or NULL if it has no data.
+  const std::vector<char>* GetBufferData(GLuint buffer) const;
+  void ClearDrawCalls() {
+    clear_masks_.clear();
+    draw_calls_.clear();
+  }
   // End test-only methods.
 
  private:
@@ -147,6 +234,61 @@ class MockGLInterface : public GLInterface {
   // Most recent CopyGlxSubBuffer() region.
   Rect partial_updates_region_;
 
+  // All CopyGlxSubBuffer() regions, oldest first.
+  std::vector<Rect> partial_updates_regions_;
+
+  // Capabilities that are currently enabled using Enable().
+  std::set<GLenum> enabled_caps_;
+
+  // Most recent values passed to DepthFunc() and DepthMask().
+  GLenum depth_func_;
+  GLboolean depth_mask_;
+
+  // Next IDs to hand out in GenBuffers() and GenTextures().
+  GLuint next_buffer_id_;
+  GLuint next_texture_id_;
+
+  // Texture currently bound to GL_TEXTURE_2D.
+  GLuint texture_2d_;
+
+  // Buffers currently bound to GL_ARRAY_BUFFER and GL_PIXEL_UNPACK_BUFFER.
+  GLuint array_buffer_;
+  GLuint pixel_unpack_buffer_;
+
+  // Buffer currently mapped by MapBuffer(), or 0 if none is mapped.
+  GLuint mapped_buffer_;
+
+  // Contents of buffers, keyed by buffer ID.
+  std::map<GLuint, std::vector<char> > buffer_data_;
+
+  // Arguments from the most recent VertexPointer() call and the buffer that
+  // was bound at the time.
+  GLuint vertex_pointer_buffer_;
+  GLint vertex_pointer_size_;
+  GLsizei vertex_pointer_stride_;
+  size_t vertex_pointer_offset_;
+
+  // Masks passed to Clear() and information about DrawArrays() calls, oldest
+  // first.
+  std::vector<GLbitfield> clear_masks_;
+  std::vector<DrawCall> draw_calls_;
+
+  // Number of times that TexImage2D() has been called.
+  int num_tex_image_uploads_;
+
+  // Regions passed to TexSubImage2D(), oldest first.
+  std::vector<Rect> tex_sub_image_regions_;
+
+  // Value returned by HasTextureFromPixmapExtension().
+  bool has_texture_from_pixmap_extension_;
+
+  // Value returned by HasPixelBufferObjectExtension().
+  bool has_pixel_buffer_object_extension_;
+
+  // Number of TexImage2D() and TexSubImage2D() calls made while a buffer
+  // was bound to GL_PIXEL_UNPACK_BUFFER.
+  int num_pixel_buffer_uploads_;
+
   DISALLOW_COPY_AND_ASSIGN(MockGLInterface);
 };
 
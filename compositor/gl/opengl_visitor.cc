@@ -7,8 +7,10 @@
 #include <sys/time.h>
 
 #include <algorithm>
+#include <cstddef>
 #include <ctime>
 #include <string>
+#include <vector>
 
 #include <GL/gl.h>
 #include <GL/glext.h>
@@ -18,12 +20,20 @@
 #include "base/basictypes.h"
 #include "base/logging.h"
 #include "window_manager/compositor/gl/gl_interface.h"
+#include "window_manager/counters.h"
 #include "window_manager/image_container.h"
 #include "window_manager/image_enums.h"
 #include "window_manager/profiler.h"
 #include "window_manager/util.h"
 
 DECLARE_bool(compositor_display_debug_needle);
+DECLARE_bool(compositor_opaque_depth_pass);
+DECLARE_bool(compositor_partial_texture_uploads);
+DECLARE_bool(compositor_pixel_buffer_uploads);
+
+DECLARE_COUNTER(Compositor_DrawCalls);
+DECLARE_COUNTER(Compositor_TextureUploads);
+DECLARE_COUNTER(Compositor_TextureUploadBytes);
 
 #ifndef COMPOSITOR_OPENGL
 #error Need COMPOSITOR_OPENGL defined to compile this file
@@ -43,15 +53,21 @@ DECLARE_bool(compositor_display_debug_needle);
 #define CHECK_GL_ERROR(gl_interface_) void(0)
 #endif  // GL_ERROR_DEBUGGING
 
+using std::vector;
 using window_manager::util::XidStr;
 
 namespace window_manager {
 
+// Number of pixel buffer objects that OpenGlDrawVisitor cycles through for
+// texture uploads.
+static const size_t kNumPixelBuffers = 3;
+
 OpenGlPixmapData::OpenGlPixmapData(OpenGlDrawVisitor* visitor)
     : visitor_(visitor),
       gl_(visitor_->gl_interface_),
       pixmap_(0),
-      glx_pixmap_(0) {
+      glx_pixmap_(0),
+      texture_allocated_(false) {
   DCHECK(visitor);
 }
 
@@ -76,7 +92,40 @@ void OpenGlPixmapData::Refresh() {
     gl_->ReleaseGlxTexImage(glx_pixmap_, GLX_FRONT_LEFT_EXT);
     gl_->BindGlxTexImage(glx_pixmap_, GLX_FRONT_LEFT_EXT, NULL);
   } else {
-    CopyPixmapImageToTexture();
+    CopyPixmapImageToTexture(Rect(Point(0, 0), pixmap_geometry_.bounds.size()));
+  }
+
+  CHECK_GL_ERROR(gl_);
+}
+
+void OpenGlPixmapData::RefreshRegion(const Region& region) {
+  if (gl_->HasTextureFromPixmapExtension() ||
+      !FLAGS_compositor_partial_texture_uploads ||
+      !texture_allocated_) {
+    Refresh();
+    return;
+  }
+
+  const Rect pixmap_rect(Point(0, 0), pixmap_geometry_.bounds.size());
+  Region clipped_region(region);
+  clipped_region.intersect(pixmap_rect);
+  if (clipped_region.empty())
+    return;
+
+  DCHECK(texture());
+  gl_->BindTexture(GL_TEXTURE_2D, texture());
+
+  // If most of the pixmap changed, fetch it all with a single request
+  // instead of one per rectangle.
+  if (clipped_region.area() > pixmap_rect.area() / 2) {
+    CopyPixmapImageToTexture(pixmap_rect);
+  } else {
+    const vector<Rect>& rects = clipped_region.rects();
+    for (vector<Rect>::const_iterator it = rects.begin();
+         it != rects.end(); ++it) {
+      if (!CopyPixmapImageToTexture(*it))
+        break;
+    }
   }
 
   CHECK_GL_ERROR(gl_);
@@ -135,7 +184,8 @@ bool OpenGlPixmapData::Init(RealCompositor::TexturePixmapActor* actor) {
   if (use_glx_pixmap) {
     gl_->BindGlxTexImage(glx_pixmap_, GLX_FRONT_LEFT_EXT, NULL);
   } else {
-    if (!CopyPixmapImageToTexture())
+    if (!CopyPixmapImageToTexture(
+            Rect(Point(0, 0), pixmap_geometry_.bounds.size())))
       return false;
   }
 
@@ -144,29 +194,19 @@ bool OpenGlPixmapData::Init(RealCompositor::TexturePixmapActor* actor) {
   return true;
 }
 
-bool OpenGlPixmapData::CopyPixmapImageToTexture() {
+bool OpenGlPixmapData::CopyPixmapImageToTexture(const Rect& rect) {
   DCHECK(pixmap_);
   DCHECK(!gl_->HasTextureFromPixmapExtension());
 
   scoped_ptr_malloc<uint8_t> data;
   ImageFormat format = IMAGE_FORMAT_UNKNOWN;
   if (!visitor_->xconn()->GetImage(
-          pixmap_,
-          Rect(Point(0, 0), pixmap_geometry_.bounds.size()),
-          pixmap_geometry_.depth,
-          &data,
-          &format)) {
-    LOG(WARNING) << "Unable to fetch image from pixmap " << XidStr(pixmap_);
+          pixmap_, rect, pixmap_geometry_.depth, &data, &format)) {
+    LOG(WARNING) << "Unable to fetch " << rect << " from pixmap "
+                 << XidStr(pixmap_);
     return false;
   }
 
-  InMemoryImageContainer image_container(
-      data.release(),
-      pixmap_geometry_.bounds.width,
-      pixmap_geometry_.bounds.height,
-      format,
-      true);
-
   GLenum pixel_data_format = 0;
   GLenum pixel_data_type = GL_UNSIGNED_BYTE;
   GLenum internal_format = GL_RGBA;
@@ -189,10 +229,31 @@ bool OpenGlPixmapData::CopyPixmapImageToTexture() {
       return false;
   }
 
-  gl_->TexImage2D(GL_TEXTURE_2D, 0, internal_format,
-                  image_container.width(), image_container.height(),
-                  0, pixel_data_format, pixel_data_type,
-                  image_container.data());
+  // Only allocate the texture's storage once; after that, update it in
+  // place so that small changes don't require re-uploading the whole
+  // pixmap.
+  PixelBufferRing* ring = visitor_->pixel_buffer_ring_.get();
+  const size_t num_bytes =
+      rect.area() * GetBitsPerPixelInImageFormat(format) / 8;
+  const GLvoid* pixels = ring->StartUpload(data.get(), num_bytes);
+  if (!texture_allocated_) {
+    DCHECK(rect == Rect(Point(0, 0), pixmap_geometry_.bounds.size()))
+        << "Initial texture upload for pixmap " << XidStr(pixmap_)
+        << " only covers " << rect;
+    gl_->TexImage2D(GL_TEXTURE_2D, 0, internal_format,
+                    rect.width, rect.height,
+                    0, pixel_data_format, pixel_data_type,
+                    pixels);
+    texture_allocated_ = true;
+  } else {
+    gl_->TexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y,
+                       rect.width, rect.height,
+                       pixel_data_format, pixel_data_type,
+                       pixels);
+  }
+  ring->FinishUpload();
+  COUNTER_INCREMENT(Compositor_TextureUploads);
+  COUNTER_ADD(Compositor_TextureUploadBytes, num_bytes);
   return true;
 }
 
@@ -213,7 +274,9 @@ void OpenGlTextureData::SetTexture(GLuint texture) {
 
 OpenGlDrawVisitor::OpenGlQuadDrawingData::OpenGlQuadDrawingData(
     GLInterface* gl_interface)
-    : gl_interface_(gl_interface) {
+    : gl_interface_(gl_interface),
+      vertex_buffer_(0),
+      stream_vertex_buffer_(0) {
   gl_interface_->GenBuffers(1, &vertex_buffer_);
   gl_interface_->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
 
@@ -226,60 +289,17 @@ OpenGlDrawVisitor::OpenGlQuadDrawingData::OpenGlQuadDrawingData(
 
   gl_interface_->BufferData(GL_ARRAY_BUFFER, sizeof(kQuad),
                             kQuad, GL_STATIC_DRAW);
-  color_buffer_.reset(new float[4*4]);
+
+  // The stream buffer's contents are supplied by each batch.
+  gl_interface_->GenBuffers(1, &stream_vertex_buffer_);
   CHECK_GL_ERROR(gl_interface_);
 }
 
 OpenGlDrawVisitor::OpenGlQuadDrawingData::~OpenGlQuadDrawingData() {
   if (vertex_buffer_)
     gl_interface_->DeleteBuffers(1, &vertex_buffer_);
-}
-
-void OpenGlDrawVisitor::OpenGlQuadDrawingData::set_vertex_color(int index,
-                                                                float r,
-                                                                float g,
-                                                                float b,
-                                                                float a) {
-  // Calculate member index
-  index *= 4;
-  // Assign the color.
-  color_buffer_[index++] = r;
-  color_buffer_[index++] = g;
-  color_buffer_[index++] = b;
-  color_buffer_[index] = a;
-}
-
-OpenGlDrawVisitor::OpenGlStateCache::OpenGlStateCache() {
-  Invalidate();
-}
-
-void OpenGlDrawVisitor::OpenGlStateCache::Invalidate() {
-  actor_opacity_ = -1.f;
-  dimmed_transparency_begin_ = -1.f;
-  dimmed_transparency_end_ = -1.f;
-  red_ = -1.f;
-  green_ = -1.f;
-  blue_ = -1.f;
-}
-
-bool OpenGlDrawVisitor::OpenGlStateCache::ColorStateChanged(
-    float actor_opacity,
-    float dimmed_transparency_begin,
-    float dimmed_transparency_end,
-    float red, float green, float blue) {
-  if (actor_opacity != actor_opacity_ ||
-      dimmed_transparency_begin != dimmed_transparency_begin_ ||
-      dimmed_transparency_end != dimmed_transparency_end_ ||
-      red != red_ || green != green_ || blue != blue_) {
-    actor_opacity_ = actor_opacity;
-    dimmed_transparency_begin_ = dimmed_transparency_begin;
-    dimmed_transparency_end_ = dimmed_transparency_end;
-    red_ = red;
-    green_ = green;
-    blue_ = blue;
-    return true;
-  }
-  return false;
+  if (stream_vertex_buffer_)
+    gl_interface_->DeleteBuffers(1, &stream_vertex_buffer_);
 }
 
 OpenGlDrawVisitor::OpenGlDrawVisitor(GLInterface* gl_interface,
@@ -289,13 +309,15 @@ OpenGlDrawVisitor::OpenGlDrawVisitor(GLInterface* gl_interface,
       gl_interface_(gl_interface),
       xconn_(compositor_->x_conn()),
       stage_(NULL),
+      quad_batch_(this),
       framebuffer_config_rgb_(0),
       framebuffer_config_rgba_(0),
       context_(0),
       ancestor_opacity_(1.0f),
       num_frames_drawn_(0),
       using_passthrough_projection_(false),
-      has_fullscreen_actor_(false) {
+      has_fullscreen_actor_(false),
+      draw_pass_(DRAW_PASS_ALL) {
   CHECK(gl_interface_);
   context_ = gl_interface_->CreateGlxContext();
   CHECK(context_) << "Unable to create a context from the available visuals.";
@@ -312,6 +334,10 @@ OpenGlDrawVisitor::OpenGlDrawVisitor(GLInterface* gl_interface,
   CHECK_GL_ERROR(gl_interface_);
 
   quad_drawing_data_.reset(new OpenGlQuadDrawingData(gl_interface_));
+  pixel_buffer_ring_.reset(
+      new PixelBufferRing(
+          gl_interface_,
+          FLAGS_compositor_pixel_buffer_uploads ? kNumPixelBuffers : 0));
 }
 
 void OpenGlDrawVisitor::FindFramebufferConfigurations() {
@@ -388,8 +414,11 @@ void OpenGlDrawVisitor::FindFramebufferConfigurations() {
 
 OpenGlDrawVisitor::~OpenGlDrawVisitor() {
   gl_interface_->Finish();
-  // Make sure the vertex buffer is deleted.
+  // Make sure the vertex buffer and pixel buffers are deleted.
   quad_drawing_data_.reset(NULL);
+  pixel_buffer_ring_.reset(NULL);
+  if (!atlas_textures_.empty())
+    gl_interface_->DeleteTextures(atlas_textures_.size(), &atlas_textures_[0]);
   CHECK_GL_ERROR(gl_interface_);
   gl_interface_->MakeGlxCurrent(0, 0);
   if (context_) {
@@ -432,10 +461,17 @@ void OpenGlDrawVisitor::BindImage(const ImageContainer& container,
   gl_interface_->TexParameterf(GL_TEXTURE_2D,
                                GL_TEXTURE_WRAP_T,
                                GL_CLAMP_TO_EDGE);
+  const size_t num_bytes =
+      container.width() * container.height() * container.bits_per_pixel() / 8;
+  const GLvoid* pixels =
+      pixel_buffer_ring_->StartUpload(container.data(), num_bytes);
   gl_interface_->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
                             container.width(), container.height(),
                             0, pixel_data_format, GL_UNSIGNED_BYTE,
-                            container.data());
+                            pixels);
+  pixel_buffer_ring_->FinishUpload();
+  COUNTER_INCREMENT(Compositor_TextureUploads);
+  COUNTER_ADD(Compositor_TextureUploadBytes, num_bytes);
   CHECK_GL_ERROR(gl_interface_);
   scoped_ptr<OpenGlTextureData> data(new OpenGlTextureData(gl_interface_));
   data->SetTexture(new_texture);
@@ -443,6 +479,65 @@ void OpenGlDrawVisitor::BindImage(const ImageContainer& container,
   actor->set_texture_data(data.release());
 }
 
+bool OpenGlDrawVisitor::BindImageInAtlas(const ImageContainer& container,
+                                         RealCompositor::ImageActor* actor) {
+  TextureAtlas::Region region;
+  if (!texture_atlas_.AddImage(container, &region))
+    return false;
+
+  // The page's pixels are uploaded by UploadDirtyAtlasPages() before the
+  // next frame is drawn, so that images that are loaded together only cause
+  // a single upload.
+  while (static_cast<int>(atlas_textures_.size()) <= region.page) {
+    GLuint texture = 0;
+    gl_interface_->GenTextures(1, &texture);
+    gl_interface_->BindTexture(GL_TEXTURE_2D, texture);
+    gl_interface_->TexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    gl_interface_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                 GL_LINEAR);
+    gl_interface_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                                 GL_LINEAR);
+    gl_interface_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                                 GL_CLAMP_TO_EDGE);
+    gl_interface_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                                 GL_CLAMP_TO_EDGE);
+    atlas_textures_.push_back(texture);
+  }
+  CHECK_GL_ERROR(gl_interface_);
+
+  actor->set_texture_data(
+      new AtlasTextureData(atlas_textures_[region.page],
+                           region,
+                           ImageFormatUsesAlpha(container.format())));
+  return true;
+}
+
+void OpenGlDrawVisitor::UploadDirtyAtlasPages() {
+  DCHECK_EQ(static_cast<int>(atlas_textures_.size()),
+            texture_atlas_.num_pages());
+  for (int i = 0; i < texture_atlas_.num_pages(); ++i) {
+    if (!texture_atlas_.IsPageDirty(i))
+      continue;
+    PROFILER_MARKER_BEGIN(UploadAtlasPage);
+    gl_interface_->BindTexture(GL_TEXTURE_2D, atlas_textures_[i]);
+    const size_t num_bytes =
+        TextureAtlas::kPageSize * TextureAtlas::kPageSize * 4;
+    const GLvoid* pixels = pixel_buffer_ring_->StartUpload(
+        texture_atlas_.GetPageData(i), num_bytes);
+    gl_interface_->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                              TextureAtlas::kPageSize,
+                              TextureAtlas::kPageSize,
+                              0, GL_RGBA, GL_UNSIGNED_BYTE,
+                              pixels);
+    pixel_buffer_ring_->FinishUpload();
+    COUNTER_INCREMENT(Compositor_TextureUploads);
+    COUNTER_ADD(Compositor_TextureUploadBytes, num_bytes);
+    CHECK_GL_ERROR(gl_interface_);
+    texture_atlas_.MarkPageClean(i);
+    PROFILER_MARKER_END(UploadAtlasPage);
+  }
+}
+
 void OpenGlDrawVisitor::DrawNeedle() {
   PROFILER_MARKER_BEGIN(DrawNeedle);
   gl_interface_->BindBuffer(GL_ARRAY_BUFFER,
@@ -458,16 +553,100 @@ void OpenGlDrawVisitor::DrawNeedle() {
   gl_interface_->Scalef(30, 3, 1.f);
   gl_interface_->Color4f(1.f, 0.f, 0.f, 0.8f);
   gl_interface_->DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  COUNTER_INCREMENT(Compositor_DrawCalls);
   gl_interface_->PopMatrix();
   PROFILER_MARKER_END(DrawNeedle);
 }
 
+bool OpenGlDrawVisitor::IsDrawnInOpaquePass(
+    const RealCompositor::QuadActor& actor) const {
+  // Tilted actors use a perspective transform that distorts their depths,
+  // so they're drawn with the translucent actors to be safe.
+  return actor.is_opaque() &&
+         actor.opacity() * ancestor_opacity_ > 0.999f &&
+         actor.tilt() <= 0.001f;
+}
+
+void OpenGlDrawVisitor::DrawStageContents(RealCompositor::StageActor* actor) {
+  // The debugging needle leaves the client state and texture and blending
+  // state different from what the batches expect, so reset them on every
+  // pass.  The vertex pointers are relative to the stream buffer, so they
+  // stay valid when each batch replaces its contents.
+  quad_batch_.InvalidateState();
+  gl_interface_->BindBuffer(GL_ARRAY_BUFFER,
+                            quad_drawing_data_->stream_vertex_buffer());
+  gl_interface_->EnableClientState(GL_VERTEX_ARRAY);
+  gl_interface_->VertexPointer(
+      4, GL_FLOAT, sizeof(QuadBatch::Vertex),
+      reinterpret_cast<const GLvoid*>(offsetof(QuadBatch::Vertex, position)));
+  gl_interface_->EnableClientState(GL_TEXTURE_COORD_ARRAY);
+  gl_interface_->TexCoordPointer(
+      2, GL_FLOAT, sizeof(QuadBatch::Vertex),
+      reinterpret_cast<const GLvoid*>(offsetof(QuadBatch::Vertex, tex_coord)));
+  gl_interface_->EnableClientState(GL_COLOR_ARRAY);
+  gl_interface_->ColorPointer(
+      4, GL_FLOAT, sizeof(QuadBatch::Vertex),
+      reinterpret_cast<const GLvoid*>(offsetof(QuadBatch::Vertex, color)));
+  CHECK_GL_ERROR(gl_interface_);
+
+  // No need to clear color buffer if something will cover up the screen.
+  GLbitfield clear_mask = has_fullscreen_actor_ ? 0 : GL_COLOR_BUFFER_BIT;
+  if (FLAGS_compositor_opaque_depth_pass)
+    clear_mask |= GL_DEPTH_BUFFER_BIT;
+  if (clear_mask)
+    gl_interface_->Clear(clear_mask);
+
+  if (FLAGS_compositor_opaque_depth_pass) {
+    // Draw the opaque actors front to back using the depths assigned by
+    // LayerVisitor, so that the GPU can reject the pixels that they hide
+    // before shading them.
+    PROFILER_MARKER_BEGIN(Opaque_Rendering_Pass);
+    gl_interface_->Enable(GL_DEPTH_TEST);
+    gl_interface_->DepthFunc(GL_LESS);
+    gl_interface_->DepthMask(GL_TRUE);
+    draw_pass_ = DRAW_PASS_OPAQUE;
+    ancestor_opacity_ = actor->opacity();
+    VisitContainer(actor);
+    quad_batch_.Flush();
+    PROFILER_MARKER_END(Opaque_Rendering_Pass);
+
+    // Then blend the translucent ones back to front on top of them.  The
+    // depth test still rejects the ones that are hidden behind opaque
+    // actors, but they shouldn't hide each other.
+    PROFILER_MARKER_BEGIN(Translucent_Rendering_Pass);
+    gl_interface_->DepthMask(GL_FALSE);
+    draw_pass_ = DRAW_PASS_TRANSLUCENT;
+    ancestor_opacity_ = actor->opacity();
+    VisitContainer(actor);
+    quad_batch_.Flush();
+    PROFILER_MARKER_END(Translucent_Rendering_Pass);
+
+    gl_interface_->DepthMask(GL_TRUE);
+    gl_interface_->Disable(GL_DEPTH_TEST);
+    draw_pass_ = DRAW_PASS_ALL;
+  } else {
+    // Visiting back to front with no z-buffer.
+    ancestor_opacity_ = actor->opacity();
+    PROFILER_MARKER_BEGIN(Rendering_Pass);
+    VisitContainer(actor);
+    quad_batch_.Flush();
+    PROFILER_MARKER_END(Rendering_Pass);
+  }
+
+  CHECK_GL_ERROR(gl_interface_);
+
+  if (FLAGS_compositor_display_debug_needle)
+    DrawNeedle();
+}
+
 void OpenGlDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
   if (!actor->IsVisible())
     return;
 
   PROFILER_MARKER_BEGIN(VisitStage);
   stage_ = actor;
+  quad_batch_.ResetStats();
+  UploadDirtyAtlasPages();
 
   if (actor->stage_color_changed()) {
     const Compositor::Color& color = actor->stage_color();
@@ -480,8 +659,6 @@ void OpenGlDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
     actor->unset_was_resized();
   }
 
-  state_cache_.Invalidate();
-
   const bool partial_update_possible =
       gl_interface_->IsCapableOfPartialUpdates() && !damaged_region_.empty();
 
@@ -497,19 +674,10 @@ void OpenGlDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
     // implement eglSwapBuffers().  An improvement to this algorithm
     // could first attempt to detect whether buffer flipping is being
     // used by performing a series of swaps and readbacks.
-    if (damaged_region_.area() < half_stage_area) {
+    if (damaged_region_.area() < half_stage_area)
       do_partial_update = true;
-
-      gl_interface_->Enable(GL_SCISSOR_TEST);
-      gl_interface_->Scissor(damaged_region_.x, damaged_region_.y,
-                             damaged_region_.width, damaged_region_.height);
-    }
   }
 
-  // No need to clear color buffer if something will cover up the screen.
-  if (!has_fullscreen_actor_)
-    gl_interface_->Clear(GL_COLOR_BUFFER_BIT);
-
   using_passthrough_projection_ = actor->using_passthrough_projection();
 
   gl_interface_->MatrixMode(GL_PROJECTION);
@@ -519,40 +687,33 @@ void OpenGlDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
   gl_interface_->LoadMatrixf(&projection[0][0]);
   gl_interface_->MatrixMode(GL_MODELVIEW);
   gl_interface_->LoadIdentity();
-  gl_interface_->BindBuffer(GL_ARRAY_BUFFER,
-                            quad_drawing_data_->vertex_buffer());
-  gl_interface_->EnableClientState(GL_VERTEX_ARRAY);
-  gl_interface_->VertexPointer(2, GL_FLOAT, 0, 0);
-  gl_interface_->EnableClientState(GL_TEXTURE_COORD_ARRAY);
-  gl_interface_->TexCoordPointer(2, GL_FLOAT, 0, 0);
-  gl_interface_->EnableClientState(GL_COLOR_ARRAY);
-  CHECK_GL_ERROR(gl_interface_);
-
-  // Visiting back to front with no z-buffer.
-  ancestor_opacity_ = actor->opacity();
-  PROFILER_MARKER_BEGIN(Rendering_Pass);
-  VisitContainer(actor);
-  PROFILER_MARKER_END(Rendering_Pass);
-
   CHECK_GL_ERROR(gl_interface_);
 
-  if (FLAGS_compositor_display_debug_needle)
-    DrawNeedle();
+  const vector<Rect>& damaged_rects = damaged_region_.rects();
+  if (do_partial_update) {
+    // Draw the scene once per damaged rect, scissored to that rect, so that
+    // only the pixels that actually changed get filled.
+    gl_interface_->Enable(GL_SCISSOR_TEST);
+    for (vector<Rect>::const_iterator it = damaged_rects.begin();
+         it != damaged_rects.end(); ++it) {
+      gl_interface_->Scissor(it->x, it->y, it->width, it->height);
+      DrawStageContents(actor);
+    }
+    gl_interface_->Disable(GL_SCISSOR_TEST);
+  } else {
+    DrawStageContents(actor);
+  }
 
+  compositor_->HandleBufferSwapStarted();
   PROFILER_MARKER_BEGIN(Swap_Buffer);
   if (do_partial_update) {
-    gl_interface_->Disable(GL_SCISSOR_TEST);
-    gl_interface_->CopyGlxSubBuffer(actor->GetStageXWindow(),
-                                    damaged_region_.x,
-                                    damaged_region_.y,
-                                    damaged_region_.width,
-                                    damaged_region_.height);
+    for (vector<Rect>::const_iterator it = damaged_rects.begin();
+         it != damaged_rects.end(); ++it) {
+      gl_interface_->CopyGlxSubBuffer(actor->GetStageXWindow(),
+                                      it->x, it->y, it->width, it->height);
+    }
 #ifdef EXTRA_LOGGING
-    DLOG(INFO) << "Partial updates: "
-               << damaged_region_.x << ", "
-               << damaged_region_.y << ", "
-               << damaged_region_.width << ", "
-               << damaged_region_.height << ".";
+    DLOG(INFO) << "Partial updates: " << damaged_region_ << ".";
 #endif
   } else {
     gl_interface_->SwapGlxBuffers(actor->GetStageXWindow());
@@ -589,27 +750,33 @@ void OpenGlDrawVisitor::VisitContainer(RealCompositor::ContainerActor* actor) {
   float original_opacity = ancestor_opacity_;
   ancestor_opacity_ *= actor->opacity();
 
-  // Walk backwards so we go back to front.
-  RealCompositor::ActorVector::const_reverse_iterator iterator;
-  for (iterator = children.rbegin(); iterator != children.rend();
-       ++iterator) {
-    RealCompositor::Actor* child = *iterator;
-    if (!child->IsVisible())
-      continue;
+  if (draw_pass_ == DRAW_PASS_OPAQUE) {
+    // Walk forwards so we go front to back.
+    for (RealCompositor::ActorVector::const_iterator iterator =
+           children.begin(); iterator != children.end(); ++iterator) {
+      RealCompositor::Actor* child = *iterator;
+      if (!child->IsVisible())
+        continue;
+      child->Accept(this);
+      CHECK_GL_ERROR(gl_interface_);
+    }
+  } else {
+    // Walk backwards so we go back to front.
+    RealCompositor::ActorVector::const_reverse_iterator iterator;
+    for (iterator = children.rbegin(); iterator != children.rend();
+         ++iterator) {
+      RealCompositor::Actor* child = *iterator;
+      if (!child->IsVisible())
+        continue;
 #ifdef EXTRA_LOGGING
-    DLOG(INFO) << "Drawing child " << child->name()
-               << " (visible: " << child->IsVisible()
-               << ", opacity: " << child->opacity()
-               << ", is_opaque: " << child->is_opaque() << ")";
+      DLOG(INFO) << "Drawing child " << child->name()
+                 << " (visible: " << child->IsVisible()
+                 << ", opacity: " << child->opacity()
+                 << ", is_opaque: " << child->is_opaque() << ")";
 #endif
-
-    // TODO: move this down into the Visit* functions
-    if (child->is_opaque() && child->opacity() * ancestor_opacity_ > 0.999)
-      gl_interface_->Disable(GL_BLEND);
-    else
-      gl_interface_->Enable(GL_BLEND);
-    child->Accept(this);
-    CHECK_GL_ERROR(gl_interface_);
+      child->Accept(this);
+      CHECK_GL_ERROR(gl_interface_);
+    }
   }
 
   // Reset ancestor opacity.
@@ -642,8 +809,13 @@ void OpenGlDrawVisitor::VisitTexturePixmap(
       return;
     }
 
+    // Creating the texture binds it, so draw the queued quads first and make
+    // the next batch rebind its texture.
+    quad_batch_.Flush();
     scoped_ptr<OpenGlPixmapData> data(new OpenGlPixmapData(this));
-    if (!data->Init(actor)) {
+    const bool initialized = data->Init(actor);
+    quad_batch_.InvalidateState();
+    if (!initialized) {
       PROFILER_MARKER_END(VisitTexturePixmap);
       return;
     }
@@ -661,6 +833,10 @@ void OpenGlDrawVisitor::VisitQuad(RealCompositor::QuadActor* actor) {
   if (!actor->IsVisible())
     return;
 
+  if (draw_pass_ != DRAW_PASS_ALL &&
+      IsDrawnInOpaquePass(*actor) != (draw_pass_ == DRAW_PASS_OPAQUE))
+    return;
+
 #ifdef EXTRA_LOGGING
   DLOG(INFO) << "Drawing quad " << actor->name() << ".";
 #endif
@@ -691,66 +867,42 @@ void OpenGlDrawVisitor::VisitQuad(RealCompositor::QuadActor* actor) {
   DCHECK_LE(blue, 1.f);
   DCHECK_GE(blue, 0.f);
 
-  if (state_cache_.ColorStateChanged(actor_opacity,
-                                     dimmed_transparency_begin,
-                                     dimmed_transparency_end,
-                                     red, green, blue)) {
-    // Scale the vertex colors on the right by the transparency, since
-    // we want it to fade to black as transparency of the dimming
-    // overlay goes to zero. (note that the dimming is not *really* an
-    // overlay -- it's just multiplied in here to simulate that).
-    float dim_red_begin = red * dimmed_transparency_begin;
-    float dim_green_begin = green * dimmed_transparency_begin;
-    float dim_blue_begin = blue * dimmed_transparency_begin;
-    float dim_red_end = red * dimmed_transparency_end;
-    float dim_green_end = green * dimmed_transparency_end;
-    float dim_blue_end = blue * dimmed_transparency_end;
-
-    quad_drawing_data_->set_vertex_color(
-        0, dim_red_begin, dim_green_begin, dim_blue_begin, actor_opacity);
-    quad_drawing_data_->set_vertex_color(
-        1, dim_red_begin, dim_green_begin, dim_blue_begin, actor_opacity);
-    quad_drawing_data_->set_vertex_color(
-        2, dim_red_end, dim_green_end, dim_blue_end, actor_opacity);
-    quad_drawing_data_->set_vertex_color(
-        3, dim_red_end, dim_green_end, dim_blue_end, actor_opacity);
-
-    gl_interface_->EnableClientState(GL_COLOR_ARRAY);
-    // Have to un-bind the array buffer to set the color pointer so that
-    // it uses the color buffer instead of the vertex buffer memory.
-    gl_interface_->BindBuffer(GL_ARRAY_BUFFER, 0);
-    gl_interface_->ColorPointer(4, GL_FLOAT, 0,
-                                quad_drawing_data_->color_buffer());
-  }
-
-  gl_interface_->BindBuffer(GL_ARRAY_BUFFER,
-                            quad_drawing_data_->vertex_buffer());
-  CHECK_GL_ERROR(gl_interface_);
+  // Scale the vertex colors on the right by the transparency, since
+  // we want it to fade to black as transparency of the dimming
+  // overlay goes to zero. (note that the dimming is not *really* an
+  // overlay -- it's just multiplied in here to simulate that).
+  const float dim_red_begin = red * dimmed_transparency_begin;
+  const float dim_green_begin = green * dimmed_transparency_begin;
+  const float dim_blue_begin = blue * dimmed_transparency_begin;
+  const float dim_red_end = red * dimmed_transparency_end;
+  const float dim_green_end = green * dimmed_transparency_end;
+  const float dim_blue_end = blue * dimmed_transparency_end;
+  const float colors[4 * 4] = {
+    dim_red_begin, dim_green_begin, dim_blue_begin, actor_opacity,
+    dim_red_begin, dim_green_begin, dim_blue_begin, actor_opacity,
+    dim_red_end, dim_green_end, dim_blue_end, actor_opacity,
+    dim_red_end, dim_green_end, dim_blue_end, actor_opacity,
+  };
 
-  // Find out if this quad has pixmap or texture data to bind.
+  QuadBatch::State state;
+  TextureData::TexCoords tex_coords;
   if (actor->texture_data()) {
-    // Actor has a texture to bind.
-    gl_interface_->Enable(GL_TEXTURE_2D);
-    gl_interface_->BindTexture(GL_TEXTURE_2D,
-                               actor->texture_data()->texture());
-    if (quad_is_screen_aligned) {
-      gl_interface_->TexParameteri(GL_TEXTURE_2D,
-                                   GL_TEXTURE_MIN_FILTER,
-                                   GL_NEAREST);
-      gl_interface_->TexParameteri(GL_TEXTURE_2D,
-                                   GL_TEXTURE_MAG_FILTER,
-                                   GL_NEAREST);
-    } else {
-      gl_interface_->TexParameteri(GL_TEXTURE_2D,
-                                   GL_TEXTURE_MIN_FILTER,
-                                   GL_LINEAR);
-      gl_interface_->TexParameteri(GL_TEXTURE_2D,
-                                   GL_TEXTURE_MAG_FILTER,
-                                   GL_LINEAR);
-    }
+    state.texture = actor->texture_data()->texture();
+    // Atlas pages are shared by quads that are and aren't screen-aligned,
+    // so always filter them linearly rather than splitting batches over the
+    // filter.  Unscaled quads sample texel centers either way.
+    state.linear_filter =
+        !quad_is_screen_aligned || actor->texture_data()->in_atlas();
+    tex_coords = actor->texture_data()->tex_coords();
+  }
+  // The fixed-function pipeline modulates the texture by the vertex color
+  // regardless of whether the texture has alpha, so leave
+  // |texture_has_alpha| at its default to avoid splitting batches over it.
+  if (draw_pass_ == DRAW_PASS_ALL) {
+    state.blend =
+        !(actor->is_opaque() && actor->opacity() * ancestor_opacity_ > 0.999f);
   } else {
-    // Actor has no texture.
-    gl_interface_->Disable(GL_TEXTURE_2D);
+    state.blend = (draw_pass_ == DRAW_PASS_TRANSLUCENT);
   }
 
 #ifdef EXTRA_LOGGING
@@ -761,14 +913,55 @@ void OpenGlDrawVisitor::VisitQuad(RealCompositor::QuadActor* actor) {
              << ") and opacity " << actor_opacity;
 #endif
 
-  gl_interface_->PushMatrix();
-  // operator[] in Matrix4 returns by value in const version.
-  Matrix4 model_view = actor->model_view();
-  gl_interface_->LoadMatrixf(&model_view[0][0]);
-  gl_interface_->DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  gl_interface_->PopMatrix();
-  CHECK_GL_ERROR(gl_interface_);
+  quad_batch_.AddQuad(state, actor->model_view(), colors, tex_coords);
   PROFILER_DYNAMIC_MARKER_END();
 }
 
+void OpenGlDrawVisitor::DrawQuadBatch(const QuadBatch::State& state,
+                                      const QuadBatch::State* previous_state,
+                                      const QuadBatch::Vertex* vertices,
+                                      size_t num_vertices) {
+  PROFILER_MARKER_BEGIN(DrawQuadBatch);
+  // Only touch the state that differs from the previous batch.
+  const bool texture_changed =
+      !previous_state || state.texture != previous_state->texture;
+  if (!previous_state ||
+      (state.texture != 0) != (previous_state->texture != 0)) {
+    if (state.texture)
+      gl_interface_->Enable(GL_TEXTURE_2D);
+    else
+      gl_interface_->Disable(GL_TEXTURE_2D);
+  }
+  if (state.texture && texture_changed)
+    gl_interface_->BindTexture(GL_TEXTURE_2D, state.texture);
+  // The filter is part of the texture object's state, so it needs to be set
+  // whenever we switch to a different texture.
+  if (state.texture &&
+      (texture_changed ||
+       state.linear_filter != previous_state->linear_filter)) {
+    const GLint filter = state.linear_filter ? GL_LINEAR : GL_NEAREST;
+    gl_interface_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    gl_interface_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  }
+  if (!previous_state || state.blend != previous_state->blend) {
+    if (state.blend)
+      gl_interface_->Enable(GL_BLEND);
+    else
+      gl_interface_->Disable(GL_BLEND);
+  }
+
+  // Replace the stream buffer's contents with the batch.  The vertices were
+  // already transformed, so the model view matrix is left as the identity.
+  gl_interface_->BindBuffer(GL_ARRAY_BUFFER,
+                            quad_drawing_data_->stream_vertex_buffer());
+  gl_interface_->BufferData(GL_ARRAY_BUFFER,
+                            num_vertices * sizeof(QuadBatch::Vertex),
+                            vertices,
+                            GL_STREAM_DRAW);
+  gl_interface_->DrawArrays(GL_TRIANGLES, 0, num_vertices);
+  COUNTER_INCREMENT(Compositor_DrawCalls);
+  CHECK_GL_ERROR(gl_interface_);
+  PROFILER_MARKER_END(DrawQuadBatch);
+}
+
 }  // namespace window_manager
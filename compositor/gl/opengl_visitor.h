@@ -13,7 +13,10 @@
 #include "base/memory/scoped_ptr.h"
 #include "window_manager/compositor/compositor.h"
 #include "window_manager/compositor/gl/gl_interface.h"
+#include "window_manager/compositor/gl/pixel_buffer_ring.h"
+#include "window_manager/compositor/quad_batch.h"
 #include "window_manager/compositor/real_compositor.h"
+#include "window_manager/compositor/texture_atlas.h"
 #include "window_manager/compositor/texture_data.h"
 #include "window_manager/x11/x_connection.h"
 
@@ -40,6 +43,7 @@ class OpenGlPixmapData : public TextureData {
 
   // Begin TextureData methods.
   virtual void Refresh();
+  virtual void RefreshRegion(const Region& region);
   // End TextureData methods.
 
   // Initialize our texture and make it contain the current contents of the
@@ -48,10 +52,13 @@ class OpenGlPixmapData : public TextureData {
   bool Init(RealCompositor::TexturePixmapActor* actor);
 
  private:
-  // Fetch the contents of |pixmap_| from the X server and copy them to our
-  // texture.  This is the slower implementation used when the
-  // texture-from-pixmap extension is unavailable.  Returns true on success.
-  bool CopyPixmapImageToTexture();
+  // Fetch the contents of |rect| within |pixmap_| from the X server and
+  // copy them to the same position in our texture.  This is the slower
+  // implementation used when the texture-from-pixmap extension is
+  // unavailable.  The texture's storage is allocated to the pixmap's size
+  // by the first call, which must cover the whole pixmap; later calls
+  // update it in place.  Returns true on success.
+  bool CopyPixmapImageToTexture(const Rect& rect);
 
   OpenGlDrawVisitor* visitor_;  // not owned
   GLInterface* gl_;             // not owned
@@ -66,10 +73,16 @@ class OpenGlPixmapData : public TextureData {
   // Dimensions and depth of |pixmap_|.  This is only initialized if
   // |glx_pixmap_| isn't being used.
   XConnection::WindowGeometry pixmap_geometry_;
+
+  // Has storage been allocated for our texture by CopyPixmapImageToTexture()?
+  bool texture_allocated_;
 };
 
-// This class visits an actor tree and draws it using OpenGL.
-class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
+// This class visits an actor tree and draws it using OpenGL.  Quads are
+// transformed on the CPU and collected into batches that share the same
+// texture and blending state, each of which is drawn with a single call.
+class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor,
+                          public QuadBatch::Delegate {
  public:
   OpenGlDrawVisitor(GLInterface* gl_interface,
                     RealCompositor* compositor,
@@ -80,13 +93,22 @@ class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
   void set_has_fullscreen_actor(bool has_fullscreen_actor) {
     has_fullscreen_actor_ = has_fullscreen_actor;
   }
-  void set_damaged_region(const Rect& damaged_region) {
+  void set_damaged_region(const Region& damaged_region) {
     damaged_region_ = damaged_region;
   }
 
+  // Counters describing the most recently drawn frame.
+  const QuadBatch::Stats& frame_stats() const { return quad_batch_.stats(); }
+
   void BindImage(const ImageContainer& container,
                  RealCompositor::ImageActor* actor);
 
+  // Like BindImage(), but packs the image into |texture_atlas_| so that it
+  // shares a texture with other static images.  Returns false without
+  // binding anything if the image can't be packed.
+  bool BindImageInAtlas(const ImageContainer& container,
+                        RealCompositor::ImageActor* actor);
+
   virtual void VisitActor(RealCompositor::Actor* actor) {}
   virtual void VisitStage(RealCompositor::StageActor* actor);
   virtual void VisitContainer(RealCompositor::ContainerActor* actor);
@@ -94,6 +116,13 @@ class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
   virtual void VisitTexturePixmap(RealCompositor::TexturePixmapActor* actor);
   virtual void VisitQuad(RealCompositor::QuadActor* actor);
 
+  // Begin QuadBatch::Delegate methods.
+  virtual void DrawQuadBatch(const QuadBatch::State& state,
+                             const QuadBatch::State* previous_state,
+                             const QuadBatch::Vertex* vertices,
+                             size_t num_vertices);
+  // End QuadBatch::Delegate methods.
+
  private:
   class OpenGlQuadDrawingData {
    public:
@@ -101,36 +130,18 @@ class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
     virtual ~OpenGlQuadDrawingData();
 
     GLuint vertex_buffer() { return vertex_buffer_; }
-    float* color_buffer() { return color_buffer_.get(); }
-
-    // Sets the vertex color of the give vertex index.
-    // Has no effect on drawing until the next call to SetBufferData.
-    void set_vertex_color(int index, float r, float g, float b, float a);
+    GLuint stream_vertex_buffer() { return stream_vertex_buffer_; }
 
    private:
     // This is the gl interface to use for communicating with GL.
     GLInterface* gl_interface_;
 
-    // This is the vertex buffer that holds the rect we use for
-    // rendering quads.
+    // This is the vertex buffer that holds the unit rect used for drawing
+    // the debugging needle.
     GLuint vertex_buffer_;
 
-    scoped_array<float> color_buffer_;
-  };
-
-  class OpenGlStateCache {
-   public:
-    OpenGlStateCache();
-    void Invalidate();
-    bool ColorStateChanged(float actor_opacity,
-                           float dimmed_transparency_begin,
-                           float dimmed_transparency_end,
-                           float red, float green, float blue);
-   private:
-    float actor_opacity_;
-    float dimmed_transparency_begin_;
-    float dimmed_transparency_end_;
-    float red_, green_, blue_;
+    // This is the vertex buffer that batches of quads are streamed into.
+    GLuint stream_vertex_buffer_;
   };
 
   // So it can get access to the config data.
@@ -139,6 +150,32 @@ class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
   // This draws a debugging "needle" in the upper left corner.
   void DrawNeedle();
 
+  // Which actors are drawn while visiting the tree.
+  enum DrawPass {
+    // All actors, back to front.
+    DRAW_PASS_ALL = 0,
+    // Only actors for which IsDrawnInOpaquePass() is true, front to back.
+    DRAW_PASS_OPAQUE,
+    // The remaining actors, back to front.
+    DRAW_PASS_TRANSLUCENT,
+  };
+
+  // Draws all of |actor|'s children.  This is called once per frame for full
+  // updates, or once per damaged rect (with the scissor set to that rect) for
+  // partial updates.  If --compositor_opaque_depth_pass is set, this draws
+  // the opaque actors front to back with depth testing first and then
+  // blends the rest back to front; otherwise, everything is drawn back to
+  // front.
+  void DrawStageContents(RealCompositor::StageActor* actor);
+
+  // Should |actor| be drawn in DRAW_PASS_OPAQUE rather than
+  // DRAW_PASS_TRANSLUCENT?  Only valid while visiting |actor|'s parent.
+  bool IsDrawnInOpaquePass(const RealCompositor::QuadActor& actor) const;
+
+  // Upload the pixels of any |texture_atlas_| pages that have changed since
+  // they were last drawn, creating textures for new pages.
+  void UploadDirtyAtlasPages();
+
   // Finds an appropriate framebuffer configurations for the current
   // display.  Sets framebuffer_config_rgba_ and framebuffer_config_rgb_.
   void FindFramebufferConfigurations();
@@ -151,11 +188,22 @@ class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
   XConnection* xconn_;  // Not owned.
   RealCompositor::StageActor* stage_; // Not owned.
 
-  // This holds the drawing data used for quads.  Note that only
-  // QuadActors use this drawing data, and they all share the same
-  // one (to keep from allocating a lot of quad vertex buffers).
+  // This holds the vertex buffers used for quads.  All QuadActors share the
+  // same ones (to keep from allocating a lot of quad vertex buffers).
   scoped_ptr<OpenGlQuadDrawingData> quad_drawing_data_;
 
+  // Collects quads with matching state so they can be drawn together.
+  QuadBatch quad_batch_;
+
+  // Used to stream pixel data to textures.  Shared by images, atlas pages,
+  // and pixmaps that are copied without texture-from-pixmap.
+  scoped_ptr<PixelBufferRing> pixel_buffer_ring_;
+
+  // Small static images packed together, and the textures holding each of
+  // the atlas's pages.
+  TextureAtlas texture_atlas_;
+  std::vector<GLuint> atlas_textures_;
+
   // The framebuffer configs to use with this display.
   GLXFBConfig framebuffer_config_rgb_;
   GLXFBConfig framebuffer_config_rgba_;
@@ -170,15 +218,9 @@ class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
   // debugging needle.
   int num_frames_drawn_;
 
-  // Use this struct to store OpenGl states from the previous quad. The stored
-  // states can be used to compare against states of the current quad, and we
-  // only need to reset OpenGl states that are changed to avoid unnecessary GL
-  // state changes.
-  OpenGlStateCache state_cache_;
-
-  // The rectangular region of the screen that is damaged in the frame.
+  // The region of the screen that is damaged in the frame.
   // This information allows the draw visitor to perform partial updates.
-  Rect damaged_region_;
+  Region damaged_region_;
 
   // Used to track whether the current projection matrix is a pass-through
   // matrix.  Pass-through means the output of the model view transform will
@@ -191,6 +233,9 @@ class OpenGlDrawVisitor : virtual public RealCompositor::ActorVisitor {
   // actor so we can optimize by not clearing the COLOR_BUFFER_BIT.
   bool has_fullscreen_actor_;
 
+  // The pass that's currently being drawn.
+  DrawPass draw_pass_;
+
   DISALLOW_COPY_AND_ASSIGN(OpenGlDrawVisitor);
 };
 
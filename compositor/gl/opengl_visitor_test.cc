@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <cstdarg>
+#include <cstring>
 
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
@@ -11,12 +12,15 @@
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/stl_util-inl.h"
 #include "window_manager/compositor/compositor.h"
 #include "window_manager/compositor/gl/mock_gl_interface.h"
 #include "window_manager/compositor/gl/opengl_visitor.h"
 #include "window_manager/compositor/real_compositor.h"
 #include "window_manager/event_loop.h"
 #include "window_manager/geometry.h"
+#include "window_manager/image_container.h"
+#include "window_manager/region.h"
 #include "window_manager/test_lib.h"
 #include "window_manager/util.h"
 #include "window_manager/x11/mock_x_connection.h"
@@ -24,6 +28,10 @@
 DEFINE_bool(logtostderr, false,
             "Print debugging messages to stderr (suppressed otherwise)");
 
+DECLARE_bool(compositor_opaque_depth_pass);
+
+using std::vector;
+
 namespace window_manager {
 
 class OpenGlVisitorTest : public BasicCompositingTest {};
@@ -71,6 +79,338 @@ TEST_F(OpenGlVisitorTest, StageColor) {
   EXPECT_FLOAT_EQ(1.f, gl_->clear_alpha());
 }
 
+// Check that with --compositor_opaque_depth_pass, opaque actors are drawn
+// front to back with depth testing before translucent actors are blended
+// back to front.
+TEST_F(OpenGlVisitorTest, OpaqueDepthPass) {
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  stage->SetSize(1024, 768);
+
+  // Add three overlapping boxes, from back to front: an opaque one, a
+  // translucent one, and another opaque one.  They're placed at different x
+  // positions so we can tell their draw calls apart.
+  scoped_ptr<RealCompositor::ColoredBoxActor> back(
+      compositor_->CreateColoredBox(100, 100, Compositor::Color()));
+  back->Move(10, 0, 0);
+  stage->AddActor(back.get());
+  scoped_ptr<RealCompositor::ColoredBoxActor> middle(
+      compositor_->CreateColoredBox(100, 100, Compositor::Color()));
+  middle->Move(20, 0, 0);
+  middle->SetOpacity(0.5f, 0);
+  stage->AddActor(middle.get());
+  scoped_ptr<RealCompositor::ColoredBoxActor> front(
+      compositor_->CreateColoredBox(100, 100, Compositor::Color()));
+  front->Move(30, 0, 0);
+  stage->AddActor(front.get());
+
+  // By default, everything is drawn back to front without depth testing.
+  FLAGS_compositor_opaque_depth_pass = false;
+  gl_->ClearDrawCalls();
+  compositor_->SetDirty();
+  Draw();
+  vector<MockGLInterface::DrawCall> calls = gl_->draw_calls();
+  ASSERT_EQ(3U, calls.size());
+  for (size_t i = 0; i < calls.size(); ++i) {
+    EXPECT_EQ(static_cast<GLenum>(GL_TRIANGLES), calls[i].mode);
+    EXPECT_EQ(static_cast<GLsizei>(QuadBatch::kVerticesPerQuad),
+              calls[i].count);
+  }
+  EXPECT_FLOAT_EQ(10.f, calls[0].x);
+  EXPECT_FALSE(calls[0].blend);
+  EXPECT_FLOAT_EQ(20.f, calls[1].x);
+  EXPECT_TRUE(calls[1].blend);
+  EXPECT_FLOAT_EQ(30.f, calls[2].x);
+  EXPECT_FALSE(calls[2].blend);
+  for (size_t i = 0; i < calls.size(); ++i)
+    EXPECT_FALSE(calls[i].depth_test) << "call " << i;
+  ASSERT_EQ(1U, gl_->clear_masks().size());
+  EXPECT_EQ(static_cast<GLbitfield>(GL_COLOR_BUFFER_BIT),
+            gl_->clear_masks()[0]);
+
+  // LayerVisitor should assign increasing depths from front to back.
+  EXPECT_LT(front->z(), middle->z());
+  EXPECT_LT(middle->z(), back->z());
+
+  // With the flag, the opaque boxes should be drawn first, front to back and
+  // writing to the depth buffer, followed by the translucent one.  The two
+  // opaque boxes share the same state, so they're drawn as a single batch.
+  FLAGS_compositor_opaque_depth_pass = true;
+  gl_->ClearDrawCalls();
+  compositor_->SetDirty();
+  Draw();
+  calls = gl_->draw_calls();
+  ASSERT_EQ(2U, calls.size());
+  EXPECT_EQ(static_cast<GLsizei>(2 * QuadBatch::kVerticesPerQuad),
+            calls[0].count);
+  EXPECT_FLOAT_EQ(30.f, calls[0].x);
+  EXPECT_FLOAT_EQ(front->z(), calls[0].z);
+  EXPECT_TRUE(calls[0].depth_test);
+  EXPECT_TRUE(calls[0].depth_mask);
+  EXPECT_FALSE(calls[0].blend);
+
+  EXPECT_EQ(static_cast<GLsizei>(QuadBatch::kVerticesPerQuad),
+            calls[1].count);
+  EXPECT_FLOAT_EQ(20.f, calls[1].x);
+  EXPECT_FLOAT_EQ(middle->z(), calls[1].z);
+  EXPECT_TRUE(calls[1].depth_test);
+  EXPECT_FALSE(calls[1].depth_mask);
+  EXPECT_TRUE(calls[1].blend);
+
+  ASSERT_EQ(1U, gl_->clear_masks().size());
+  EXPECT_EQ(static_cast<GLbitfield>(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT),
+            gl_->clear_masks()[0]);
+  EXPECT_EQ(static_cast<GLenum>(GL_LESS), gl_->depth_func());
+
+  // The depth state should be restored afterwards.
+  EXPECT_FALSE(gl_->IsEnabled(GL_DEPTH_TEST));
+  EXPECT_TRUE(gl_->depth_mask());
+
+  // Tilted actors should be drawn with the translucent ones, back to front.
+  front->SetTilt(0.5f, 0);
+  gl_->ClearDrawCalls();
+  compositor_->SetDirty();
+  Draw();
+  calls = gl_->draw_calls();
+  ASSERT_EQ(2U, calls.size());
+  EXPECT_FLOAT_EQ(10.f, calls[0].x);
+  EXPECT_TRUE(calls[0].depth_mask);
+  EXPECT_EQ(static_cast<GLsizei>(2 * QuadBatch::kVerticesPerQuad),
+            calls[1].count);
+  EXPECT_FLOAT_EQ(20.f, calls[1].x);
+  EXPECT_FALSE(calls[1].depth_mask);
+  EXPECT_TRUE(calls[1].blend);
+
+  FLAGS_compositor_opaque_depth_pass = false;
+}
+
+// Check that consecutive quads that share the same state are drawn with a
+// single call, and that the per-frame counters are updated.
+TEST_F(OpenGlVisitorTest, BatchQuads) {
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  stage->SetSize(1024, 768);
+
+  // Add a row of opaque boxes that don't overlap.
+  static const int kNumBoxes = 5;
+  vector<RealCompositor::ColoredBoxActor*> boxes;
+  for (int i = 0; i < kNumBoxes; ++i) {
+    RealCompositor::ColoredBoxActor* box =
+        compositor_->CreateColoredBox(50, 50, Compositor::Color(0.f, 0.f, 1.f));
+    box->Move(100 * i, 0, 0);
+    stage->AddActor(box);
+    boxes.push_back(box);
+  }
+
+  gl_->ClearDrawCalls();
+  compositor_->SetDirty();
+  Draw();
+  vector<MockGLInterface::DrawCall> calls = gl_->draw_calls();
+  ASSERT_EQ(1U, calls.size());
+  EXPECT_EQ(static_cast<GLsizei>(kNumBoxes * QuadBatch::kVerticesPerQuad),
+            calls[0].count);
+  // The first box added is at the bottom, so it's drawn first.
+  EXPECT_FLOAT_EQ(0.f, calls[0].x);
+  EXPECT_FALSE(calls[0].blend);
+
+  const QuadBatch::Stats& stats = compositor_->draw_visitor()->frame_stats();
+  EXPECT_EQ(kNumBoxes, stats.num_quads);
+  EXPECT_EQ(1, stats.num_draw_calls);
+  EXPECT_EQ(1, stats.num_state_changes);
+
+  // Making a box in the middle translucent should split the batch in three,
+  // with blending toggled on and back off between them.
+  boxes[2]->SetOpacity(0.5f, 0);
+  gl_->ClearDrawCalls();
+  compositor_->SetDirty();
+  Draw();
+  calls = gl_->draw_calls();
+  ASSERT_EQ(3U, calls.size());
+  EXPECT_EQ(static_cast<GLsizei>(2 * QuadBatch::kVerticesPerQuad),
+            calls[0].count);
+  EXPECT_FALSE(calls[0].blend);
+  EXPECT_EQ(static_cast<GLsizei>(QuadBatch::kVerticesPerQuad),
+            calls[1].count);
+  EXPECT_FLOAT_EQ(200.f, calls[1].x);
+  EXPECT_TRUE(calls[1].blend);
+  EXPECT_EQ(static_cast<GLsizei>(2 * QuadBatch::kVerticesPerQuad),
+            calls[2].count);
+  EXPECT_FALSE(calls[2].blend);
+
+  EXPECT_EQ(kNumBoxes, stats.num_quads);
+  EXPECT_EQ(3, stats.num_draw_calls);
+  EXPECT_EQ(3, stats.num_state_changes);
+
+  STLDeleteElements(&boxes);
+}
+
+// Check that small images share a texture in the atlas, get uploaded once,
+// and are drawn in a single batch.
+TEST_F(OpenGlVisitorTest, TextureAtlas) {
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  stage->SetSize(1024, 768);
+
+  static const int kNumImages = 2;
+  static const int kImageSize = 16;
+  vector<RealCompositor::ImageActor*> images;
+  for (int i = 0; i < kNumImages; ++i) {
+    uint8_t* data = new uint8_t[kImageSize * kImageSize * 4];
+    memset(data, 0xff, kImageSize * kImageSize * 4);
+    InMemoryImageContainer container(
+        data, kImageSize, kImageSize, IMAGE_FORMAT_RGBA_32, false);
+    RealCompositor::ImageActor* image = compositor_->CreateImage();
+    image->SetImageDataInternal(container, true);
+    image->Move(100 * i, 0, 0);
+    stage->AddActor(image);
+    images.push_back(image);
+  }
+
+  ASSERT_TRUE(images[0]->texture_data());
+  ASSERT_TRUE(images[1]->texture_data());
+  EXPECT_TRUE(images[0]->texture_data()->in_atlas());
+  EXPECT_TRUE(images[1]->texture_data()->in_atlas());
+  EXPECT_EQ(images[0]->texture_data()->texture(),
+            images[1]->texture_data()->texture());
+  EXPECT_NE(images[0]->texture_data()->tex_coords().left,
+            images[1]->texture_data()->tex_coords().left);
+  EXPECT_EQ(kImageSize, images[0]->width());
+
+  // The page should be uploaded once, before the images are drawn together.
+  const int initial_uploads = gl_->num_tex_image_uploads();
+  gl_->ClearDrawCalls();
+  compositor_->SetDirty();
+  Draw();
+  EXPECT_EQ(initial_uploads + 1, gl_->num_tex_image_uploads());
+  vector<MockGLInterface::DrawCall> calls = gl_->draw_calls();
+  ASSERT_EQ(1U, calls.size());
+  EXPECT_EQ(static_cast<GLsizei>(kNumImages * QuadBatch::kVerticesPerQuad),
+            calls[0].count);
+
+  // Nothing should be uploaded when the page hasn't changed.
+  compositor_->SetDirty();
+  Draw();
+  EXPECT_EQ(initial_uploads + 1, gl_->num_tex_image_uploads());
+
+  STLDeleteElements(&images);
+}
+
+// Check that creating a pixmap's texture in the middle of a frame doesn't
+// leave it bound for quads that were batched before it.
+TEST_F(OpenGlVisitorTest, CreatePixmapTextureWhileBatching) {
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  stage->SetSize(1024, 768);
+
+  // Add two images that share an atlas texture.  Only the second one has
+  // alpha, so it's drawn in a second batch that doesn't need to rebind the
+  // texture.
+  static const int kImageSize = 16;
+  vector<RealCompositor::ImageActor*> images;
+  for (int i = 0; i < 2; ++i) {
+    uint8_t* data = new uint8_t[kImageSize * kImageSize * 4];
+    memset(data, 0xff, kImageSize * kImageSize * 4);
+    InMemoryImageContainer container(
+        data, kImageSize, kImageSize,
+        i == 0 ? IMAGE_FORMAT_RGBX_32 : IMAGE_FORMAT_RGBA_32, false);
+    RealCompositor::ImageActor* image = compositor_->CreateImage();
+    image->SetImageDataInternal(container, true);
+    image->Move(400 * i, 0, 0);
+    stage->AddActor(image);
+    images.push_back(image);
+  }
+  ASSERT_TRUE(images[0]->texture_data());
+  const GLuint atlas_texture = images[0]->texture_data()->texture();
+  ASSERT_EQ(atlas_texture, images[1]->texture_data()->texture());
+
+  // Add a new window on top of them.  Its texture is created while the
+  // second image's quad is still waiting to be drawn.
+  XWindow xid = xconn_->CreateWindow(
+      xconn_->GetRootWindow(),  // parent
+      Rect(0, 0, 200, 100),
+      false,      // override_redirect=false
+      false,      // input_only=false
+      0, 0);      // event_mask, visual
+  scoped_ptr<RealCompositor::TexturePixmapActor> actor(
+      dynamic_cast<RealCompositor::TexturePixmapActor*>(
+          compositor_->CreateTexturePixmap()));
+  CHECK(actor.get());
+  actor->SetPixmap(xconn_->GetCompositingPixmapForWindow(xid));
+  actor->Move(100, 0, 0);
+  actor->Show();
+  stage->AddActor(actor.get());
+
+  gl_->ClearDrawCalls();
+  compositor_->SetDirty();
+  Draw();
+  ASSERT_TRUE(actor->texture_data());
+  const GLuint pixmap_texture = actor->texture_data()->texture();
+  EXPECT_NE(atlas_texture, pixmap_texture);
+
+  vector<MockGLInterface::DrawCall> calls = gl_->draw_calls();
+  ASSERT_EQ(3U, calls.size());
+  EXPECT_FLOAT_EQ(0.f, calls[0].x);
+  EXPECT_EQ(atlas_texture, calls[0].texture);
+  EXPECT_FLOAT_EQ(400.f, calls[1].x);
+  EXPECT_EQ(atlas_texture, calls[1].texture);
+  EXPECT_FLOAT_EQ(100.f, calls[2].x);
+  EXPECT_EQ(pixmap_texture, calls[2].texture);
+
+  STLDeleteElements(&images);
+}
+
+// Check that when texture-from-pixmap is unavailable, only the damaged
+// parts of pixmaps are copied to their textures after the initial upload.
+TEST_F(OpenGlVisitorTest, PartialPixmapTextureUploads) {
+  gl_->set_has_texture_from_pixmap_extension(false);
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  stage->SetSize(1024, 768);
+
+  XWindow xid = xconn_->CreateWindow(
+      xconn_->GetRootWindow(),  // parent
+      Rect(0, 0, 200, 100),
+      false,      // override_redirect=false
+      false,      // input_only=false
+      0, 0);      // event_mask, visual
+  scoped_ptr<RealCompositor::TexturePixmapActor> actor(
+      dynamic_cast<RealCompositor::TexturePixmapActor*>(
+          compositor_->CreateTexturePixmap()));
+  CHECK(actor.get());
+  actor->SetPixmap(xconn_->GetCompositingPixmapForWindow(xid));
+  actor->Show();
+  stage->AddActor(actor.get());
+
+  // The whole pixmap should be uploaded when the texture is created.
+  const int initial_uploads = gl_->num_tex_image_uploads();
+  Draw();
+  ASSERT_TRUE(actor->texture_data());
+  EXPECT_EQ(initial_uploads + 1, gl_->num_tex_image_uploads());
+  EXPECT_TRUE(gl_->tex_sub_image_regions().empty());
+
+  // After that, damaged areas should be updated in place (clipped to the
+  // pixmap's bounds).
+  actor->MergeDamagedRegion(Rect(10, 20, 30, 40));
+  actor->MergeDamagedRegion(Rect(190, 90, 20, 20));
+  actor->UpdateTexture();
+  EXPECT_EQ(initial_uploads + 1, gl_->num_tex_image_uploads());
+  ASSERT_EQ(2U, gl_->tex_sub_image_regions().size());
+  Region uploaded_region;
+  uploaded_region.merge(gl_->tex_sub_image_regions()[0]);
+  uploaded_region.merge(gl_->tex_sub_image_regions()[1]);
+  Region expected_region;
+  expected_region.merge(Rect(10, 20, 30, 40));
+  expected_region.merge(Rect(190, 90, 10, 10));
+  EXPECT_EQ(expected_region, uploaded_region);
+
+  // Damage covering most of the pixmap should be fetched with one request.
+  actor->MergeDamagedRegion(Rect(0, 0, 180, 100));
+  actor->UpdateTexture();
+  ASSERT_EQ(3U, gl_->tex_sub_image_regions().size());
+  EXPECT_EQ(Rect(0, 0, 200, 100), gl_->tex_sub_image_regions()[2]);
+
+  // Updates without any recorded damage should refresh the whole texture.
+  actor->UpdateTexture();
+  ASSERT_EQ(4U, gl_->tex_sub_image_regions().size());
+  EXPECT_EQ(Rect(0, 0, 200, 100), gl_->tex_sub_image_regions()[3]);
+  EXPECT_EQ(initial_uploads + 1, gl_->num_tex_image_uploads());
+}
+
 }  // end namespace window_manager
 
 int main(int argc, char** argv) {
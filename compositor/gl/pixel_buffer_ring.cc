@@ -0,0 +1,81 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/compositor/gl/pixel_buffer_ring.h"
+
+#include <cstring>
+
+#include <GL/glext.h>
+
+#include "base/logging.h"
+#include "window_manager/compositor/gl/gl_interface.h"
+
+namespace window_manager {
+
+PixelBufferRing::PixelBufferRing(GLInterface* gl_interface,
+                                 size_t num_buffers)
+    : gl_interface_(gl_interface),
+      num_buffers_(num_buffers),
+      next_buffer_index_(0),
+      buffer_bound_(false),
+      num_buffered_uploads_(0),
+      num_direct_uploads_(0) {
+  DCHECK(gl_interface_);
+}
+
+PixelBufferRing::~PixelBufferRing() {
+  DCHECK(!buffer_bound_);
+  if (!buffers_.empty())
+    gl_interface_->DeleteBuffers(buffers_.size(), &buffers_[0]);
+}
+
+const GLvoid* PixelBufferRing::StartUpload(const GLvoid* data, size_t size) {
+  DCHECK(!buffer_bound_) << "FinishUpload() wasn't called";
+  if (!num_buffers_ || !data || !size ||
+      !gl_interface_->HasPixelBufferObjectExtension()) {
+    num_direct_uploads_++;
+    return data;
+  }
+
+  if (buffers_.empty()) {
+    buffers_.resize(num_buffers_, 0);
+    gl_interface_->GenBuffers(buffers_.size(), &buffers_[0]);
+  }
+
+  const GLuint buffer = buffers_[next_buffer_index_];
+  next_buffer_index_ = (next_buffer_index_ + 1) % buffers_.size();
+  gl_interface_->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+  // Orphan the buffer's previous storage so that mapping it doesn't need to
+  // wait for an earlier upload that's still reading from it.
+  gl_interface_->BufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL,
+                            GL_STREAM_DRAW);
+  void* mapped_data =
+      gl_interface_->MapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+  if (mapped_data) {
+    memcpy(mapped_data, data, size);
+    // The buffer's contents can be lost (e.g. on a mode switch) while it's
+    // mapped, in which case unmapping it fails.
+    if (gl_interface_->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+      buffer_bound_ = true;
+      num_buffered_uploads_++;
+      return NULL;  // zero offset into the bound buffer
+    }
+  }
+
+  LOG(WARNING) << "Unable to copy " << size << " bytes to pixel buffer "
+               << buffer << "; uploading from client memory instead";
+  gl_interface_->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  num_direct_uploads_++;
+  return data;
+}
+
+void PixelBufferRing::FinishUpload() {
+  if (!buffer_bound_)
+    return;
+  gl_interface_->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  buffer_bound_ = false;
+}
+
+}  // namespace window_manager
@@ -0,0 +1,79 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_COMPOSITOR_GL_PIXEL_BUFFER_RING_H_
+#define WINDOW_MANAGER_COMPOSITOR_GL_PIXEL_BUFFER_RING_H_
+
+#include <GL/gl.h>
+
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace window_manager {
+
+class GLInterface;
+
+// PixelBufferRing streams texture uploads through a small ring of pixel
+// buffer objects.  Pixel data is copied into the next buffer in the ring
+// and the texture is then uploaded from the buffer, which lets the driver
+// return immediately and transfer the data to the texture asynchronously
+// while we continue drawing.  Cycling through several buffers (and
+// orphaning each buffer's old storage before reusing it) means that we
+// never need to wait for a previous upload from the same buffer to finish.
+//
+// If pixel buffer objects aren't supported or a buffer can't be mapped,
+// uploads are done directly from client memory instead.
+//
+// Usage:
+//
+//   const GLvoid* pixels = ring.StartUpload(data, size);
+//   gl->TexImage2D(..., pixels);
+//   ring.FinishUpload();
+class PixelBufferRing {
+ public:
+  // |num_buffers| is the number of buffers to cycle through; zero disables
+  // the use of pixel buffer objects.  Buffers are created on first use, so
+  // a GL context must be current when StartUpload() is called.
+  PixelBufferRing(GLInterface* gl_interface, size_t num_buffers);
+  ~PixelBufferRing();
+
+  size_t num_buffers() const { return num_buffers_; }
+  int num_buffered_uploads() const { return num_buffered_uploads_; }
+  int num_direct_uploads() const { return num_direct_uploads_; }
+
+  // Copy |size| bytes from |data| into the next buffer in the ring and bind
+  // it to GL_PIXEL_UNPACK_BUFFER.  Returns the pointer that should be
+  // passed to TexImage2D() or TexSubImage2D(): an offset into the bound
+  // buffer, or |data| itself if the upload must be done from client memory.
+  const GLvoid* StartUpload(const GLvoid* data, size_t size);
+
+  // Unbind the buffer bound by StartUpload(), if any.  Must be called after
+  // the upload has been issued and before any other pixel transfers.
+  void FinishUpload();
+
+ private:
+  GLInterface* gl_interface_;  // not owned
+
+  size_t num_buffers_;
+
+  // Buffer IDs, created by the first call to StartUpload().
+  std::vector<GLuint> buffers_;
+
+  // Index in |buffers_| of the buffer to use for the next upload.
+  size_t next_buffer_index_;
+
+  // Is one of |buffers_| currently bound to GL_PIXEL_UNPACK_BUFFER?
+  bool buffer_bound_;
+
+  // Number of uploads done through a buffer and directly from client memory.
+  int num_buffered_uploads_;
+  int num_direct_uploads_;
+
+  DISALLOW_COPY_AND_ASSIGN(PixelBufferRing);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_COMPOSITOR_GL_PIXEL_BUFFER_RING_H_
@@ -0,0 +1,91 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstring>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "window_manager/compositor/gl/mock_gl_interface.h"
+#include "window_manager/compositor/gl/pixel_buffer_ring.h"
+#include "window_manager/test_lib.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using std::vector;
+
+namespace window_manager {
+
+class PixelBufferRingTest : public ::testing::Test {
+ protected:
+  // Upload |data| through |ring| and return the buffer that was bound
+  // during the upload (or 0 if none was).
+  GLuint Upload(PixelBufferRing* ring, const vector<char>& data) {
+    const GLvoid* pixels = ring->StartUpload(&data[0], data.size());
+    const GLuint buffer = gl_.pixel_unpack_buffer();
+    gl_.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, data.size() / 4,
+                   0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    if (buffer)
+      EXPECT_TRUE(pixels == NULL);
+    else
+      EXPECT_TRUE(pixels == &data[0]);
+    ring->FinishUpload();
+    EXPECT_EQ(0U, gl_.pixel_unpack_buffer());
+    return buffer;
+  }
+
+  MockGLInterface gl_;
+};
+
+// Check that uploads cycle through the buffers and copy the data into them.
+TEST_F(PixelBufferRingTest, Basic) {
+  gl_.set_has_pixel_buffer_object_extension(true);
+  PixelBufferRing ring(&gl_, 2);
+
+  vector<char> data(16, 'a');
+  const GLuint first_buffer = Upload(&ring, data);
+  EXPECT_NE(0U, first_buffer);
+  ASSERT_TRUE(gl_.GetBufferData(first_buffer));
+  EXPECT_EQ(data, *gl_.GetBufferData(first_buffer));
+
+  data.assign(32, 'b');
+  const GLuint second_buffer = Upload(&ring, data);
+  EXPECT_NE(0U, second_buffer);
+  EXPECT_NE(first_buffer, second_buffer);
+  EXPECT_EQ(data, *gl_.GetBufferData(second_buffer));
+
+  // The first buffer should be reused for the third upload.
+  data.assign(8, 'c');
+  EXPECT_EQ(first_buffer, Upload(&ring, data));
+  EXPECT_EQ(data, *gl_.GetBufferData(first_buffer));
+
+  EXPECT_EQ(3, ring.num_buffered_uploads());
+  EXPECT_EQ(0, ring.num_direct_uploads());
+  EXPECT_EQ(3, gl_.num_pixel_buffer_uploads());
+}
+
+// Check that we upload directly from client memory when pixel buffer
+// objects are unavailable or disabled.
+TEST_F(PixelBufferRingTest, Fallback) {
+  vector<char> data(16, 'a');
+
+  PixelBufferRing unsupported_ring(&gl_, 2);
+  EXPECT_EQ(0U, Upload(&unsupported_ring, data));
+  EXPECT_EQ(1, unsupported_ring.num_direct_uploads());
+
+  gl_.set_has_pixel_buffer_object_extension(true);
+  PixelBufferRing disabled_ring(&gl_, 0);
+  EXPECT_EQ(0U, Upload(&disabled_ring, data));
+  EXPECT_EQ(1, disabled_ring.num_direct_uploads());
+
+  EXPECT_EQ(0, gl_.num_pixel_buffer_uploads());
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
@@ -5,11 +5,17 @@
 #include "window_manager/compositor/gl/real_gl_interface.h"
 
 #include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
 
 #include "base/logging.h"
 #include "window_manager/x11/real_x_connection.h"
 
+DECLARE_bool(compositor_opaque_depth_pass);
+
 using std::string;
+using std::vector;
 
 namespace window_manager {
 
@@ -30,6 +36,9 @@ static bool supports_anisotropy = false;
 // http://www.opengl.org/registry/specs/EXT/texture_filter_anisotropic.txt
 static float max_anisotropy = 1.0f;
 
+// True if GL supports pixel buffer objects.
+static bool supports_pixel_buffer_objects = false;
+
 RealGLInterface::RealGLInterface(RealXConnection* connection)
     : xconn_(connection),
       has_texture_from_pixmap_extension_(false) {
@@ -92,15 +101,23 @@ RealGLInterface::RealGLInterface(RealXConnection* connection)
       LOG(INFO) << "glXCopySubBufferMESA is un-available: "
                 << "not supported on this device.";
   }
-  GLint attributes[] = {
-    GLX_RGBA,
-    GLX_DOUBLEBUFFER,
-    GLX_RED_SIZE, 8,
-    GLX_GREEN_SIZE, 8,
-    GLX_BLUE_SIZE, 8,
-    None
-  };
-  visual_info_ = glXChooseVisual(display, DefaultScreen(display), attributes);
+  vector<GLint> attributes;
+  attributes.push_back(GLX_RGBA);
+  attributes.push_back(GLX_DOUBLEBUFFER);
+  attributes.push_back(GLX_RED_SIZE);
+  attributes.push_back(8);
+  attributes.push_back(GLX_GREEN_SIZE);
+  attributes.push_back(8);
+  attributes.push_back(GLX_BLUE_SIZE);
+  attributes.push_back(8);
+  // The opaque pass needs a depth buffer.
+  if (FLAGS_compositor_opaque_depth_pass) {
+    attributes.push_back(GLX_DEPTH_SIZE);
+    attributes.push_back(16);
+  }
+  attributes.push_back(None);
+  visual_info_ = glXChooseVisual(display, DefaultScreen(display),
+                                 &attributes[0]);
   CHECK(visual_info_) << "Did not find a suitable GL visual";
   LOG(INFO) << "Chose visual " << visual_info_->visualid;
 }
@@ -109,6 +126,10 @@ RealGLInterface::~RealGLInterface() {
   XFree(visual_info_);
 }
 
+bool RealGLInterface::HasPixelBufferObjectExtension() {
+  return supports_pixel_buffer_objects;
+}
+
 void RealGLInterface::GlxFree(void* item) {
   XFree(item);
 }
@@ -195,6 +216,8 @@ Bool RealGLInterface::MakeGlxCurrent(GLXDrawable drawable,
           string::npos;
       if (supports_anisotropy)
         glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+      supports_pixel_buffer_objects =
+          kGlExtensions.find("GL_ARB_pixel_buffer_object") != string::npos;
     }
   }
   return current;
@@ -327,6 +350,10 @@ void RealGLInterface::DeleteTextures(GLsizei n, const GLuint* textures) {
   glDeleteTextures(n, textures);
 }
 
+void RealGLInterface::DepthFunc(GLenum func) {
+  glDepthFunc(func);
+}
+
 void RealGLInterface::DepthMask(GLboolean flag) {
   glDepthMask(flag);
 }
@@ -359,6 +386,14 @@ void RealGLInterface::GenBuffers(GLsizei n, GLuint* buffers) {
   glGenBuffers(n, buffers);
 }
 
+GLvoid* RealGLInterface::MapBuffer(GLenum target, GLenum access) {
+  return glMapBuffer(target, access);
+}
+
+GLboolean RealGLInterface::UnmapBuffer(GLenum target) {
+  return glUnmapBuffer(target);
+}
+
 void RealGLInterface::GenTextures(GLsizei n, GLuint* textures) {
   glGenTextures(n, textures);
 }
@@ -440,6 +475,19 @@ void RealGLInterface::TexImage2D(GLenum target,
                border, format, type, pixels);
 }
 
+void RealGLInterface::TexSubImage2D(GLenum target,
+                                    GLint level,
+                                    GLint xoffset,
+                                    GLint yoffset,
+                                    GLsizei width,
+                                    GLsizei height,
+                                    GLenum format,
+                                    GLenum type,
+                                    const GLvoid* pixels) {
+  glTexSubImage2D(target, level, xoffset, yoffset, width, height,
+                  format, type, pixels);
+}
+
 void RealGLInterface::EnableAnisotropicFiltering() {
   if (supports_anisotropy)
     TexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropy);
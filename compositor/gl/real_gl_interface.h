@@ -22,6 +22,7 @@ class RealGLInterface : public GLInterface {
   virtual bool HasTextureFromPixmapExtension() {
     return has_texture_from_pixmap_extension_;
   }
+  virtual bool HasPixelBufferObjectExtension();
   virtual void GlxFree(void* item);
   virtual XVisualID GetVisual();
 
@@ -64,6 +65,7 @@ class RealGLInterface : public GLInterface {
   virtual void Color4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
   virtual void DeleteBuffers(GLsizei n, const GLuint* buffers);
   virtual void DeleteTextures(GLsizei n, const GLuint* textures);
+  virtual void DepthFunc(GLenum func);
   virtual void DepthMask(GLboolean flag);
   virtual void Disable(GLenum cap);
   virtual void DisableClientState(GLenum array);
@@ -72,6 +74,8 @@ class RealGLInterface : public GLInterface {
   virtual void EnableClientState(GLenum cap);
   virtual void Finish();
   virtual void GenBuffers(GLsizei n, GLuint* buffers);
+  virtual GLvoid* MapBuffer(GLenum target, GLenum access);
+  virtual GLboolean UnmapBuffer(GLenum target);
   virtual void GenTextures(GLsizei n, GLuint* textures);
   virtual GLenum GetError();
   virtual void LoadIdentity();
@@ -99,6 +103,15 @@ class RealGLInterface : public GLInterface {
                           GLenum format,
                           GLenum type,
                           const GLvoid* pixels);
+  virtual void TexSubImage2D(GLenum target,
+                             GLint level,
+                             GLint xoffset,
+                             GLint yoffset,
+                             GLsizei width,
+                             GLsizei height,
+                             GLenum format,
+                             GLenum type,
+                             const GLvoid* pixels);
   virtual void EnableAnisotropicFiltering();
   virtual void Translatef(GLfloat x, GLfloat y, GLfloat z);
   virtual void VertexPointer(GLint size, GLenum type, GLsizei stride,
@@ -4,6 +4,9 @@
 
 #include "window_manager/compositor/gles/opengles_visitor.h"
 
+#include <cstddef>
+#include <vector>
+
 #include <X11/Xlib.h>
 #include <xcb/damage.h>
 
@@ -15,12 +18,17 @@
 #include "base/logging.h"
 #include "window_manager/compositor/gles/gles2_interface.h"
 #include "window_manager/compositor/gles/shaders.h"
+#include "window_manager/counters.h"
 #include "window_manager/image_container.h"
 
 #ifndef COMPOSITOR_OPENGLES
 #error Need COMPOSITOR_OPENGLES defined to compile this file
 #endif
 
+DECLARE_COUNTER(Compositor_DrawCalls);
+DECLARE_COUNTER(Compositor_TextureUploads);
+DECLARE_COUNTER(Compositor_TextureUploadBytes);
+
 namespace window_manager {
 
 OpenGlesDrawVisitor::OpenGlesDrawVisitor(Gles2Interface* gl,
@@ -31,6 +39,8 @@ OpenGlesDrawVisitor::OpenGlesDrawVisitor(Gles2Interface* gl,
       stage_(stage),
       x_connection_(compositor_->x_conn()),
       egl_surface_is_capable_of_partial_updates_(false),
+      stream_vertex_buffer_object_(0),
+      quad_batch_(this),
       has_fullscreen_actor_(false),
       using_passthrough_projection_(false) {
   CHECK(gl_);
@@ -105,23 +115,19 @@ OpenGlesDrawVisitor::OpenGlesDrawVisitor(Gles2Interface* gl,
   gl_->GenBuffers(1, &vertex_buffer_object_);
   CHECK(vertex_buffer_object_ > 0) << "VBO allocation failed.";
   gl_->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
-  static float kTriAndQuad[] = {
-    // Triangle-strip quad.
-    0.f, 0.f,
-    0.f, 1.f,
-    1.f, 0.f,
-    1.f, 1.f,
-
-    // Large Triangle
+  static float kLargeTriangle[] = {
     0.f, 0.f,
     0.f, 2.f,
     2.f, 0.f,
   };
   gl_->BufferData(GL_ARRAY_BUFFER,
-                  sizeof(kTriAndQuad), kTriAndQuad,
+                  sizeof(kLargeTriangle), kLargeTriangle,
                   GL_STATIC_DRAW);
-  quad_vertices_index_ = 0;
-  tri_vertices_index_ = 4;
+  tri_vertices_index_ = 0;
+
+  // The stream buffer's contents are supplied by each batch.
+  gl_->GenBuffers(1, &stream_vertex_buffer_object_);
+  CHECK(stream_vertex_buffer_object_ > 0) << "VBO allocation failed.";
 
   // Unchanging state
   gl_->BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -129,6 +135,9 @@ OpenGlesDrawVisitor::OpenGlesDrawVisitor(Gles2Interface* gl,
 
 OpenGlesDrawVisitor::~OpenGlesDrawVisitor() {
   gl_->DeleteBuffers(1, &vertex_buffer_object_);
+  gl_->DeleteBuffers(1, &stream_vertex_buffer_object_);
+  if (!atlas_textures_.empty())
+    gl_->DeleteTextures(atlas_textures_.size(), &atlas_textures_[0]);
 
   LOG_IF(ERROR, gl_->EglMakeCurrent(egl_display_,
                                     EGL_NO_SURFACE,
@@ -179,6 +188,10 @@ void OpenGlesDrawVisitor::BindImage(const ImageContainer& container,
   gl_->TexImage2D(GL_TEXTURE_2D, 0, gl_format,
                   container.width(), container.height(),
                   0, gl_format, gl_type, container.data());
+  COUNTER_INCREMENT(Compositor_TextureUploads);
+  COUNTER_ADD(Compositor_TextureUploadBytes,
+              container.width() * container.height() *
+                  container.bits_per_pixel() / 8);
 
   scoped_ptr<OpenGlesTextureData> data(new OpenGlesTextureData(gl_));
   data->SetTexture(texture);
@@ -186,6 +199,52 @@ void OpenGlesDrawVisitor::BindImage(const ImageContainer& container,
   actor->set_texture_data(data.release());
 }
 
+bool OpenGlesDrawVisitor::BindImageInAtlas(const ImageContainer& container,
+                                           RealCompositor::QuadActor* actor) {
+  TextureAtlas::Region region;
+  if (!texture_atlas_.AddImage(container, &region))
+    return false;
+
+  // The page's pixels are uploaded by UploadDirtyAtlasPages() before the
+  // next frame is drawn, so that images that are loaded together only cause
+  // a single upload.
+  while (static_cast<int>(atlas_textures_.size()) <= region.page) {
+    GLuint texture = 0;
+    gl_->GenTextures(1, &texture);
+    CHECK(texture > 0) << "Failed to allocated texture.";
+    gl_->BindTexture(GL_TEXTURE_2D, texture);
+    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    atlas_textures_.push_back(texture);
+  }
+
+  actor->set_texture_data(
+      new AtlasTextureData(atlas_textures_[region.page],
+                           region,
+                           ImageFormatUsesAlpha(container.format())));
+  return true;
+}
+
+void OpenGlesDrawVisitor::UploadDirtyAtlasPages() {
+  DCHECK_EQ(static_cast<int>(atlas_textures_.size()),
+            texture_atlas_.num_pages());
+  for (int i = 0; i < texture_atlas_.num_pages(); ++i) {
+    if (!texture_atlas_.IsPageDirty(i))
+      continue;
+    gl_->BindTexture(GL_TEXTURE_2D, atlas_textures_[i]);
+    gl_->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                    TextureAtlas::kPageSize, TextureAtlas::kPageSize,
+                    0, GL_RGBA, GL_UNSIGNED_BYTE,
+                    texture_atlas_.GetPageData(i));
+    COUNTER_INCREMENT(Compositor_TextureUploads);
+    COUNTER_ADD(Compositor_TextureUploadBytes,
+                TextureAtlas::kPageSize * TextureAtlas::kPageSize * 4);
+    texture_atlas_.MarkPageClean(i);
+  }
+}
+
 void OpenGlesDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
   if (!actor->IsVisible())
     return;
@@ -216,49 +275,63 @@ void OpenGlesDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
     // implement eglSwapBuffers().  An improvement to this algorithm
     // could first attempt to detect whether buffer flipping is being
     // used by performing a series of swaps and readbacks.
-    if (damaged_region_.area() < half_stage_area) {
+    if (damaged_region_.area() < half_stage_area)
       do_partial_update = true;
-
-      PushScissorRect(damaged_region_);
-    }
   }
 
   if (do_partial_update) {
     DLOG(INFO) << "Performing partial screen update: "
-               << damaged_region_.x << ", "
-               << damaged_region_.y << ", "
-               << damaged_region_.width << ", "
-               << damaged_region_.height << ".";
+               << damaged_region_ << ".";
   } else {
     DLOG(INFO) << "Performing fullscreen update.";
   }
 
-  // No need to clear color buffer if something will cover up the screen.
-  if (!has_fullscreen_actor_)
-    gl_->Clear(GL_COLOR_BUFFER_BIT);
-
   projection_ = actor->projection();
   using_passthrough_projection_ = actor->using_passthrough_projection();
   stage_height_ = actor->height();
 
-  // Back to front rendering of all the actors.
-  ancestor_opacity_ = actor->opacity();
-  VisitContainer(actor);
+  // This also forgets the previous frame's state, so the new projection gets
+  // loaded into the shaders.
+  quad_batch_.ResetStats();
+  UploadDirtyAtlasPages();
 
+  const std::vector<Rect>& damaged_rects = damaged_region_.rects();
   if (do_partial_update) {
-    DCHECK(partial_update_possible);
-
-    PopScissorRect();
-    gl_->EglPostSubBufferNV(egl_display_, egl_surface_,
-                            damaged_region_.x,
-                            damaged_region_.y,
-                            damaged_region_.width,
-                            damaged_region_.height);
+    // Draw the scene once per damaged rect, scissored to that rect, so that
+    // only the pixels that actually changed get filled.
+    for (std::vector<Rect>::const_iterator it = damaged_rects.begin();
+         it != damaged_rects.end(); ++it) {
+      PushScissorRect(*it);
+      DrawStageContents(actor);
+      PopScissorRect();
+    }
+    DCHECK(scissor_stack_.empty());
+
+    compositor_->HandleBufferSwapStarted();
+    for (std::vector<Rect>::const_iterator it = damaged_rects.begin();
+         it != damaged_rects.end(); ++it) {
+      gl_->EglPostSubBufferNV(egl_display_, egl_surface_,
+                              it->x, it->y, it->width, it->height);
+    }
   } else {
+    DrawStageContents(actor);
+    compositor_->HandleBufferSwapStarted();
     gl_->EglSwapBuffers(egl_display_, egl_surface_);
   }
 }
 
+void OpenGlesDrawVisitor::DrawStageContents(
+    RealCompositor::StageActor* actor) {
+  // No need to clear color buffer if something will cover up the screen.
+  if (!has_fullscreen_actor_)
+    gl_->Clear(GL_COLOR_BUFFER_BIT);
+
+  // Back to front rendering of all the actors.
+  ancestor_opacity_ = actor->opacity();
+  VisitContainer(actor);
+  quad_batch_.Flush();
+}
+
 void OpenGlesDrawVisitor::VisitContainer(
     RealCompositor::ContainerActor* actor) {
   if (!actor->IsVisible())
@@ -273,11 +346,6 @@ void OpenGlesDrawVisitor::VisitContainer(
   const RealCompositor::ActorVector children = actor->GetChildren();
   for (RealCompositor::ActorVector::const_reverse_iterator i =
        children.rbegin(); i != children.rend(); ++i) {
-    // TODO move this down into the Visit* functions
-    if ((*i)->is_opaque() && (*i)->opacity() * ancestor_opacity_ > 0.999)
-      gl_->Disable(GL_BLEND);
-    else
-      gl_->Enable(GL_BLEND);
     (*i)->Accept(this);
   }
 
@@ -297,7 +365,10 @@ void OpenGlesDrawVisitor::VisitTexturePixmap(
   if (!actor->texture_data())
     CreateTextureData(actor);
 
-  VisitQuad(actor);
+  if (ShouldDrawWithSingleTriangle(*actor))
+    DrawPixmapWithSingleTriangle(actor, ancestor_opacity_);
+  else
+    VisitQuad(actor);
 }
 
 void OpenGlesDrawVisitor::VisitQuad(RealCompositor::QuadActor* actor) {
@@ -309,151 +380,199 @@ void OpenGlesDrawVisitor::DrawQuad(RealCompositor::QuadActor* actor,
   if (!actor->IsVisible())
     return;
 
-  // This must live until after the draw call, so it's at the top level
-  GLfloat colors[4 * 4];
-  const bool using_actor_opacity = actor->dimmed_opacity_begin() != 0.f ||
-                                   actor->dimmed_opacity_end() != 0.f;
+  const float actor_opacity = actor->opacity() * ancestor_opacity;
+  const float dimmed_transparency_begin = 1.f - actor->dimmed_opacity_begin();
+  const float dimmed_transparency_end = 1.f - actor->dimmed_opacity_end();
+  const Compositor::Color& color = actor->color();
+  const GLfloat colors[4 * 4] = {
+    dimmed_transparency_begin * color.red,
+    dimmed_transparency_begin * color.green,
+    dimmed_transparency_begin * color.blue,
+    actor_opacity,
+
+    dimmed_transparency_begin * color.red,
+    dimmed_transparency_begin * color.green,
+    dimmed_transparency_begin * color.blue,
+    actor_opacity,
+
+    dimmed_transparency_end * color.red,
+    dimmed_transparency_end * color.green,
+    dimmed_transparency_end * color.blue,
+    actor_opacity,
+
+    dimmed_transparency_end * color.red,
+    dimmed_transparency_end * color.green,
+    dimmed_transparency_end * color.blue,
+    actor_opacity,
+  };
+
+  TextureData* texture_data = actor->texture_data();
+  QuadBatch::State state;
+  state.texture = texture_data ? texture_data->texture() : 0;
+  state.texture_has_alpha = texture_data ? texture_data->has_alpha() : true;
+  // Atlas pages are shared by quads that are and aren't screen-aligned, so
+  // always filter them linearly rather than splitting batches over the
+  // filter.  Unscaled quads sample texel centers either way.
+  state.linear_filter =
+      !(!actor->IsTransformed() && using_passthrough_projection_) ||
+      (texture_data && texture_data->in_atlas());
+  const TextureData::TexCoords tex_coords =
+      texture_data ? texture_data->tex_coords() : TextureData::TexCoords();
+  state.blend = !(actor->is_opaque() && actor_opacity > 0.999f);
+
+  quad_batch_.AddQuad(state, actor->model_view(), colors, tex_coords);
+}
 
-  const Matrix4 model_view = actor->model_view();
-  const bool quad_is_screen_aligned =
-    !actor->IsTransformed() &&
-    using_passthrough_projection_;
+bool OpenGlesDrawVisitor::ShouldDrawWithSingleTriangle(
+    const RealCompositor::QuadActor& actor) const {
+  // This path isn't compatible with dimmed actors because a single
+  // triangle's vertices can't be set up to interpolate the colors like a
+  // quad does.
+  return !actor.IsTransformed() &&
+         using_passthrough_projection_ &&
+         actor.dimmed_opacity_begin() == 0.f &&
+         actor.dimmed_opacity_end() == 0.f;
+}
 
-  const bool use_passthrough_rendering = quad_is_screen_aligned &&
-    !using_actor_opacity;
+void OpenGlesDrawVisitor::DrawPixmapWithSingleTriangle(
+    RealCompositor::TexturePixmapActor* actor,
+    float ancestor_opacity) {
+  DCHECK(ShouldDrawWithSingleTriangle(*actor));
+  quad_batch_.Flush();
+
+  const float actor_opacity = actor->opacity() * ancestor_opacity;
+  if (actor->is_opaque() && actor_opacity > 0.999f)
+    gl_->Disable(GL_BLEND);
+  else
+    gl_->Enable(GL_BLEND);
 
   // mvp matrix
-  Matrix4 mvp = projection_ * model_view;
+  const Matrix4 mvp = projection_ * actor->model_view();
 
   // texture
   TextureData* texture_data = actor->texture_data();
   gl_->BindTexture(GL_TEXTURE_2D,
                    texture_data ? texture_data->texture() : 0);
-  if (quad_is_screen_aligned) {
-    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  } else {
-    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  }
+  gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   const bool texture_has_alpha = texture_data ?
                                    texture_data->has_alpha() :
                                    true;
 
   // shader
-  if (!using_actor_opacity) {
-    if (texture_has_alpha) {
-      gl_->UseProgram(tex_color_shader_->program());
-      gl_->UniformMatrix4fv(tex_color_shader_->MvpLocation(), 1, GL_FALSE,
-                            &mvp[0][0]);
-      gl_->Uniform1i(tex_color_shader_->SamplerLocation(), 0);
-      gl_->Uniform4f(tex_color_shader_->ColorLocation(), actor->color().red,
-                     actor->color().green, actor->color().blue,
-                     actor->opacity() * ancestor_opacity);
-
-      gl_->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
-      gl_->VertexAttribPointer(tex_color_shader_->PosLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      gl_->VertexAttribPointer(tex_color_shader_->TexInLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      tex_color_shader_->EnableVertexAttribs();
-    } else {
-      gl_->UseProgram(no_alpha_color_shader_->program());
-      gl_->UniformMatrix4fv(no_alpha_color_shader_->MvpLocation(), 1, GL_FALSE,
-                            &mvp[0][0]);
-      gl_->Uniform1i(no_alpha_color_shader_->SamplerLocation(), 0);
-      gl_->Uniform4f(no_alpha_color_shader_->ColorLocation(),
-                     actor->color().red, actor->color().green,
-                     actor->color().blue,
-                     actor->opacity() * ancestor_opacity);
-
-      gl_->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
-      gl_->VertexAttribPointer(no_alpha_color_shader_->PosLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      gl_->VertexAttribPointer(no_alpha_color_shader_->TexInLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      no_alpha_color_shader_->EnableVertexAttribs();
-    }
+  gl_->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+  if (texture_has_alpha) {
+    gl_->UseProgram(tex_color_shader_->program());
+    gl_->UniformMatrix4fv(tex_color_shader_->MvpLocation(), 1, GL_FALSE,
+                          &mvp[0][0]);
+    gl_->Uniform1i(tex_color_shader_->SamplerLocation(), 0);
+    gl_->Uniform4f(tex_color_shader_->ColorLocation(), actor->color().red,
+                   actor->color().green, actor->color().blue, actor_opacity);
+    gl_->VertexAttribPointer(tex_color_shader_->PosLocation(),
+                             2, GL_FLOAT, GL_FALSE, 0, 0);
+    gl_->VertexAttribPointer(tex_color_shader_->TexInLocation(),
+                             2, GL_FLOAT, GL_FALSE, 0, 0);
+    tex_color_shader_->EnableVertexAttribs();
   } else {
-    const float actor_opacity = actor->opacity() * ancestor_opacity;
-    const float dimmed_transparency_begin = 1.f - actor->dimmed_opacity_begin();
-    const float dimmed_transparency_end = 1.f - actor->dimmed_opacity_end();
-
-    // TODO: Consider managing a ring buffer in a VBO ourselves.  Could be
-    // better performance depending on driver quality.
-    colors[ 0] = dimmed_transparency_begin * actor->color().red;
-    colors[ 1] = dimmed_transparency_begin * actor->color().green;
-    colors[ 2] = dimmed_transparency_begin * actor->color().blue;
-    colors[ 3] = actor_opacity;
-
-    colors[ 4] = dimmed_transparency_begin * actor->color().red;
-    colors[ 5] = dimmed_transparency_begin * actor->color().green;
-    colors[ 6] = dimmed_transparency_begin * actor->color().blue;
-    colors[ 7] = actor_opacity;
-
-    colors[ 8] = dimmed_transparency_end * actor->color().red;
-    colors[ 9] = dimmed_transparency_end * actor->color().green;
-    colors[10] = dimmed_transparency_end * actor->color().blue;
-    colors[11] = actor_opacity;
-
-    colors[12] = dimmed_transparency_end * actor->color().red;
-    colors[13] = dimmed_transparency_end * actor->color().green;
-    colors[14] = dimmed_transparency_end * actor->color().blue;
-    colors[15] = actor_opacity;
-
-    if (texture_has_alpha) {
+    gl_->UseProgram(no_alpha_color_shader_->program());
+    gl_->UniformMatrix4fv(no_alpha_color_shader_->MvpLocation(), 1, GL_FALSE,
+                          &mvp[0][0]);
+    gl_->Uniform1i(no_alpha_color_shader_->SamplerLocation(), 0);
+    gl_->Uniform4f(no_alpha_color_shader_->ColorLocation(),
+                   actor->color().red, actor->color().green,
+                   actor->color().blue, actor_opacity);
+    gl_->VertexAttribPointer(no_alpha_color_shader_->PosLocation(),
+                             2, GL_FLOAT, GL_FALSE, 0, 0);
+    gl_->VertexAttribPointer(no_alpha_color_shader_->TexInLocation(),
+                             2, GL_FLOAT, GL_FALSE, 0, 0);
+    no_alpha_color_shader_->EnableVertexAttribs();
+  }
+
+  PushScissorRect(Rect(actor->x(),
+                       stage_height_ - (actor->y() + actor->height()),
+                       actor->width(), actor->height()));
+  gl_->DrawArrays(GL_TRIANGLES, tri_vertices_index_, 3);
+  COUNTER_INCREMENT(Compositor_DrawCalls);
+  PopScissorRect();
+
+  // We changed the program, texture and blending behind the batch's back.
+  quad_batch_.InvalidateState();
+}
+
+// Points |shader|'s attributes at the interleaved vertices in the currently
+// bound array buffer.
+template<class ShadeShader>
+static void SetUpShadeShaderAttribs(Gles2Interface* gl, ShadeShader* shader) {
+  const GLsizei stride = sizeof(QuadBatch::Vertex);
+  gl->VertexAttribPointer(
+      shader->PosLocation(), 4, GL_FLOAT, GL_FALSE, stride,
+      reinterpret_cast<const void*>(offsetof(QuadBatch::Vertex, position)));
+  gl->VertexAttribPointer(
+      shader->TexInLocation(), 2, GL_FLOAT, GL_FALSE, stride,
+      reinterpret_cast<const void*>(offsetof(QuadBatch::Vertex, tex_coord)));
+  gl->VertexAttribPointer(
+      shader->ColorInLocation(), 4, GL_FLOAT, GL_FALSE, stride,
+      reinterpret_cast<const void*>(offsetof(QuadBatch::Vertex, color)));
+  shader->EnableVertexAttribs();
+}
+
+void OpenGlesDrawVisitor::DrawQuadBatch(
+    const QuadBatch::State& state,
+    const QuadBatch::State* previous_state,
+    const QuadBatch::Vertex* vertices,
+    size_t num_vertices) {
+  // Only touch the state that differs from the previous batch.  The
+  // vertices were already transformed by their model view matrices, so the
+  // shaders just need the projection.
+  const bool program_changed =
+      !previous_state ||
+      state.texture_has_alpha != previous_state->texture_has_alpha;
+  if (program_changed) {
+    if (state.texture_has_alpha) {
       gl_->UseProgram(tex_shade_shader_->program());
       gl_->UniformMatrix4fv(tex_shade_shader_->MvpLocation(), 1, GL_FALSE,
-                            &mvp[0][0]);
+                            &projection_[0][0]);
       gl_->Uniform1i(tex_shade_shader_->SamplerLocation(), 0);
-      gl_->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
-      gl_->VertexAttribPointer(tex_shade_shader_->PosLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      gl_->VertexAttribPointer(tex_shade_shader_->TexInLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      gl_->BindBuffer(GL_ARRAY_BUFFER, 0);
-      gl_->VertexAttribPointer(tex_shade_shader_->ColorInLocation(),
-                               4, GL_FLOAT, GL_FALSE, 0, colors);
-      tex_shade_shader_->EnableVertexAttribs();
     } else {
       gl_->UseProgram(no_alpha_shade_shader_->program());
-      gl_->UniformMatrix4fv(no_alpha_shade_shader_->MvpLocation(), 1, GL_FALSE,
-                            &mvp[0][0]);
+      gl_->UniformMatrix4fv(no_alpha_shade_shader_->MvpLocation(), 1,
+                            GL_FALSE, &projection_[0][0]);
       gl_->Uniform1i(no_alpha_shade_shader_->SamplerLocation(), 0);
-      gl_->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
-      gl_->VertexAttribPointer(no_alpha_shade_shader_->PosLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      gl_->VertexAttribPointer(no_alpha_shade_shader_->TexInLocation(),
-                               2, GL_FLOAT, GL_FALSE, 0, 0);
-      gl_->BindBuffer(GL_ARRAY_BUFFER, 0);
-      gl_->VertexAttribPointer(no_alpha_shade_shader_->ColorInLocation(),
-                               4, GL_FLOAT, GL_FALSE, 0, colors);
-      no_alpha_shade_shader_->EnableVertexAttribs();
     }
   }
 
-  // Draw
-  if (use_passthrough_rendering) {
-    // Draw using a single, scissored triangle to decrease the chance of the
-    // actor's texture being updated by another asynchronous engine on the GPU
-    // in between the individual triangles making up the quad.  This eliminates
-    // ugly diagonal tearing. This path isn't compatible with alpha-blended
-    // actors because a single triangle's vertices can't be set up to
-    // interpolate the alpha values like a quad does.
-    DCHECK(!using_actor_opacity);
-
-    PushScissorRect(Rect(actor->x(),
-                         stage_height_ - (actor->y() + actor->height()),
-                         actor->width(), actor->height()));
-    gl_->DrawArrays(GL_TRIANGLES, tri_vertices_index_, 3);
-    PopScissorRect();
-  } else {
-    // The quad vertices must start at index zero to line up with the non-VBO
-    // colors array indices.  If they're moved, the colors array needs to be
-    // resized and shifted accordingly.
-    DCHECK(quad_vertices_index_ == 0);
-    gl_->DrawArrays(GL_TRIANGLE_STRIP, quad_vertices_index_, 4);
+  const bool texture_changed =
+      !previous_state || state.texture != previous_state->texture;
+  if (texture_changed)
+    gl_->BindTexture(GL_TEXTURE_2D, state.texture);
+  // The filter is part of the texture object's state, so it needs to be set
+  // whenever we switch to a different texture.
+  if (texture_changed ||
+      state.linear_filter != previous_state->linear_filter) {
+    const GLint filter = state.linear_filter ? GL_LINEAR : GL_NEAREST;
+    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    gl_->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  }
+
+  if (!previous_state || state.blend != previous_state->blend) {
+    if (state.blend)
+      gl_->Enable(GL_BLEND);
+    else
+      gl_->Disable(GL_BLEND);
   }
+
+  // Replace the stream buffer's contents with the batch.
+  gl_->BindBuffer(GL_ARRAY_BUFFER, stream_vertex_buffer_object_);
+  gl_->BufferData(GL_ARRAY_BUFFER,
+                  num_vertices * sizeof(QuadBatch::Vertex),
+                  vertices,
+                  GL_STREAM_DRAW);
+  if (state.texture_has_alpha)
+    SetUpShadeShaderAttribs(gl_, tex_shade_shader_.get());
+  else
+    SetUpShadeShaderAttribs(gl_, no_alpha_shade_shader_.get());
+  gl_->DrawArrays(GL_TRIANGLES, 0, num_vertices);
+  COUNTER_INCREMENT(Compositor_DrawCalls);
 }
 
 void OpenGlesDrawVisitor::CreateTextureData(
@@ -13,7 +13,9 @@
 #include "base/memory/scoped_ptr.h"
 
 #include "window_manager/compositor/compositor.h"
+#include "window_manager/compositor/quad_batch.h"
 #include "window_manager/compositor/real_compositor.h"
+#include "window_manager/compositor/texture_atlas.h"
 #include "window_manager/compositor/texture_data.h"
 #include "window_manager/math_types.h"
 
@@ -26,8 +28,11 @@ class NoAlphaColorShader;
 class NoAlphaShadeShader;
 class Gles2Interface;
 
-// This class vists an actor tree and draws it using OpenGLES
-class OpenGlesDrawVisitor : virtual public RealCompositor::ActorVisitor {
+// This class vists an actor tree and draws it using OpenGLES.  Quads that
+// share the same texture, shader and blending state are collected into
+// batches that are each drawn with a single call.
+class OpenGlesDrawVisitor : virtual public RealCompositor::ActorVisitor,
+                            public QuadBatch::Delegate {
  public:
   OpenGlesDrawVisitor(Gles2Interface* gl,
                       RealCompositor* compositor,
@@ -36,13 +41,22 @@ class OpenGlesDrawVisitor : virtual public RealCompositor::ActorVisitor {
   void set_has_fullscreen_actor(bool has_fullscreen_actor) {
     has_fullscreen_actor_ = has_fullscreen_actor;
   }
-  void set_damaged_region(const Rect& damaged_region) {
+  void set_damaged_region(const Region& damaged_region) {
     damaged_region_ = damaged_region;
   }
 
+  // Counters describing the most recently drawn frame.
+  const QuadBatch::Stats& frame_stats() const { return quad_batch_.stats(); }
+
   void BindImage(const ImageContainer& container,
                  RealCompositor::QuadActor* actor);
 
+  // Like BindImage(), but packs the image into |texture_atlas_| so that it
+  // shares a texture with other static images.  Returns false without
+  // binding anything if the image can't be packed.
+  bool BindImageInAtlas(const ImageContainer& container,
+                        RealCompositor::QuadActor* actor);
+
   virtual void VisitActor(RealCompositor::Actor* actor) {}
   virtual void VisitStage(RealCompositor::StageActor* actor);
   virtual void VisitContainer(RealCompositor::ContainerActor* actor);
@@ -50,10 +64,18 @@ class OpenGlesDrawVisitor : virtual public RealCompositor::ActorVisitor {
   virtual void VisitTexturePixmap(RealCompositor::TexturePixmapActor* actor);
   virtual void VisitQuad(RealCompositor::QuadActor* actor);
 
+  // Adds |actor| to the current batch.
   void DrawQuad(RealCompositor::QuadActor* actor,
                 float ancestor_opacity);
   void CreateTextureData(RealCompositor::TexturePixmapActor *actor) const;
 
+  // Begin QuadBatch::Delegate methods.
+  virtual void DrawQuadBatch(const QuadBatch::State& state,
+                             const QuadBatch::State* previous_state,
+                             const QuadBatch::Vertex* vertices,
+                             size_t num_vertices);
+  // End QuadBatch::Delegate methods.
+
  protected:
   // Manage the scissor rect stack. Pushing a rect on the stack intersects the
   // new rect with the current rect (if any) and enables the GL scissor test
@@ -63,6 +85,29 @@ class OpenGlesDrawVisitor : virtual public RealCompositor::ActorVisitor {
   void PopScissorRect();
 
  private:
+  // Draws all of |actor|'s children back to front.  This is called once per
+  // frame for full updates, or once per damaged rect (with that rect pushed
+  // on the scissor stack) for partial updates.
+  void DrawStageContents(RealCompositor::StageActor* actor);
+
+  // Upload the pixels of any |texture_atlas_| pages that have changed since
+  // they were last drawn, creating textures for new pages.
+  void UploadDirtyAtlasPages();
+
+  // Draws a screen-aligned, undimmed pixmap actor immediately using a single
+  // scissored triangle, flushing the current batch first.  Drawing the whole
+  // actor with one triangle decreases the chance of its texture being
+  // updated by another asynchronous engine on the GPU in between the
+  // individual triangles making up the quad, which would cause diagonal
+  // tearing.
+  void DrawPixmapWithSingleTriangle(RealCompositor::TexturePixmapActor* actor,
+                                    float ancestor_opacity);
+
+  // Returns true if |actor| should be drawn with a single triangle by
+  // DrawPixmapWithSingleTriangle().
+  bool ShouldDrawWithSingleTriangle(
+      const RealCompositor::QuadActor& actor) const;
+
   Gles2Interface* gl_;  // Not owned.
   RealCompositor* compositor_;  // Not owned.
   Compositor::StageActor* stage_;  // Not owned.
@@ -87,17 +132,27 @@ class OpenGlesDrawVisitor : virtual public RealCompositor::ActorVisitor {
   // global vertex buffer object
   GLuint vertex_buffer_object_;
 
+  // Vertex buffer object that batches of quads are streamed into.
+  GLuint stream_vertex_buffer_object_;
+
+  // Collects quads with matching state so they can be drawn together.
+  QuadBatch quad_batch_;
+
+  // Small static images packed together, and the textures holding each of
+  // the atlas's pages.
+  TextureAtlas texture_atlas_;
+  std::vector<GLuint> atlas_textures_;
+
   // location of primitive indices in vertex buffer object
   GLint tri_vertices_index_;
-  GLint quad_vertices_index_;
 
   // This is used to indicate whether the entire screen will be covered by an
   // actor so we can optimize by not clearing the COLOR_BUFFER_BIT.
   bool has_fullscreen_actor_;
 
-  // The rectangular region of the screen that is damaged in the frame.
+  // The region of the screen that is damaged in the frame.
   // This information allows the draw visitor to perform partial updates.
-  Rect damaged_region_;
+  Region damaged_region_;
 
   // Used to track whether the current projection matrix is a pass-through
   // matrix.  Pass-through means the output of the model view transform will
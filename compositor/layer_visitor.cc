@@ -8,14 +8,29 @@
 #include <cmath>
 
 #include "window_manager/compositor/real_compositor.h"
+#include "window_manager/counters.h"
 #include "window_manager/geometry.h"
 #include "window_manager/util.h"
 
+// Number of quads that were skipped because they were offscreen or hidden
+// behind opaque actors.
+DEFINE_COUNTER(Compositor_CulledActors);
+
 namespace window_manager {
 
 using std::ceil;
+using std::fabs;
+using std::floor;
 using std::max;
 using std::min;
+using std::vector;
+
+// static
+const size_t LayerVisitor::kMaxOccludingRects = 16;
+
+// Tolerance used when checking for axis-aligned quads and converting their
+// bounds to pixels, to absorb floating-point error in the transforms.
+static const float kPixelTolerance = 0.01f;
 
 enum CullingResult {
   CULLING_WINDOW_OFFSCREEN,
@@ -47,10 +62,14 @@ static inline bool IsBoxFullScreen(const LayerVisitor::BoundingBox& a) {
 // The input region is in window coordinates where top_left is (0, 0) and
 // bottom_right is (1, 1).  Output is the bounding box of the transformed window
 // in GL coordinates where bottom_left is (-1, -1) and top_right is (1, 1).
+// If |is_axis_aligned_out| is non-NULL, it's set to whether the transformed
+// region is itself an axis-aligned rectangle (i.e. it exactly fills its
+// bounding box).
 static LayerVisitor::BoundingBox ComputeTransformedBoundingBox(
     const RealCompositor::StageActor& stage,
     const RealCompositor::QuadActor& actor,
-    const LayerVisitor::BoundingBox& region) {
+    const LayerVisitor::BoundingBox& region,
+    bool* is_axis_aligned_out) {
   const Matrix4& transform = stage.projection() * actor.model_view();
 
   Vector4 v0(region.x_min, region.y_min, 0, 1);
@@ -68,20 +87,40 @@ static LayerVisitor::BoundingBox ComputeTransformedBoundingBox(
   v2 /= v2[3];
   v3 /= v3[3];
 
+  if (is_axis_aligned_out) {
+    // Convert the tolerance from pixels to GL coordinates.
+    const float x_tolerance = 2.f * kPixelTolerance / stage.width();
+    const float y_tolerance = 2.f * kPixelTolerance / stage.height();
+    *is_axis_aligned_out = fabs(v0[0] - v1[0]) < x_tolerance &&
+                           fabs(v2[0] - v3[0]) < x_tolerance &&
+                           fabs(v0[1] - v3[1]) < y_tolerance &&
+                           fabs(v1[1] - v2[1]) < y_tolerance;
+  }
+
   return LayerVisitor::BoundingBox(min4(v0[0], v1[0], v2[0], v3[0]),
                                    max4(v0[0], v1[0], v2[0], v3[0]),
                                    min4(v0[1], v1[1], v2[1], v3[1]),
                                    max4(v0[1], v1[1], v2[1], v3[1]));
 }
 
-static CullingResult PerformActorCullingTest(
-    const RealCompositor::StageActor& stage,
-    const RealCompositor::QuadActor& actor) {
+// Recompute the actor's cached bounding box in GL coordinates.  This must be
+// called after its model view matrix changes.
+static void UpdateActorGlBounds(const RealCompositor::StageActor& stage,
+                                RealCompositor::QuadActor* actor) {
   static const LayerVisitor::BoundingBox region(0, 1, 0, 1);
 
-  LayerVisitor::BoundingBox box =
-    ComputeTransformedBoundingBox(stage, actor, region);
+  RealCompositor::QuadActor::GlBounds bounds;
+  const LayerVisitor::BoundingBox box = ComputeTransformedBoundingBox(
+      stage, *actor, region, &bounds.is_axis_aligned);
+  bounds.x_min = box.x_min;
+  bounds.x_max = box.x_max;
+  bounds.y_min = box.y_min;
+  bounds.y_max = box.y_max;
+  actor->set_gl_bounds(bounds);
+}
 
+static CullingResult PerformActorCullingTest(
+    const LayerVisitor::BoundingBox& box) {
   if (!IsBoxOnScreen(box))
     return CULLING_WINDOW_OFFSCREEN;
 
@@ -107,7 +146,40 @@ static LayerVisitor::BoundingBox MapRegionToGlCoordinates(
   y_max /= actor.height();
 
   LayerVisitor::BoundingBox box(x_min, x_max, y_min, y_max);
-  return ComputeTransformedBoundingBox(stage, actor, box);
+  return ComputeTransformedBoundingBox(stage, actor, box, NULL);
+}
+
+// Convert a box in GL coordinates to a rectangle in stage pixels where
+// (0, 0) is bottom_left.  If |inner| is true, the rectangle is shrunk to the
+// pixels that the box covers completely; otherwise, it's grown to include
+// every pixel that the box touches.
+static Rect ConvertBoxToStagePixels(const LayerVisitor::BoundingBox& box,
+                                    int stage_width,
+                                    int stage_height,
+                                    bool inner) {
+  const float x_min = (box.x_min + 1.f) / 2.f * stage_width;
+  const float x_max = (box.x_max + 1.f) / 2.f * stage_width;
+  const float y_min = (box.y_min + 1.f) / 2.f * stage_height;
+  const float y_max = (box.y_max + 1.f) / 2.f * stage_height;
+
+  // Give the box the benefit of the doubt in both cases, so that
+  // floating-point error doesn't make an actor slightly miss the pixels that
+  // it was supposed to cover exactly.
+  Rect rect;
+  if (inner) {
+    rect.x = static_cast<int>(ceil(x_min - kPixelTolerance));
+    rect.y = static_cast<int>(ceil(y_min - kPixelTolerance));
+    rect.width = static_cast<int>(floor(x_max + kPixelTolerance)) - rect.x;
+    rect.height = static_cast<int>(floor(y_max + kPixelTolerance)) - rect.y;
+  } else {
+    rect.x = static_cast<int>(floor(x_min + kPixelTolerance));
+    rect.y = static_cast<int>(floor(y_min + kPixelTolerance));
+    rect.width = static_cast<int>(ceil(x_max - kPixelTolerance)) - rect.x;
+    rect.height = static_cast<int>(ceil(y_max - kPixelTolerance)) - rect.y;
+  }
+  if (rect.width <= 0 || rect.height <= 0)
+    return Rect();
+  return rect;
 }
 
 
@@ -124,9 +196,21 @@ void LayerVisitor::VisitStage(
   top_fullscreen_actor_ = NULL;
   visiting_top_visible_actor_ = true;
   has_fullscreen_actor_ = false;
+  ancestor_opacity_ = 1.0f;
+  ancestor_model_view_changed_ = false;
+  num_model_view_updates_ = 0;
+  opaque_region_.clear();
+
+  // Give each actor its own slice of the projected depth range.  |count_|
+  // includes containers, so this leaves some room unused at the back.
+  layer_thickness_ =
+      (RealCompositor::StageActor::kProjectedDepthMax -
+       RealCompositor::StageActor::kProjectedDepthMin) / max(count_, 1);
+  depth_ = RealCompositor::StageActor::kProjectedDepthMin +
+           layer_thickness_ / 2.f;
 
   if (use_partial_updates_)
-    updated_area_.clear();
+    updated_areas_.clear();
 
   actor->UpdateProjection();
   VisitContainer(actor);
@@ -135,13 +219,26 @@ void LayerVisitor::VisitStage(
 void LayerVisitor::VisitContainer(
     RealCompositor::ContainerActor* actor) {
   CHECK(actor);
-  if (!actor->IsVisible())
+  if (!actor->IsVisible()) {
+    // We won't visit the container's children, so make sure that we catch
+    // up on any changes above them when the container becomes visible.
+    if (ancestor_model_view_changed_)
+      actor->MarkModelViewDirty();
     return;
+  }
 
   // No culling test for ContainerActor because the container does not bound
   // its children actors.  No need to set_z first because container doesn't
   // use z in its model view matrix.
-  actor->UpdateModelView();
+  const bool original_ancestor_model_view_changed =
+      ancestor_model_view_changed_;
+  if (actor->UpdateModelViewIfNeeded(ancestor_model_view_changed_)) {
+    num_model_view_updates_++;
+    ancestor_model_view_changed_ = true;
+  }
+
+  const float original_ancestor_opacity = ancestor_opacity_;
+  ancestor_opacity_ *= actor->opacity();
 
   RealCompositor::ActorVector children = actor->GetChildren();
   for (RealCompositor::ActorVector::const_iterator it = children.begin();
@@ -150,31 +247,70 @@ void LayerVisitor::VisitContainer(
       (*it)->Accept(this);
   }
 
+  ancestor_opacity_ = original_ancestor_opacity;
+  ancestor_model_view_changed_ = original_ancestor_model_view_changed;
+
   // The containers should be "further" than all their children.
   this->VisitActor(actor);
 }
 
 void LayerVisitor::VisitTexturedQuadActor(
     RealCompositor::QuadActor* actor, bool is_texture_opaque) {
-  actor->set_culled(has_fullscreen_actor_);
-  if (!actor->IsVisible())
+  // Everything behind a fullscreen actor is culled.  Visible actors are
+  // culled (and counted) below along with the ones that are offscreen or
+  // occluded.
+  actor->set_culled(false);
+  if (!actor->IsVisible()) {
+    actor->set_culled(has_fullscreen_actor_);
+    if (ancestor_model_view_changed_)
+      actor->MarkModelViewDirty();
     return;
+  }
 
   VisitActor(actor);
   actor->set_is_opaque(actor->is_opaque() && is_texture_opaque);
 
-  // Must update model view matrix before culling test.
-  actor->UpdateModelView();
-  CullingResult result =
-      PerformActorCullingTest(*stage_actor_, *actor);
+  actor->set_z(depth_);
+  depth_ += layer_thickness_;
 
-  actor->set_culled(result == CULLING_WINDOW_OFFSCREEN);
-  if (actor->culled())
+  // Must set z and update model view matrix before culling test.  The
+  // bounds only change when the matrix does.
+  if (actor->UpdateModelViewIfNeeded(ancestor_model_view_changed_)) {
+    num_model_view_updates_++;
+    UpdateActorGlBounds(*stage_actor_, actor);
+  }
+  const RealCompositor::QuadActor::GlBounds& bounds = actor->gl_bounds();
+  const BoundingBox box(bounds.x_min, bounds.x_max,
+                        bounds.y_min, bounds.y_max);
+  const bool is_axis_aligned = bounds.is_axis_aligned;
+  CullingResult result = PerformActorCullingTest(box);
+
+  // Actors are visited from front to back, so if opaque actors that we've
+  // already seen completely cover this one, it's hidden.
+  const int stage_width = stage_actor_->width();
+  const int stage_height = stage_actor_->height();
+  actor->set_culled(
+      has_fullscreen_actor_ ||
+      result == CULLING_WINDOW_OFFSCREEN ||
+      opaque_region_.contains_rect(
+          ConvertBoxToStagePixels(box, stage_width, stage_height, false)));
+  if (actor->culled()) {
+    COUNTER_INCREMENT(Compositor_CulledActors);
     return;
+  }
 
   if (actor->is_opaque() && result == CULLING_WINDOW_FULLSCREEN)
     has_fullscreen_actor_ = true;
 
+  // Only actors that exactly fill their bounding boxes (i.e. ones that
+  // aren't rotated or tilted) can occlude the actors behind them.
+  if (actor->is_opaque() && ancestor_opacity_ > 0.999f && is_axis_aligned &&
+      opaque_region_.num_rects() < kMaxOccludingRects) {
+    Rect rect = ConvertBoxToStagePixels(box, stage_width, stage_height, true);
+    rect.intersect(Rect(0, 0, stage_width, stage_height));
+    opaque_region_.merge(rect);
+  }
+
   visiting_top_visible_actor_ = false;
 }
 
@@ -202,33 +338,48 @@ void LayerVisitor::VisitTexturePixmap(
   if (!actor->IsVisible() || actor->width() <= 0 || actor->height() <= 0)
     return;
 
+  // Catch up on any texture updates that were skipped while the actor was
+  // culled.  Actors that are still culled keep their stale textures until
+  // they're uncovered.
+  if (!actor->culled())
+    actor->RefreshStaleTexture();
+
   if (visiting_top_visible_actor && has_fullscreen_actor_)
     top_fullscreen_actor_ = actor;
 
   if (use_partial_updates_) {
-    BoundingBox region = MapRegionToGlCoordinates(
-        *stage_actor_,
-        *actor,
-        actor->GetDamagedRegion());
-    updated_area_.merge(region);
+    const vector<Rect>& damaged_rects = actor->GetDamagedRegion().rects();
+    for (vector<Rect>::const_iterator it = damaged_rects.begin();
+         it != damaged_rects.end(); ++it) {
+      updated_areas_.push_back(
+          MapRegionToGlCoordinates(*stage_actor_, *actor, *it));
+    }
   }
   actor->ResetDamagedRegion();
 }
 
-Rect LayerVisitor::GetDamagedRegion(int stage_width, int stage_height) {
-  Rect region;
-  if (use_partial_updates_) {
-    float x_min = (updated_area_.x_min + 1.f) / 2.f * stage_width;
-    float y_min = (updated_area_.y_min + 1.f) / 2.f * stage_height;
-    float x_max = (updated_area_.x_max + 1.f) / 2.f * stage_width;
-    float y_max = (updated_area_.y_max + 1.f) / 2.f * stage_height;
-    region.x = static_cast<int>(x_min);
-    region.y = static_cast<int>(y_min);
+Region LayerVisitor::GetDamagedRegion(int stage_width, int stage_height) {
+  Region region;
+  if (!use_partial_updates_)
+    return region;
+
+  for (vector<BoundingBox>::const_iterator it = updated_areas_.begin();
+       it != updated_areas_.end(); ++it) {
+    float x_min = (it->x_min + 1.f) / 2.f * stage_width;
+    float y_min = (it->y_min + 1.f) / 2.f * stage_height;
+    float x_max = (it->x_max + 1.f) / 2.f * stage_width;
+    float y_max = (it->y_max + 1.f) / 2.f * stage_height;
+    Rect rect;
+    rect.x = static_cast<int>(x_min);
+    rect.y = static_cast<int>(y_min);
     // Important: To be properly conservative, the differences below need to
     // happen after the conversion to int.
-    region.width = static_cast<int>(ceil(x_max)) - region.x;
-    region.height = static_cast<int>(ceil(y_max)) - region.y;
+    rect.width = static_cast<int>(ceil(x_max)) - rect.x;
+    rect.height = static_cast<int>(ceil(y_max)) - rect.y;
+    region.merge(rect);
   }
+  region.intersect(Rect(0, 0, stage_width, stage_height));
+  region.simplify(Compositor::TexturePixmapActor::kMaxDamagedRects);
   return region;
 }
 
@@ -5,13 +5,18 @@
 #ifndef WINDOW_MANAGER_COMPOSITOR_LAYER_VISITOR_H_
 #define WINDOW_MANAGER_COMPOSITOR_LAYER_VISITOR_H_
 
+#include <vector>
+
 #include "window_manager/compositor/real_compositor.h"
+#include "window_manager/region.h"
 
 namespace window_manager {
 
-// LayerVisitor is used to update actors' opacities, transformation
+// LayerVisitor is used to update actors' opacities, depths, transformation
 // matrices and culling information.  It traverses through the actor tree
-// before DrawVisitor on each frame.  LayerVisitor keeps information about the
+// before DrawVisitor on each frame.  Actors are visited from front to back
+// and are assigned increasing depths, so that the draw visitors can use depth
+// testing.  LayerVisitor keeps information about the
 // composition of the actors during the traversal, and the information is used
 // to help RealCompositor and DrawCompositor perform optimizations.
 class LayerVisitor : virtual public RealCompositor::ActorVisitor {
@@ -53,13 +58,22 @@ class LayerVisitor : virtual public RealCompositor::ActorVisitor {
     float y_max;
   };
 
+  // Maximum number of rectangles used to track the area covered by opaque
+  // actors.  Opaque actors that are visited after the limit is reached are
+  // still drawn but don't occlude anything.
+  static const size_t kMaxOccludingRects;
+
   LayerVisitor(int32 count, bool use_partial_updates)
       : count_(count),
         has_fullscreen_actor_(false),
         stage_actor_(NULL),
+        ancestor_opacity_(1.0f),
+        ancestor_model_view_changed_(false),
+        num_model_view_updates_(0),
+        layer_thickness_(0.0f),
+        depth_(0.0f),
         visiting_top_visible_actor_(true),
         top_fullscreen_actor_(NULL),
-        updated_area_(0.0f, 0.0f, 0.0f, 0.0f),
         use_partial_updates_(use_partial_updates) {}
   virtual ~LayerVisitor() {}
 
@@ -68,6 +82,10 @@ class LayerVisitor : virtual public RealCompositor::ActorVisitor {
     return top_fullscreen_actor_;
   }
 
+  // Number of actors whose model view matrices were recomputed during the
+  // most recent traversal.
+  int num_model_view_updates() const { return num_model_view_updates_; }
+
   virtual void VisitActor(RealCompositor::Actor* actor);
   virtual void VisitStage(RealCompositor::StageActor* actor);
   virtual void VisitContainer(RealCompositor::ContainerActor* actor);
@@ -79,14 +97,34 @@ class LayerVisitor : virtual public RealCompositor::ActorVisitor {
       bool is_texture_opaque);
 
   // Get the damaged region in screen coordinates where (0, 0) is bottom_left
-  // and (w-1, h-1) is top_right.
-  Rect GetDamagedRegion(int stage_width, int stage_height);
+  // and (w-1, h-1) is top_right.  The region is clipped to the stage and
+  // holds at most Compositor::TexturePixmapActor::kMaxDamagedRects rects.
+  Region GetDamagedRegion(int stage_width, int stage_height);
 
  private:
   int32 count_;
   bool has_fullscreen_actor_;
   const RealCompositor::StageActor* stage_actor_;
 
+  // Cumulative opacity of the containers above the actor being visited.
+  float ancestor_opacity_;
+
+  // Was the model view matrix of any container above the actor being
+  // visited recomputed?  If so, the actor's matrix must be recomputed too.
+  bool ancestor_model_view_changed_;
+
+  int num_model_view_updates_;
+
+  // Distance between the depths of consecutive quads, and the depth that
+  // will be assigned to the next visible quad.
+  float layer_thickness_;
+  float depth_;
+
+  // Area of the stage covered by the opaque, axis-aligned actors visited so
+  // far, in pixels with (0, 0) at the bottom left.  Since actors are visited
+  // from front to back, anything completely inside this region is hidden.
+  Region opaque_region_;
+
   // This flag indicates whether the actor being visited is the topmost
   // visible actor.
   bool visiting_top_visible_actor_;
@@ -96,10 +134,10 @@ class LayerVisitor : virtual public RealCompositor::ActorVisitor {
   // not satisfied.
   const RealCompositor::TexturePixmapActor* top_fullscreen_actor_;
 
-  // This restores the dirty region union of all actors from the most
-  // recent VisitStage.  It's defined in GL coordinates where (-1, -1) is
+  // Dirty areas of all actors from the most recent VisitStage, one box per
+  // damaged rect.  They're defined in GL coordinates where (-1, -1) is
   // bottom_left and (1, 1) is top_right.
-  BoundingBox updated_area_;
+  std::vector<BoundingBox> updated_areas_;
 
   bool use_partial_updates_;
 
@@ -193,14 +193,15 @@ void MockCompositor::TexturePixmapActor::ClearAlphaMask() {
 void MockCompositor::TexturePixmapActor::MergeDamagedRegion(
     const Rect& region) {
   damaged_region_.merge(region);
+  damaged_region_.simplify(kMaxDamagedRects);
 }
 
-const Rect& MockCompositor::TexturePixmapActor::GetDamagedRegion() const {
+const Region& MockCompositor::TexturePixmapActor::GetDamagedRegion() const {
   return damaged_region_;
 }
 
 void MockCompositor::TexturePixmapActor::ResetDamagedRegion() {
-  damaged_region_.reset(0, 0, 0, 0);
+  damaged_region_.clear();
 }
 
 MockCompositor::ImageActor* MockCompositor::CreateImageFromFile(
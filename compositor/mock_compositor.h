@@ -9,7 +9,9 @@
 
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/time.h"
 #include "window_manager/compositor/compositor.h"
+#include "window_manager/compositor/frame_stats.h"
 
 namespace window_manager {
 
@@ -78,6 +80,18 @@ class MockCompositor : public Compositor {
       scale_y_ = scale_y;
     }
     virtual void SetOpacity(double opacity, int anim_ms) { opacity_ = opacity; }
+    virtual void MoveWithCurve(int x, int y, int anim_ms,
+                               const AnimationCurve& curve) {
+      Move(x, y, anim_ms);
+    }
+    virtual void ScaleWithCurve(double scale_x, double scale_y, int anim_ms,
+                                const AnimationCurve& curve) {
+      Scale(scale_x, scale_y, anim_ms);
+    }
+    virtual void SetOpacityWithCurve(double opacity, int anim_ms,
+                                     const AnimationCurve& curve) {
+      SetOpacity(opacity, anim_ms);
+    }
     virtual void Show() { is_shown_ = true; }
     virtual void Hide() { is_shown_ = false; }
     virtual void SetTilt(double tilt, int anim_ms) { tilt_ = tilt; }
@@ -219,7 +233,7 @@ class MockCompositor : public Compositor {
     virtual void SetAlphaMask(const uint8_t* bytes, int width, int height);
     virtual void ClearAlphaMask();
     virtual void MergeDamagedRegion(const Rect& region);
-    virtual const Rect& GetDamagedRegion() const;
+    virtual const Region& GetDamagedRegion() const;
     virtual void ResetDamagedRegion();
     // End Compositor::TexturePixmapActor methods.
 
@@ -239,7 +253,7 @@ class MockCompositor : public Compositor {
     int num_texture_updates_;
 
     // Dirty region.
-    Rect damaged_region_;
+    Region damaged_region_;
 
     DISALLOW_COPY_AND_ASSIGN(TexturePixmapActor);
   };
@@ -247,7 +261,9 @@ class MockCompositor : public Compositor {
   explicit MockCompositor(XConnection* xconn)
       : xconn_(xconn),
         num_forced_draws_(0),
-        should_load_images_(false) {}
+        should_load_images_(false),
+        has_active_animations_(false),
+        frame_stats_(base::TimeDelta::FromMilliseconds(16)) {}
   ~MockCompositor() {}
 
   // Begin Compositor methods
@@ -275,14 +291,22 @@ class MockCompositor : public Compositor {
     active_visibility_groups_ = groups;
   }
   virtual void ForceDraw() { num_forced_draws_++; }
+  virtual const FrameStats* GetFrameStats() const { return &frame_stats_; }
+  virtual bool HasActiveAnimations() const { return has_active_animations_; }
   // End Compositor methods
 
+  // Tests can record fake frames here.
+  FrameStats* frame_stats() { return &frame_stats_; }
+
   const std::tr1::unordered_set<int>& active_visibility_groups() const {
     return active_visibility_groups_;
   }
   int num_forced_draws() const { return num_forced_draws_; }
 
   void set_should_load_images(bool load) { should_load_images_ = load; }
+  void set_has_active_animations(bool animating) {
+    has_active_animations_ = animating;
+  }
 
  private:
   XConnection* xconn_;  // not owned
@@ -293,6 +317,11 @@ class MockCompositor : public Compositor {
   // Should we load actual image files in CreateImageFromFile()?
   bool should_load_images_;
 
+  // Value returned by HasActiveAnimations().
+  bool has_active_animations_;
+
+  FrameStats frame_stats_;
+
   DISALLOW_COPY_AND_ASSIGN(MockCompositor);
 };
 
@@ -0,0 +1,95 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/compositor/quad_batch.h"
+
+#include "base/logging.h"
+
+namespace window_manager {
+
+// static
+const size_t QuadBatch::kVerticesPerQuad = 6;
+// static
+const size_t QuadBatch::kMaxQuadsPerBatch = 256;
+
+// Indices of the unit quad's corners that make up its two triangles, in the
+// order used by AddQuad()'s |colors| argument.
+static const int kQuadTriangleCorners[] = { 0, 1, 2, 2, 1, 3 };
+
+// Untransformed positions of the unit quad's corners.
+static const float kQuadCorners[4][2] = {
+  { 0.f, 0.f },
+  { 0.f, 1.f },
+  { 1.f, 0.f },
+  { 1.f, 1.f },
+};
+
+int QuadBatch::State::CountDifferences(const State& other) const {
+  return (texture != other.texture ? 1 : 0) +
+         (texture_has_alpha != other.texture_has_alpha ? 1 : 0) +
+         (linear_filter != other.linear_filter ? 1 : 0) +
+         (blend != other.blend ? 1 : 0);
+}
+
+QuadBatch::QuadBatch(Delegate* delegate)
+    : delegate_(delegate),
+      last_state_is_valid_(false) {
+  CHECK(delegate_);
+  vertices_.reserve(kMaxQuadsPerBatch * kVerticesPerQuad);
+}
+
+void QuadBatch::AddQuad(const State& state,
+                        const Matrix4& model_view,
+                        const float colors[16],
+                        const TextureData::TexCoords& tex_coords) {
+  if (!vertices_.empty() &&
+      (state != pending_state_ || num_pending_quads() >= kMaxQuadsPerBatch))
+    Flush();
+  pending_state_ = state;
+
+  Vertex corners[4];
+  for (int i = 0; i < 4; ++i) {
+    const Vector4 position =
+        model_view * Vector4(kQuadCorners[i][0], kQuadCorners[i][1], 0.f, 1.f);
+    for (int j = 0; j < 4; ++j) {
+      corners[i].position[j] = position[j];
+      corners[i].color[j] = colors[i * 4 + j];
+    }
+    corners[i].tex_coord[0] = kQuadCorners[i][0] ?
+        tex_coords.right : tex_coords.left;
+    corners[i].tex_coord[1] = kQuadCorners[i][1] ?
+        tex_coords.bottom : tex_coords.top;
+  }
+  for (size_t i = 0; i < arraysize(kQuadTriangleCorners); ++i)
+    vertices_.push_back(corners[kQuadTriangleCorners[i]]);
+  stats_.num_quads++;
+}
+
+void QuadBatch::Flush() {
+  if (vertices_.empty())
+    return;
+
+  if (last_state_is_valid_)
+    stats_.num_state_changes += pending_state_.CountDifferences(last_state_);
+  else
+    stats_.num_state_changes++;
+
+  delegate_->DrawQuadBatch(pending_state_,
+                           last_state_is_valid_ ? &last_state_ : NULL,
+                           &vertices_[0],
+                           vertices_.size());
+  stats_.num_draw_calls++;
+
+  last_state_ = pending_state_;
+  last_state_is_valid_ = true;
+  vertices_.clear();
+}
+
+void QuadBatch::ResetStats() {
+  DCHECK(vertices_.empty());
+  stats_ = Stats();
+  InvalidateState();
+}
+
+}  // namespace window_manager
@@ -0,0 +1,154 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_COMPOSITOR_QUAD_BATCH_H_
+#define WINDOW_MANAGER_COMPOSITOR_QUAD_BATCH_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "window_manager/compositor/texture_data.h"
+#include "window_manager/math_types.h"
+
+namespace window_manager {
+
+// QuadBatch collects consecutive quads that share the same GL state so that
+// they can be drawn with a single draw call.  The draw visitors add a quad
+// for each actor in drawing order.  Whenever a quad needs different state
+// than the ones already in the batch (or the batch is full), the pending
+// quads are handed to the delegate, which uploads them into a streamed
+// vertex buffer and draws them.
+//
+// Vertices are transformed by the actors' model view matrices on the CPU, so
+// quads with different transforms can share a draw call.  They're stored in
+// homogeneous coordinates, so the projection (and the perspective divide for
+// tilted actors) still happens on the GPU.
+class QuadBatch {
+ public:
+  // GL state that all of the quads in a batch share.
+  struct State {
+    State()
+        : texture(0),
+          texture_has_alpha(true),
+          linear_filter(true),
+          blend(false) {}
+
+    bool operator==(const State& o) const {
+      return texture == o.texture &&
+             texture_has_alpha == o.texture_has_alpha &&
+             linear_filter == o.linear_filter &&
+             blend == o.blend;
+    }
+    bool operator!=(const State& o) const { return !(*this == o); }
+
+    // Number of fields that differ between this state and |other|.
+    int CountDifferences(const State& other) const;
+
+    // Texture to bind, or 0 for untextured quads.
+    uint32_t texture;
+
+    // Does |texture| have an alpha channel?
+    bool texture_has_alpha;
+
+    // Should the texture be sampled with GL_LINEAR (rather than GL_NEAREST)
+    // filtering?
+    bool linear_filter;
+
+    // Should blending be enabled?
+    bool blend;
+  };
+
+  // A single vertex.  Vertices are interleaved so that a batch can be
+  // uploaded with a single call.
+  struct Vertex {
+    // Position after the model view transform, as (x, y, z, w).
+    float position[4];
+    float tex_coord[2];
+    // Color as (r, g, b, a).
+    float color[4];
+  };
+
+  // Counters describing the work done by the batch.
+  struct Stats {
+    Stats() : num_quads(0), num_draw_calls(0), num_state_changes(0) {}
+
+    int num_quads;
+    int num_draw_calls;
+
+    // Number of state fields that had to be changed between draw calls.
+    // Drawing the first batch after InvalidateState() counts as a single
+    // change.
+    int num_state_changes;
+  };
+
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // Draw |num_vertices| vertices from |vertices| as GL_TRIANGLES using
+    // |state|.  |previous_state| is the state that was used for the last
+    // batch, or NULL if it's unknown (in which case all of |state| must be
+    // applied).
+    virtual void DrawQuadBatch(const State& state,
+                               const State* previous_state,
+                               const Vertex* vertices,
+                               size_t num_vertices) = 0;
+  };
+
+  // Each quad is drawn as two triangles.
+  static const size_t kVerticesPerQuad;
+
+  // Maximum number of quads that are drawn with a single call.
+  static const size_t kMaxQuadsPerBatch;
+
+  explicit QuadBatch(Delegate* delegate);
+  ~QuadBatch() {}
+
+  const Stats& stats() const { return stats_; }
+  size_t num_pending_quads() const {
+    return vertices_.size() / kVerticesPerQuad;
+  }
+
+  // Add a unit quad, transformed by |model_view|, that should be drawn with
+  // |state|.  |colors| contains RGBA colors for the quad's corners, in the
+  // order (0, 0), (0, 1), (1, 0), (1, 1).  |tex_coords| is the part of the
+  // texture that's stretched across the quad.  Pending quads are flushed
+  // first if |state| doesn't match theirs.
+  void AddQuad(const State& state,
+               const Matrix4& model_view,
+               const float colors[16],
+               const TextureData::TexCoords& tex_coords);
+
+  // Draw all of the pending quads.
+  void Flush();
+
+  // Forget the state of the last batch.  This must be called after GL state
+  // is changed behind the batch's back.
+  void InvalidateState() { last_state_is_valid_ = false; }
+
+  // Reset |stats_| and invalidate the state.  Called at the start of each
+  // frame.
+  void ResetStats();
+
+ private:
+  Delegate* delegate_;  // not owned
+
+  // Vertices for pending quads, and the state that they'll be drawn with.
+  std::vector<Vertex> vertices_;
+  State pending_state_;
+
+  // State used for the last batch that was drawn.
+  State last_state_;
+  bool last_state_is_valid_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(QuadBatch);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_COMPOSITOR_QUAD_BATCH_H_
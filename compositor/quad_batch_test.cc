@@ -0,0 +1,201 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "window_manager/compositor/quad_batch.h"
+#include "window_manager/math_types.h"
+#include "window_manager/test_lib.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using std::vector;
+
+namespace window_manager {
+
+namespace {
+
+// Delegate that records the batches that it's asked to draw.
+class RecordingDelegate : public QuadBatch::Delegate {
+ public:
+  struct Batch {
+    QuadBatch::State state;
+    bool had_previous_state;
+    vector<QuadBatch::Vertex> vertices;
+  };
+
+  RecordingDelegate() {}
+  virtual ~RecordingDelegate() {}
+
+  const vector<Batch>& batches() const { return batches_; }
+
+  // Begin QuadBatch::Delegate methods.
+  virtual void DrawQuadBatch(const QuadBatch::State& state,
+                             const QuadBatch::State* previous_state,
+                             const QuadBatch::Vertex* vertices,
+                             size_t num_vertices) {
+    Batch batch;
+    batch.state = state;
+    batch.had_previous_state = (previous_state != NULL);
+    batch.vertices.assign(vertices, vertices + num_vertices);
+    batches_.push_back(batch);
+  }
+  // End QuadBatch::Delegate methods.
+
+ private:
+  vector<Batch> batches_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordingDelegate);
+};
+
+// Colors for AddQuad(): red at the begin edge and green at the end edge.
+const float kColors[16] = {
+  1.f, 0.f, 0.f, 1.f,
+  1.f, 0.f, 0.f, 1.f,
+  0.f, 1.f, 0.f, 1.f,
+  0.f, 1.f, 0.f, 1.f,
+};
+
+const TextureData::TexCoords kTexCoords;
+
+}  // namespace
+
+class QuadBatchTest : public ::testing::Test {};
+
+// Check that quads are transformed on the CPU and split into triangles.
+TEST_F(QuadBatchTest, Vertices) {
+  RecordingDelegate delegate;
+  QuadBatch batch(&delegate);
+
+  // Scale a unit quad to 20x10 and move it to (5, 7, 0.5).
+  Matrix4 model_view = Matrix4::translation(Vector3(5.f, 7.f, 0.5f)) *
+                       Matrix4::scale(Vector3(20.f, 10.f, 1.f));
+  batch.AddQuad(QuadBatch::State(), model_view, kColors, kTexCoords);
+  EXPECT_EQ(1U, batch.num_pending_quads());
+
+  // Add a second quad that only uses part of the texture.
+  batch.AddQuad(QuadBatch::State(), model_view, kColors,
+                TextureData::TexCoords(0.25f, 0.5f, 0.75f, 1.f));
+  EXPECT_TRUE(delegate.batches().empty());
+
+  batch.Flush();
+  EXPECT_EQ(0U, batch.num_pending_quads());
+  ASSERT_EQ(1U, delegate.batches().size());
+  const vector<QuadBatch::Vertex>& vertices = delegate.batches()[0].vertices;
+  ASSERT_EQ(2 * QuadBatch::kVerticesPerQuad, vertices.size());
+
+  // The triangles are (0, 0), (0, 1), (1, 0) and (1, 0), (0, 1), (1, 1).
+  static const float kExpectedTexCoords[6][2] = {
+    { 0.f, 0.f }, { 0.f, 1.f }, { 1.f, 0.f },
+    { 1.f, 0.f }, { 0.f, 1.f }, { 1.f, 1.f },
+  };
+  for (size_t i = 0; i < QuadBatch::kVerticesPerQuad; ++i) {
+    SCOPED_TRACE(testing::Message() << "vertex " << i);
+    const float u = kExpectedTexCoords[i][0];
+    const float v = kExpectedTexCoords[i][1];
+    EXPECT_FLOAT_EQ(u, vertices[i].tex_coord[0]);
+    EXPECT_FLOAT_EQ(v, vertices[i].tex_coord[1]);
+    EXPECT_FLOAT_EQ(5.f + 20.f * u, vertices[i].position[0]);
+    EXPECT_FLOAT_EQ(7.f + 10.f * v, vertices[i].position[1]);
+    EXPECT_FLOAT_EQ(0.5f, vertices[i].position[2]);
+    EXPECT_FLOAT_EQ(1.f, vertices[i].position[3]);
+    // The begin color is used along u == 0 and the end color along u == 1.
+    EXPECT_FLOAT_EQ(u == 0.f ? 1.f : 0.f, vertices[i].color[0]);
+    EXPECT_FLOAT_EQ(u == 0.f ? 0.f : 1.f, vertices[i].color[1]);
+    EXPECT_FLOAT_EQ(1.f, vertices[i].color[3]);
+  }
+
+  for (size_t i = 0; i < QuadBatch::kVerticesPerQuad; ++i) {
+    SCOPED_TRACE(testing::Message() << "vertex " << i);
+    const QuadBatch::Vertex& vertex =
+        vertices[QuadBatch::kVerticesPerQuad + i];
+    EXPECT_FLOAT_EQ(kExpectedTexCoords[i][0] ? 0.75f : 0.25f,
+                    vertex.tex_coord[0]);
+    EXPECT_FLOAT_EQ(kExpectedTexCoords[i][1] ? 1.f : 0.5f,
+                    vertex.tex_coord[1]);
+  }
+
+  // Flushing again shouldn't draw anything.
+  batch.Flush();
+  EXPECT_EQ(1U, delegate.batches().size());
+}
+
+// Check that quads are only drawn together when their state matches, and
+// that the counters track the draw calls and state changes.
+TEST_F(QuadBatchTest, StateChanges) {
+  RecordingDelegate delegate;
+  QuadBatch batch(&delegate);
+  const Matrix4 identity = Matrix4::identity();
+
+  QuadBatch::State opaque_state;
+  opaque_state.texture = 3;
+  QuadBatch::State blended_state = opaque_state;
+  blended_state.blend = true;
+  QuadBatch::State other_texture_state = blended_state;
+  other_texture_state.texture = 4;
+  other_texture_state.linear_filter = false;
+
+  batch.AddQuad(opaque_state, identity, kColors, kTexCoords);
+  batch.AddQuad(opaque_state, identity, kColors, kTexCoords);
+  batch.AddQuad(blended_state, identity, kColors, kTexCoords);
+  batch.AddQuad(other_texture_state, identity, kColors, kTexCoords);
+  batch.AddQuad(other_texture_state, identity, kColors, kTexCoords);
+  batch.Flush();
+
+  const vector<RecordingDelegate::Batch>& batches = delegate.batches();
+  ASSERT_EQ(3U, batches.size());
+  EXPECT_TRUE(batches[0].state == opaque_state);
+  EXPECT_FALSE(batches[0].had_previous_state);
+  EXPECT_EQ(2 * QuadBatch::kVerticesPerQuad, batches[0].vertices.size());
+  EXPECT_TRUE(batches[1].state == blended_state);
+  EXPECT_TRUE(batches[1].had_previous_state);
+  EXPECT_EQ(QuadBatch::kVerticesPerQuad, batches[1].vertices.size());
+  EXPECT_TRUE(batches[2].state == other_texture_state);
+  EXPECT_EQ(2 * QuadBatch::kVerticesPerQuad, batches[2].vertices.size());
+
+  // The first batch counts as a single change, the second changes blending,
+  // and the third changes the texture and filter.
+  EXPECT_EQ(5, batch.stats().num_quads);
+  EXPECT_EQ(3, batch.stats().num_draw_calls);
+  EXPECT_EQ(1 + 1 + 2, batch.stats().num_state_changes);
+
+  // After resetting, the previous state should be unknown.
+  batch.ResetStats();
+  EXPECT_EQ(0, batch.stats().num_quads);
+  batch.AddQuad(other_texture_state, identity, kColors, kTexCoords);
+  batch.Flush();
+  ASSERT_EQ(4U, batches.size());
+  EXPECT_FALSE(batches[3].had_previous_state);
+  EXPECT_EQ(1, batch.stats().num_state_changes);
+}
+
+// Check that full batches are flushed automatically.
+TEST_F(QuadBatchTest, MaxQuadsPerBatch) {
+  RecordingDelegate delegate;
+  QuadBatch batch(&delegate);
+  for (size_t i = 0; i < QuadBatch::kMaxQuadsPerBatch + 1; ++i) {
+    batch.AddQuad(QuadBatch::State(), Matrix4::identity(),
+                  kColors, kTexCoords);
+  }
+  ASSERT_EQ(1U, delegate.batches().size());
+  EXPECT_EQ(QuadBatch::kMaxQuadsPerBatch * QuadBatch::kVerticesPerQuad,
+            delegate.batches()[0].vertices.size());
+  EXPECT_EQ(1U, batch.num_pending_quads());
+
+  batch.Flush();
+  ASSERT_EQ(2U, delegate.batches().size());
+  EXPECT_EQ(2, batch.stats().num_draw_calls);
+  // Nothing changed between the batches.
+  EXPECT_EQ(1, batch.stats().num_state_changes);
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
@@ -20,7 +20,9 @@
 #elif defined(COMPOSITOR_XRENDER)
 #include "window_manager/compositor/xrender/xrender_visitor.h"
 #endif
+#include "window_manager/compositor/frame_clock.h"
 #include "window_manager/compositor/layer_visitor.h"
+#include "window_manager/counters.h"
 #include "window_manager/event_loop.h"
 #include "window_manager/image_container.h"
 #include "window_manager/profiler.h"
@@ -31,19 +33,49 @@ DEFINE_bool(compositor_display_debug_needle, false,
             "Specify this to turn on a debugging aid for seeing when "
             "frames are being drawn.");
 
+DEFINE_bool(compositor_opaque_depth_pass, false,
+            "Draw opaque actors front to back with depth testing before "
+            "blending translucent actors back to front, so that hidden pixels "
+            "can be rejected early (OpenGL only).");
+
+DEFINE_bool(compositor_partial_texture_uploads, true,
+            "When texture-from-pixmap is unavailable, copy only the damaged "
+            "parts of windows' pixmaps to their textures instead of the "
+            "whole pixmaps (OpenGL only).");
+
+DEFINE_bool(compositor_pixel_buffer_uploads, true,
+            "Upload textures through a ring of pixel buffer objects so that "
+            "the transfers can overlap with drawing, if the driver supports "
+            "them (OpenGL only).");
+
+DEFINE_bool(compositor_texture_atlas, true,
+            "Pack small images loaded from files (e.g. shadows) into shared "
+            "atlas textures so they can be drawn without rebinding textures "
+            "(OpenGL and OpenGL ES only).");
+
 DEFINE_int64(draw_timeout_ms, 16,
-             "Minimum time in milliseconds between scene redraws.");
+             "Minimum time in milliseconds between scene redraws when using "
+             "the \"timer\" frame clock.");
+DEFINE_string(compositor_frame_clock, "timer",
+              "Clock used to schedule frames: \"timer\" draws as soon as "
+              "possible every --draw_timeout_ms; \"vblank\" starts drawing "
+              "just early enough to make the next vblank.");
+DEFINE_int64(vblank_interval_us, 16667,
+             "Display refresh interval in microseconds, used by the "
+             "\"vblank\" frame clock.");
+
+// Updated by the draw visitors.
+DEFINE_COUNTER(Compositor_DrawCalls);
+DEFINE_COUNTER(Compositor_TextureUploads);
+DEFINE_COUNTER(Compositor_TextureUploadBytes);
 
 using base::TimeDelta;
 using base::TimeTicks;
 using std::find;
-using std::make_pair;
-using std::map;
 using std::max;
 using std::min;
 using std::set;
 using std::string;
-using std::tr1::shared_ptr;
 using std::tr1::unordered_set;
 using window_manager::util::FindWithDefault;
 using window_manager::util::GetMonotonicTime;
@@ -56,20 +88,10 @@ namespace window_manager {
 
 static const float kDimmedOpacityBegin = 0.2f;
 static const float kDimmedOpacityEnd = 0.6f;
-// Project layers to depths between 0 and 1.
-static const float kProjectedDepthMin = 0.0f;
-static const float kProjectedDepthMax = 1.0f;
 
-// Template used to round float values returned by animations to integers when
-// applied to integer properties (read: position).
-template<class T>
-static T MaybeRoundFloat(float value) {
-  return static_cast<T>(value);
-}
-
-template<>
-int MaybeRoundFloat(float value) {
-  return static_cast<int>(roundf(value));
+// Get the number of microseconds between two times.
+static int GetDurationUs(const TimeTicks& start, const TimeTicks& end) {
+  return static_cast<int>((end - start).InMicroseconds());
 }
 
 void RealCompositor::ActorVisitor::VisitContainer(ContainerActor* actor) {
@@ -100,6 +122,7 @@ RealCompositor::Actor::Actor(RealCompositor* compositor)
       tilt_(0.f),
       culled_(false),
       model_view_(Matrix4::identity()),
+      model_view_dirty_(true),
       is_opaque_(false),
       has_children_(false),
       is_shown_(true),
@@ -112,6 +135,7 @@ RealCompositor::Actor::~Actor() {
   if (parent_) {
     parent_->RemoveActor(this);
   }
+  compositor_->animation_system()->CancelAnimationsForOwner(this);
   compositor_->RemoveActor(this);
 }
 
@@ -139,18 +163,17 @@ void RealCompositor::Actor::CloneImpl(RealCompositor::Actor* clone) {
 }
 
 void RealCompositor::Actor::Move(int x, int y, int duration_ms) {
-  MoveX(x, duration_ms);
-  MoveY(y, duration_ms);
+  MoveWithCurve(x, y, duration_ms, AnimationCurve());
 }
 
 void RealCompositor::Actor::MoveX(int x, int duration_ms) {
-  AnimateField(&int_animations_, &x_, x,
-               TimeDelta::FromMilliseconds(duration_ms));
+  AnimateField(&x_, x, TimeDelta::FromMilliseconds(duration_ms),
+               AnimationCurve());
 }
 
 void RealCompositor::Actor::MoveY(int y, int duration_ms) {
-  AnimateField(&int_animations_, &y_, y,
-               TimeDelta::FromMilliseconds(duration_ms));
+  AnimateField(&y_, y, TimeDelta::FromMilliseconds(duration_ms),
+               AnimationCurve());
 }
 
 AnimationPair* RealCompositor::Actor::CreateMoveAnimation() {
@@ -161,31 +184,45 @@ AnimationPair* RealCompositor::Actor::CreateMoveAnimation() {
 
 void RealCompositor::Actor::SetMoveAnimation(AnimationPair* animations) {
   DCHECK(animations);
-  SetAnimationForField(
-      &int_animations_, &x_, animations->release_first_animation());
-  SetAnimationForField(
-      &int_animations_, &y_, animations->release_second_animation());
+  SetAnimationForField(&x_, animations->release_first_animation());
+  SetAnimationForField(&y_, animations->release_second_animation());
   delete animations;
 }
 
 void RealCompositor::Actor::Scale(double scale_x, double scale_y,
                                   int duration_ms) {
-  TimeDelta duration = TimeDelta::FromMilliseconds(duration_ms);
-  AnimateField(&float_animations_, &scale_x_, static_cast<float>(scale_x),
-               duration);
-  AnimateField(&float_animations_, &scale_y_, static_cast<float>(scale_y),
-               duration);
+  ScaleWithCurve(scale_x, scale_y, duration_ms, AnimationCurve());
 }
 
 void RealCompositor::Actor::SetOpacity(double opacity, int duration_ms) {
-  AnimateField(&float_animations_, &opacity_, static_cast<float>(opacity),
-               TimeDelta::FromMilliseconds(duration_ms));
+  SetOpacityWithCurve(opacity, duration_ms, AnimationCurve());
+}
+
+void RealCompositor::Actor::MoveWithCurve(int x, int y, int duration_ms,
+                                          const AnimationCurve& curve) {
+  TimeDelta duration = TimeDelta::FromMilliseconds(duration_ms);
+  AnimateField(&x_, x, duration, curve);
+  AnimateField(&y_, y, duration, curve);
+}
+
+void RealCompositor::Actor::ScaleWithCurve(double scale_x, double scale_y,
+                                           int duration_ms,
+                                           const AnimationCurve& curve) {
+  TimeDelta duration = TimeDelta::FromMilliseconds(duration_ms);
+  AnimateField(&scale_x_, static_cast<float>(scale_x), duration, curve);
+  AnimateField(&scale_y_, static_cast<float>(scale_y), duration, curve);
+}
+
+void RealCompositor::Actor::SetOpacityWithCurve(double opacity,
+                                                int duration_ms,
+                                                const AnimationCurve& curve) {
+  AnimateField(&opacity_, static_cast<float>(opacity),
+               TimeDelta::FromMilliseconds(duration_ms), curve);
 }
 
 void RealCompositor::Actor::SetTilt(double tilt, int duration_ms) {
-  AnimateField(&float_animations_, &tilt_,
-               static_cast<float>(tilt),
-               TimeDelta::FromMilliseconds(duration_ms));
+  AnimateField(&tilt_, static_cast<float>(tilt),
+               TimeDelta::FromMilliseconds(duration_ms), AnimationCurve());
 }
 
 void RealCompositor::Actor::Raise(Compositor::Actor* other) {
@@ -229,10 +266,10 @@ void RealCompositor::Actor::LowerToBottom() {
 
 void RealCompositor::Actor::ShowDimmed(bool dimmed, int anim_ms) {
   TimeDelta duration = TimeDelta::FromMilliseconds(anim_ms);
-  AnimateField(&float_animations_, &dimmed_opacity_begin_,
-               dimmed ? kDimmedOpacityBegin : 0.f, duration);
-  AnimateField(&float_animations_, &dimmed_opacity_end_,
-               dimmed ? kDimmedOpacityEnd : 0.f, duration);
+  AnimateField(&dimmed_opacity_begin_,
+               dimmed ? kDimmedOpacityBegin : 0.f, duration, AnimationCurve());
+  AnimateField(&dimmed_opacity_end_,
+               dimmed ? kDimmedOpacityEnd : 0.f, duration, AnimationCurve());
 }
 
 void RealCompositor::Actor::AddToVisibilityGroup(int group_id) {
@@ -279,14 +316,8 @@ bool RealCompositor::Actor::IsInActiveVisibilityGroup() const {
   return false;
 }
 
-void RealCompositor::Actor::Update(int* count, const TimeTicks& now) {
+void RealCompositor::Actor::Update(int* count) {
   (*count)++;
-  if (int_animations_.empty() && float_animations_.empty())
-    return;
-
-  SetDirty();
-  UpdateInternal(&int_animations_, now);
-  UpdateInternal(&float_animations_, now);
 }
 
 void RealCompositor::Actor::UpdateModelView() {
@@ -318,6 +349,14 @@ void RealCompositor::Actor::UpdateModelView() {
   }
 }
 
+bool RealCompositor::Actor::UpdateModelViewIfNeeded(bool parent_changed) {
+  if (!model_view_dirty_ && !parent_changed)
+    return false;
+  UpdateModelView();
+  model_view_dirty_ = false;
+  return true;
+}
+
 bool RealCompositor::Actor::IsTransformed() const {
   const Vector4 c0 = model_view_[0];
   const Vector4 c1 = model_view_[1];
@@ -344,30 +383,27 @@ bool RealCompositor::Actor::IsTransformed() const {
 }
 
 template<class T> void RealCompositor::Actor::AnimateField(
-    map<T*, shared_ptr<Animation> >* animation_map,
-    T* field, T value, const TimeDelta& duration) {
-  typeof(animation_map->begin()) iterator = animation_map->find(field);
+    T* field, T value, const TimeDelta& duration,
+    const AnimationCurve& curve) {
+  AnimationSystem* animation_system = compositor_->animation_system();
   // If we're not currently animating the field and it's already at the
   // right value, there's no reason to do anything.
-  if (iterator == animation_map->end() && value == *field)
+  if (value == *field && !animation_system->IsAnimating(field))
     return;
 
   if (duration.InMilliseconds() > 0) {
-    shared_ptr<Animation> animation(
-        new Animation(*field, compositor_->GetMonotonicTimeForAnimation()));
-    animation->AppendKeyframe(value, duration);
-    if (iterator != animation_map->end()) {
-      iterator->second = animation;
-    } else {
-      animation_map->insert(make_pair(field, animation));
-      compositor_->IncrementNumAnimations();
-    }
+    animation_system->Animate(field, *field, value,
+                              compositor_->GetMonotonicTimeForAnimation(),
+                              duration,
+                              curve,
+                              this,
+                              GetDirtyFlagForField(field));
+    compositor_->HandleAnimationStarted();
   } else {
-    if (iterator != animation_map->end()) {
-      animation_map->erase(iterator);
-      compositor_->DecrementNumAnimations();
-    }
+    animation_system->Cancel(field);
     *field = value;
+    if (AffectsModelView(field))
+      model_view_dirty_ = true;
     SetDirty();
   }
 }
@@ -379,36 +415,14 @@ template<class T> Animation* RealCompositor::Actor::CreateAnimationForField(
 }
 
 template<class T> void RealCompositor::Actor::SetAnimationForField(
-    std::map<T*, std::tr1::shared_ptr<Animation> >* animation_map,
-    T* field,
-    Animation* new_animation) {
+    T* field, Animation* new_animation) {
   DCHECK(field);
   DCHECK(new_animation);
 
-  shared_ptr<Animation> animation(new_animation);
-  typeof(animation_map->begin()) iterator = animation_map->find(field);
-  if (iterator != animation_map->end()) {
-    iterator->second = animation;
-  } else {
-    animation_map->insert(make_pair(field, animation));
-    compositor_->IncrementNumAnimations();
-  }
-}
-
-template<class T> void RealCompositor::Actor::UpdateInternal(
-    map<T*, shared_ptr<Animation> >* animation_map, const TimeTicks& now) {
-  typeof(animation_map->begin()) iterator = animation_map->begin();
-  while (iterator != animation_map->end()) {
-    *(iterator->first) = MaybeRoundFloat<T>(iterator->second->GetValue(now));
-    if (iterator->second->IsDone(now)) {
-      typeof(iterator) old_iterator = iterator;
-      ++iterator;
-      animation_map->erase(old_iterator);
-      compositor_->DecrementNumAnimations();
-    } else {
-      ++iterator;
-    }
-  }
+  scoped_ptr<Animation> animation(new_animation);
+  compositor_->animation_system()->SetAnimation(
+      field, *animation, this, GetDirtyFlagForField(field));
+  compositor_->HandleAnimationStarted();
 }
 
 
@@ -450,12 +464,14 @@ void RealCompositor::ContainerActor::RemoveActor(Compositor::Actor* actor) {
   }
 }
 
-void RealCompositor::ContainerActor::Update(int* count, const TimeTicks& now) {
+void RealCompositor::ContainerActor::Update(int* count) {
+  PROFILER_STATIC_MARKER_BEGIN(RealCompositor_ContainerActor_Update);
   for (ActorVector::iterator iterator = children_.begin();
        iterator != children_.end(); ++iterator) {
-    (*iterator)->Update(count, now);
+    (*iterator)->Update(count);
   }
-  RealCompositor::Actor::Update(count, now);
+  RealCompositor::Actor::Update(count);
+  PROFILER_STATIC_MARKER_END(RealCompositor_ContainerActor_Update);
 }
 
 void RealCompositor::ContainerActor::UpdateModelView() {
@@ -609,7 +625,14 @@ RealCompositor::Actor* RealCompositor::ImageActor::Clone() {
 
 void RealCompositor::ImageActor::SetImageData(
     const ImageContainer& image_container) {
-  compositor()->draw_visitor()->BindImage(image_container, this);
+  SetImageDataInternal(image_container, false);
+}
+
+void RealCompositor::ImageActor::SetImageDataInternal(
+    const ImageContainer& image_container, bool use_atlas) {
+  if (!use_atlas ||
+      !compositor()->draw_visitor()->BindImageInAtlas(image_container, this))
+    compositor()->draw_visitor()->BindImage(image_container, this);
   SetSizeInternal(image_container.width(), image_container.height());
   SetDirty();
 }
@@ -619,7 +642,8 @@ RealCompositor::TexturePixmapActor::TexturePixmapActor(
     RealCompositor* compositor)
     : RealCompositor::QuadActor(compositor),
       pixmap_(0),
-      pixmap_is_opaque_(false) {
+      pixmap_is_opaque_(false),
+      texture_is_stale_(false) {
   SetSizeInternal(0, 0);
 }
 
@@ -632,6 +656,8 @@ void RealCompositor::TexturePixmapActor::SetPixmap(XID pixmap) {
   set_texture_data(NULL);
   pixmap_ = pixmap;
   pixmap_is_opaque_ = false;
+  texture_is_stale_ = false;
+  texture_damaged_region_.clear();
 
   if (pixmap_) {
     XConnection::WindowGeometry geometry;
@@ -651,16 +677,44 @@ void RealCompositor::TexturePixmapActor::SetPixmap(XID pixmap) {
 }
 
 void RealCompositor::TexturePixmapActor::UpdateTexture() {
-  if (texture_data())
-    texture_data()->Refresh();
-
   // Note that culled flag is one frame behind, but it is still valid for the
   // update here, because the stage will be set dirty if object is moving into
-  // or out of view.
-  if (is_shown() && !culled())
+  // or out of view.  Culled actors aren't drawn, so we defer refreshing their
+  // textures until LayerVisitor finds them visible again.
+  if (culled()) {
+    texture_is_stale_ = true;
+    return;
+  }
+
+  RefreshTexture();
+
+  if (is_shown())
     compositor()->SetPartiallyDirty();
 }
 
+void RealCompositor::TexturePixmapActor::RefreshStaleTexture() {
+  if (!texture_is_stale_)
+    return;
+  RefreshTexture();
+}
+
+void RealCompositor::TexturePixmapActor::RefreshTexture() {
+  if (texture_data()) {
+    if (texture_damaged_region_.empty())
+      texture_data()->Refresh();
+    else
+      texture_data()->RefreshRegion(texture_damaged_region_);
+  }
+  texture_damaged_region_.clear();
+  texture_is_stale_ = false;
+}
+
+
+// Project layers to depths between 0 and 1.
+// static
+const float RealCompositor::StageActor::kProjectedDepthMin = 0.0f;
+// static
+const float RealCompositor::StageActor::kProjectedDepthMax = 1.0f;
 
 RealCompositor::StageActor::StageActor(RealCompositor* the_compositor,
                                        XWindow window,
@@ -718,13 +772,15 @@ RealCompositor::RealCompositor(EventLoop* event_loop,
       x_conn_(xconn),
       dirty_(true),
       partially_dirty_(false),
-      num_animations_(0),
       actor_count_(0),
       draw_timeout_id_(-1),
       draw_timeout_enabled_(false),
+      draw_timeout_delay_ms_(0),
+      frame_stats_(TimeDelta::FromMicroseconds(FLAGS_vblank_interval_us)),
       texture_pixmap_actor_uses_fast_path_(true),
       prev_top_fullscreen_actor_(NULL),
-      force_notification_about_top_fullscreen_actor_(false) {
+      force_notification_about_top_fullscreen_actor_(false),
+      animations_started_since_notification_(false) {
   CHECK(event_loop_);
   XWindow root = x_conn()->GetRootWindow();
   XConnection::WindowGeometry geometry;
@@ -757,9 +813,19 @@ RealCompositor::RealCompositor(EventLoop* event_loop,
     texture_pixmap_actor_uses_fast_path_ = false;
 #endif
 
+  if (FLAGS_compositor_frame_clock == "vblank") {
+    frame_clock_.reset(new VblankFrameClock(
+        TimeDelta::FromMicroseconds(FLAGS_vblank_interval_us)));
+  } else {
+    LOG_IF(WARNING, FLAGS_compositor_frame_clock != "timer")
+        << "Unknown frame clock \"" << FLAGS_compositor_frame_clock
+        << "\"; using \"timer\"";
+    frame_clock_.reset(new TimerFrameClock(
+        TimeDelta::FromMilliseconds(FLAGS_draw_timeout_ms)));
+  }
+
   draw_timeout_id_ = event_loop_->AddTimeout(
-      NewPermanentCallback(this, &RealCompositor::Draw), 0,
-      FLAGS_draw_timeout_ms);
+      NewPermanentCallback(this, &RealCompositor::Draw), 0, 0);
   draw_timeout_enabled_ = true;
 }
 
@@ -772,6 +838,16 @@ RealCompositor::~RealCompositor() {
   }
 }
 
+void RealCompositor::SetFrameClock(FrameClock* clock) {
+  DCHECK(clock);
+  frame_clock_.reset(clock);
+  if (draw_timeout_enabled_) {
+    // Reschedule the pending frame using the new clock.
+    draw_timeout_enabled_ = false;
+    EnableDrawTimeout();
+  }
+}
+
 void RealCompositor::RegisterCompositionChangeListener(
       CompositionChangeListener* listener) {
   DCHECK(listener);
@@ -805,7 +881,9 @@ RealCompositor::ImageActor* RealCompositor::CreateImageFromFile(
       ImageContainer::CreateContainerFromFile(filename));
   CHECK(container.get() &&
         container->LoadImage() == ImageContainer::IMAGE_LOAD_SUCCESS);
-  actor->SetImageData(*(container.get()));
+  // Images loaded from files are static, so small ones can share textures.
+  actor->SetImageDataInternal(*(container.get()),
+                              FLAGS_compositor_texture_atlas);
   return actor;
 }
 
@@ -870,36 +948,47 @@ void RealCompositor::UpdateTopFullscreenActor(
     (*it)->HandleTopFullscreenActorChange(top_fullscreen_actor);
 }
 
-void RealCompositor::IncrementNumAnimations() {
-  num_animations_++;
-  if (num_animations_ == 1)
-    EnableDrawTimeout();
+void RealCompositor::HandleAnimationStarted() {
+  animations_started_since_notification_ = true;
+  EnableDrawTimeout();
 }
 
-void RealCompositor::DecrementNumAnimations() {
-  num_animations_--;
-  DCHECK_GE(num_animations_, 0) << "Decrementing animation count below zero";
+void RealCompositor::HandleBufferSwapStarted() {
+  buffer_swap_start_time_ = GetMonotonicTime();
 }
 
 void RealCompositor::Draw() {
-  PROFILER_MARKER_BEGIN(RealCompositor_Draw);
+  PROFILER_STATIC_MARKER_BEGIN(RealCompositor_Draw);
   TimeTicks now = GetMonotonicTime();
-  if (num_animations_ > 0 || dirty_) {
+  FrameStats::FrameTiming timing;
+  timing.start_time = now;
+  TimeTicks phase_start_time = now;
+
+  if (animation_system_.num_animations() > 0 || dirty_) {
+    PROFILER_STATIC_MARKER_BEGIN(RealCompositor_Draw_Update);
+    if (animation_system_.Update(now) > 0)
+      SetDirty();
     actor_count_ = 0;
-    PROFILER_MARKER_BEGIN(RealCompositor_Draw_Update);
-    default_stage_->Update(&actor_count_, now);
-    PROFILER_MARKER_END(RealCompositor_Draw_Update);
+    default_stage_->Update(&actor_count_);
+    PROFILER_MARKER_TAP_WITH_ARG(RealCompositor_Actor_Count, actor_count_);
+    PROFILER_STATIC_MARKER_END(RealCompositor_Draw_Update);
+    const TimeTicks update_end_time = GetMonotonicTime();
+    timing.durations_us[FrameStats::PHASE_UPDATE] =
+        GetDurationUs(phase_start_time, update_end_time);
+    phase_start_time = update_end_time;
   }
 
   if (dirty_ || partially_dirty_) {
-    last_draw_time_ = now;
-
     const bool use_partial_updates = !dirty_ && partially_dirty_;
     LayerVisitor layer_visitor(actor_count(), use_partial_updates);
     default_stage_->Accept(&layer_visitor);
+    const TimeTicks layer_visit_end_time = GetMonotonicTime();
+    timing.durations_us[FrameStats::PHASE_LAYER_VISIT] =
+        GetDurationUs(phase_start_time, layer_visit_end_time);
+    phase_start_time = layer_visit_end_time;
     UpdateTopFullscreenActor(layer_visitor.top_fullscreen_actor());
     force_notification_about_top_fullscreen_actor_ = false;
-    Rect damaged_region = layer_visitor.GetDamagedRegion(
+    Region damaged_region = layer_visitor.GetDamagedRegion(
         default_stage_->width(), default_stage_->height());
 
     // It is possible to receive partially_dirty_ notifications for actors
@@ -908,37 +997,68 @@ void RealCompositor::Draw() {
     // traversed through the tree.
     if ((!use_partial_updates || !damaged_region.empty()) &&
         should_draw_frame()) {
-      PROFILER_MARKER_BEGIN(RealCompositor_Draw_Render);
+      PROFILER_MARKER_BEGIN_WITH_ARG(RealCompositor_Draw_Render,
+                                     use_partial_updates ?
+                                         damaged_region.area() :
+                                         default_stage_->width() *
+                                             default_stage_->height());
       draw_visitor_->set_damaged_region(damaged_region);
       draw_visitor_->set_has_fullscreen_actor(
           layer_visitor.has_fullscreen_actor());
+      buffer_swap_start_time_ = TimeTicks();
       default_stage_->Accept(draw_visitor_.get());
+      const TimeTicks swap_end_time = GetMonotonicTime();
+      frame_clock_->HandleFrameDrawn(now, swap_end_time);
       PROFILER_MARKER_END(RealCompositor_Draw_Render);
+
+      const TimeTicks render_end_time = buffer_swap_start_time_.is_null() ?
+          swap_end_time : buffer_swap_start_time_;
+      timing.durations_us[FrameStats::PHASE_RENDER] =
+          GetDurationUs(phase_start_time, render_end_time);
+      timing.durations_us[FrameStats::PHASE_SWAP] =
+          GetDurationUs(render_end_time, swap_end_time);
+      timing.durations_us[FrameStats::PHASE_TOTAL] =
+          GetDurationUs(now, swap_end_time);
+      frame_stats_.RecordFrame(
+          timing, animation_system_.num_animations() > 0);
     }
     dirty_ = false;
     partially_dirty_ = false;
   }
-  if (num_animations_ == 0)
+
+  // The draw timeout is a one-shot, so it needs to be rearmed for the next
+  // frame if we're animating.
+  if (animation_system_.num_animations() == 0) {
     DisableDrawTimeout();
+    // Listeners may be waiting for the animations to finish before doing
+    // something, so let them know that they have.
+    if (animations_started_since_notification_) {
+      animations_started_since_notification_ = false;
+      for (unordered_set<CompositionChangeListener*>::const_iterator it =
+             composition_change_listeners_.begin();
+           it != composition_change_listeners_.end(); ++it)
+        (*it)->HandleAnimationsFinished();
+    }
+  } else {
+    draw_timeout_enabled_ = false;
+    EnableDrawTimeout();
+  }
 
   // Reset the cached timestamp used for new animations.
   monotonic_time_for_animation_ = TimeTicks();
 
-  PROFILER_MARKER_END(RealCompositor_Draw);
+  PROFILER_STATIC_MARKER_END(RealCompositor_Draw);
 }
 
 void RealCompositor::EnableDrawTimeout() {
   if (!draw_timeout_enabled_) {
-    TimeDelta time_since_draw =
-        !last_draw_time_.is_null() ?
-            GetMonotonicTime() - last_draw_time_ :
-            TimeDelta();
-    int64_t ms_until_draw =
-        max(FLAGS_draw_timeout_ms - time_since_draw.InMilliseconds(),
+    const TimeTicks now = GetMonotonicTime();
+    // Round down: starting a frame slightly early is better than missing
+    // the deadline.
+    draw_timeout_delay_ms_ =
+        max((frame_clock_->GetNextDrawTime(now) - now).InMilliseconds(),
             static_cast<int64_t>(0));
-    event_loop_->ResetTimeout(draw_timeout_id_,
-                              ms_until_draw,
-                              FLAGS_draw_timeout_ms);
+    event_loop_->ResetTimeout(draw_timeout_id_, draw_timeout_delay_ms_, 0);
     draw_timeout_enabled_ = true;
   }
 }
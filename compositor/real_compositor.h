@@ -6,7 +6,6 @@
 #define WINDOW_MANAGER_COMPOSITOR_REAL_COMPOSITOR_H_
 
 #include <list>
-#include <map>
 #include <set>
 #include <string>
 #include <tr1/memory>
@@ -20,7 +19,9 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/time.h"
 #include "window_manager/compositor/animation.h"
+#include "window_manager/compositor/animation_system.h"
 #include "window_manager/compositor/compositor.h"
+#include "window_manager/compositor/frame_stats.h"
 #include "window_manager/math_types.h"
 #include "window_manager/x11/x_types.h"
 
@@ -34,6 +35,7 @@
 namespace window_manager {
 
 class EventLoop;
+class FrameClock;
 class Gles2Interface;
 class GLInterface;
 class OpenGlDrawVisitor;
@@ -117,6 +119,12 @@ class RealCompositor : public Compositor {
     virtual void SetMoveAnimation(AnimationPair* animations);
     virtual void Scale(double scale_x, double scale_y, int duration_ms);
     virtual void SetOpacity(double opacity, int duration_ms);
+    virtual void MoveWithCurve(int x, int y, int duration_ms,
+                               const AnimationCurve& curve);
+    virtual void ScaleWithCurve(double scale_x, double scale_y,
+                                int duration_ms, const AnimationCurve& curve);
+    virtual void SetOpacityWithCurve(double opacity, int duration_ms,
+                                     const AnimationCurve& curve);
     virtual void Show() { SetIsShown(true); }
     virtual void Hide() { SetIsShown(false); }
     virtual void SetTilt(double tilt, int duration_ms);
@@ -135,13 +143,26 @@ class RealCompositor : public Compositor {
 
     virtual Actor* Clone();
 
-    // Updates the actor in response to time passing, and counts the
-    // number of actors as it goes.
-    virtual void Update(int32* count, const base::TimeTicks& now);
+    // Counts the number of actors in this actor's subtree.  Animations are
+    // run separately by the compositor's AnimationSystem.
+    virtual void Update(int32* count);
 
     // Updates the model view matrix associated with this actor.
     virtual void UpdateModelView();
 
+    // Calls UpdateModelView() if the actor's model view matrix has been
+    // marked dirty or if |parent_changed| is true (meaning that the parent's
+    // matrix was just recomputed).  Returns true if the matrix was
+    // recomputed, in which case the matrices of the actor's children also
+    // need to be recomputed.
+    bool UpdateModelViewIfNeeded(bool parent_changed);
+
+    // Marks the model view matrix as needing to be recomputed by the next
+    // call to UpdateModelViewIfNeeded().  This is done automatically when
+    // one of the fields that the matrix is derived from changes.
+    void MarkModelViewDirty() { model_view_dirty_ = true; }
+    bool model_view_dirty() const { return model_view_dirty_; }
+
     // Returns true if the model view matrix applies any transformations
     // beyond those needed to map the actor's origin and dimensions directly
     // to window coordinates at depth z().
@@ -156,13 +177,21 @@ class RealCompositor : public Compositor {
       return ActorVector();
     }
 
-    void set_parent(ContainerActor* parent) { parent_ = parent; }
+    void set_parent(ContainerActor* parent) {
+      parent_ = parent;
+      model_view_dirty_ = true;
+    }
     ContainerActor* parent() const { return parent_; }
     int width() const { return width_; }
     int height() const { return height_; }
     int x() const { return x_; }
     int y() const { return y_; }
-    void set_z(float z) { z_ = z; }
+    void set_z(float z) {
+      if (z == z_)
+        return;
+      z_ = z;
+      model_view_dirty_ = true;
+    }
     float z() const { return z_; }
 
     // Note that is_opaque, culled, and model_view are not valid until after
@@ -208,6 +237,7 @@ class RealCompositor : public Compositor {
     void SetSizeInternal(int width, int height) {
       width_ = width;
       height_ = height;
+      model_view_dirty_ = true;
       SetDirty();
     }
 
@@ -222,11 +252,11 @@ class RealCompositor : public Compositor {
     void set_has_children(bool has_children) { has_children_ = has_children; }
 
    private:
-    // Animate one of this actor's fields moving to a new value.
-    // |animation_map| is |&int_animations_| or |&float_animations_|.
+    // Animate one of this actor's fields moving to a new value along
+    // |curve|.
     template<class T> void AnimateField(
-        std::map<T*, std::tr1::shared_ptr<Animation> >* animation_map,
-        T* field, T value, const base::TimeDelta& duration);
+        T* field, T value, const base::TimeDelta& duration,
+        const AnimationCurve& curve);
 
     // Create a new animation for a field and return it.
     // The animation starts at the current time with the field's current value.
@@ -234,24 +264,28 @@ class RealCompositor : public Compositor {
     template<class T> Animation* CreateAnimationForField(T* field);
 
     // Use an already-constructed animation for |field|.  Takes ownership of
-    // |animation|.  |animation_map| is |&int_animations_| or
-    // |&float_animations_|.
+    // |animation|.
     template<class T> void SetAnimationForField(
-        std::map<T*, std::tr1::shared_ptr<Animation> >* animation_map,
-        T* field,
-        Animation* new_animation);
+        T* field, Animation* new_animation);
 
-    // Helper method called by Update() for |int_animations_| and
-    // |float_animations_|.  Goes through the passed-in map, calling each
-    // animation's IsDone() and GetValue() methods and deleting it if it's done.
-    template<class T> void UpdateInternal(
-        std::map<T*, std::tr1::shared_ptr<Animation> >* animation_map,
-        const base::TimeTicks& now);
+    // Get the flag that the compositor's AnimationSystem should set when it
+    // updates |field|.
+    bool* GetDirtyFlagForField(const void* field) {
+      return AffectsModelView(field) ? &model_view_dirty_ : NULL;
+    }
 
     // Is this actor in a visibility group that's currently being drawn (or
     // are visibility groups disabled in the compositor)?
     bool IsInActiveVisibilityGroup() const;
 
+    // Is |field| one of the fields that the model view matrix is derived
+    // from?
+    bool AffectsModelView(const void* field) const {
+      return field == &x_ || field == &y_ || field == &z_ ||
+             field == &width_ || field == &height_ ||
+             field == &scale_x_ || field == &scale_y_ || field == &tilt_;
+    }
+
     RealCompositor* compositor_;
 
     // Parent containing this actor.
@@ -287,6 +321,10 @@ class RealCompositor : public Compositor {
     // changes and it can be reused.
     Matrix4 model_view_;
 
+    // Does |model_view_| need to be recomputed?  Set when the actor's
+    // position, size, scale, tilt, depth or parent changes.
+    bool model_view_dirty_;
+
     // Calculated during the layer visitor pass, and used to determine
     // if this object is opaque for traversal purposes.
     bool is_opaque_;
@@ -306,10 +344,6 @@ class RealCompositor : public Compositor {
     // Name used for identifying the actor (useful for debugging).
     std::string name_;
 
-    // Map from the address of a field to the animation that is modifying it.
-    std::map<int*, std::tr1::shared_ptr<Animation> > int_animations_;
-    std::map<float*, std::tr1::shared_ptr<Animation> > float_animations_;
-
     // IDs of visibility groups this actor is a member of.
     std::set<int> visibility_groups_;
 
@@ -354,7 +388,7 @@ class RealCompositor : public Compositor {
     // End Compositor::ContainerActor methods.
 
     void RemoveActor(Compositor::Actor* actor);
-    virtual void Update(int32* count, const base::TimeTicks& now);
+    virtual void Update(int32* count);
 
     // Raise one child over another.  Raise to top if "above" is NULL.
     void RaiseChild(RealCompositor::Actor* child,
@@ -396,6 +430,28 @@ class RealCompositor : public Compositor {
 
     virtual Actor* Clone();
 
+    // Bounding box of the quad in GL coordinates, where (-1, -1) is the
+    // bottom left of the stage and (1, 1) is the top right, along with
+    // whether the quad exactly fills it.  LayerVisitor computes this when
+    // it updates the model view matrix and reuses it on frames where the
+    // matrix doesn't change.
+    struct GlBounds {
+      GlBounds()
+          : x_min(0.f),
+            x_max(0.f),
+            y_min(0.f),
+            y_max(0.f),
+            is_axis_aligned(false) {}
+
+      float x_min;
+      float x_max;
+      float y_min;
+      float y_max;
+      bool is_axis_aligned;
+    };
+    const GlBounds& gl_bounds() const { return gl_bounds_; }
+    void set_gl_bounds(const GlBounds& bounds) { gl_bounds_ = bounds; }
+
    protected:
     explicit QuadActor(RealCompositor* compositor);
 
@@ -412,6 +468,9 @@ class RealCompositor : public Compositor {
     // Texture drawn on the quad, or NULL if none should be drawn.
     std::tr1::shared_ptr<TextureData> texture_data_;
 
+    // Cached bounds computed by LayerVisitor.
+    GlBounds gl_bounds_;
+
     DISALLOW_COPY_AND_ASSIGN(QuadActor);
   };
 
@@ -461,6 +520,13 @@ class RealCompositor : public Compositor {
     virtual void SetImageData(const ImageContainer& image_container);
     // End Compositor::ImageActor methods.
 
+    // Like SetImageData(), but if |use_atlas| is true, tries to pack the
+    // image into the draw visitor's texture atlas instead of giving it its
+    // own texture.  Atlas space is never reclaimed, so this should only be
+    // used for static images.
+    void SetImageDataInternal(const ImageContainer& image_container,
+                              bool use_atlas);
+
     // Implement VisitorDestination for visitor.
     virtual void Accept(ActorVisitor* visitor) {
       CHECK(visitor);
@@ -504,27 +570,44 @@ class RealCompositor : public Compositor {
       NOTIMPLEMENTED();
     }
     virtual void ClearAlphaMask() { NOTIMPLEMENTED(); }
-    virtual const Rect& GetDamagedRegion() const { return damaged_region_; }
+    virtual const Region& GetDamagedRegion() const { return damaged_region_; }
     virtual void MergeDamagedRegion(const Rect& region) {
       damaged_region_.merge(region);
+      damaged_region_.simplify(kMaxDamagedRects);
+      texture_damaged_region_.merge(region);
+      texture_damaged_region_.simplify(kMaxDamagedRects);
     }
-    virtual void ResetDamagedRegion() {
-      damaged_region_.reset(0, 0, 0, 0);
-    }
+    virtual void ResetDamagedRegion() { damaged_region_.clear(); }
     // End Compositor::TexturePixmapActor methods.
 
+    // Refresh the texture if UpdateTexture() skipped doing so while the
+    // actor was culled.  Called by LayerVisitor once the actor is visible.
+    void RefreshStaleTexture();
+
    private:
     FRIEND_TEST(RealCompositorTest, HandleXEvents);
 
+    // Refresh the texture using |texture_damaged_region_| (or all of the
+    // pixmap if no damage has been reported) and clear the region.
+    void RefreshTexture();
+
     // Offscreen X pixmap whose contents we're displaying.
     XID pixmap_;
 
     // Is |pixmap_| opaque (i.e. it has a non-32-bit depth)?
     bool pixmap_is_opaque_;
 
-    // Rectangle bounding all not-yet-composited regions reported by Damage
-    // events.
-    Rect damaged_region_;
+    // Has the pixmap changed since the texture was last refreshed?
+    bool texture_is_stale_;
+
+    // Not-yet-composited regions reported by Damage events.
+    Region damaged_region_;
+
+    // Regions reported by Damage events that haven't been copied to the
+    // texture yet.  Unlike |damaged_region_|, this isn't reset when the
+    // actor is drawn, so it also accumulates damage while we're skipping
+    // texture updates for a culled actor.
+    Region texture_damaged_region_;
 
     DISALLOW_COPY_AND_ASSIGN(TexturePixmapActor);
   };
@@ -532,6 +615,11 @@ class RealCompositor : public Compositor {
   class StageActor : public RealCompositor::ContainerActor,
                      public Compositor::StageActor {
    public:
+    // Range of actor z values that the projection maps to depths between the
+    // near and far planes.  LayerVisitor assigns depths within this range.
+    static const float kProjectedDepthMin;
+    static const float kProjectedDepthMax;
+
     StageActor(RealCompositor* compositor, XWindow window,
                int width, int height);
     virtual ~StageActor();
@@ -624,6 +712,10 @@ class RealCompositor : public Compositor {
   virtual void SetActiveVisibilityGroups(
       const std::tr1::unordered_set<int>& groups);
   virtual void ForceDraw();
+  virtual const FrameStats* GetFrameStats() const { return &frame_stats_; }
+  virtual bool HasActiveAnimations() const {
+    return animation_system_.num_animations() > 0;
+  }
   // End Compositor methods
 
   XConnection* x_conn() { return x_conn_; }
@@ -637,7 +729,9 @@ class RealCompositor : public Compositor {
   XRenderDrawVisitor* draw_visitor() { return draw_visitor_.get(); }
 #endif
   int actor_count() { return actor_count_; }
+  AnimationSystem* animation_system() { return &animation_system_; }
   bool dirty() const { return dirty_; }
+  bool partially_dirty() const { return partially_dirty_; }
   bool using_visibility_groups() const {
     return !active_visibility_groups_.empty();
   }
@@ -648,6 +742,10 @@ class RealCompositor : public Compositor {
   // These accessors are present for testing.
   int draw_timeout_id() const { return draw_timeout_id_; }
   bool draw_timeout_enabled() const { return draw_timeout_enabled_; }
+  int64_t draw_timeout_delay_ms() const { return draw_timeout_delay_ms_; }
+
+  // Replace the clock used to schedule frames.  Takes ownership of |clock|.
+  void SetFrameClock(FrameClock* clock);
 
   void AddActor(Actor* actor) { actors_.push_back(actor); }
   void RemoveActor(Actor* actor);
@@ -663,11 +761,14 @@ class RealCompositor : public Compositor {
   // listeners if necessary.
   void UpdateTopFullscreenActor(const TexturePixmapActor* top_fullscreen_actor);
 
-  // Increment or decrement the number of in-progress actors.  This is
-  // invoked by Actor as animations start or stop.  The increment method
-  // enables the draw timeout if needed.
-  void IncrementNumAnimations();
-  void DecrementNumAnimations();
+  // Invoked by Actor after it adds an animation to |animation_system_|.
+  // Enables the draw timeout if needed.
+  void HandleAnimationStarted();
+
+  // Invoked by the draw visitor when it's done rendering a frame and is
+  // about to swap buffers, so that |frame_stats_| can time the two
+  // separately.
+  void HandleBufferSwapStarted();
 
  private:
   friend class BasicCompositingTest;  // calls Draw()
@@ -681,7 +782,8 @@ class RealCompositor : public Compositor {
   void Draw();
 
   // Enable or disable the draw timeout.  Safe to call if it's already
-  // enabled/disabled.
+  // enabled/disabled.  The timeout is a one-shot that's armed to fire at
+  // the time requested by |frame_clock_|.
   void EnableDrawTimeout();
   void DisableDrawTimeout();
 
@@ -697,8 +799,9 @@ class RealCompositor : public Compositor {
   // This indicates if part of the scene is dirty and needs partial updates.
   bool partially_dirty_;
 
-  // Total number of in-progress animations.
-  int num_animations_;
+  // In-progress animations of actors' fields.  This must outlive the
+  // actors, which cancel their animations when they're destroyed.
+  AnimationSystem animation_system_;
 
   // This is the list of actors to display.
   ActorVector actors_;
@@ -719,15 +822,25 @@ class RealCompositor : public Compositor {
   scoped_ptr<XRenderDrawVisitor> draw_visitor_;
 #endif
 
-  // Time that we last drew the scene.
-  base::TimeTicks last_draw_time_;
-
   // ID of the event loop timeout used to invoke Draw().
   int draw_timeout_id_;
 
   // Is the drawing timeout currently enabled?
   bool draw_timeout_enabled_;
 
+  // Delay that the draw timeout was most recently armed with.
+  int64_t draw_timeout_delay_ms_;
+
+  // Decides when the next frame should be drawn.
+  scoped_ptr<FrameClock> frame_clock_;
+
+  // Timing of recently-drawn frames.
+  FrameStats frame_stats_;
+
+  // Time at which the draw visitor started swapping buffers for the frame
+  // that's currently being drawn.  Null if it hasn't yet.
+  base::TimeTicks buffer_swap_start_time_;
+
   // Actor visibility groups that we're currently going to draw.  If empty,
   // we're not using visibility groups and just draw all actors.
   std::tr1::unordered_set<int> active_visibility_groups_;
@@ -755,6 +868,10 @@ class RealCompositor : public Compositor {
   // if the top fullscreen actor hasn't changed.
   bool force_notification_about_top_fullscreen_actor_;
 
+  // Has an animation been started since we last notified
+  // CompositionChangeListeners that all animations had finished?
+  bool animations_started_since_notification_;
+
   // Listeners that will be notified when the screen area consumed by the
   // actors changes.  Listener objects aren't owned by us.
   std::tr1::unordered_set<CompositionChangeListener*>
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdarg>
+#include <ctime>
 #include <string>
 #include <tr1/unordered_set>
 #include <vector>
@@ -16,10 +17,15 @@
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "window_manager/compositor/compositor.h"
+#include "window_manager/compositor/frame_clock.h"
+#include "window_manager/compositor/frame_stats.h"
 #include "window_manager/compositor/gl/mock_gl_interface.h"
 #include "window_manager/compositor/layer_visitor.h"
 #include "window_manager/compositor/real_compositor.h"
+#include "window_manager/compositor/texture_data.h"
+#include "window_manager/counters.h"
 #include "window_manager/event_loop.h"
+#include "window_manager/region.h"
 #include "window_manager/test_lib.h"
 #include "window_manager/util.h"
 #include "window_manager/x11/mock_x_connection.h"
@@ -27,6 +33,8 @@
 DEFINE_bool(logtostderr, false,
             "Print debugging messages to stderr (suppressed otherwise)");
 
+DECLARE_COUNTER(Compositor_CulledActors);
+
 using std::set;
 using std::string;
 using std::tr1::unordered_set;
@@ -37,6 +45,13 @@ using window_manager::util::SetMonotonicTimeForTest;
 
 namespace window_manager {
 
+// Returns the CPU time consumed by the current thread, in microseconds.
+static int64_t GetThreadCpuTimeUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 class NameCheckVisitor : virtual public RealCompositor::ActorVisitor {
  public:
   NameCheckVisitor() {}
@@ -56,18 +71,21 @@ class RealCompositorTreeTest : public BasicCompositingTreeTest {};
 TEST_F(RealCompositorTreeTest, Culling) {
   // Test lower-level layer-setting routines
   int32 count = 0;
-  stage_->Update(&count, GetMonotonicTime());
+  stage_->Update(&count);
   EXPECT_EQ(8, count);
   RealCompositor::ActorVector actors;
 
   // First we test the layer visitor directly.
+  Counter::ResetAllCounters();
   LayerVisitor layer_visitor(count, false);
   stage_->Accept(&layer_visitor);
 
-  // rect3 is fullscreen and opaque, so rect2 and rect1 are culled.
+  // rect3 is fullscreen and opaque, so rect2 and rect1 are culled.  Each
+  // of them should be counted once.
   EXPECT_TRUE(layer_visitor.has_fullscreen_actor());
   EXPECT_TRUE(rect2_->culled());
   EXPECT_TRUE(rect1_->culled());
+  EXPECT_EQ(2, COUNTER_Compositor_CulledActors.value());
 
   // Now we test higher-level layer depth results.
   Draw();
@@ -82,7 +100,7 @@ TEST_F(RealCompositorTreeTest, CullingOpacity) {
 
   // Test lower-level layer-setting routines
   int32 count = 0;
-  stage_->Update(&count, GetMonotonicTime());
+  stage_->Update(&count);
   EXPECT_EQ(8, count);
   RealCompositor::ActorVector actors;
 
@@ -102,6 +120,144 @@ TEST_F(RealCompositorTreeTest, CullingOpacity) {
   EXPECT_TRUE(rect1_->culled());
 }
 
+// Test that actors that are covered by opaque non-fullscreen actors get
+// culled.
+TEST_F(RealCompositorTest, OcclusionCulling) {
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  stage->SetSize(1366, 768);
+
+  // Add a box and then another one with the same bounds on top of it.
+  scoped_ptr<RealCompositor::ColoredBoxActor> bottom(
+      compositor_->CreateColoredBox(200, 200, Compositor::Color()));
+  bottom->Move(100, 100, 0);
+  stage->AddActor(bottom.get());
+  scoped_ptr<RealCompositor::ColoredBoxActor> top(
+      compositor_->CreateColoredBox(200, 200, Compositor::Color()));
+  top->Move(100, 100, 0);
+  stage->AddActor(top.get());
+  Draw();
+  EXPECT_TRUE(bottom->culled());
+  EXPECT_FALSE(top->culled());
+
+  // After sliding the top box to the right, the bottom one is visible.
+  top->Move(150, 100, 0);
+  Draw();
+  EXPECT_FALSE(bottom->culled());
+
+  // Covering the rest of the bottom box with a third box should cull it
+  // again, since the two boxes above it cover it together.
+  scoped_ptr<RealCompositor::ColoredBoxActor> left(
+      compositor_->CreateColoredBox(50, 200, Compositor::Color()));
+  left->Move(100, 100, 0);
+  stage->AddActor(left.get());
+  Draw();
+  EXPECT_TRUE(bottom->culled());
+
+  // Translucent actors don't occlude anything...
+  left->SetOpacity(0.5f, 0);
+  Draw();
+  EXPECT_FALSE(bottom->culled());
+
+  // ... and neither do opaque actors in translucent groups.
+  left->SetOpacity(1.0f, 0);
+  stage->RemoveActor(left.get());
+  scoped_ptr<RealCompositor::ContainerActor> group(
+      compositor_->CreateGroup());
+  group->AddActor(left.get());
+  group->SetOpacity(0.5f, 0);
+  stage->AddActor(group.get());
+  Draw();
+  EXPECT_FALSE(bottom->culled());
+
+  group->SetOpacity(1.0f, 0);
+  Draw();
+  EXPECT_TRUE(bottom->culled());
+
+  // Tilted actors don't fill their bounding boxes, so they don't occlude
+  // the actors behind them either.
+  top->SetTilt(0.5f, 0);
+  Draw();
+  EXPECT_FALSE(bottom->culled());
+}
+
+// TextureData implementation that just counts how many times it's been
+// refreshed.
+class CountingTextureData : public TextureData {
+ public:
+  CountingTextureData() : num_refreshes_(0) {}
+  virtual ~CountingTextureData() {}
+
+  int num_refreshes() const { return num_refreshes_; }
+  virtual void Refresh() { num_refreshes_++; }
+
+ private:
+  int num_refreshes_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingTextureData);
+};
+
+// Test that we don't refresh the textures of culled actors until they
+// become visible again.
+TEST_F(RealCompositorTest, SkipTextureUpdatesForCulledActors) {
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  stage->SetSize(1366, 768);
+
+  XWindow xid = xconn_->CreateWindow(
+      xconn_->GetRootWindow(),  // parent
+      Rect(0, 0, 200, 200),
+      false,      // override_redirect=false
+      false,      // input_only=false
+      0, 0);      // event_mask, visual
+  scoped_ptr<RealCompositor::TexturePixmapActor> actor(
+      dynamic_cast<RealCompositor::TexturePixmapActor*>(
+          compositor_->CreateTexturePixmap()));
+  CHECK(actor.get());
+  actor->SetPixmap(xconn_->GetCompositingPixmapForWindow(xid));
+  actor->Move(100, 100, 0);
+  stage->AddActor(actor.get());
+  CountingTextureData* texture_data = new CountingTextureData;
+  actor->set_texture_data(texture_data);
+
+  // Cover the actor with a box.
+  scoped_ptr<RealCompositor::ColoredBoxActor> box(
+      compositor_->CreateColoredBox(300, 300, Compositor::Color()));
+  box->Move(50, 50, 0);
+  stage->AddActor(box.get());
+  Draw();
+  ASSERT_TRUE(actor->culled());
+
+  // Updating the texture while the actor is covered shouldn't refresh it or
+  // trigger a redraw.
+  actor->MergeDamagedRegion(Rect(0, 0, 20, 20));
+  actor->UpdateTexture();
+  actor->MergeDamagedRegion(Rect(20, 20, 20, 20));
+  actor->UpdateTexture();
+  EXPECT_EQ(0, texture_data->num_refreshes());
+  EXPECT_FALSE(compositor_->dirty());
+  EXPECT_FALSE(compositor_->partially_dirty());
+
+  // Drawing other changes while the actor is still covered shouldn't
+  // refresh its stale texture either.
+  compositor_->SetDirty();
+  Draw();
+  EXPECT_TRUE(actor->culled());
+  EXPECT_EQ(0, texture_data->num_refreshes());
+
+  // When the box moves out of the way, the texture should be refreshed
+  // once before the actor is drawn.
+  box->Move(500, 50, 0);
+  Draw();
+  EXPECT_FALSE(actor->culled());
+  EXPECT_EQ(1, texture_data->num_refreshes());
+
+  // Visible actors should be refreshed immediately.
+  actor->UpdateTexture();
+  EXPECT_EQ(2, texture_data->num_refreshes());
+  EXPECT_TRUE(compositor_->partially_dirty());
+  Draw();
+  EXPECT_EQ(2, texture_data->num_refreshes());
+}
+
 TEST_F(RealCompositorTreeTest, ActorVisitor) {
   NameCheckVisitor visitor;
   stage_->Accept(&visitor);
@@ -398,9 +554,211 @@ TEST_F(RealCompositorTest, DrawTimeout) {
   Draw();
   EXPECT_FALSE(compositor_->draw_timeout_enabled());
 
+  // Deleting an actor in the middle of an animation should cancel the
+  // animation, so we stop drawing after the next frame.
+  actor.reset(compositor_->CreateColoredBox(1, 1, Compositor::Color()));
+  compositor_->GetDefaultStage()->AddActor(actor.get());
+  actor->MoveX(300, 100);
+  EXPECT_EQ(1U, compositor_->animation_system()->num_animations());
+  actor.reset();
+  EXPECT_EQ(0U, compositor_->animation_system()->num_animations());
+  Draw();
+  EXPECT_FALSE(compositor_->draw_timeout_enabled());
+
   // TODO: Test the durations that we set for for the timeout.
 }
 
+// CompositionChangeListener implementation that counts how many times it's
+// been told that animations have finished.
+class AnimationsFinishedListener : public CompositionChangeListener {
+ public:
+  AnimationsFinishedListener() : num_notifications_(0) {}
+  virtual ~AnimationsFinishedListener() {}
+
+  int num_notifications() const { return num_notifications_; }
+
+  virtual void HandleTopFullscreenActorChange(
+      const Compositor::TexturePixmapActor* top_fullscreen_actor) {}
+  virtual void HandleAnimationsFinished() { num_notifications_++; }
+
+ private:
+  int num_notifications_;
+
+  DISALLOW_COPY_AND_ASSIGN(AnimationsFinishedListener);
+};
+
+// Test that listeners are notified once the last animation has finished.
+TEST_F(RealCompositorTest, NotifyWhenAnimationsFinish) {
+  int64_t now = 1000;  // arbitrary
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  AnimationsFinishedListener listener;
+  compositor_->RegisterCompositionChangeListener(&listener);
+
+  scoped_ptr<RealCompositor::Actor> actor(
+      compositor_->CreateColoredBox(1, 1, Compositor::Color()));
+  compositor_->GetDefaultStage()->AddActor(actor.get());
+  Draw();
+  EXPECT_EQ(0, listener.num_notifications());
+
+  // We shouldn't hear anything while animations are still running.
+  actor->MoveX(300, 100);
+  actor->MoveY(400, 200);
+  now += 150;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  EXPECT_TRUE(compositor_->HasActiveAnimations());
+  EXPECT_EQ(0, listener.num_notifications());
+
+  now += 100;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  EXPECT_FALSE(compositor_->HasActiveAnimations());
+  EXPECT_EQ(1, listener.num_notifications());
+
+  // Frames drawn without animations shouldn't send more notifications.
+  actor->Move(0, 0, 0);
+  Draw();
+  EXPECT_EQ(1, listener.num_notifications());
+
+  // Animations that are cancelled before they're drawn should still
+  // result in a notification.
+  actor->MoveX(300, 100);
+  actor.reset();
+  Draw();
+  EXPECT_EQ(2, listener.num_notifications());
+
+  compositor_->UnregisterCompositionChangeListener(&listener);
+  SetMonotonicTimeForTest(base::TimeTicks());
+}
+
+// Test that drawn frames are recorded in the compositor's frame stats.
+TEST_F(RealCompositorTest, FrameStats) {
+  int64_t now = 1000;  // arbitrary
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  const FrameStats* stats = compositor_->GetFrameStats();
+  const int64_t initial_frames = stats->num_frames();
+
+  // Drawing when nothing has changed shouldn't record a frame.
+  Draw();
+  EXPECT_EQ(initial_frames, stats->num_frames());
+
+  scoped_ptr<RealCompositor::Actor> actor(
+      compositor_->CreateColoredBox(1, 1, Compositor::Color()));
+  compositor_->GetDefaultStage()->AddActor(actor.get());
+  actor->MoveX(100, 50);
+  Draw();
+  EXPECT_EQ(initial_frames + 1, stats->num_frames());
+
+  // The next frame follows an animated one, so its interval is recorded.
+  now += 16;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  EXPECT_EQ(initial_frames + 2, stats->num_frames());
+  EXPECT_EQ(16000, stats->GetPercentileUs(FrameStats::PHASE_INTERVAL, 100));
+  EXPECT_EQ(0, stats->num_janky_frames());
+}
+
+// Test that actors can be animated along other curves and that a spring
+// animation can be retargeted while it's running.
+TEST_F(RealCompositorTest, MoveWithCurve) {
+  int64_t now = 1000;  // arbitrary
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  scoped_ptr<RealCompositor::Actor> actor(
+      compositor_->CreateColoredBox(1, 1, Compositor::Color()));
+  compositor_->GetDefaultStage()->AddActor(actor.get());
+  Draw();
+
+  actor->MoveWithCurve(100, 0, 100, AnimationCurve::Linear());
+  now += 25;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  EXPECT_EQ(25, actor->GetX());
+
+  // Retarget the X animation with a spring.  The unchanged Y position
+  // shouldn't be animated.
+  actor->MoveWithCurve(200, 0, 100, AnimationCurve::Spring());
+  actor->MoveWithCurve(300, 0, 100, AnimationCurve::Spring());
+  EXPECT_EQ(1U, compositor_->animation_system()->num_animations());
+  now += 50;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  EXPECT_GT(actor->GetX(), 250);
+  EXPECT_LT(actor->GetX(), 300);
+
+  now += 50;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  EXPECT_EQ(300, actor->GetX());
+  EXPECT_EQ(0, actor->GetY());
+  EXPECT_FALSE(compositor_->draw_timeout_enabled());
+
+  actor->ScaleWithCurve(0.5, 0.5, 100, AnimationCurve::EaseIn());
+  actor->SetOpacityWithCurve(0.5, 100, AnimationCurve::EaseOut());
+  EXPECT_EQ(3U, compositor_->animation_system()->num_animations());
+  now += 50;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  Draw();
+  // Ease-in falls behind a linear curve halfway through, while ease-out
+  // gets ahead of it.
+  EXPECT_GT(actor->GetXScale(), 0.75);
+  EXPECT_LT(actor->GetOpacity(), 0.75);
+}
+
+// Test that the draw timeout is armed with the delays requested by the frame
+// clock, using the event loop to run the timeout.
+TEST_F(RealCompositorTest, DrawTimeoutUsesFrameClock) {
+  int64_t now = 1000;  // arbitrary
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  event_loop_->RunTimeoutForTesting(compositor_->draw_timeout_id());
+  EXPECT_FALSE(compositor_->draw_timeout_enabled());
+
+  // With the default timer-based clock, a change 5 ms after the last frame
+  // should be drawn once --draw_timeout_ms has passed.
+  now += 5;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  scoped_ptr<RealCompositor::Actor> actor(
+      compositor_->CreateColoredBox(1, 1, Compositor::Color()));
+  compositor_->GetDefaultStage()->AddActor(actor.get());
+  EXPECT_TRUE(compositor_->draw_timeout_enabled());
+  EXPECT_EQ(11, compositor_->draw_timeout_delay_ms());
+
+  now += 11;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  event_loop_->RunTimeoutForTesting(compositor_->draw_timeout_id());
+  EXPECT_FALSE(compositor_->draw_timeout_enabled());
+
+  // Switch to a vblank-driven clock with a 16 ms refresh.  Its first frame
+  // is drawn immediately and establishes the vblank phase.
+  compositor_->SetFrameClock(
+      new VblankFrameClock(base::TimeDelta::FromMilliseconds(16)));
+  actor->Move(10, 10, 0);
+  EXPECT_TRUE(compositor_->draw_timeout_enabled());
+  EXPECT_EQ(0, compositor_->draw_timeout_delay_ms());
+  event_loop_->RunTimeoutForTesting(compositor_->draw_timeout_id());
+  const int64_t vblank = now;
+
+  // An animation started 3 ms later should wait until just before the next
+  // vblank, leaving room for the deadline margin (drawing takes no time
+  // here, since the clock doesn't advance).
+  now += 3;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  actor->MoveX(300, 100);
+  EXPECT_TRUE(compositor_->draw_timeout_enabled());
+  const int64_t margin_ms = VblankFrameClock::kDeadlineMarginUs / 1000;
+  EXPECT_EQ(vblank + 16 - margin_ms - now,
+            compositor_->draw_timeout_delay_ms());
+
+  // After drawing that frame, the timeout should be rearmed for the
+  // following vblank since the animation is still running.
+  now = vblank + 16 - margin_ms;
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(now));
+  event_loop_->RunTimeoutForTesting(compositor_->draw_timeout_id());
+  EXPECT_TRUE(compositor_->draw_timeout_enabled());
+  EXPECT_GT(compositor_->draw_timeout_delay_ms(), 0);
+  EXPECT_LE(compositor_->draw_timeout_delay_ms(), 16);
+}
+
 // Test that we replace existing animations rather than creating
 // overlapping animations for the same field.
 TEST_F(RealCompositorTest, ReplaceAnimations) {
@@ -616,6 +974,67 @@ TEST_F(RealCompositorTest, PartialUpdates) {
   EXPECT_LE(expected_max_y, updated_region.y + updated_region.height);
 }
 
+// Test that damage in opposite corners of the screen is redrawn as separate
+// rectangles instead of a single bounding box covering most of the screen.
+TEST_F(RealCompositorTest, PartialUpdatesWithMultipleRects) {
+  const int stage_width = 1366;
+  const int stage_height = 768;
+  compositor_->GetDefaultStage()->SetSize(stage_width, stage_height);
+
+  scoped_ptr<Compositor::TexturePixmapActor> actor(
+      compositor_->CreateTexturePixmap());
+  RealCompositor::TexturePixmapActor* cast_actor =
+      dynamic_cast<RealCompositor::TexturePixmapActor*>(actor.get());
+  CHECK(cast_actor);
+  cast_actor->Show();
+  compositor_->GetDefaultStage()->AddActor(cast_actor);
+
+  XWindow xid = xconn_->CreateWindow(
+      xconn_->GetRootWindow(),  // parent
+      Rect(0, 0, stage_width, stage_height),
+      false,      // override_redirect=false
+      false,      // input_only=false
+      0, 0);      // event_mask, visual
+  cast_actor->SetPixmap(xconn_->GetCompositingPixmapForWindow(xid));
+  Draw();
+  EXPECT_FALSE(compositor_->dirty());
+
+  // Damage a small area in the top-left corner and another one in the
+  // bottom-right corner.  Their bounding box would cover more than half of
+  // the screen, so without multi-rect damage we'd do a full update.
+  const Rect top_left_damage(4, 4, 10, 16);
+  const Rect bottom_right_damage(stage_width - 60, stage_height - 20, 50, 8);
+  cast_actor->MergeDamagedRegion(top_left_damage);
+  cast_actor->MergeDamagedRegion(bottom_right_damage);
+  EXPECT_EQ(2U, cast_actor->GetDamagedRegion().num_rects());
+  compositor_->SetPartiallyDirty();
+
+  const int full_updates_count = gl_->full_updates_count();
+  const int partial_updates_count = gl_->partial_updates_count();
+  Draw();
+  EXPECT_EQ(full_updates_count, gl_->full_updates_count());
+  EXPECT_EQ(partial_updates_count + 2, gl_->partial_updates_count());
+  EXPECT_TRUE(cast_actor->GetDamagedRegion().empty());
+
+  // Each of the copied rects should cover one of the damaged areas (after
+  // flipping them to GL's bottom-left origin), and together they should be
+  // much smaller than the bounding box.
+  Region copied_region;
+  const vector<Rect>& copied_rects = gl_->partial_updates_regions();
+  ASSERT_GE(copied_rects.size(), 2U);
+  copied_region.merge(copied_rects[copied_rects.size() - 2]);
+  copied_region.merge(copied_rects[copied_rects.size() - 1]);
+  EXPECT_TRUE(copied_region.contains_rect(
+      Rect(top_left_damage.x,
+           stage_height - top_left_damage.bottom(),
+           top_left_damage.width, top_left_damage.height)));
+  EXPECT_TRUE(copied_region.contains_rect(
+      Rect(bottom_right_damage.x,
+           stage_height - bottom_right_damage.bottom(),
+           bottom_right_damage.width, bottom_right_damage.height)));
+  EXPECT_LT(copied_region.area(), 1000U);
+}
+
 // Test LayerVisitor's top fullscreen window.
 TEST_F(RealCompositorTest, LayerVisitorTopFullscreenWindow) {
   // Now create texture pixmap actors and add them to the stage.
@@ -750,6 +1169,147 @@ TEST_F(RealCompositorTest, SynchronizeAnimations) {
   EXPECT_EQ(kSrcX, actor2->GetX());
 }
 
+// Check that LayerVisitor only recomputes the model view matrices of actors
+// whose transforms (or whose ancestors' transforms) have changed.
+TEST_F(RealCompositorTest, IncrementalModelViewUpdates) {
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  scoped_ptr<RealCompositor::ContainerActor> group(compositor_->CreateGroup());
+  stage->AddActor(group.get());
+  scoped_ptr<RealCompositor::ColoredBoxActor> child1(
+      compositor_->CreateColoredBox(10, 10, Compositor::Color()));
+  scoped_ptr<RealCompositor::ColoredBoxActor> child2(
+      compositor_->CreateColoredBox(10, 10, Compositor::Color()));
+  group->AddActor(child1.get());
+  group->AddActor(child2.get());
+  child2->Move(20, 0, 0);
+  scoped_ptr<RealCompositor::ColoredBoxActor> box(
+      compositor_->CreateColoredBox(10, 10, Compositor::Color()));
+  stage->AddActor(box.get());
+  box->Move(0, 50, 0);
+
+  // Everything needs to be computed the first time.
+  int32 count = 0;
+  stage->Update(&count);
+  LayerVisitor layer_visitor(count, false);
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(count, layer_visitor.num_model_view_updates());
+
+  // Nothing has changed, so nothing should be recomputed.
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(0, layer_visitor.num_model_view_updates());
+
+  // Moving a quad should only update it.
+  box->Move(5, 50, 0);
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(1, layer_visitor.num_model_view_updates());
+
+  // Changing the opacity doesn't affect the transform.
+  box->SetOpacity(0.5, 0);
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(0, layer_visitor.num_model_view_updates());
+
+  // Moving the group should update it and both of its children.
+  group->Move(100, 0, 0);
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(3, layer_visitor.num_model_view_updates());
+  EXPECT_FLOAT_EQ(120.f, child2->model_view()[3][0]);
+
+  // If a child is hidden when its parent moves, it should still pick up the
+  // change once it's shown again.
+  child2->Hide();
+  group->Move(200, 0, 0);
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(2, layer_visitor.num_model_view_updates());
+  // child1 is also updated, since child2 takes up a layer in front of it
+  // again and pushes it back.
+  child2->Show();
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(2, layer_visitor.num_model_view_updates());
+  EXPECT_FLOAT_EQ(220.f, child2->model_view()[3][0]);
+
+  // Resizing the stage changes the projection, so everything's bounds need
+  // to be recomputed.
+  stage->SetSize(stage->width() + 10, stage->height());
+  stage->Accept(&layer_visitor);
+  EXPECT_EQ(count, layer_visitor.num_model_view_updates());
+}
+
+// Measure the per-frame CPU time spent updating and laying out trees of
+// various sizes in which a single actor is animating, both with incremental
+// model view updates and with every matrix recomputed on each frame.  Run
+// with --logtostderr to see the results.
+TEST_F(RealCompositorTest, ModelViewBenchmark) {
+  static const int kTreeSizes[] = { 50, 200, 1000 };
+  static const int kActorsPerGroup = 10;
+  static const int kNumFrames = 100;
+  static const int kFrameMs = 16;
+
+  RealCompositor::StageActor* stage = compositor_->GetDefaultStage();
+  for (size_t i = 0; i < arraysize(kTreeSizes); ++i) {
+    const int64_t start_ms = 1000;  // arbitrary
+    SetMonotonicTimeForTest(CreateTimeTicksFromMs(start_ms));
+
+    // Build groups that each contain a container and its boxes.
+    vector<RealCompositor::Actor*> actors;
+    for (int j = 0; j < kTreeSizes[i] / kActorsPerGroup; ++j) {
+      RealCompositor::ContainerActor* group = compositor_->CreateGroup();
+      group->Move((j % 8) * 100, (j / 8) * 10, 0);
+      stage->AddActor(group);
+      actors.push_back(group);
+      for (int k = 0; k < kActorsPerGroup - 1; ++k) {
+        RealCompositor::ColoredBoxActor* box =
+            compositor_->CreateColoredBox(8, 8, Compositor::Color());
+        box->Move(k * 10, 0, 0);
+        group->AddActor(box);
+        actors.push_back(box);
+      }
+    }
+    ASSERT_EQ(kTreeSizes[i], static_cast<int>(actors.size()));
+    actors.back()->Move(500, 500, kNumFrames * 2 * kFrameMs);
+
+    int64_t incremental_us = 0, full_us = 0;
+    int num_incremental_updates = 0;
+    for (int frame = 0; frame < 2 * kNumFrames; ++frame) {
+      // Alternate between the two modes so that they see the same trees.
+      const bool full = frame % 2;
+      if (full)
+        stage->MarkModelViewDirty();
+
+      const int64_t start_us = GetThreadCpuTimeUs();
+      compositor_->animation_system()->Update(
+          CreateTimeTicksFromMs(start_ms + frame * kFrameMs));
+      int32 count = 0;
+      stage->Update(&count);
+      LayerVisitor layer_visitor(count, false);
+      stage->Accept(&layer_visitor);
+      const int64_t elapsed_us = GetThreadCpuTimeUs() - start_us;
+
+      if (full) {
+        full_us += elapsed_us;
+      } else {
+        incremental_us += elapsed_us;
+        if (frame > 0)
+          num_incremental_updates += layer_visitor.num_model_view_updates();
+      }
+    }
+
+    // Only the animating actor should've been updated in incremental mode
+    // (apart from the first frame).
+    EXPECT_EQ(kNumFrames - 1, num_incremental_updates);
+    LOG(INFO) << kTreeSizes[i] << " actors: "
+              << static_cast<double>(incremental_us) / kNumFrames
+              << " us/frame incremental, "
+              << static_cast<double>(full_us) / kNumFrames
+              << " us/frame full";
+
+    // Delete the boxes before their groups.
+    for (vector<RealCompositor::Actor*>::reverse_iterator it =
+           actors.rbegin(); it != actors.rend(); ++it) {
+      delete *it;
+    }
+  }
+}
+
 }  // namespace window_manager
 
 int main(int argc, char** argv) {
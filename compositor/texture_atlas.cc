@@ -0,0 +1,192 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/compositor/texture_atlas.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "base/stl_util-inl.h"
+#include "window_manager/image_container.h"
+#include "window_manager/image_enums.h"
+
+using std::max;
+using std::min;
+using std::vector;
+
+namespace window_manager {
+
+// static
+const int TextureAtlas::kPageSize = 512;
+// static
+const int TextureAtlas::kMaxImageSize = 128;
+// static
+const int TextureAtlas::kPadding = 1;
+
+namespace {
+
+const int kBytesPerPixel = 4;
+
+// Offsets of the red, green, blue and alpha bytes within a pixel of a
+// 32-bit format.  Returns false for other formats.
+bool GetChannelOffsets(ImageFormat format,
+                       int* red, int* green, int* blue, int* alpha) {
+  switch (format) {
+    case IMAGE_FORMAT_RGBA_32:  // fallthrough
+    case IMAGE_FORMAT_RGBX_32:
+      *red = 0;
+      *green = 1;
+      *blue = 2;
+      *alpha = 3;
+      return true;
+    case IMAGE_FORMAT_BGRA_32:  // fallthrough
+    case IMAGE_FORMAT_BGRX_32:
+      *red = 2;
+      *green = 1;
+      *blue = 0;
+      *alpha = 3;
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+TextureAtlas::Page::Page()
+    : data(new uint8_t[kPageSize * kPageSize * kBytesPerPixel]),
+      dirty(true) {
+  memset(data.get(), 0, kPageSize * kPageSize * kBytesPerPixel);
+}
+
+TextureAtlas::TextureAtlas() {}
+
+TextureAtlas::~TextureAtlas() {
+  STLDeleteElements(&pages_);
+}
+
+const uint8_t* TextureAtlas::GetPageData(int page) const {
+  DCHECK_GE(page, 0);
+  DCHECK_LT(page, num_pages());
+  return pages_[page]->data.get();
+}
+
+bool TextureAtlas::IsPageDirty(int page) const {
+  DCHECK_GE(page, 0);
+  DCHECK_LT(page, num_pages());
+  return pages_[page]->dirty;
+}
+
+void TextureAtlas::MarkPageClean(int page) {
+  DCHECK_GE(page, 0);
+  DCHECK_LT(page, num_pages());
+  pages_[page]->dirty = false;
+}
+
+bool TextureAtlas::AddImage(const ImageContainer& image, Region* region) {
+  DCHECK(region);
+  const int width = image.width();
+  const int height = image.height();
+  if (width <= 0 || height <= 0 ||
+      width > kMaxImageSize || height > kMaxImageSize)
+    return false;
+
+  int red = 0, green = 0, blue = 0, alpha = 0;
+  if (!GetChannelOffsets(image.format(), &red, &green, &blue, &alpha))
+    return false;
+  const bool image_has_alpha = ImageFormatUsesAlpha(image.format());
+
+  const Size padded_size(width + 2 * kPadding, height + 2 * kPadding);
+  int page_index = -1;
+  Point position;
+  Allocate(padded_size, &page_index, &position);
+  Page* page = pages_[page_index];
+
+  // Copy the image, repeating its edge pixels into the padding.
+  const uint8_t* src_data = image.data();
+  const size_t src_stride = image.stride();
+  for (int y = 0; y < padded_size.height; ++y) {
+    const int src_y = min(max(y - kPadding, 0), height - 1);
+    uint8_t* dest = page->data.get() +
+        ((position.y + y) * kPageSize + position.x) * kBytesPerPixel;
+    for (int x = 0; x < padded_size.width; ++x) {
+      const int src_x = min(max(x - kPadding, 0), width - 1);
+      const uint8_t* src =
+          src_data + src_y * src_stride + src_x * kBytesPerPixel;
+      dest[0] = src[red];
+      dest[1] = src[green];
+      dest[2] = src[blue];
+      dest[3] = image_has_alpha ? src[alpha] : 0xff;
+      dest += kBytesPerPixel;
+    }
+  }
+  page->dirty = true;
+
+  region->page = page_index;
+  region->bounds.reset(position.x + kPadding, position.y + kPadding,
+                       width, height);
+  region->tex_coords = TextureData::TexCoords(
+      static_cast<float>(region->bounds.x) / kPageSize,
+      static_cast<float>(region->bounds.y) / kPageSize,
+      static_cast<float>(region->bounds.x + width) / kPageSize,
+      static_cast<float>(region->bounds.y + height) / kPageSize);
+  return true;
+}
+
+void TextureAtlas::Allocate(const Size& size,
+                            int* page_out,
+                            Point* position_out) {
+  DCHECK_LE(size.width, kPageSize);
+  DCHECK_LE(size.height, kPageSize);
+  for (size_t i = 0; i < pages_.size(); ++i) {
+    if (AllocateOnPage(pages_[i], size, position_out)) {
+      *page_out = i;
+      return;
+    }
+  }
+
+  pages_.push_back(new Page);
+  CHECK(AllocateOnPage(pages_.back(), size, position_out));
+  *page_out = pages_.size() - 1;
+}
+
+// static
+bool TextureAtlas::AllocateOnPage(Page* page,
+                                  const Size& size,
+                                  Point* position_out) {
+  Shelf* best_shelf = NULL;
+  for (vector<Shelf>::iterator it = page->shelves.begin();
+       it != page->shelves.end(); ++it) {
+    if (it->height < size.height || kPageSize - it->used < size.width)
+      continue;
+    if (!best_shelf || it->height < best_shelf->height)
+      best_shelf = &(*it);
+  }
+
+  if (!best_shelf) {
+    const int next_y = page->shelves.empty() ?
+        0 : page->shelves.back().y + page->shelves.back().height;
+    if (kPageSize - next_y < size.height)
+      return false;
+    page->shelves.push_back(Shelf(next_y, size.height));
+    best_shelf = &(page->shelves.back());
+  }
+
+  position_out->reset(best_shelf->used, best_shelf->y);
+  best_shelf->used += size.width;
+  return true;
+}
+
+
+AtlasTextureData::AtlasTextureData(uint32_t texture,
+                                   const TextureAtlas::Region& region,
+                                   bool has_alpha) {
+  set_texture(texture);
+  set_in_atlas(true);
+  set_tex_coords(region.tex_coords);
+  set_has_alpha(has_alpha);
+}
+
+}  // namespace window_manager
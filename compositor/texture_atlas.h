@@ -0,0 +1,131 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_COMPOSITOR_TEXTURE_ATLAS_H_
+#define WINDOW_MANAGER_COMPOSITOR_TEXTURE_ATLAS_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "window_manager/compositor/texture_data.h"
+#include "window_manager/geometry.h"
+
+namespace window_manager {
+
+class ImageContainer;
+
+// TextureAtlas packs small static images (e.g. the borders and corners of
+// shadows) into a few large pages so that they can share a texture.  This
+// saves texture binds and lets the quads that display the images be drawn
+// in the same batch.
+//
+// The atlas itself just packs the images into RGBA pixel data in memory.
+// The draw visitors own the textures for each page and upload pages that
+// were modified by AddImage() before drawing them.  Space is never
+// reclaimed, so the atlas should only be used for images that live for the
+// life of the compositor.
+class TextureAtlas {
+ public:
+  // Location of an image within the atlas.
+  struct Region {
+    Region() : page(-1) {}
+
+    // Index of the page containing the image.
+    int page;
+
+    // Pixel bounds of the image within the page.
+    Rect bounds;
+
+    // Normalized coordinates of |bounds|.
+    TextureData::TexCoords tex_coords;
+  };
+
+  // Width and height of each page, in pixels.
+  static const int kPageSize;
+
+  // Images that are wider or taller than this aren't packed into the atlas.
+  static const int kMaxImageSize;
+
+  // Number of pixels around each image that are filled by repeating the
+  // image's edges, so that linear filtering at the edges of a stretched
+  // image doesn't sample its neighbors.
+  static const int kPadding;
+
+  TextureAtlas();
+  ~TextureAtlas();
+
+  int num_pages() const { return pages_.size(); }
+
+  // Pixel data for a page, as kPageSize rows of kPageSize RGBA pixels.
+  const uint8_t* GetPageData(int page) const;
+
+  // Has |page| been modified since the last call to MarkPageClean()?
+  bool IsPageDirty(int page) const;
+  void MarkPageClean(int page);
+
+  // Copy |image| into the atlas, converting it to RGBA, and fill |region|
+  // with its location.  Returns false if the image is too large or in an
+  // unsupported format, in which case it should get its own texture.
+  bool AddImage(const ImageContainer& image, Region* region);
+
+ private:
+  // A row of images with the same maximum height.
+  struct Shelf {
+    Shelf(int new_y, int new_height) : y(new_y), height(new_height), used(0) {}
+
+    int y;
+    int height;
+
+    // Width of the part of the shelf that's in use.
+    int used;
+  };
+
+  struct Page {
+    Page();
+
+    // kPageSize * kPageSize RGBA pixels.
+    scoped_array<uint8_t> data;
+
+    std::vector<Shelf> shelves;
+
+    // Does the page have changes that haven't been uploaded yet?
+    bool dirty;
+
+    DISALLOW_COPY_AND_ASSIGN(Page);
+  };
+
+  // Find space for a |size| area (including padding), adding a new page if
+  // needed.  Sets |page_out| and the top-left corner |position_out| of the
+  // area.
+  void Allocate(const Size& size, int* page_out, Point* position_out);
+
+  // Try to find space for |size| on a single page, preferring the shelf
+  // that wastes the least vertical space.  Returns false if it doesn't fit.
+  static bool AllocateOnPage(Page* page, const Size& size, Point* position_out);
+
+  // Owned pages.  Pointers are used so that pages don't need to be copied.
+  std::vector<Page*> pages_;
+
+  DISALLOW_COPY_AND_ASSIGN(TextureAtlas);
+};
+
+// TextureData for an image stored in a TextureAtlas.  The texture belongs
+// to the draw visitor that owns the atlas, so it isn't deleted here.
+class AtlasTextureData : public TextureData {
+ public:
+  AtlasTextureData(uint32_t texture,
+                   const TextureAtlas::Region& region,
+                   bool has_alpha);
+  virtual ~AtlasTextureData() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AtlasTextureData);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_COMPOSITOR_TEXTURE_ATLAS_H_
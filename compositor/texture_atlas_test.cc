@@ -0,0 +1,166 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstdlib>
+#include <cstring>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "base/memory/scoped_ptr.h"
+#include "window_manager/compositor/texture_atlas.h"
+#include "window_manager/image_container.h"
+#include "window_manager/test_lib.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+namespace window_manager {
+
+class TextureAtlasTest : public ::testing::Test {
+ protected:
+  // Create a |width|x|height| image where each pixel's first three bytes
+  // hold its x coordinate, its y coordinate and |tag|, and the fourth holds
+  // |alpha|.
+  ImageContainer* CreateImage(int width, int height, ImageFormat format,
+                              uint8_t tag, uint8_t alpha) {
+    uint8_t* data = static_cast<uint8_t*>(malloc(width * height * 4));
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        uint8_t* pixel = data + (y * width + x) * 4;
+        pixel[0] = x;
+        pixel[1] = y;
+        pixel[2] = tag;
+        pixel[3] = alpha;
+      }
+    }
+    return new InMemoryImageContainer(data, width, height, format, true);
+  }
+
+  // Get the RGBA pixel at (x, y) on |page|.
+  const uint8_t* GetPixel(const TextureAtlas& atlas, int page, int x, int y) {
+    return atlas.GetPageData(page) + (y * TextureAtlas::kPageSize + x) * 4;
+  }
+};
+
+// Check that images are copied into the page along with their padding.
+TEST_F(TextureAtlasTest, AddImage) {
+  TextureAtlas atlas;
+  EXPECT_EQ(0, atlas.num_pages());
+
+  scoped_ptr<ImageContainer> image(
+      CreateImage(4, 3, IMAGE_FORMAT_RGBA_32, 7, 128));
+  TextureAtlas::Region region;
+  ASSERT_TRUE(atlas.AddImage(*image, &region));
+  ASSERT_EQ(1, atlas.num_pages());
+  EXPECT_TRUE(atlas.IsPageDirty(0));
+  EXPECT_EQ(0, region.page);
+  EXPECT_EQ(Rect(TextureAtlas::kPadding, TextureAtlas::kPadding, 4, 3),
+            region.bounds);
+
+  const float page_size = TextureAtlas::kPageSize;
+  EXPECT_FLOAT_EQ(region.bounds.x / page_size, region.tex_coords.left);
+  EXPECT_FLOAT_EQ(region.bounds.y / page_size, region.tex_coords.top);
+  EXPECT_FLOAT_EQ((region.bounds.x + 4) / page_size, region.tex_coords.right);
+  EXPECT_FLOAT_EQ((region.bounds.y + 3) / page_size, region.tex_coords.bottom);
+
+  // Check a pixel inside of the image.
+  const uint8_t* pixel =
+      GetPixel(atlas, 0, region.bounds.x + 2, region.bounds.y + 1);
+  EXPECT_EQ(2, pixel[0]);
+  EXPECT_EQ(1, pixel[1]);
+  EXPECT_EQ(7, pixel[2]);
+  EXPECT_EQ(128, pixel[3]);
+
+  // The padding should repeat the image's edges.
+  pixel = GetPixel(atlas, 0, region.bounds.x - 1, region.bounds.y - 1);
+  EXPECT_EQ(0, pixel[0]);
+  EXPECT_EQ(0, pixel[1]);
+  EXPECT_EQ(7, pixel[2]);
+  pixel = GetPixel(atlas, 0, region.bounds.right(), region.bounds.bottom());
+  EXPECT_EQ(3, pixel[0]);
+  EXPECT_EQ(2, pixel[1]);
+  EXPECT_EQ(7, pixel[2]);
+
+  atlas.MarkPageClean(0);
+  EXPECT_FALSE(atlas.IsPageDirty(0));
+
+  // A second image should go next to the first one on the same page, and
+  // dirty it again.
+  scoped_ptr<ImageContainer> image2(
+      CreateImage(2, 2, IMAGE_FORMAT_RGBA_32, 8, 255));
+  TextureAtlas::Region region2;
+  ASSERT_TRUE(atlas.AddImage(*image2, &region2));
+  EXPECT_EQ(1, atlas.num_pages());
+  EXPECT_TRUE(atlas.IsPageDirty(0));
+  EXPECT_EQ(0, region2.page);
+  EXPECT_EQ(region.bounds.y, region2.bounds.y);
+  EXPECT_EQ(region.bounds.right() + 2 * TextureAtlas::kPadding,
+            region2.bounds.x);
+  Rect overlap = region.bounds;
+  overlap.intersect(region2.bounds);
+  EXPECT_TRUE(overlap.empty());
+}
+
+// Check that other 32-bit formats are converted to RGBA.
+TEST_F(TextureAtlasTest, ConvertFormats) {
+  TextureAtlas atlas;
+  scoped_ptr<ImageContainer> image(
+      CreateImage(2, 2, IMAGE_FORMAT_BGRX_32, 9, 0));
+  TextureAtlas::Region region;
+  ASSERT_TRUE(atlas.AddImage(*image, &region));
+
+  // Red and blue should be swapped, and the unused alpha byte should be
+  // replaced with an opaque value.
+  const uint8_t* pixel =
+      GetPixel(atlas, 0, region.bounds.x + 1, region.bounds.y);
+  EXPECT_EQ(9, pixel[0]);
+  EXPECT_EQ(0, pixel[1]);
+  EXPECT_EQ(1, pixel[2]);
+  EXPECT_EQ(255, pixel[3]);
+}
+
+// Check that images that are too large are rejected and that we add more
+// pages as needed.
+TEST_F(TextureAtlasTest, Pages) {
+  TextureAtlas atlas;
+  TextureAtlas::Region region;
+  scoped_ptr<ImageContainer> large_image(
+      CreateImage(TextureAtlas::kMaxImageSize + 1, 1,
+                  IMAGE_FORMAT_RGBA_32, 0, 255));
+  EXPECT_FALSE(atlas.AddImage(*large_image, &region));
+  EXPECT_EQ(0, atlas.num_pages());
+
+  // Fill the first page with the largest images that we accept.
+  const int padded_size =
+      TextureAtlas::kMaxImageSize + 2 * TextureAtlas::kPadding;
+  const int images_per_page =
+      (TextureAtlas::kPageSize / padded_size) *
+      (TextureAtlas::kPageSize / padded_size);
+  scoped_ptr<ImageContainer> image(
+      CreateImage(TextureAtlas::kMaxImageSize, TextureAtlas::kMaxImageSize,
+                  IMAGE_FORMAT_RGBA_32, 0, 255));
+  for (int i = 0; i < images_per_page; ++i) {
+    ASSERT_TRUE(atlas.AddImage(*image, &region));
+    EXPECT_EQ(0, region.page) << "image " << i;
+  }
+  EXPECT_EQ(1, atlas.num_pages());
+
+  // The next one should start a new page.
+  ASSERT_TRUE(atlas.AddImage(*image, &region));
+  EXPECT_EQ(1, region.page);
+  EXPECT_EQ(2, atlas.num_pages());
+
+  // A small image should still fit in a gap on the first page.
+  scoped_ptr<ImageContainer> small_image(
+      CreateImage(1, 1, IMAGE_FORMAT_RGBA_32, 0, 255));
+  ASSERT_TRUE(atlas.AddImage(*small_image, &region));
+  EXPECT_EQ(0, region.page);
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
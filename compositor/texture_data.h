@@ -7,26 +7,55 @@
 
 #include <stdint.h>
 
+#include "window_manager/region.h"
+
 namespace window_manager {
 
 class TextureData {
  public:
+  // Normalized coordinates of the part of a texture that holds an image.
+  struct TexCoords {
+    TexCoords() : left(0.f), top(0.f), right(1.f), bottom(1.f) {}
+    TexCoords(float new_left, float new_top, float new_right, float new_bottom)
+        : left(new_left), top(new_top), right(new_right), bottom(new_bottom) {}
+
+    float left, top, right, bottom;
+  };
+
   virtual ~TextureData() {}
   uint32_t texture() const { return texture_; }
 
   bool has_alpha() const { return has_alpha_; }
   void set_has_alpha(bool has_alpha) { has_alpha_ = has_alpha; }
+
+  // Is the texture a TextureAtlas page that's shared with other images?
+  bool in_atlas() const { return in_atlas_; }
+
+  // This covers the whole texture unless the image was packed into a
+  // TextureAtlas.
+  const TexCoords& tex_coords() const { return tex_coords_; }
+
+  // Update the texture to match its source.  RefreshRegion() is passed
+  // the parts of the source (in pixels) that have changed; implementations
+  // that can't update part of a texture refresh all of it instead.
   virtual void Refresh() {}
+  virtual void RefreshRegion(const Region& region) { Refresh(); }
 
  protected:
   // TextureData is not allowed to be instantiated.
-  TextureData() : texture_(0), has_alpha_(true) {}
+  TextureData() : texture_(0), has_alpha_(true), in_atlas_(false) {}
   void set_texture(uint32_t texture) { texture_ = texture; }
   const uint32_t* texture_ptr() { return &texture_; }
+  void set_in_atlas(bool in_atlas) { in_atlas_ = in_atlas; }
+  void set_tex_coords(const TexCoords& tex_coords) {
+    tex_coords_ = tex_coords;
+  }
 
  private:
   uint32_t texture_;
   bool has_alpha_;
+  bool in_atlas_;
+  TexCoords tex_coords_;
   DISALLOW_COPY_AND_ASSIGN(TextureData);
 };
 
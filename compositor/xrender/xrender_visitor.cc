@@ -4,11 +4,14 @@
 
 #include "window_manager/compositor/xrender/xrender_visitor.h"
 
+#include <vector>
+
 #include <X11/extensions/Xrender.h>
 
 #include "base/basictypes.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "window_manager/counters.h"
 #include "window_manager/image_container.h"
 #include "window_manager/image_enums.h"
 #include "window_manager/util.h"
@@ -19,6 +22,10 @@
 #error Need COMPOSITOR_XRENDER defined to compile this file
 #endif
 
+DECLARE_COUNTER(Compositor_DrawCalls);
+
+using std::vector;
+
 namespace window_manager {
 
 const int kRGBPictureBitDepth = 24;
@@ -56,7 +63,7 @@ XRenderDrawVisitor::XRenderDrawVisitor(RealCompositor* compositor,
       back_picture_(None),
       back_pixmap_(None),
       stage_picture_(None),
-      compositor_(NULL),
+      compositor_(compositor),
       xconn_(compositor->x_conn()),
       stage_(NULL),
       ancestor_opacity_(1.0),
@@ -93,6 +100,22 @@ void XRenderDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
     actor->unset_was_resized();
   }
 
+  // The damaged region uses GL-style coordinates where (0, 0) is the
+  // bottom-left corner of the stage; flip it for XRender.
+  const int stage_height = root_geometry_.bounds.height;
+  vector<Rect> clip_rects;
+  const vector<Rect>& damaged_rects = damaged_region_.rects();
+  for (vector<Rect>::const_iterator it = damaged_rects.begin();
+       it != damaged_rects.end(); ++it) {
+    clip_rects.push_back(
+        Rect(it->x, stage_height - it->y - it->height, it->width, it->height));
+  }
+
+  // Only the damaged rects need to be redrawn into the back buffer; the rest
+  // of it still holds the previous frame.
+  if (!clip_rects.empty())
+    xconn_->RenderSetPictureClipRectangles(back_picture_, clip_rects);
+
   // If we don't have a full screen actor we do a fill with the stage color.
   if (!has_fullscreen_actor_) {
     const Compositor::Color& color = actor->stage_color();
@@ -117,25 +140,28 @@ void XRenderDrawVisitor::VisitStage(RealCompositor::StageActor* actor) {
   DLOG(INFO) << "Ending Render pass.";
 #endif
 
-  if (!damaged_region_.empty()) {
-    Matrix4 identity = Matrix4::identity();
-    identity[0][0] = damaged_region_.width;
-    identity[1][1] = damaged_region_.height;
-    identity[3][0] = damaged_region_.x;
-    identity[3][1] = root_geometry_.bounds.height -
-                     damaged_region_.y - damaged_region_.height;
-
-    xconn_->RenderComposite(false,
-                            back_picture_,
-                            None,
-                            stage_picture_,
-                            Point(damaged_region_.x,
-                                  root_geometry_.bounds.height -
-                                  damaged_region_.y -
-                                  damaged_region_.height),
-                            Point(0, 0),
-                            identity,
-                            damaged_region_.size());
+  // Copy the back buffer to the screen.
+  compositor_->HandleBufferSwapStarted();
+  if (!clip_rects.empty()) {
+    xconn_->RenderSetPictureClipRectangles(back_picture_, vector<Rect>());
+
+    for (vector<Rect>::const_iterator it = clip_rects.begin();
+         it != clip_rects.end(); ++it) {
+      Matrix4 identity = Matrix4::identity();
+      identity[0][0] = it->width;
+      identity[1][1] = it->height;
+      identity[3][0] = it->x;
+      identity[3][1] = it->y;
+
+      xconn_->RenderComposite(false,
+                              back_picture_,
+                              None,
+                              stage_picture_,
+                              it->position(),
+                              Point(0, 0),
+                              identity,
+                              it->size());
+    }
   } else {
     Matrix4 identity = Vectormath::Aos::Matrix4::identity();
     identity[0][0] = root_geometry_.bounds.width;
@@ -272,6 +298,7 @@ void XRenderDrawVisitor::VisitQuad(RealCompositor::QuadActor* actor) {
       Point(0, 0),
       actor->model_view(),
       actor->GetBounds().size());
+  COUNTER_INCREMENT(Compositor_DrawCalls);
 }
 
 bool XRenderDrawVisitor::FreeXResources() {
@@ -26,13 +26,19 @@ class XRenderDrawVisitor : virtual public RealCompositor::ActorVisitor {
   void set_has_fullscreen_actor(bool has_fullscreen_actor) {
     has_fullscreen_actor_ = has_fullscreen_actor;
   }
-  void set_damaged_region(Rect damaged_region) {
+  void set_damaged_region(const Region& damaged_region) {
     damaged_region_ = damaged_region;
   }
 
   void BindImage(const ImageContainer& container,
                  RealCompositor::ImageActor* actor);
 
+  // XRender composites whole pictures, so images always get their own.
+  bool BindImageInAtlas(const ImageContainer& container,
+                        RealCompositor::ImageActor* actor) {
+    return false;
+  }
+
   virtual void VisitActor(RealCompositor::Actor* actor) {}
   virtual void VisitStage(RealCompositor::StageActor* actor);
   virtual void VisitContainer(RealCompositor::ContainerActor* actor);
@@ -72,9 +78,9 @@ class XRenderDrawVisitor : virtual public RealCompositor::ActorVisitor {
   // leave a container node.
   float ancestor_opacity_;
 
-  // The rectangular region of the screen that is damaged in the frame.
+  // The region of the screen that is damaged in the frame.
   // This information allows the draw visitor to perform partial updates.
-  Rect damaged_region_;
+  Region damaged_region_;
 
   // This is used to indicate whether the entire screen will be covered by an
   // actor so we can optimize by not clearing the back buffer.
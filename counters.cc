@@ -0,0 +1,69 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/counters.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+
+using std::make_pair;
+using std::sort;
+using std::string;
+
+namespace window_manager {
+
+// static
+Counter* Counter::registered_counters_ = NULL;
+
+Counter::Counter(const char* name)
+    : name_(name),
+      value_(0),
+      next_(registered_counters_) {
+  DCHECK(name_);
+  registered_counters_ = this;
+}
+
+// static
+void Counter::GetSnapshot(Snapshot* snapshot) {
+  DCHECK(snapshot);
+  snapshot->clear();
+  for (const Counter* counter = registered_counters_; counter;
+       counter = counter->next_) {
+    snapshot->push_back(make_pair(string(counter->name_), counter->value_));
+  }
+  sort(snapshot->begin(), snapshot->end());
+}
+
+// static
+string Counter::FormatSnapshot(const Snapshot& snapshot) {
+  string output;
+  for (Snapshot::const_iterator it = snapshot.begin();
+       it != snapshot.end(); ++it) {
+    StringAppendF(&output, "%s%s %lld", output.empty() ? "" : "\n",
+                  it->first.c_str(), static_cast<long long>(it->second));
+  }
+  return output;
+}
+
+// static
+Counter* Counter::FindCounter(const string& name) {
+  for (Counter* counter = registered_counters_; counter;
+       counter = counter->next_) {
+    if (name == counter->name_)
+      return counter;
+  }
+  return NULL;
+}
+
+// static
+void Counter::ResetAllCounters() {
+  for (Counter* counter = registered_counters_; counter;
+       counter = counter->next_) {
+    counter->value_ = 0;
+  }
+}
+
+}  // namespace window_manager
@@ -0,0 +1,78 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_COUNTERS_H_
+#define WINDOW_MANAGER_COUNTERS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+
+// Define a counter named |name| (which must be a valid identifier) at
+// global scope.  Counters from other files can be used after declaring them
+// with DECLARE_COUNTER(), similar to gflags' DEFINE_*() and DECLARE_*().
+#define DEFINE_COUNTER(name) \
+  ::window_manager::Counter COUNTER_##name(#name)
+#define DECLARE_COUNTER(name) \
+  extern ::window_manager::Counter COUNTER_##name
+
+#define COUNTER_INCREMENT(name) ::COUNTER_##name.Increment()
+#define COUNTER_ADD(name, amount) ::COUNTER_##name.Add(amount)
+
+namespace window_manager {
+
+// A named count of how many times something has happened on a hot path
+// (X round trips, texture uploads, draw calls, etc.).  Counters are cheap
+// enough to leave enabled in release builds, unlike the profiler: they're
+// registered during static initialization, and updating one is a single
+// add.
+//
+// Counters aren't atomic, since everything that updates them runs on the
+// window manager's main thread.  Snapshots should be taken there too.
+class Counter {
+ public:
+  // |name| must outlive the counter; DEFINE_COUNTER() passes a literal.
+  explicit Counter(const char* name);
+
+  const char* name() const { return name_; }
+  int64_t value() const { return value_; }
+
+  void Increment() { value_++; }
+  void Add(int64_t amount) { value_ += amount; }
+
+  // Get the current values of all registered counters, sorted by name.
+  typedef std::vector<std::pair<std::string, int64_t> > Snapshot;
+  static void GetSnapshot(Snapshot* snapshot);
+
+  // Format |snapshot| as newline-separated "name value" lines.
+  static std::string FormatSnapshot(const Snapshot& snapshot);
+
+  // Find a registered counter by name, returning NULL if there isn't one.
+  static Counter* FindCounter(const std::string& name);
+
+  // Reset all registered counters to 0.  Used for testing.
+  static void ResetAllCounters();
+
+ private:
+  const char* name_;
+  int64_t value_;
+
+  // Next counter in the registry.
+  Counter* next_;
+
+  // Most-recently-registered counter.  This is a POD that's initialized
+  // before any constructors run, so counters in different files can be
+  // registered in any order.
+  static Counter* registered_counters_;
+
+  DISALLOW_COPY_AND_ASSIGN(Counter);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_COUNTERS_H_
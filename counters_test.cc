@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "window_manager/counters.h"
+#include "window_manager/test_lib.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+DEFINE_COUNTER(CountersTest_Foo);
+DEFINE_COUNTER(CountersTest_Bar);
+
+using std::string;
+
+namespace window_manager {
+
+class CountersTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Counter::ResetAllCounters();
+  }
+};
+
+TEST_F(CountersTest, Basic) {
+  EXPECT_EQ(0, COUNTER_CountersTest_Foo.value());
+  COUNTER_INCREMENT(CountersTest_Foo);
+  COUNTER_INCREMENT(CountersTest_Foo);
+  COUNTER_ADD(CountersTest_Bar, 1LL << 40);
+  EXPECT_EQ(2, COUNTER_CountersTest_Foo.value());
+  EXPECT_EQ(1LL << 40, COUNTER_CountersTest_Bar.value());
+
+  // Counters should be registered under their names.
+  EXPECT_EQ(&COUNTER_CountersTest_Foo,
+            Counter::FindCounter("CountersTest_Foo"));
+  EXPECT_TRUE(Counter::FindCounter("CountersTest_Baz") == NULL);
+
+  Counter::ResetAllCounters();
+  EXPECT_EQ(0, COUNTER_CountersTest_Foo.value());
+  EXPECT_EQ(0, COUNTER_CountersTest_Bar.value());
+}
+
+// Check that snapshots include all counters, sorted by name.
+TEST_F(CountersTest, Snapshot) {
+  COUNTER_ADD(CountersTest_Foo, 5);
+  COUNTER_INCREMENT(CountersTest_Bar);
+
+  // Counters from the libraries that are linked into this test will also be
+  // registered, so just look at ours.
+  Counter::Snapshot snapshot;
+  Counter::GetSnapshot(&snapshot);
+  Counter::Snapshot our_counters;
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    if (i > 0) {
+      EXPECT_LT(snapshot[i - 1].first, snapshot[i].first);
+    }
+    if (snapshot[i].first.find("CountersTest_") == 0)
+      our_counters.push_back(snapshot[i]);
+  }
+  ASSERT_EQ(2U, our_counters.size());
+  EXPECT_EQ("CountersTest_Bar", our_counters[0].first);
+  EXPECT_EQ(1, our_counters[0].second);
+  EXPECT_EQ("CountersTest_Foo", our_counters[1].first);
+  EXPECT_EQ(5, our_counters[1].second);
+
+  EXPECT_EQ("CountersTest_Bar 1\nCountersTest_Foo 5",
+            Counter::FormatSnapshot(our_counters));
+  EXPECT_EQ("", Counter::FormatSnapshot(Counter::Snapshot()));
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
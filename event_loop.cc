@@ -4,8 +4,10 @@
 
 #include "window_manager/event_loop.h"
 
+#include <errno.h>
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
+#include <time.h>
 
 #include <algorithm>
 #include <vector>
@@ -16,33 +18,46 @@ extern "C" {
 
 #include "base/eintr_wrapper.h"
 #include "base/logging.h"
+#include "window_manager/counters.h"
 
 using std::hex;
+using std::make_heap;
 using std::make_pair;
-using std::set;
+using std::max;
+using std::pop_heap;
+using std::push_heap;
 using std::tr1::shared_ptr;
 using std::vector;
 
+DEFINE_COUNTER(EventLoop_Wakeups);
+DEFINE_COUNTER(EventLoop_TimeoutsRun);
+DEFINE_COUNTER(EventLoop_PostedTasksRun);
+DEFINE_COUNTER(EventLoop_TimerFdUpdates);
+
 namespace window_manager {
 
-static void FillTimerSpec(struct itimerspec* spec,
-                          int64_t initial_timeout_ms,
-                          int64_t recurring_timeout_ms) {
-  DCHECK(spec);
-  memset(spec, 0, sizeof(*spec));
-  spec->it_value.tv_sec = initial_timeout_ms / 1000;
-  // timerfd interprets 0 values as disabling the timer; set it to run in
-  // one nanosecond instead.
-  spec->it_value.tv_nsec = initial_timeout_ms ?
-      (initial_timeout_ms % 1000) * 1000000 :
-      1;
-  spec->it_interval.tv_sec = recurring_timeout_ms / 1000;
-  spec->it_interval.tv_nsec = (recurring_timeout_ms % 1000) * 1000000;
+// Orders TimeoutHeapEntry structs so that std::push_heap() and friends
+// keep the earliest deadline at the front of the heap.  Ties are broken by
+// ID so that timeouts with the same deadline run in the order in which
+// they were added.
+template<class Entry>
+static bool HasLaterDeadline(const Entry& a, const Entry& b) {
+  if (a.deadline_us != b.deadline_us)
+    return a.deadline_us > b.deadline_us;
+  return a.id > b.id;
 }
 
 EventLoop::EventLoop()
     : exit_requested_(false),
       epoll_fd_(-1),
+      timer_fd_(-1),
+      timer_fd_armed_(false),
+      timer_fd_deadline_us_(0),
+      num_timer_fd_updates_(0),
+      num_wakeups_(0),
+      idle_(false),
+      fake_time_us_(0),
+      next_timeout_id_(0),
       timerfd_supported_(IsTimerFdSupported()) {
   epoll_fd_ = epoll_create(10);  // argument is ignored since 2.6.8
   PCHECK(epoll_fd_ != -1) << "epoll_create() failed";
@@ -50,15 +65,21 @@ EventLoop::EventLoop()
     LOG(ERROR) << "timerfd doesn't work on this system (perhaps your kernel "
                << "doesn't support it).  EventLoop::Run() will crash if "
                << "called.";
+    return;
   }
+
+  // Use a monotonically-increasing clock -- we don't want to be affected
+  // by changes to the system time.
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  PCHECK(timer_fd_ != -1) << "timerfd_create() failed";
+  AddFileDescriptor(
+      timer_fd_, NewPermanentCallback(this, &EventLoop::HandleTimerFdReadable));
 }
 
 EventLoop::~EventLoop() {
   close(epoll_fd_);
-  for (set<int>::iterator it = timeout_fds_.begin();
-       it != timeout_fds_.end(); ++it) {
-    PCHECK(HANDLE_EINTR(close(*it)) == 0);
-  }
+  if (timer_fd_ >= 0)
+    PCHECK(HANDLE_EINTR(close(timer_fd_)) == 0);
 }
 
 void EventLoop::Run() {
@@ -83,11 +104,15 @@ void EventLoop::Run() {
       break;
     }
 
-    CHECK(!callbacks_.empty())
+    // |timer_fd_| is always registered, so make sure that there's either
+    // another FD or a timeout that could wake us up.
+    CHECK(callbacks_.size() > 1 || !timeouts_.empty())
         << "No event sources for event loop; would sleep forever";
     const int num_events = HANDLE_EINTR(
         epoll_wait(epoll_fd_, epoll_events, kMaxEpollEvents, -1));
     PCHECK(num_events != -1) << "epoll_wait() failed";
+    num_wakeups_++;
+    COUNTER_INCREMENT(EventLoop_Wakeups);
 
     for (int i = 0; i < num_events; ++i) {
       const int event_fd = epoll_events[i].data.fd;
@@ -100,15 +125,6 @@ void EventLoop::Run() {
         continue;
       }
 
-      // We have to read from timer fds to reset their ready state.
-      if (timeout_fds_.count(event_fd) > 0) {
-        uint64_t num_expirations = 0;
-        CHECK(HANDLE_EINTR(read(event_fd,
-                                &num_expirations,
-                                sizeof(num_expirations))) ==
-              sizeof(num_expirations)) << "Short read on fd " << event_fd;
-      }
-
       // Save all the callbacks so we can run them later -- they may add or
       // remove FDs, and we don't want things to be changed underneath us.
       callbacks_to_run_.insert(it->second);
@@ -151,37 +167,32 @@ int EventLoop::AddTimeout(Closure* cb,
   DCHECK_GE(initial_timeout_ms, 0);
   DCHECK_GE(recurring_timeout_ms, 0);
 
+  const int id = next_timeout_id_++;
   if (!timerfd_supported_) {
     // If we previously established that timerfd doesn't work on this
-    // system, just return an arbitrary fake descriptor -- we'll crash
-    // before we'd try to use it in Run().
+    // system, just return an arbitrary fake ID -- we'll crash before we'd
+    // try to use it in Run().
     delete cb;
-    static int next_timer_fd = 0;
-    return next_timer_fd++;
+    return id;
   }
 
-  // Use a monotonically-increasing clock -- we don't want to be affected
-  // by changes to the system time.
-  const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-  PCHECK(timer_fd != -1) << "timerfd_create() failed";
-
-  AddFileDescriptor(timer_fd, cb);
-  CHECK(timeout_fds_.insert(timer_fd).second);
-
-  struct itimerspec new_timer_spec;
-  struct itimerspec old_timer_spec;
-  FillTimerSpec(&new_timer_spec, initial_timeout_ms, recurring_timeout_ms);
-  PCHECK(timerfd_settime(timer_fd, 0, &new_timer_spec, &old_timer_spec) == 0);
-  return timer_fd;
+  Timeout& timeout = timeouts_[id];
+  timeout.callback.reset(cb);
+  timeout.recurring_us = recurring_timeout_ms * 1000;
+  ScheduleTimeout(id, &timeout,
+                  GetMonotonicTimeUs() + initial_timeout_ms * 1000);
+  UpdateTimerFd();
+  return id;
 }
 
 void EventLoop::RemoveTimeout(int id) {
   if (!timerfd_supported_)
     return;
 
-  RemoveFileDescriptor(id);
-  CHECK(timeout_fds_.erase(id) == 1);
-  PCHECK(HANDLE_EINTR(close(id)) == 0);
+  // The timeout's heap entry (if any) will be discarded when it reaches the
+  // top of the heap.
+  CHECK(timeouts_.erase(id) == 1) << "Got request to remove unknown timeout "
+                                  << id;
 }
 
 void EventLoop::PostTask(Closure* cb) {
@@ -193,22 +204,72 @@ void EventLoop::SuspendTimeout(int id) {
   if (!timerfd_supported_)
     return;
 
-  struct itimerspec new_timer_spec;
-  struct itimerspec old_timer_spec;
-  memset(&new_timer_spec, 0, sizeof(new_timer_spec));
-  PCHECK(timerfd_settime(id, 0, &new_timer_spec, &old_timer_spec) == 0);
+  TimeoutMap::iterator it = timeouts_.find(id);
+  CHECK(it != timeouts_.end()) << "Got request to suspend unknown timeout "
+                               << id;
+  it->second.scheduled = false;
+  it->second.deferred = false;
+  it->second.generation++;
 }
 
 void EventLoop::ResetTimeout(int id,
                              int64_t initial_timeout_ms,
                              int64_t recurring_timeout_ms) {
+  DCHECK_GE(initial_timeout_ms, 0);
+  DCHECK_GE(recurring_timeout_ms, 0);
   if (!timerfd_supported_)
     return;
 
-  struct itimerspec new_timer_spec;
-  struct itimerspec old_timer_spec;
-  FillTimerSpec(&new_timer_spec, initial_timeout_ms, recurring_timeout_ms);
-  PCHECK(timerfd_settime(id, 0, &new_timer_spec, &old_timer_spec) == 0);
+  TimeoutMap::iterator it = timeouts_.find(id);
+  CHECK(it != timeouts_.end()) << "Got request to reset unknown timeout "
+                               << id;
+  it->second.recurring_us = recurring_timeout_ms * 1000;
+  ScheduleTimeout(id, &(it->second),
+                  GetMonotonicTimeUs() + initial_timeout_ms * 1000);
+  UpdateTimerFd();
+}
+
+void EventLoop::SetTimeoutDeferrable(int id, bool deferrable) {
+  if (!timerfd_supported_)
+    return;
+
+  TimeoutMap::iterator it = timeouts_.find(id);
+  CHECK(it != timeouts_.end()) << "Got request to modify unknown timeout "
+                               << id;
+  Timeout& timeout = it->second;
+  timeout.deferrable = deferrable;
+  if (idle_ && deferrable && timeout.scheduled) {
+    DeferTimeout(&timeout);
+  } else if (!deferrable && timeout.deferred) {
+    ScheduleTimeout(id, &timeout, timeout.deadline_us);
+    UpdateTimerFd();
+  }
+}
+
+void EventLoop::SetIdle(bool idle) {
+  if (idle == idle_ || !timerfd_supported_)
+    return;
+  idle_ = idle;
+
+  if (idle_) {
+    for (TimeoutMap::iterator it = timeouts_.begin();
+         it != timeouts_.end(); ++it) {
+      if (it->second.deferrable && it->second.scheduled)
+        DeferTimeout(&(it->second));
+    }
+    // Don't wake up for a deadline that's just been deferred.
+    ResetTimerFd();
+  } else {
+    const int64_t now_us = GetMonotonicTimeUs();
+    for (TimeoutMap::iterator it = timeouts_.begin();
+         it != timeouts_.end(); ++it) {
+      if (it->second.deferred) {
+        ScheduleTimeout(it->first, &(it->second),
+                        max(it->second.deadline_us, now_us));
+      }
+    }
+    UpdateTimerFd();
+  }
 }
 
 // static
@@ -226,10 +287,31 @@ bool EventLoop::IsTimerFdSupported() {
 }
 
 void EventLoop::RunTimeoutForTesting(int id) {
-  CHECK(timeout_fds_.count(id)) << "Timeout " << id << " not registered";
-  FdCallbackMap::iterator it = callbacks_.find(id);
-  CHECK(it != callbacks_.end());
-  it->second->Run();
+  TimeoutMap::iterator it = timeouts_.find(id);
+  CHECK(it != timeouts_.end()) << "Timeout " << id << " not registered";
+  shared_ptr<Closure> callback = it->second.callback;
+  callback->Run();
+}
+
+void EventLoop::UseFakeClockForTesting() {
+  if (!fake_time_us_)
+    fake_time_us_ = GetMonotonicTimeUs();
+}
+
+int EventLoop::AdvanceFakeClockForTesting(int64_t ms) {
+  CHECK(fake_time_us_) << "UseFakeClockForTesting() wasn't called";
+  DCHECK_GE(ms, 0);
+  const int64_t end_us = fake_time_us_ + ms * 1000;
+  int num_wakeups = 0;
+  while (timer_fd_armed_ && timer_fd_deadline_us_ <= end_us) {
+    fake_time_us_ = max(fake_time_us_, timer_fd_deadline_us_);
+    num_wakeups++;
+    num_wakeups_++;
+    COUNTER_INCREMENT(EventLoop_Wakeups);
+    HandleTimerFdReadable();
+  }
+  fake_time_us_ = end_us;
+  return num_wakeups;
 }
 
 void EventLoop::RunAllPostedTasks() {
@@ -239,8 +321,169 @@ void EventLoop::RunAllPostedTasks() {
     for (vector<shared_ptr<Closure> >::iterator it = tasks_to_run.begin();
          it != tasks_to_run.end(); ++it) {
       (*it)->Run();
+      COUNTER_INCREMENT(EventLoop_PostedTasksRun);
     }
   }
 }
 
+int64_t EventLoop::GetMonotonicTimeUs() const {
+  if (fake_time_us_)
+    return fake_time_us_;
+
+  struct timespec now;
+  PCHECK(clock_gettime(CLOCK_MONOTONIC, &now) == 0);
+  return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+void EventLoop::ScheduleTimeout(int id, Timeout* timeout, int64_t deadline_us) {
+  DCHECK(timeout);
+  timeout->deadline_us = deadline_us;
+  if (idle_ && timeout->deferrable) {
+    DeferTimeout(timeout);
+    return;
+  }
+  timeout->deferred = false;
+  timeout->scheduled = true;
+  timeout->generation++;
+  timeout_heap_.push_back(
+      TimeoutHeapEntry(deadline_us, id, timeout->generation));
+  push_heap(timeout_heap_.begin(), timeout_heap_.end(),
+            HasLaterDeadline<TimeoutHeapEntry>);
+  CompactTimeoutHeapIfNeeded();
+}
+
+void EventLoop::DeferTimeout(Timeout* timeout) {
+  DCHECK(timeout);
+  timeout->scheduled = false;
+  timeout->deferred = true;
+  timeout->generation++;
+}
+
+bool EventLoop::IsHeapEntryStale(const TimeoutHeapEntry& entry) const {
+  TimeoutMap::const_iterator it = timeouts_.find(entry.id);
+  return it == timeouts_.end() ||
+         !it->second.scheduled ||
+         it->second.generation != entry.generation;
+}
+
+void EventLoop::CompactTimeoutHeapIfNeeded() {
+  // Timeouts that keep getting pushed back leave a trail of stale entries
+  // behind them; throw them away once they outnumber the live ones.
+  static const size_t kMinHeapSizeForCompaction = 64;
+  if (timeout_heap_.size() < kMinHeapSizeForCompaction ||
+      timeout_heap_.size() <= 2 * timeouts_.size())
+    return;
+
+  timeout_heap_.clear();
+  for (TimeoutMap::const_iterator it = timeouts_.begin();
+       it != timeouts_.end(); ++it) {
+    if (it->second.scheduled) {
+      timeout_heap_.push_back(
+          TimeoutHeapEntry(
+              it->second.deadline_us, it->first, it->second.generation));
+    }
+  }
+  make_heap(timeout_heap_.begin(), timeout_heap_.end(),
+            HasLaterDeadline<TimeoutHeapEntry>);
+}
+
+void EventLoop::UpdateTimerFd() {
+  while (!timeout_heap_.empty() && IsHeapEntryStale(timeout_heap_.front())) {
+    pop_heap(timeout_heap_.begin(), timeout_heap_.end(),
+             HasLaterDeadline<TimeoutHeapEntry>);
+    timeout_heap_.pop_back();
+  }
+  if (timeout_heap_.empty())
+    return;
+
+  // If the timer is already going to fire before the earliest deadline, we
+  // leave it alone -- waking up early and going back to sleep is cheaper
+  // than re-arming the timer every time that a timeout is pushed back.
+  const int64_t deadline_us = timeout_heap_.front().deadline_us;
+  if (timer_fd_armed_ && timer_fd_deadline_us_ <= deadline_us)
+    return;
+
+  // timerfd interprets 0 values as disabling the timer, but CLOCK_MONOTONIC
+  // is never 0 after boot, so absolute deadlines are always non-zero.
+  struct itimerspec new_timer_spec;
+  struct itimerspec old_timer_spec;
+  memset(&new_timer_spec, 0, sizeof(new_timer_spec));
+  new_timer_spec.it_value.tv_sec = deadline_us / 1000000;
+  new_timer_spec.it_value.tv_nsec = (deadline_us % 1000000) * 1000;
+  PCHECK(timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME,
+                         &new_timer_spec, &old_timer_spec) == 0);
+  num_timer_fd_updates_++;
+  COUNTER_INCREMENT(EventLoop_TimerFdUpdates);
+  timer_fd_armed_ = true;
+  timer_fd_deadline_us_ = deadline_us;
+}
+
+void EventLoop::ResetTimerFd() {
+  if (timer_fd_armed_) {
+    struct itimerspec timer_spec;
+    memset(&timer_spec, 0, sizeof(timer_spec));
+    PCHECK(timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME,
+                           &timer_spec, NULL) == 0);
+    num_timer_fd_updates_++;
+    COUNTER_INCREMENT(EventLoop_TimerFdUpdates);
+    timer_fd_armed_ = false;
+  }
+  UpdateTimerFd();
+}
+
+void EventLoop::HandleTimerFdReadable() {
+  // Read from the timer to reset its ready state.  It may have already been
+  // re-armed by an earlier callback in this poll cycle, in which case there's
+  // nothing to read.
+  uint64_t num_expirations = 0;
+  if (HANDLE_EINTR(read(timer_fd_, &num_expirations,
+                        sizeof(num_expirations))) == -1) {
+    PCHECK(errno == EAGAIN) << "Unable to read from timer fd " << timer_fd_;
+  }
+  timer_fd_armed_ = false;
+
+  // Pull out all of the expired entries before running anything, so that
+  // timeouts added with 0-millisecond delays by the callbacks will be run in
+  // the next iteration of the event loop rather than in this one.
+  const int64_t now_us = GetMonotonicTimeUs();
+  vector<TimeoutHeapEntry> expired_entries;
+  while (!timeout_heap_.empty() &&
+         timeout_heap_.front().deadline_us <= now_us) {
+    pop_heap(timeout_heap_.begin(), timeout_heap_.end(),
+             HasLaterDeadline<TimeoutHeapEntry>);
+    expired_entries.push_back(timeout_heap_.back());
+    timeout_heap_.pop_back();
+  }
+
+  for (vector<TimeoutHeapEntry>::const_iterator entry_it =
+         expired_entries.begin();
+       entry_it != expired_entries.end(); ++entry_it) {
+    // Skip timeouts that were removed, suspended or rescheduled, possibly
+    // by one of the callbacks that we just ran.
+    if (IsHeapEntryStale(*entry_it))
+      continue;
+
+    Timeout& timeout = timeouts_[entry_it->id];
+    if (timeout.recurring_us > 0) {
+      // If we've fallen more than an interval behind, skip the missed runs
+      // instead of running the callback repeatedly to catch up.
+      int64_t next_deadline_us = entry_it->deadline_us + timeout.recurring_us;
+      if (next_deadline_us <= now_us)
+        next_deadline_us = now_us + timeout.recurring_us;
+      ScheduleTimeout(entry_it->id, &timeout, next_deadline_us);
+    } else {
+      timeout.scheduled = false;
+      timeout.generation++;
+    }
+
+    // Hold a reference to the callback in case it removes its own timeout.
+    shared_ptr<Closure> callback = timeout.callback;
+    callback->Run();
+    COUNTER_INCREMENT(EventLoop_TimeoutsRun);
+    RunAllPostedTasks();
+  }
+
+  UpdateTimerFd();
+}
+
 }  // namespace window_manager
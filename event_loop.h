@@ -5,6 +5,8 @@
 #ifndef WINDOW_MANAGER_EVENT_LOOP_H_
 #define WINDOW_MANAGER_EVENT_LOOP_H_
 
+#include <stdint.h>
+
 #include <map>
 #include <set>
 #include <tr1/memory>
@@ -18,13 +20,34 @@ namespace window_manager {
 
 // EventLoop provides an interface for fetching X events and setting
 // timeouts.
+//
+// All timeouts are multiplexed onto a single timerfd: pending deadlines are
+// kept in a min-heap and the timerfd is only re-armed when the earliest
+// deadline moves earlier.  Suspending, removing or postponing a timeout
+// just invalidates its heap entry, so the timeouts that get churned
+// constantly (watchdogs, coalescers, etc.) don't cost any syscalls.
+//
+// Timeouts that just poll for things that can't happen while nobody's
+// using the computer can be marked as deferrable.  While the loop is idle
+// (see SetIdle()), deferrable timeouts don't wake us up; they're run once
+// the loop stops being idle instead.
 class EventLoop {
  public:
   EventLoop();
   ~EventLoop();
 
   // Get the number of current-registered timeouts.  Used for testing.
-  int num_timeouts() const { return timeout_fds_.size(); }
+  int num_timeouts() const { return timeouts_.size(); }
+
+  // Get the number of times that we've called timerfd_settime().  Used for
+  // testing.
+  int num_timer_fd_updates() const { return num_timer_fd_updates_; }
+
+  // Get the number of times that we've woken up to handle FDs or timeouts.
+  // Used for testing.
+  int num_wakeups() const { return num_wakeups_; }
+
+  bool idle() const { return idle_; }
 
   // Loop until Exit() is called, waiting for FDs to become readable or
   // timeouts to fire.
@@ -88,7 +111,7 @@ class EventLoop {
 
   // Suspend a previously-registered timeout.  Use ResetTimeout() to
   // unsuspend it.
-  void SuspendTimeout(int fd);
+  void SuspendTimeout(int id);
 
   // Modify a previously-registered timeout.  The timeout arguments are
   // interpreted in the same manner as in AddTimeout().
@@ -96,6 +119,14 @@ class EventLoop {
                     int64_t initial_timeout_ms,
                     int64_t recurring_timeout_ms);
 
+  // Mark a previously-registered timeout as deferrable or not.
+  void SetTimeoutDeferrable(int id, bool deferrable);
+
+  // Enter or leave idle mode.  Entering it postpones all deferrable
+  // timeouts until idle mode is left, at which point the ones that would
+  // have run in the meantime are run as soon as possible.
+  void SetIdle(bool idle);
+
   // Does the system that we're currently running on support the latest
   // timerfd interface (the one with timerfd_create())?  This was
   // introduced in Linux 2.6.25 and glibc 2.8.  This is static so that
@@ -106,10 +137,102 @@ class EventLoop {
   // testing code that wants to manually run a timeout's callback.
   void RunTimeoutForTesting(int id);
 
+  // Make the loop use a simulated clock instead of CLOCK_MONOTONIC.  The
+  // simulated clock starts at the current time and only moves when
+  // AdvanceFakeClockForTesting() is called.
+  void UseFakeClockForTesting();
+
+  // Advance the simulated clock by |ms| milliseconds, running timeouts
+  // whenever Run() would have been woken up to do so.  Returns the number
+  // of wakeups.
+  int AdvanceFakeClockForTesting(int64_t ms);
+
  private:
   typedef std::vector<std::tr1::shared_ptr<Closure> > CallbackVector;
   typedef std::map<int, std::tr1::shared_ptr<Closure> > FdCallbackMap;
 
+  // A timeout registered via AddTimeout().
+  struct Timeout {
+    Timeout()
+        : deadline_us(0),
+          recurring_us(0),
+          scheduled(false),
+          deferrable(false),
+          deferred(false),
+          generation(0) {
+    }
+
+    std::tr1::shared_ptr<Closure> callback;
+
+    // CLOCK_MONOTONIC time at which the timeout should next run.  Only
+    // meaningful if |scheduled| is true.
+    int64_t deadline_us;
+
+    // Interval at which the timeout recurs, or 0 if it only runs once.
+    int64_t recurring_us;
+
+    // Is the timeout waiting to be run?  False for suspended timeouts and
+    // for non-recurring timeouts that have already run.
+    bool scheduled;
+
+    // Should the timeout be postponed while we're idle?
+    bool deferrable;
+
+    // Is the timeout waiting for us to stop being idle?  If so,
+    // |deadline_us| holds the time at which it would've otherwise run.
+    bool deferred;
+
+    // Incremented each time that the timeout is rescheduled or suspended,
+    // so that stale entries in |timeout_heap_| can be recognized.
+    int generation;
+  };
+  typedef std::map<int, Timeout> TimeoutMap;
+
+  // Entry in |timeout_heap_|.
+  struct TimeoutHeapEntry {
+    TimeoutHeapEntry(int64_t deadline_us, int id, int generation)
+        : deadline_us(deadline_us),
+          id(id),
+          generation(generation) {
+    }
+
+    int64_t deadline_us;
+    int id;
+    int generation;
+  };
+
+  // Get the current CLOCK_MONOTONIC time (or the simulated time, if
+  // UseFakeClockForTesting() has been called).
+  int64_t GetMonotonicTimeUs() const;
+
+  // Schedule |timeout| (with ID |id|) to run at |deadline_us|, invalidating
+  // any earlier heap entry for it.  Deferrable timeouts are deferred
+  // instead if we're idle.
+  void ScheduleTimeout(int id, Timeout* timeout, int64_t deadline_us);
+
+  // Invalidate |timeout|'s heap entries and mark it as waiting for us to
+  // stop being idle.
+  void DeferTimeout(Timeout* timeout);
+
+  // Is |entry| out of date with regard to the timeout that it refers to?
+  bool IsHeapEntryStale(const TimeoutHeapEntry& entry) const;
+
+  // Rebuild |timeout_heap_| from |timeouts_| if it's accumulated too many
+  // stale entries.
+  void CompactTimeoutHeapIfNeeded();
+
+  // Arm |timer_fd_| if the earliest deadline in |timeout_heap_| is earlier
+  // than the time that it's currently set to fire at.
+  void UpdateTimerFd();
+
+  // Disarm |timer_fd_| and then re-arm it for the earliest deadline.  Used
+  // when timeouts have been deferred so that we don't wake up early.
+  void ResetTimerFd();
+
+  // Invoked when |timer_fd_| becomes readable.  Runs all of the timeouts
+  // whose deadlines have passed and reschedules the recurring ones.
+  void HandleTimerFdReadable();
+
   // Run all callbacks from |posted_tasks_| and clear the vector.
   // If the existing callbacks post additional tasks, they will be run as
   // well.
@@ -133,9 +256,39 @@ class EventLoop {
   // they'll be run.
   CallbackVector posted_tasks_;
 
-  // timerfd file descriptors that we've created (a subset of the keys in
-  // |callbacks_|.
-  std::set<int> timeout_fds_;
+  // timerfd that's used to wake us up for the earliest timeout, or -1 if
+  // timerfd is unsupported.
+  int timer_fd_;
+
+  // Is |timer_fd_| currently armed, and if so, at what CLOCK_MONOTONIC
+  // time will it fire?
+  bool timer_fd_armed_;
+  int64_t timer_fd_deadline_us_;
+
+  // Number of times that we've called timerfd_settime() on |timer_fd_|.
+  int num_timer_fd_updates_;
+
+  // Number of times that we've woken up from epoll_wait() (or from
+  // AdvanceFakeClockForTesting()).
+  int num_wakeups_;
+
+  // Are we currently idle?  See SetIdle().
+  bool idle_;
+
+  // Simulated CLOCK_MONOTONIC time in microseconds, or 0 if we're using
+  // the real clock.
+  int64_t fake_time_us_;
+
+  // Registered timeouts, keyed by ID.
+  TimeoutMap timeouts_;
+
+  // ID that will be assigned to the next timeout.
+  int next_timeout_id_;
+
+  // Min-heap of pending timeouts ordered by deadline.  Entries aren't
+  // removed when their timeouts are rescheduled, suspended or removed;
+  // instead, they're skipped when they reach the top of the heap.
+  std::vector<TimeoutHeapEntry> timeout_heap_;
 
   // Does the kernel support timerfd?  If it doesn't, timeout-related calls
   // are no-ops, and we'll crash if Run() is ever called.
@@ -2,12 +2,19 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <algorithm>
 #include <vector>
 
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
 
+#include "base/eintr_wrapper.h"
 #include "base/logging.h"
+#include "base/time.h"
 #include "window_manager/callback.h"
 #include "window_manager/event_loop.h"
 #include "window_manager/test_lib.h"
@@ -16,6 +23,9 @@
 DEFINE_bool(logtostderr, false,
             "Print debugging messages to stderr (suppressed otherwise)");
 
+using base::TimeDelta;
+using base::TimeTicks;
+using std::count;
 using std::vector;
 using window_manager::EventLoop;
 
@@ -23,6 +33,24 @@ namespace window_manager {
 
 class EventLoopTest : public ::testing::Test {};
 
+// Count the file descriptors that this process has open.
+static int CountOpenFds() {
+  DIR* dir = opendir("/proc/self/fd");
+  PCHECK(dir) << "Unable to open /proc/self/fd";
+  int num_fds = 0;
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.')
+      num_fds++;
+  }
+  closedir(dir);
+  return num_fds - 1;  // don't count |dir|'s own fd
+}
+
+// Callback for timeouts that are never expected to run.
+static void HandleUnexpectedTimeout() {
+  ADD_FAILURE() << "Timeout unexpectedly ran";
+}
+
 // Helper class that receives X events and uses them to manipulate the
 // event loop.  See the comment near the end of the "Basic" test for
 // details about what's going on here.
@@ -105,6 +133,37 @@ struct RemoveScheduledTimeoutData {
   bool called;
 };
 
+// Data used for the TimeoutOrder test.
+struct TimeoutOrderData {
+  TimeoutOrderData(EventLoop* event_loop)
+      : event_loop(event_loop),
+        recurring_timeout_id(-1),
+        num_recurring_runs(0) {
+  }
+
+  void HandleTimeout(int index) {
+    run_indices.push_back(index);
+  }
+
+  // Remove the recurring timeout after it's been run three times.
+  void HandleRecurringTimeout() {
+    if (++num_recurring_runs == 3)
+      event_loop->RemoveTimeoutIfSet(&recurring_timeout_id);
+  }
+
+  void HandleFinalTimeout() {
+    event_loop->Exit();
+  }
+
+  EventLoop* event_loop;  // not owned
+
+  // Indices passed to HandleTimeout(), in the order in which it was called.
+  vector<int> run_indices;
+
+  int recurring_timeout_id;
+  int num_recurring_runs;
+};
+
 // Data used for the PostTask test.
 struct PostTaskData {
   PostTaskData(EventLoop* event_loop)
@@ -261,6 +320,174 @@ TEST_F(EventLoopTest, PostTask) {
   EXPECT_EQ(PostTaskData::PRE_POLL_CALLBACK, data.called_types[8]);
 }
 
+// Check that timeouts sharing the event loop's timer run in order of
+// their deadlines and that suspending, resetting and removing them works.
+TEST_F(EventLoopTest, TimeoutOrder) {
+  EventLoop event_loop;
+  TimeoutOrderData data(&event_loop);
+  const int first_id = event_loop.AddTimeout(
+      NewPermanentCallback(&data, &TimeoutOrderData::HandleTimeout, 0), 30, 0);
+  event_loop.AddTimeout(
+      NewPermanentCallback(&data, &TimeoutOrderData::HandleTimeout, 1), 10, 0);
+  const int suspended_id = event_loop.AddTimeout(
+      NewPermanentCallback(&data, &TimeoutOrderData::HandleTimeout, 2), 20, 0);
+  data.recurring_timeout_id = event_loop.AddTimeout(
+      NewPermanentCallback(&data, &TimeoutOrderData::HandleRecurringTimeout),
+      2, 2);
+  event_loop.AddTimeout(
+      NewPermanentCallback(&data, &TimeoutOrderData::HandleFinalTimeout),
+      40, 0);
+  EXPECT_EQ(5, event_loop.num_timeouts());
+
+  // Move the first timeout ahead of the second and suspend the third.
+  event_loop.ResetTimeout(first_id, 5, 0);
+  event_loop.SuspendTimeout(suspended_id);
+  event_loop.Run();
+
+  ASSERT_EQ(2U, data.run_indices.size());
+  EXPECT_EQ(0, data.run_indices[0]);
+  EXPECT_EQ(1, data.run_indices[1]);
+  EXPECT_EQ(3, data.num_recurring_runs);
+  EXPECT_EQ(-1, data.recurring_timeout_id);
+  EXPECT_EQ(4, event_loop.num_timeouts());
+}
+
+// Check that deferrable timeouts don't wake us up while the loop is idle
+// and that they're run as soon as it stops being idle.
+TEST_F(EventLoopTest, Idle) {
+  EventLoop event_loop;
+  event_loop.UseFakeClockForTesting();
+  TimeoutOrderData data(&event_loop);
+  const int poll_id = event_loop.AddTimeout(
+      NewPermanentCallback(&data, &TimeoutOrderData::HandleTimeout, 0),
+      100, 100);
+  event_loop.SetTimeoutDeferrable(poll_id, true);
+  event_loop.AddTimeout(
+      NewPermanentCallback(&data, &TimeoutOrderData::HandleTimeout, 1),
+      5000, 0);
+
+  EXPECT_EQ(10, event_loop.AdvanceFakeClockForTesting(1000));
+  EXPECT_EQ(10, count(data.run_indices.begin(), data.run_indices.end(), 0));
+
+  // Only the non-deferrable timeout should run while we're idle.
+  event_loop.SetIdle(true);
+  EXPECT_EQ(1, event_loop.AdvanceFakeClockForTesting(60000));
+  EXPECT_EQ(10, count(data.run_indices.begin(), data.run_indices.end(), 0));
+  EXPECT_EQ(1, count(data.run_indices.begin(), data.run_indices.end(), 1));
+
+  // When we stop being idle, the recurring timeout should run once right
+  // away (rather than once for each interval that it missed) and then
+  // resume its usual schedule.
+  event_loop.SetIdle(false);
+  EXPECT_EQ(1, event_loop.AdvanceFakeClockForTesting(0));
+  EXPECT_EQ(11, count(data.run_indices.begin(), data.run_indices.end(), 0));
+  EXPECT_EQ(1, event_loop.AdvanceFakeClockForTesting(100));
+  EXPECT_EQ(12, count(data.run_indices.begin(), data.run_indices.end(), 0));
+
+  // Rescheduling a deferrable timeout while idle shouldn't wake us up, but
+  // making it non-deferrable should.
+  event_loop.SetIdle(true);
+  event_loop.ResetTimeout(poll_id, 0, 100);
+  EXPECT_EQ(0, event_loop.AdvanceFakeClockForTesting(1000));
+  event_loop.SetTimeoutDeferrable(poll_id, false);
+  EXPECT_EQ(1, event_loop.AdvanceFakeClockForTesting(0));
+  EXPECT_EQ(13, count(data.run_indices.begin(), data.run_indices.end(), 0));
+  EXPECT_EQ(14, event_loop.num_wakeups());
+}
+
+// Compare the cost of churning 1000 timeouts on the event loop's shared
+// timer with the cost of giving each timeout its own timerfd.  Run with
+// --logtostderr to see the timings.
+TEST_F(EventLoopTest, ManyTimeoutsBenchmark) {
+  static const int kNumTimeouts = 1000;
+  static const int kNumResets = 10;
+
+  EventLoop event_loop;
+  const int initial_num_fds = CountOpenFds();
+  const int initial_num_timer_fd_updates = event_loop.num_timer_fd_updates();
+
+  // Add timeouts in a scrambled order and then keep pushing them back, the
+  // way that watchdogs and coalescers do.
+  TimeTicks start_time = TimeTicks::Now();
+  vector<int> ids;
+  for (int i = 0; i < kNumTimeouts; ++i) {
+    const int64_t offset_ms = (i * 7919) % kNumTimeouts;
+    ids.push_back(
+        event_loop.AddTimeout(NewPermanentCallback(&HandleUnexpectedTimeout),
+                              60000 + offset_ms, 0));
+  }
+  for (int reset = 1; reset <= kNumResets; ++reset) {
+    for (int i = 0; i < kNumTimeouts; ++i)
+      event_loop.ResetTimeout(ids[i], 60000 + 1000 * reset + i, 0);
+  }
+  for (int i = 0; i < kNumTimeouts; ++i)
+    event_loop.SuspendTimeout(ids[i]);
+  const TimeDelta shared_time = TimeTicks::Now() - start_time;
+
+  const int shared_num_fds = CountOpenFds() - initial_num_fds;
+  const int shared_num_syscalls =
+      event_loop.num_timer_fd_updates() - initial_num_timer_fd_updates;
+  EXPECT_EQ(kNumTimeouts, event_loop.num_timeouts());
+  EXPECT_EQ(0, shared_num_fds);
+  EXPECT_LT(shared_num_syscalls, kNumTimeouts / 10);
+
+  // Now do the same thing with a timerfd per timeout: a timerfd_create(),
+  // epoll_ctl() and timerfd_settime() for each addition, plus a
+  // timerfd_settime() for each reset and suspension.
+  const int epoll_fd = epoll_create(10);
+  PCHECK(epoll_fd != -1);
+  start_time = TimeTicks::Now();
+  vector<int> timer_fds;
+  int per_timer_num_syscalls = 0;
+  struct itimerspec timer_spec;
+  memset(&timer_spec, 0, sizeof(timer_spec));
+  for (int i = 0; i < kNumTimeouts; ++i) {
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timer_fd == -1) {
+      PLOG(WARNING) << "Ran out of fds after creating " << i << " timers";
+      break;
+    }
+    timer_fds.push_back(timer_fd);
+    struct epoll_event epoll_event;
+    epoll_event.events = EPOLLIN;
+    epoll_event.data.fd = timer_fd;
+    PCHECK(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &epoll_event) == 0);
+    timer_spec.it_value.tv_sec = 60 + (i * 7919) % kNumTimeouts / 1000;
+    PCHECK(timerfd_settime(timer_fd, 0, &timer_spec, NULL) == 0);
+    per_timer_num_syscalls += 3;
+  }
+  for (int reset = 1; reset <= kNumResets; ++reset) {
+    timer_spec.it_value.tv_sec = 60 + reset;
+    for (size_t i = 0; i < timer_fds.size(); ++i) {
+      PCHECK(timerfd_settime(timer_fds[i], 0, &timer_spec, NULL) == 0);
+      per_timer_num_syscalls++;
+    }
+  }
+  memset(&timer_spec, 0, sizeof(timer_spec));
+  for (size_t i = 0; i < timer_fds.size(); ++i) {
+    PCHECK(timerfd_settime(timer_fds[i], 0, &timer_spec, NULL) == 0);
+    per_timer_num_syscalls++;
+  }
+  const TimeDelta per_timer_time = TimeTicks::Now() - start_time;
+  const int per_timer_num_fds = CountOpenFds() - initial_num_fds - 1;
+
+  for (size_t i = 0; i < timer_fds.size(); ++i)
+    PCHECK(HANDLE_EINTR(close(timer_fds[i])) == 0);
+  PCHECK(HANDLE_EINTR(close(epoll_fd)) == 0);
+
+  EXPECT_EQ(static_cast<int>(timer_fds.size()), per_timer_num_fds);
+  EXPECT_GT(per_timer_num_syscalls, shared_num_syscalls);
+
+  LOG(INFO) << kNumTimeouts << " timeouts with " << kNumResets
+            << " resets each:\n"
+            << "  shared timer:    " << shared_num_syscalls << " syscalls, "
+            << shared_num_fds << " extra fds, "
+            << shared_time.InMicroseconds() << " us\n"
+            << "  timer per fd:    " << per_timer_num_syscalls
+            << " syscalls, " << per_timer_num_fds << " extra fds, "
+            << per_timer_time.InMicroseconds() << " us";
+}
+
 }  // namespace window_manager
 
 int main(int argc, char** argv) {
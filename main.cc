@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <signal.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 
 #include <cmath>
@@ -30,6 +32,7 @@ extern "C" {
 #endif
 #include "window_manager/event_loop.h"
 #include "window_manager/profiler.h"
+#include "window_manager/profiler_stream.h"
 #include "window_manager/real_dbus_interface.h"
 #include "window_manager/util.h"
 #include "window_manager/window_manager.h"
@@ -44,8 +47,19 @@ DEFINE_int32(pause_at_start, 0,
 DEFINE_string(profile_dir, "./profile",
               "Directory where profiles should be written; created if it "
               "doesn't exist.");
+DEFINE_bool(profile_continuous, false,
+            "Stream profiler samples to a memory-mapped file from a "
+            "background thread instead of buffering --profile_max_samples "
+            "samples at a time and writing them from the main thread.");
+DEFINE_int32(profile_max_file_mb, 256,
+             "Maximum size of the profile written with --profile_continuous; "
+             "later samples are dropped.");
 DEFINE_int32(profile_max_samples, 200,
              "Maximum number of samples (buffer size) for profiler.");
+DEFINE_int32(profile_ring_buffer_size, 16384,
+             "Number of samples that can be queued for the profiler's "
+             "background thread with --profile_continuous (must be a power "
+             "of 2).  Samples are dropped when it's full.");
 DEFINE_bool(start_profiler, false, "Start profiler at window manager startup.");
 
 using std::string;
@@ -81,6 +95,16 @@ static int HandleXIOError(Display* display) {
   _exit(EXIT_FAILURE);
 }
 
+// Handler called when SIGUSR1 is readable from |signal_fd|.  Drains the
+// pending signals and asks |wm| to dump frame timing statistics and
+// counters.
+static void HandleFrameStatsSignal(int signal_fd, WindowManager* wm) {
+  struct signalfd_siginfo info;
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {}
+  wm->DumpFrameStats();
+  wm->DumpCounters();
+}
+
 int main(int argc, char** argv) {
   base::AtExitManager exit_manager;  // needed by base::Singleton
 
@@ -125,9 +149,17 @@ int main(int argc, char** argv) {
   }
 
   const string profile_path = FLAGS_profile_dir + "/" + profile_basename;
-  Singleton<window_manager::Profiler>()->Start(
-      new window_manager::ProfilerWriter(FilePath(profile_path)),
-      kMaxNumProfilerSymbols, FLAGS_profile_max_samples);
+  if (FLAGS_profile_continuous) {
+    Singleton<window_manager::Profiler>()->StartContinuous(
+        new window_manager::ProfilerStreamWriter(
+            FilePath(profile_path),
+            static_cast<size_t>(FLAGS_profile_max_file_mb) * 1024 * 1024),
+        kMaxNumProfilerSymbols, FLAGS_profile_ring_buffer_size);
+  } else {
+    Singleton<window_manager::Profiler>()->Start(
+        new window_manager::ProfilerWriter(FilePath(profile_path)),
+        kMaxNumProfilerSymbols, FLAGS_profile_max_samples);
+  }
 
   Singleton<window_manager::DynamicMarker>()->set_profiler(
       Singleton<window_manager::Profiler>::get());
@@ -172,6 +204,21 @@ int main(int argc, char** argv) {
   event_loop.AddPrePollCallback(
       NewPermanentCallback(&wm, &WindowManager::ProcessPendingEvents));
 
+  // Dump frame timing statistics and counters when we get SIGUSR1.  The
+  // signal is read from a signalfd so that it's handled by the event loop
+  // rather than interrupting whatever we happen to be doing.  Children
+  // inherit the blocked signal, so commands are started with
+  // util::RunCommandInBackground(), which clears the mask.
+  sigset_t frame_stats_signals;
+  sigemptyset(&frame_stats_signals);
+  sigaddset(&frame_stats_signals, SIGUSR1);
+  PCHECK(sigprocmask(SIG_BLOCK, &frame_stats_signals, NULL) == 0);
+  const int signal_fd =
+      signalfd(-1, &frame_stats_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  PCHECK(signal_fd >= 0);
+  event_loop.AddFileDescriptor(
+      signal_fd, NewPermanentCallback(&HandleFrameStatsSignal, signal_fd, &wm));
+
   event_loop.Run();
   return EXIT_SUCCESS;
 }
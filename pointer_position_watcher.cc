@@ -31,6 +31,9 @@ PointerPositionWatcher::PointerPositionWatcher(
       event_loop_->AddTimeout(
           NewPermanentCallback(this, &PointerPositionWatcher::HandleTimeout),
           0, kTimeoutMs);  // recurring=true
+  // Don't mark this timeout as deferrable: we don't get X events for
+  // pointer motion, so the event loop can go idle while the pointer is
+  // moving.
 }
 
 PointerPositionWatcher::~PointerPositionWatcher() {
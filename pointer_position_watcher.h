@@ -28,7 +28,9 @@ class XConnection;
 // With that being said, repeatedly waking up to poll the X server over
 // long periods of time is a bad idea from a power consumption perspective,
 // so this should only be used in cases where the user is likely to
-// enter/leave the target region soon.
+// enter/leave the target region soon.  Polling continues while the event
+// loop is idle, since pointer motion doesn't generate the X events that
+// would end idle mode.
 class PointerPositionWatcher {
  public:
   // The constructor takes ownership of |cb|.
@@ -91,6 +91,38 @@ TEST_F(PointerPositionWatcherTest, Basic) {
   EXPECT_EQ(-1, watcher->timeout_id());
 }
 
+// Check that we keep polling while the event loop is idle.  We don't get X
+// events for pointer motion, so moving the pointer doesn't end idle mode.
+TEST_F(PointerPositionWatcherTest, PollWhileIdle) {
+  if (!EventLoop::IsTimerFdSupported())
+    return;
+
+  EventLoop event_loop;
+  event_loop.UseFakeClockForTesting();
+  MockXConnection xconn;
+  xconn.SetPointerPosition(Point(5, 5));
+
+  TestCallbackCounter counter;
+  PointerPositionWatcher watcher(
+      &event_loop,
+      &xconn,
+      NewPermanentCallback(&counter, &TestCallbackCounter::Increment),
+      false,  // watch_for_entering_target
+      Rect(0, 0, 10, 10));
+  event_loop.SetIdle(true);
+  event_loop.AdvanceFakeClockForTesting(1000);
+  EXPECT_EQ(0, counter.num_calls());
+  EXPECT_GE(watcher.timeout_id(), 0);
+
+  // Move the pointer out of the target while we're still idle.  The
+  // callback should run at the next poll.
+  xconn.SetPointerPosition(Point(20, 20));
+  event_loop.AdvanceFakeClockForTesting(1000);
+  EXPECT_EQ(1, counter.num_calls());
+  EXPECT_EQ(-1, watcher.timeout_id());
+  EXPECT_TRUE(event_loop.idle());
+}
+
 // Test that we don't crash if a callback deletes the watcher that ran it.
 TEST_F(PointerPositionWatcherTest, DeleteFromCallback) {
   EventLoop event_loop;
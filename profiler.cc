@@ -6,6 +6,7 @@
 
 #include <cstring>
 #include <stack>
+#include <vector>
 
 #include <sys/time.h>
 #include <stdio.h>
@@ -15,18 +16,41 @@
 #include "base/hash_tables.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/stl_util-inl.h"
+#include "base/threading/platform_thread.h"
 #include "base/time.h"
 #include "window_manager/profiler_data.h"
+#include "window_manager/profiler_stream.h"
 
 namespace window_manager {
 
+using base::AutoLock;
+using base::PlatformThread;
 using base::TimeTicks;
 using file_util::CloseFile;
 using file_util::OpenFile;
+using std::stack;
+using std::vector;
+
+namespace profiler {
+
+const char* const kStaticMarkerNames[NUM_STATIC_MARKERS] = {
+#define DEFINE_STATIC_MARKER_NAME(name) #name,
+  PROFILER_STATIC_MARKERS(DEFINE_STATIC_MARKER_NAME)
+#undef DEFINE_STATIC_MARKER_NAME
+};
+
+}  // namespace profiler
 
 //
 // Static constants and functions
 //
+
+// In continuous mode, samples are staged in a small per-thread array and
+// pushed to the thread's ring buffer in batches of this many samples (or
+// when the thread calls Flush()).
+static const unsigned int kStagingBufferSize = 64;
+
 static inline int64_t Now() {
   return TimeTicks::Now().ToInternalValue();
 }
@@ -52,6 +76,15 @@ void Marker::End() {
   profiler_->AddSample(symbol_id_, Now(), profiler::MARK_FLAG_END);
 }
 
+void Marker::TapWithArg(int64_t arg) {
+  profiler_->AddSampleWithArg(symbol_id_, Now(), profiler::MARK_FLAG_TAP, arg);
+}
+
+void Marker::BeginWithArg(int64_t arg) {
+  profiler_->AddSampleWithArg(
+      symbol_id_, Now(), profiler::MARK_FLAG_BEGIN, arg);
+}
+
 //
 // DynamicMarker definition
 //
@@ -59,7 +92,12 @@ DynamicMarker::DynamicMarker()
     : profiler_(NULL) {
 }
 
+DynamicMarker::~DynamicMarker() {
+  STLDeleteElements(&all_recent_symbol_ids_);
+}
+
 unsigned int DynamicMarker::GetSymbolId(const char* name) {
+  AutoLock lock(lock_);
   if (symbol_table_.find(name) == symbol_table_.end()) {
     unsigned int symbol_id =  profiler_->AddSymbol(name);
     symbol_table_[name] = symbol_id;
@@ -69,34 +107,55 @@ unsigned int DynamicMarker::GetSymbolId(const char* name) {
   }
 }
 
+stack<unsigned int>* DynamicMarker::GetRecentSymbolIds() {
+  stack<unsigned int>* symbol_ids = recent_symbol_ids_.Get();
+  if (!symbol_ids) {
+    symbol_ids = new stack<unsigned int>;
+    recent_symbol_ids_.Set(symbol_ids);
+    AutoLock lock(lock_);
+    all_recent_symbol_ids_.push_back(symbol_ids);
+  }
+  return symbol_ids;
+}
+
 void DynamicMarker::Tap(const char* name) {
   profiler_->AddSample(GetSymbolId(name), Now(), profiler::MARK_FLAG_TAP);
 }
 
 void DynamicMarker::Begin(const char* name) {
   unsigned int symbol_id = GetSymbolId(name);
-  recent_symbol_ids_.push(symbol_id);
+  GetRecentSymbolIds()->push(symbol_id);
   profiler_->AddSample(symbol_id, Now(), profiler::MARK_FLAG_BEGIN);
 }
 
 void DynamicMarker::End() {
-  unsigned int symbol_id = recent_symbol_ids_.top();
+  stack<unsigned int>* symbol_ids = GetRecentSymbolIds();
+  unsigned int symbol_id = symbol_ids->top();
   profiler_->AddSample(symbol_id, Now(), profiler::MARK_FLAG_END);
-  recent_symbol_ids_.pop();
+  symbol_ids->pop();
 }
 
 //
 // Profiler definition
 //
+Profiler::ThreadBuffer::ThreadBuffer(int32_t thread_id, unsigned int capacity)
+    : thread_id(thread_id),
+      samples(new profiler::Sample[capacity]),
+      num_samples(0),
+      capacity(capacity) {
+}
+
+Profiler::ThreadBuffer::~ThreadBuffer() {
+}
+
 Profiler::Profiler()
     : profiler_writer_(NULL),
       status_(STATUS_STOP),
       max_num_symbols_(0),
       max_num_samples_(0),
+      ring_buffer_size_(0),
       num_symbols_(0),
-      num_samples_(0),
-      symbols_(NULL),
-      samples_(NULL) {
+      symbols_(NULL) {
 }
 
 Profiler::~Profiler() {
@@ -110,8 +169,10 @@ void Profiler::Start(ProfilerWriter* profiler_writer,
     LOG(WARNING) << "the profiler has already started";
   } else if (profiler_writer == NULL) {
     LOG(WARNING) << "profiler writer cannot be NULL";
-  } else if (max_num_symbols == 0 || max_num_samples == 0) {
-    LOG(WARNING) << "the maximum # of symbols and samples must > 0";
+  } else if (max_num_symbols < profiler::NUM_STATIC_MARKERS ||
+             max_num_samples < 2) {
+    LOG(WARNING) << "the maximum # of symbols must >= # of static markers and "
+                 << "the maximum # of samples must > 1";
   } else {
     profiler_writer_ = profiler_writer;
     max_num_symbols_ = max_num_symbols;
@@ -119,10 +180,35 @@ void Profiler::Start(ProfilerWriter* profiler_writer,
     status_ = STATUS_RUN;
 
     symbols_.reset(new profiler::Symbol[max_num_symbols_]);
-    samples_.reset(new profiler::Sample[max_num_samples_]);
+    memset(symbols_.get(), 0, sizeof(symbols_[0]) * max_num_symbols_);
+    RegisterStaticMarkers();
+  }
+}
 
+void Profiler::StartContinuous(ProfilerStreamWriter* stream_writer,
+                               unsigned int max_num_symbols,
+                               unsigned int ring_buffer_size) {
+  scoped_ptr<ProfilerStreamWriter> scoped_stream_writer(stream_writer);
+  if (status_ != STATUS_STOP) {
+    LOG(WARNING) << "the profiler has already started";
+  } else if (stream_writer == NULL) {
+    LOG(WARNING) << "profiler stream writer cannot be NULL";
+  } else if (max_num_symbols < profiler::NUM_STATIC_MARKERS ||
+             ring_buffer_size == 0 ||
+             (ring_buffer_size & (ring_buffer_size - 1)) != 0) {
+    LOG(WARNING) << "the maximum # of symbols must >= # of static markers and "
+                 << "the ring buffer size must be a power of 2";
+  } else if (!stream_writer->Start(max_num_symbols)) {
+    LOG(WARNING) << "unable to start profiler stream writer";
+  } else {
+    stream_writer_.swap(scoped_stream_writer);
+    max_num_symbols_ = max_num_symbols;
+    ring_buffer_size_ = ring_buffer_size;
+    status_ = STATUS_RUN;
+
+    symbols_.reset(new profiler::Symbol[max_num_symbols_]);
     memset(symbols_.get(), 0, sizeof(symbols_[0]) * max_num_symbols_);
-    memset(samples_.get(), 0, sizeof(samples_[0]) * max_num_samples_);
+    RegisterStaticMarkers();
   }
 }
 
@@ -144,47 +230,139 @@ void Profiler::Stop() {
     LOG(WARNING) << "the profiler was not started";
     return;
   }
-  Flush();
+  status_ = STATUS_STOP;
+
+  for (vector<ThreadBuffer*>::iterator it = thread_buffers_.begin();
+       it != thread_buffers_.end(); ++it) {
+    FlushThreadBuffer(*it);
+  }
+
+  if (continuous()) {
+    stream_writer_->Stop();
+    int64_t num_wraparounds = 0, num_overflows = 0;
+    for (vector<ThreadBuffer*>::iterator it = thread_buffers_.begin();
+         it != thread_buffers_.end(); ++it) {
+      num_wraparounds += (*it)->ring_buffer->num_wraparounds();
+      num_overflows += (*it)->ring_buffer->GetNumOverflows();
+    }
+    LOG(INFO) << "profiler wrote " << stream_writer_->GetNumWrittenSamples()
+              << " samples from " << thread_buffers_.size()
+              << " thread(s); ring buffers wrapped around " << num_wraparounds
+              << " time(s) and overflowed " << num_overflows << " time(s), "
+              << stream_writer_->GetNumDroppedSamples()
+              << " samples didn't fit in the file";
+    stream_writer_.reset(NULL);
+  }
+
+  current_thread_buffer_.Set(NULL);
+  STLDeleteElements(&thread_buffers_);
   max_num_symbols_ = 0;
   max_num_samples_ = 0;
+  ring_buffer_size_ = 0;
+  num_symbols_ = 0;
   symbols_.reset(NULL);
-  samples_.reset(NULL);
-  status_ = STATUS_STOP;
 }
 
 void Profiler::Flush() {
-  if (status_ != STATUS_STOP && num_samples_ != 0) {
-    profiler_writer_->Update(*this);
-    num_samples_ = 0;
+  if (status_ != STATUS_STOP) {
+    ThreadBuffer* buffer = current_thread_buffer_.Get();
+    if (buffer)
+      FlushThreadBuffer(buffer);
   }
 }
 
 unsigned int Profiler::AddSymbol(const char* name) {
+  AutoLock lock(lock_);
   if (status_ == STATUS_STOP || num_symbols_ == max_num_symbols_) {
     return max_num_symbols_;
   }
   const int kBufferSize = sizeof(symbols_[num_symbols_].name);
   strncpy(symbols_[num_symbols_].name, name, kBufferSize - 1);
   symbols_[num_symbols_].name[kBufferSize - 1] = '\0';
+  if (continuous())
+    stream_writer_->WriteSymbol(num_symbols_, symbols_[num_symbols_]);
 
   return num_symbols_++;
 }
 
 void Profiler::AddSample(unsigned int symbol_id, int64_t time,
                          profiler::MarkFlag flag) {
+  profiler::Sample sample;
+  sample.symbol_id = symbol_id;
+  sample.flag = flag;
+  sample.time = time;
+  sample.has_arg = 0;
+  sample.arg = 0;
+  RecordSample(&sample);
+}
+
+void Profiler::AddSampleWithArg(unsigned int symbol_id, int64_t time,
+                                profiler::MarkFlag flag, int64_t arg) {
+  profiler::Sample sample;
+  sample.symbol_id = symbol_id;
+  sample.flag = flag;
+  sample.time = time;
+  sample.has_arg = 1;
+  sample.arg = arg;
+  RecordSample(&sample);
+}
+
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer() {
+  ThreadBuffer* buffer = current_thread_buffer_.Get();
+  if (buffer)
+    return buffer;
+
+  AutoLock lock(lock_);
+  if (continuous()) {
+    buffer = new ThreadBuffer(PlatformThread::CurrentId(), kStagingBufferSize);
+    buffer->ring_buffer.reset(new ProfilerRingBuffer(ring_buffer_size_));
+    stream_writer_->AddRingBuffer(buffer->ring_buffer.get());
+  } else {
+    buffer = new ThreadBuffer(PlatformThread::CurrentId(), max_num_samples_);
+  }
+  thread_buffers_.push_back(buffer);
+  current_thread_buffer_.Set(buffer);
+  return buffer;
+}
+
+void Profiler::RecordSample(profiler::Sample* sample) {
   if (status_ != STATUS_RUN) {
     return;
   }
-  if (symbol_id >= num_symbols_) {
+  if (static_cast<unsigned int>(sample->symbol_id) >= num_symbols_) {
     LOG(WARNING) << "symbol id provided exceeds number of symbols";
     return;
   }
-  samples_[num_samples_].symbol_id = symbol_id;
-  samples_[num_samples_].flag = flag;
-  samples_[num_samples_].time = time;
-  if (++num_samples_ == max_num_samples_) {
-    Flush();
+
+  ThreadBuffer* buffer = GetThreadBuffer();
+  sample->thread_id = buffer->thread_id;
+  buffer->samples[buffer->num_samples] = *sample;
+  if (++buffer->num_samples == buffer->capacity) {
+    FlushThreadBuffer(buffer);
+  }
+}
+
+void Profiler::RegisterStaticMarkers() {
+  for (int i = 0; i < profiler::NUM_STATIC_MARKERS; ++i) {
+    const unsigned int symbol_id =
+        AddSymbol(profiler::kStaticMarkerNames[i]);
+    DCHECK_EQ(symbol_id, static_cast<unsigned int>(i));
+  }
+}
+
+void Profiler::FlushThreadBuffer(ThreadBuffer* buffer) {
+  if (buffer->num_samples == 0)
+    return;
+  if (continuous()) {
+    // The ring buffer counts the samples that it drops.
+    for (unsigned int i = 0; i < buffer->num_samples; ++i)
+      buffer->ring_buffer->Push(buffer->samples[i]);
+    buffer->num_samples = 0;
+    return;
   }
+  AutoLock lock(lock_);
+  profiler_writer_->Update(*this, buffer->samples.get(), buffer->num_samples);
+  buffer->num_samples = 0;
 }
 
 //
@@ -196,7 +374,9 @@ ProfilerWriter::ProfilerWriter(FilePath file_path)
       file_path_(file_path) {
 }
 
-void ProfilerWriter::Update(const Profiler& profiler) {
+void ProfilerWriter::Update(const Profiler& profiler,
+                            const profiler::Sample* samples,
+                            unsigned int num_samples) {
   FILE* fp = NULL;
   if (num_written_samples_ == 0) {
     fp = OpenFile(file_path_, "wb");
@@ -209,7 +389,7 @@ void ProfilerWriter::Update(const Profiler& profiler) {
     return;
   }
 
-  num_written_samples_ += profiler.num_samples_;
+  num_written_samples_ += num_samples;
 
   // overwrite header
   size_t result = 0;
@@ -233,9 +413,8 @@ void ProfilerWriter::Update(const Profiler& profiler) {
 
   // append samples
   fseek(fp, 0, SEEK_END);
-  result = fwrite(profiler.samples_.get(), sizeof(profiler.samples_[0]),
-                  profiler.num_samples_, fp);
-  DCHECK_EQ(result, profiler.num_samples_);
+  result = fwrite(samples, sizeof(samples[0]), num_samples, fp);
+  DCHECK_EQ(result, num_samples);
 
   CloseFile(fp);
 }
@@ -7,11 +7,16 @@
 
 #include <string>
 #include <stack>
+#include <vector>
 #include "base/file_path.h"
 #include "base/hash_tables.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/singleton.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/thread_local.h"
+#include "base/time.h"
 #include "window_manager/profiler_data.h"
+#include "window_manager/profiler_markers.h"
 
 //
 // IMPORTANT NOTE:
@@ -25,9 +30,16 @@
 // Profiler::Start and Profiler::Stop are used to signal start and stop of the
 // profiler, both should be called only once throughout the program.
 // Profiler::Start should be called before any of the other PROFILER_* macros
-// are used.  Profiler::Stop is called at the very end, but it is optional since
-// the destructor will call it again.  PROFILER_PAUSE / PROFILER_RESUME can be
-// used to pause/resume the profiler once it is started.
+// are used.  Profiler::StartContinuous can be used instead of Profiler::Start
+// to run the profiler in continuous mode, where samples are passed through a
+// lock-free ring buffer to a background thread that appends them to a
+// memory-mapped file; this avoids stalling the profiled thread on file I/O
+// when the sample buffer fills up, so it can be left running for long
+// sessions.  In continuous mode Profiler::Flush pushes the calling thread's
+// 64-sample staging array to the ring buffer.  Profiler::Stop is called at
+// the very end, but it is optional since the destructor will call it again.
+// PROFILER_PAUSE / PROFILER_RESUME can be used to pause/resume the profiler
+// once it is started.
 //
 // PROFILER_MARKER_BEGIN and PROFILER_MARKER_END are used in conjunction to
 // mark a region for timing.  PROFILER_MARKER_END must match with a
@@ -55,6 +67,28 @@
 //   ...
 // }
 //
+// PROFILER_MARKER_TAP_WITH_ARG and PROFILER_MARKER_BEGIN_WITH_ARG additionally
+// record an integer argument with the sample, e.g. the number of actors that
+// were visited or the area that was damaged.
+//
+// Usage {
+//   PROFILER_MARKER_TAP_WITH_ARG(_num_actors_, actor_count);
+// }
+//
+// Markers may be used from multiple threads.  Each thread records samples to
+// its own buffer, and every sample includes the ID of the thread that
+// recorded it.  PROFILER_FLUSH only flushes the calling thread's buffer;
+// Profiler::Stop flushes all of them, so other threads should stop recording
+// samples before it's called.
+//
+// PROFILER_STATIC_MARKER_BEGIN, PROFILER_STATIC_MARKER_END and
+// PROFILER_STATIC_MARKER_TAP work like the corresponding PROFILER_MARKER_*
+// macros, but can only be used with markers listed in profiler_markers.h.
+// Their symbol IDs are compile-time constants and recording a sample usually
+// just writes it to a preallocated per-thread buffer, so they're cheap enough
+// to use in hot paths.  See profiler_test.cc for a comparison of the
+// overhead of the different kinds of markers.
+//
 // PROFILER_DYNAMIC_MARKER_* macros are used to create dynamic markers.  They
 // are not statically compiled into the program, and can be created while the
 // program is running.  Use static markers whenever possible, they are
@@ -85,12 +119,39 @@
       Singleton<window_manager::Profiler>::get(), #name); \
   _marker_##name.Begin()
 
+#define PROFILER_MARKER_TAP_WITH_ARG(name, arg) \
+  do { \
+    static window_manager::Marker _marker_##name( \
+        Singleton<window_manager::Profiler>::get(), #name); \
+    _marker_##name.TapWithArg(arg); \
+  } while (false)
+
+#define PROFILER_MARKER_BEGIN_WITH_ARG(name, arg) \
+  static window_manager::Marker _marker_##name( \
+      Singleton<window_manager::Profiler>::get(), #name); \
+  _marker_##name.BeginWithArg(arg)
+
 #define PROFILER_MARKER_CONTINUE(name) \
   _marker_##name.Tap()
 
 #define PROFILER_MARKER_END(name) \
   _marker_##name.End()
 
+#define PROFILER_STATIC_MARKER_TAP(name) \
+  Singleton<window_manager::Profiler>::get()->AddStaticSample( \
+      window_manager::profiler::STATIC_MARKER_##name, \
+      window_manager::profiler::MARK_FLAG_TAP)
+
+#define PROFILER_STATIC_MARKER_BEGIN(name) \
+  Singleton<window_manager::Profiler>::get()->AddStaticSample( \
+      window_manager::profiler::STATIC_MARKER_##name, \
+      window_manager::profiler::MARK_FLAG_BEGIN)
+
+#define PROFILER_STATIC_MARKER_END(name) \
+  Singleton<window_manager::Profiler>::get()->AddStaticSample( \
+      window_manager::profiler::STATIC_MARKER_##name, \
+      window_manager::profiler::MARK_FLAG_END)
+
 #define PROFILER_DYNAMIC_MARKER_TAP(name) \
   Singleton<window_manager::DynamicMarker>()->Tap(name)
 
@@ -112,10 +173,20 @@
   do {} while (false)
 #define PROFILER_MARKER_BEGIN(name) \
   do {} while (false)
+#define PROFILER_MARKER_TAP_WITH_ARG(name, arg) \
+  do {} while (false)
+#define PROFILER_MARKER_BEGIN_WITH_ARG(name, arg) \
+  do {} while (false)
 #define PROFILER_MARKER_CONTINUE(name) \
   do {} while (false)
 #define PROFILER_MARKER_END(name) \
   do {} while (false)
+#define PROFILER_STATIC_MARKER_TAP(name) \
+  do {} while (false)
+#define PROFILER_STATIC_MARKER_BEGIN(name) \
+  do {} while (false)
+#define PROFILER_STATIC_MARKER_END(name) \
+  do {} while (false)
 #define PROFILER_DYNAMIC_MARKER_TAP(name) \
   do {} while (false)
 #define PROFILER_DYNAMIC_MARKER_BEGIN(name) \
@@ -129,6 +200,8 @@ namespace window_manager {
 class DynamicMarker;
 class Marker;
 class Profiler;
+class ProfilerRingBuffer;
+class ProfilerStreamWriter;
 class ProfilerWriter;
 class ScopedMarker;
 
@@ -138,6 +211,8 @@ class Marker {
   void Tap();
   void Begin();
   void End();
+  void TapWithArg(int64_t arg);
+  void BeginWithArg(int64_t arg);
 
  private:
   Profiler* profiler_;
@@ -160,12 +235,25 @@ class DynamicMarker {
   friend struct DefaultSingletonTraits<DynamicMarker>;
 
   DynamicMarker();
+  ~DynamicMarker();
   unsigned int GetSymbolId(const char* name);
 
+  // Get the calling thread's stack of IDs of symbols passed to Begin(),
+  // creating it if needed.
+  std::stack<unsigned int>* GetRecentSymbolIds();
+
   Profiler* profiler_;
-  std::stack<unsigned int> recent_symbol_ids_;
+
+  // Protects |symbol_table_| and |all_recent_symbol_ids_|.
+  base::Lock lock_;
+
   base::hash_map<std::string, unsigned int> symbol_table_;
 
+  // Per-thread stacks returned by GetRecentSymbolIds(), and all of the
+  // stacks that have been created (so they can be deleted).
+  base::ThreadLocalPointer<std::stack<unsigned int> > recent_symbol_ids_;
+  std::vector<std::stack<unsigned int>*> all_recent_symbol_ids_;
+
   DISALLOW_COPY_AND_ASSIGN(DynamicMarker);
 };
 
@@ -192,6 +280,11 @@ class Profiler {
 
   void Start(ProfilerWriter* profiler_writer, unsigned int max_num_symbols,
              unsigned int max_num_samples);
+  // Takes ownership of |stream_writer|.  |ring_buffer_size| must be a power
+  // of two.
+  void StartContinuous(ProfilerStreamWriter* stream_writer,
+                       unsigned int max_num_symbols,
+                       unsigned int ring_buffer_size);
   void Pause();
   void Resume();
   void Stop();
@@ -199,34 +292,112 @@ class Profiler {
   void Flush();
   unsigned int AddSymbol(const char* name);
   void AddSample(unsigned int symbol_id, int64_t time, profiler::MarkFlag flag);
+  void AddSampleWithArg(unsigned int symbol_id, int64_t time,
+                        profiler::MarkFlag flag, int64_t arg);
+
+  // Record a sample for a marker from profiler_markers.h at the current
+  // time.  This is inlined; when the calling thread's buffer has room, it
+  // just writes the sample there.
+  void AddStaticSample(profiler::StaticMarkerId marker_id,
+                       profiler::MarkFlag flag);
 
   ProfilerStatus status() const {
     return status_;
   }
 
+  // Is the profiler running in continuous mode?
+  bool continuous() const {
+    return stream_writer_.get() != NULL;
+  }
+
  private:
   friend struct DefaultSingletonTraits<Profiler>;
   friend class ProfilerWriter;
 
+  // Samples recorded by a single thread.
+  struct ThreadBuffer {
+    ThreadBuffer(int32_t thread_id, unsigned int capacity);
+    ~ThreadBuffer();
+
+    int32_t thread_id;
+
+    // Samples that haven't been written (or, in continuous mode, pushed to
+    // |ring_buffer|) yet.
+    scoped_array<profiler::Sample> samples;
+    unsigned int num_samples;
+    unsigned int capacity;
+
+    // Only used in continuous mode.
+    scoped_ptr<ProfilerRingBuffer> ring_buffer;
+  };
+
   Profiler();
   ~Profiler();
 
+  // Register the symbols for the markers in profiler_markers.h, so that
+  // their IDs match their StaticMarkerId values.
+  void RegisterStaticMarkers();
+
+  // Get the calling thread's buffer, creating it if needed.
+  ThreadBuffer* GetThreadBuffer();
+
+  // Record |sample| in the calling thread's buffer, filling in its thread
+  // ID.
+  void RecordSample(profiler::Sample* sample);
+
+  // Write out the samples in |buffer| (or push them to its ring buffer in
+  // continuous mode) and clear it.
+  void FlushThreadBuffer(ThreadBuffer* buffer);
+
   ProfilerWriter* profiler_writer_;
   ProfilerStatus status_;
   unsigned int max_num_symbols_;
   unsigned int max_num_samples_;
+  unsigned int ring_buffer_size_;
   unsigned int num_symbols_;
-  unsigned int num_samples_;
   scoped_array<profiler::Symbol> symbols_;
-  scoped_array<profiler::Sample> samples_;
+
+  // Used instead of |profiler_writer_| in continuous mode.
+  scoped_ptr<ProfilerStreamWriter> stream_writer_;
+
+  // Protects |symbols_|, |num_symbols_|, |thread_buffers_|, and the
+  // writers.
+  base::Lock lock_;
+
+  // Buffers for all threads that have recorded samples, and the calling
+  // thread's buffer.
+  std::vector<ThreadBuffer*> thread_buffers_;
+  base::ThreadLocalPointer<ThreadBuffer> current_thread_buffer_;
 
   DISALLOW_COPY_AND_ASSIGN(Profiler);
 };
 
+inline void Profiler::AddStaticSample(profiler::StaticMarkerId marker_id,
+                                      profiler::MarkFlag flag) {
+  if (status_ != STATUS_RUN) {
+    return;
+  }
+  ThreadBuffer* buffer = current_thread_buffer_.Get();
+  // Let AddSample() handle creating the buffer and flushing it when full.
+  if (buffer == NULL || buffer->num_samples + 1 >= buffer->capacity) {
+    AddSample(marker_id, base::TimeTicks::Now().ToInternalValue(), flag);
+    return;
+  }
+  profiler::Sample& sample = buffer->samples[buffer->num_samples++];
+  sample.symbol_id = marker_id;
+  sample.flag = flag;
+  sample.time = base::TimeTicks::Now().ToInternalValue();
+  sample.thread_id = buffer->thread_id;
+  sample.has_arg = 0;
+  sample.arg = 0;
+}
+
 class ProfilerWriter {
  public:
   explicit ProfilerWriter(FilePath file_path);
-  void Update(const Profiler& profiler);
+  void Update(const Profiler& profiler,
+              const profiler::Sample* samples,
+              unsigned int num_samples);
 
  private:
   unsigned int num_written_samples_;
@@ -25,6 +25,9 @@ struct Sample {
   int32_t symbol_id;
   int32_t flag;  // MarkFlag
   int64_t time;
+  int32_t thread_id;  // ID of the thread that recorded the sample
+  int32_t has_arg;    // nonzero if |arg| was supplied
+  int64_t arg;        // optional value, e.g. a number of actors
 };
 
 }  // namespace profiler
@@ -0,0 +1,33 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_PROFILER_MARKERS_H_
+#define WINDOW_MANAGER_PROFILER_MARKERS_H_
+
+// Markers that can be used with the PROFILER_STATIC_MARKER_* macros in
+// profiler.h.  Their symbols are registered in this order when the profiler
+// starts, so each marker's symbol ID is a compile-time constant and recording
+// a sample doesn't need to look anything up.  Keep the list sorted.
+#define PROFILER_STATIC_MARKERS(MARKER) \
+  MARKER(RealCompositor_ContainerActor_Update) \
+  MARKER(RealCompositor_Draw) \
+  MARKER(RealCompositor_Draw_Update)
+
+namespace window_manager {
+namespace profiler {
+
+enum StaticMarkerId {
+#define DEFINE_STATIC_MARKER_ID(name) STATIC_MARKER_##name,
+  PROFILER_STATIC_MARKERS(DEFINE_STATIC_MARKER_ID)
+#undef DEFINE_STATIC_MARKER_ID
+  NUM_STATIC_MARKERS
+};
+
+// Names of the static markers, indexed by StaticMarkerId.
+extern const char* const kStaticMarkerNames[NUM_STATIC_MARKERS];
+
+}  // namespace profiler
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_PROFILER_MARKERS_H_
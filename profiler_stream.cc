@@ -0,0 +1,303 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/profiler_stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "base/eintr_wrapper.h"
+#include "base/logging.h"
+
+using base::AutoLock;
+using base::subtle::Acquire_Load;
+using base::subtle::Atomic32;
+using base::subtle::NoBarrier_AtomicIncrement;
+using base::subtle::NoBarrier_Load;
+using base::subtle::NoBarrier_Store;
+using base::subtle::Release_Store;
+using std::max;
+using std::min;
+using std::vector;
+
+namespace window_manager {
+
+// How long the drain thread sleeps between passes over the ring buffers.
+static const int kDrainIntervalMs = 100;
+
+// Maximum number of samples that are copied out of a ring buffer at once.
+static const uint32_t kDrainBatchSize = 1024;
+
+// Granularity with which the output file is grown.  Growing it in large
+// chunks keeps the number of ftruncate() calls down.
+static const size_t kFileGrowthBytes = 1024 * 1024;
+
+// The file starts with three 32-bit fields: the maximum number of symbols,
+// the number of symbols, and the number of samples.
+static const size_t kNumHeaderFields = 3;
+static const int kMaxNumSymbolsField = 0;
+static const int kNumSymbolsField = 1;
+static const int kNumSamplesField = 2;
+
+// Begin ProfilerRingBuffer methods.
+
+ProfilerRingBuffer::ProfilerRingBuffer(uint32_t capacity)
+    : capacity_(capacity),
+      samples_(new profiler::Sample[capacity]),
+      head_(0),
+      tail_(0),
+      num_overflows_(0),
+      num_pushed_(0) {
+  CHECK_GT(capacity_, 0U);
+  CHECK_EQ(capacity_ & (capacity_ - 1), 0U)
+      << "Capacity " << capacity_ << " isn't a power of two";
+  CHECK_LE(capacity_, 1U << 31);
+}
+
+ProfilerRingBuffer::~ProfilerRingBuffer() {}
+
+uint32_t ProfilerRingBuffer::GetSize() const {
+  const uint32_t tail = static_cast<uint32_t>(Acquire_Load(&tail_));
+  const uint32_t head = static_cast<uint32_t>(Acquire_Load(&head_));
+  return head - tail;
+}
+
+uint32_t ProfilerRingBuffer::GetNumOverflows() const {
+  return static_cast<uint32_t>(NoBarrier_Load(&num_overflows_));
+}
+
+bool ProfilerRingBuffer::Push(const profiler::Sample& sample) {
+  const uint32_t head = static_cast<uint32_t>(NoBarrier_Load(&head_));
+  const uint32_t tail = static_cast<uint32_t>(Acquire_Load(&tail_));
+  if (head - tail >= capacity_) {
+    NoBarrier_AtomicIncrement(&num_overflows_, 1);
+    return false;
+  }
+
+  samples_[head & (capacity_ - 1)] = sample;
+  // Publish the sample only after it's been written.
+  Release_Store(&head_, static_cast<Atomic32>(head + 1));
+  num_pushed_++;
+  return true;
+}
+
+uint32_t ProfilerRingBuffer::Pop(profiler::Sample* samples,
+                                 uint32_t max_samples) {
+  DCHECK(samples);
+  const uint32_t tail = static_cast<uint32_t>(NoBarrier_Load(&tail_));
+  const uint32_t head = static_cast<uint32_t>(Acquire_Load(&head_));
+  const uint32_t num_samples = min(head - tail, max_samples);
+
+  for (uint32_t i = 0; i < num_samples; ++i)
+    samples[i] = samples_[(tail + i) & (capacity_ - 1)];
+
+  // Only let the producer reuse the slots after we've copied them.
+  Release_Store(&tail_, static_cast<Atomic32>(tail + num_samples));
+  return num_samples;
+}
+
+// Begin ProfilerStreamWriter methods.
+
+ProfilerStreamWriter::ProfilerStreamWriter(const FilePath& file_path,
+                                           size_t max_file_bytes)
+    : file_path_(file_path),
+      max_file_bytes_(max_file_bytes),
+      max_num_symbols_(0),
+      fd_(-1),
+      map_(NULL),
+      file_bytes_(0),
+      thread_started_(false),
+      should_stop_(0),
+      num_written_samples_(0),
+      num_dropped_samples_(0) {
+}
+
+ProfilerStreamWriter::~ProfilerStreamWriter() {
+  Stop();
+}
+
+bool ProfilerStreamWriter::Start(unsigned int max_num_symbols) {
+  if (fd_ >= 0) {
+    LOG(WARNING) << "Stream writer has already been started";
+    return false;
+  }
+
+  max_num_symbols_ = max_num_symbols;
+  if (max_file_bytes_ < GetSamplesOffset()) {
+    LOG(WARNING) << "Maximum profile size " << max_file_bytes_
+                 << " is too small to hold " << max_num_symbols_
+                 << " symbol(s)";
+    return false;
+  }
+
+  fd_ = HANDLE_EINTR(open(file_path_.value().c_str(),
+                          O_RDWR | O_CREAT | O_TRUNC, 0644));
+  if (fd_ < 0) {
+    PLOG(WARNING) << "Unable to open " << file_path_.value();
+    return false;
+  }
+
+  void* map = mmap(NULL, max_file_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd_, 0);
+  if (map == MAP_FAILED) {
+    PLOG(WARNING) << "Unable to map " << file_path_.value();
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  map_ = static_cast<char*>(map);
+  file_bytes_ = 0;
+
+  if (!GrowFile(GetSamplesOffset())) {
+    Stop();
+    return false;
+  }
+  uint32_t* header = reinterpret_cast<uint32_t*>(map_);
+  header[kMaxNumSymbolsField] = max_num_symbols_;
+  header[kNumSymbolsField] = 0;
+  header[kNumSamplesField] = 0;
+
+  drain_buffer_.reset(new profiler::Sample[kDrainBatchSize]);
+  NoBarrier_Store(&should_stop_, 0);
+  NoBarrier_Store(&num_written_samples_, 0);
+  NoBarrier_Store(&num_dropped_samples_, 0);
+
+  if (pthread_create(&thread_, NULL, &ProfilerStreamWriter::RunDrainThread,
+                     this) != 0) {
+    LOG(WARNING) << "Unable to start profiler drain thread";
+    Stop();
+    return false;
+  }
+  thread_started_ = true;
+  return true;
+}
+
+void ProfilerStreamWriter::Stop() {
+  if (fd_ < 0)
+    return;
+
+  if (thread_started_) {
+    Release_Store(&should_stop_, 1);
+    pthread_join(thread_, NULL);
+    thread_started_ = false;
+    Drain();
+  }
+
+  const size_t final_bytes = GetSamplesOffset() +
+      GetNumWrittenSamples() * sizeof(profiler::Sample);
+  if (HANDLE_EINTR(ftruncate(fd_, min(final_bytes, file_bytes_))) != 0)
+    PLOG(WARNING) << "Unable to truncate " << file_path_.value();
+
+  munmap(map_, max_file_bytes_);
+  map_ = NULL;
+  file_bytes_ = 0;
+  close(fd_);
+  fd_ = -1;
+  drain_buffer_.reset(NULL);
+
+  AutoLock lock(ring_buffers_lock_);
+  ring_buffers_.clear();
+}
+
+void ProfilerStreamWriter::AddRingBuffer(ProfilerRingBuffer* ring_buffer) {
+  DCHECK(ring_buffer);
+  AutoLock lock(ring_buffers_lock_);
+  ring_buffers_.push_back(ring_buffer);
+}
+
+void ProfilerStreamWriter::WriteSymbol(unsigned int symbol_id,
+                                       const profiler::Symbol& symbol) {
+  if (!map_ || symbol_id >= max_num_symbols_)
+    return;
+
+  memcpy(map_ + kNumHeaderFields * sizeof(uint32_t) +
+             symbol_id * sizeof(profiler::Symbol),
+         &symbol, sizeof(symbol));
+  uint32_t* header = reinterpret_cast<uint32_t*>(map_);
+  header[kNumSymbolsField] = max(header[kNumSymbolsField], symbol_id + 1);
+}
+
+uint32_t ProfilerStreamWriter::GetNumWrittenSamples() const {
+  return static_cast<uint32_t>(NoBarrier_Load(&num_written_samples_));
+}
+
+uint32_t ProfilerStreamWriter::GetNumDroppedSamples() const {
+  return static_cast<uint32_t>(NoBarrier_Load(&num_dropped_samples_));
+}
+
+// static
+void* ProfilerStreamWriter::RunDrainThread(void* data) {
+  ProfilerStreamWriter* writer = static_cast<ProfilerStreamWriter*>(data);
+  while (!Acquire_Load(&writer->should_stop_)) {
+    writer->Drain();
+    usleep(kDrainIntervalMs * 1000);
+  }
+  return NULL;
+}
+
+void ProfilerStreamWriter::Drain() {
+  AutoLock lock(ring_buffers_lock_);
+  for (vector<ProfilerRingBuffer*>::iterator it = ring_buffers_.begin();
+       it != ring_buffers_.end(); ++it) {
+    uint32_t num_popped = 0;
+    while ((num_popped = (*it)->Pop(drain_buffer_.get(), kDrainBatchSize)))
+      WriteSamples(num_popped);
+  }
+}
+
+void ProfilerStreamWriter::WriteSamples(uint32_t num_samples) {
+  const uint32_t num_written = GetNumWrittenSamples();
+  const size_t offset =
+      GetSamplesOffset() + num_written * sizeof(profiler::Sample);
+  const size_t max_samples_that_fit =
+      (max_file_bytes_ - offset) / sizeof(profiler::Sample);
+  uint32_t num_to_write = num_samples;
+  if (num_to_write > max_samples_that_fit) {
+    num_to_write = max_samples_that_fit;
+    NoBarrier_AtomicIncrement(&num_dropped_samples_,
+                              num_samples - num_to_write);
+  }
+  if (!num_to_write)
+    return;
+
+  const size_t num_bytes = num_to_write * sizeof(profiler::Sample);
+  if (!GrowFile(offset + num_bytes)) {
+    NoBarrier_AtomicIncrement(&num_dropped_samples_, num_to_write);
+    return;
+  }
+
+  memcpy(map_ + offset, drain_buffer_.get(), num_bytes);
+  NoBarrier_Store(&num_written_samples_, num_written + num_to_write);
+  reinterpret_cast<uint32_t*>(map_)[kNumSamplesField] =
+      num_written + num_to_write;
+}
+
+bool ProfilerStreamWriter::GrowFile(size_t min_bytes) {
+  if (min_bytes <= file_bytes_)
+    return true;
+
+  const size_t new_bytes = min(
+      max_file_bytes_,
+      (min_bytes + kFileGrowthBytes - 1) / kFileGrowthBytes * kFileGrowthBytes);
+  DCHECK_GE(new_bytes, min_bytes);
+  if (HANDLE_EINTR(ftruncate(fd_, new_bytes)) != 0) {
+    PLOG(WARNING) << "Unable to grow " << file_path_.value() << " to "
+                  << new_bytes << " bytes";
+    return false;
+  }
+  file_bytes_ = new_bytes;
+  return true;
+}
+
+size_t ProfilerStreamWriter::GetSamplesOffset() const {
+  return kNumHeaderFields * sizeof(uint32_t) +
+      max_num_symbols_ * sizeof(profiler::Symbol);
+}
+
+}  // namespace window_manager
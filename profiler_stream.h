@@ -0,0 +1,166 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_PROFILER_STREAM_H_
+#define WINDOW_MANAGER_PROFILER_STREAM_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/file_path.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
+#include "window_manager/profiler_data.h"
+
+namespace window_manager {
+
+// Fixed-size queue of profiler samples that can be written by one thread
+// and read by another without locking.  Profiler uses this in continuous
+// mode so that recording a sample never blocks on disk I/O: samples are
+// pushed by a profiled thread (each thread has its own buffer) and drained
+// by ProfilerStreamWriter's background thread.
+//
+// If the consumer falls behind and the buffer fills up, new samples are
+// dropped and counted as overflows rather than overwriting unread ones.
+class ProfilerRingBuffer {
+ public:
+  // |capacity| must be a power of two.
+  explicit ProfilerRingBuffer(uint32_t capacity);
+  ~ProfilerRingBuffer();
+
+  uint32_t capacity() const { return capacity_; }
+
+  // Number of samples currently waiting to be popped.
+  uint32_t GetSize() const;
+
+  // Number of samples that have been dropped because the buffer was full.
+  // Safe to call from any thread.
+  uint32_t GetNumOverflows() const;
+
+  // Number of times that the producer has wrapped around to the start of
+  // the buffer.  Only meaningful when called from the producer's thread.
+  int64_t num_wraparounds() const { return num_pushed_ / capacity_; }
+
+  // Append a sample.  Returns false (and increments the overflow counter)
+  // if the buffer is full.  Must only be called by the producer.
+  bool Push(const profiler::Sample& sample);
+
+  // Copy up to |max_samples| of the oldest samples to |samples| and remove
+  // them from the buffer, returning the number copied.  Must only be
+  // called by the consumer.
+  uint32_t Pop(profiler::Sample* samples, uint32_t max_samples);
+
+ private:
+  const uint32_t capacity_;
+  scoped_array<profiler::Sample> samples_;
+
+  // Free-running counts of samples that have been pushed and popped.
+  // Their difference (modulo 2^32) is the number of queued samples, and
+  // masking them with |capacity_ - 1| yields an index into |samples_|.
+  // |head_| is only written by the producer and |tail_| by the consumer.
+  volatile base::subtle::Atomic32 head_;
+  volatile base::subtle::Atomic32 tail_;
+
+  volatile base::subtle::Atomic32 num_overflows_;
+
+  // Total number of samples pushed, for |num_wraparounds()|.  Only
+  // accessed by the producer.
+  int64_t num_pushed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProfilerRingBuffer);
+};
+
+// Writes samples from one or more ProfilerRingBuffers to a memory-mapped
+// file on a background thread.  The file uses the same layout as the one
+// written by ProfilerWriter (a header, |max_num_symbols| symbol slots, and
+// then the samples), so it can be read by tools/prof_analysis, and its
+// header is kept up to date as samples are drained so that the file is
+// usable even if the process dies without calling Stop().  Samples from
+// different buffers are interleaved in the order in which they're drained,
+// so they're only ordered by time within each thread.
+class ProfilerStreamWriter {
+ public:
+  // The file will not be allowed to grow past |max_file_bytes|; samples
+  // that don't fit are dropped and counted.
+  ProfilerStreamWriter(const FilePath& file_path, size_t max_file_bytes);
+  ~ProfilerStreamWriter();
+
+  // Create and map the file and start the drain thread.  Returns false on
+  // failure.
+  bool Start(unsigned int max_num_symbols);
+
+  // Start draining samples from |ring_buffer|, which must outlive this
+  // object or the next call to Stop().  May be called from any thread.
+  void AddRingBuffer(ProfilerRingBuffer* ring_buffer);
+
+  // Stop the drain thread, write any remaining samples, truncate the file
+  // to its final size, and unmap it.  Called by the destructor.
+  void Stop();
+
+  // Write a symbol to slot |symbol_id| in the file's header.  Calls must be
+  // serialized by the caller.
+  void WriteSymbol(unsigned int symbol_id, const profiler::Symbol& symbol);
+
+  // Number of samples written to and dropped from the file so far.  Safe
+  // to call from any thread.
+  uint32_t GetNumWrittenSamples() const;
+  uint32_t GetNumDroppedSamples() const;
+
+ private:
+  static void* RunDrainThread(void* data);
+
+  // Write all of the samples that are currently in the ring buffers to the
+  // file.
+  void Drain();
+
+  // Write |num_samples| samples from |drain_buffer_| to the file, dropping
+  // them if they don't fit.
+  void WriteSamples(uint32_t num_samples);
+
+  // Grow the file so that it's at least |min_bytes| long, returning false
+  // if it can't be.
+  bool GrowFile(size_t min_bytes);
+
+  // Offset of the first sample in the file.
+  size_t GetSamplesOffset() const;
+
+  FilePath file_path_;
+  size_t max_file_bytes_;
+
+  unsigned int max_num_symbols_;
+
+  // Buffers that are drained by the drain thread, guarded by
+  // |ring_buffers_lock_|.
+  std::vector<ProfilerRingBuffer*> ring_buffers_;  // not owned
+  base::Lock ring_buffers_lock_;
+
+  int fd_;
+
+  // Mapping covering the first |max_file_bytes_| bytes of the file.  Only
+  // the first |file_bytes_| of it are backed by the file.
+  char* map_;
+  size_t file_bytes_;
+
+  // Scratch buffer used by Drain().
+  scoped_array<profiler::Sample> drain_buffer_;
+
+  pthread_t thread_;
+  bool thread_started_;
+
+  // Set to tell the drain thread to exit.
+  volatile base::subtle::Atomic32 should_stop_;
+
+  volatile base::subtle::Atomic32 num_written_samples_;
+  volatile base::subtle::Atomic32 num_dropped_samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProfilerStreamWriter);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_PROFILER_STREAM_H_
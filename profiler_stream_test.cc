@@ -0,0 +1,176 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <pthread.h>
+
+#include <cstring>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "base/file_path.h"
+#include "base/file_util.h"
+#include "window_manager/profiler_data.h"
+#include "window_manager/profiler_stream.h"
+#include "window_manager/test_lib.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using std::string;
+
+namespace window_manager {
+
+class ProfilerStreamTest : public ::testing::Test {};
+
+static profiler::Sample CreateSample(int32_t symbol_id, int64_t time) {
+  profiler::Sample sample;
+  sample.symbol_id = symbol_id;
+  sample.flag = profiler::MARK_FLAG_TAP;
+  sample.time = time;
+  sample.thread_id = 0;
+  sample.has_arg = 0;
+  sample.arg = 0;
+  return sample;
+}
+
+// Number of samples pushed by RunProducerThread().
+static const int kNumThreadedSamples = 100000;
+
+// Push samples with increasing times to a ring buffer, retrying whenever
+// it's full.
+static void* RunProducerThread(void* data) {
+  ProfilerRingBuffer* ring_buffer = static_cast<ProfilerRingBuffer*>(data);
+  for (int i = 0; i < kNumThreadedSamples; ++i) {
+    while (!ring_buffer->Push(CreateSample(0, i)))
+      sched_yield();
+  }
+  return NULL;
+}
+
+TEST_F(ProfilerStreamTest, RingBuffer) {
+  ProfilerRingBuffer ring_buffer(4);
+  profiler::Sample samples[4];
+  EXPECT_EQ(0U, ring_buffer.Pop(samples, 4));
+
+  EXPECT_TRUE(ring_buffer.Push(CreateSample(1, 10)));
+  EXPECT_TRUE(ring_buffer.Push(CreateSample(2, 20)));
+  EXPECT_TRUE(ring_buffer.Push(CreateSample(3, 30)));
+  EXPECT_EQ(3U, ring_buffer.GetSize());
+
+  // We should be able to pop fewer samples than are available.
+  ASSERT_EQ(2U, ring_buffer.Pop(samples, 2));
+  EXPECT_EQ(1, samples[0].symbol_id);
+  EXPECT_EQ(20, samples[1].time);
+  EXPECT_EQ(1U, ring_buffer.GetSize());
+
+  // Fill the buffer, wrapping around to its start, and check that the next
+  // push is dropped.
+  EXPECT_TRUE(ring_buffer.Push(CreateSample(4, 40)));
+  EXPECT_TRUE(ring_buffer.Push(CreateSample(5, 50)));
+  EXPECT_TRUE(ring_buffer.Push(CreateSample(6, 60)));
+  EXPECT_EQ(1, ring_buffer.num_wraparounds());
+  EXPECT_EQ(0U, ring_buffer.GetNumOverflows());
+  EXPECT_FALSE(ring_buffer.Push(CreateSample(7, 70)));
+  EXPECT_EQ(1U, ring_buffer.GetNumOverflows());
+
+  ASSERT_EQ(4U, ring_buffer.Pop(samples, 4));
+  EXPECT_EQ(3, samples[0].symbol_id);
+  EXPECT_EQ(4, samples[1].symbol_id);
+  EXPECT_EQ(5, samples[2].symbol_id);
+  EXPECT_EQ(6, samples[3].symbol_id);
+  EXPECT_EQ(0U, ring_buffer.GetSize());
+}
+
+// Check that samples pushed from another thread arrive intact and in order.
+TEST_F(ProfilerStreamTest, RingBufferThreaded) {
+  ProfilerRingBuffer ring_buffer(64);
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, RunProducerThread,
+                              &ring_buffer));
+
+  profiler::Sample samples[16];
+  int num_received = 0;
+  while (num_received < kNumThreadedSamples) {
+    const uint32_t num_popped = ring_buffer.Pop(samples, 16);
+    for (uint32_t i = 0; i < num_popped; ++i) {
+      ASSERT_EQ(num_received, samples[i].time);
+      num_received++;
+    }
+    if (!num_popped)
+      sched_yield();
+  }
+  pthread_join(thread, NULL);
+  EXPECT_EQ(0U, ring_buffer.GetSize());
+}
+
+// Check that ProfilerStreamWriter writes a file in the format read by
+// tools/prof_analysis.
+TEST_F(ProfilerStreamTest, Writer) {
+  ScopedTempDirectory temp_dir;
+  const FilePath path = temp_dir.path().Append("profile");
+  const unsigned int kMaxNumSymbols = 4;
+  const size_t kSamplesOffset =
+      3 * sizeof(uint32_t) + kMaxNumSymbols * sizeof(profiler::Symbol);
+
+  // Only leave room for three samples in the file.
+  ProfilerRingBuffer ring_buffer(8);
+  ProfilerStreamWriter writer(path,
+                              kSamplesOffset + 3 * sizeof(profiler::Sample));
+  ASSERT_TRUE(writer.Start(kMaxNumSymbols));
+  writer.AddRingBuffer(&ring_buffer);
+
+  profiler::Symbol symbol;
+  memset(&symbol, 0, sizeof(symbol));
+  strncpy(symbol.name, "foo", sizeof(symbol.name) - 1);
+  writer.WriteSymbol(0, symbol);
+  for (int i = 0; i < 5; ++i)
+    ring_buffer.Push(CreateSample(0, i * 10));
+  writer.Stop();
+  EXPECT_EQ(3U, writer.GetNumWrittenSamples());
+  EXPECT_EQ(2U, writer.GetNumDroppedSamples());
+
+  string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(path, &contents));
+  ASSERT_EQ(kSamplesOffset + 3 * sizeof(profiler::Sample), contents.size());
+
+  uint32_t header[3];
+  memcpy(header, contents.data(), sizeof(header));
+  EXPECT_EQ(kMaxNumSymbols, header[0]);
+  EXPECT_EQ(1U, header[1]);
+  EXPECT_EQ(3U, header[2]);
+  EXPECT_STREQ("foo", contents.data() + sizeof(header));
+
+  profiler::Sample samples[3];
+  memcpy(samples, contents.data() + kSamplesOffset, sizeof(samples));
+  EXPECT_EQ(0, samples[0].time);
+  EXPECT_EQ(20, samples[2].time);
+}
+
+// Check that samples from multiple ring buffers all get written.
+TEST_F(ProfilerStreamTest, WriterWithMultipleBuffers) {
+  ScopedTempDirectory temp_dir;
+  ProfilerRingBuffer first_ring_buffer(8), second_ring_buffer(8);
+  ProfilerStreamWriter writer(temp_dir.path().Append("profile"), 1024 * 1024);
+  ASSERT_TRUE(writer.Start(1));
+  writer.AddRingBuffer(&first_ring_buffer);
+  writer.AddRingBuffer(&second_ring_buffer);
+
+  for (int i = 0; i < 3; ++i) {
+    first_ring_buffer.Push(CreateSample(0, i));
+    second_ring_buffer.Push(CreateSample(0, i));
+  }
+  writer.Stop();
+  EXPECT_EQ(6U, writer.GetNumWrittenSamples());
+  EXPECT_EQ(0U, writer.GetNumDroppedSamples());
+  EXPECT_EQ(0U, first_ring_buffer.GetSize());
+  EXPECT_EQ(0U, second_ring_buffer.GetSize());
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
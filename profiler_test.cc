@@ -0,0 +1,112 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstring>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "base/file_path.h"
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/memory/singleton.h"
+#include "base/time.h"
+#include "window_manager/profiler.h"
+#include "window_manager/profiler_data.h"
+#include "window_manager/profiler_markers.h"
+#include "window_manager/test_lib.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using base::TimeDelta;
+using base::TimeTicks;
+using std::string;
+
+namespace window_manager {
+
+class ProfilerTest : public ::testing::Test {};
+
+// Log the average cost of each sample recorded since |start|.
+static void LogOverhead(const char* type, const TimeTicks& start,
+                        int num_samples) {
+  const TimeDelta elapsed = TimeTicks::Now() - start;
+  LOG(INFO) << type << " markers: "
+            << elapsed.InMicroseconds() * 1000.0 / num_samples
+            << " ns per sample";
+}
+
+// Microbenchmark comparing the per-sample overhead of static, regular and
+// dynamic markers (run with --logtostderr to see the results), and check
+// that static markers' samples use the right symbols.
+TEST_F(ProfilerTest, MarkerOverhead) {
+  const int kNumIterations = 50000;
+  ScopedTempDirectory temp_dir;
+  const FilePath path = temp_dir.path().Append("profile");
+
+  // Make the buffer big enough that it won't be flushed while we're timing.
+  Profiler* profiler = Singleton<Profiler>::get();
+  profiler->Start(new ProfilerWriter(path), 16, 8 * kNumIterations);
+  ASSERT_EQ(Profiler::STATUS_RUN, profiler->status());
+
+  TimeTicks start = TimeTicks::Now();
+  for (int i = 0; i < kNumIterations; ++i) {
+    profiler->AddStaticSample(profiler::STATIC_MARKER_RealCompositor_Draw,
+                              profiler::MARK_FLAG_BEGIN);
+    profiler->AddStaticSample(profiler::STATIC_MARKER_RealCompositor_Draw,
+                              profiler::MARK_FLAG_END);
+  }
+  LogOverhead("Static", start, 2 * kNumIterations);
+
+  Marker marker(profiler, "marker");
+  start = TimeTicks::Now();
+  for (int i = 0; i < kNumIterations; ++i) {
+    marker.Begin();
+    marker.End();
+  }
+  LogOverhead("Regular", start, 2 * kNumIterations);
+
+  DynamicMarker* dynamic_marker = Singleton<DynamicMarker>::get();
+  dynamic_marker->set_profiler(profiler);
+  start = TimeTicks::Now();
+  for (int i = 0; i < kNumIterations; ++i) {
+    dynamic_marker->Begin("dynamic_marker");
+    dynamic_marker->End();
+  }
+  LogOverhead("Dynamic", start, 2 * kNumIterations);
+  dynamic_marker->set_profiler(NULL);
+
+  profiler->Stop();
+
+  string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(path, &contents));
+  uint32_t header[3];
+  ASSERT_GE(contents.size(), sizeof(header));
+  memcpy(header, contents.data(), sizeof(header));
+  EXPECT_EQ(16U, header[0]);
+  EXPECT_EQ(profiler::NUM_STATIC_MARKERS + 2, static_cast<int>(header[1]));
+  EXPECT_EQ(6U * kNumIterations, header[2]);
+
+  // The static markers' symbols should come first.
+  const profiler::Symbol* symbols =
+      reinterpret_cast<const profiler::Symbol*>(
+          contents.data() + sizeof(header));
+  for (int i = 0; i < profiler::NUM_STATIC_MARKERS; ++i)
+    EXPECT_STREQ(profiler::kStaticMarkerNames[i], symbols[i].name);
+  EXPECT_STREQ("marker", symbols[profiler::NUM_STATIC_MARKERS].name);
+
+  profiler::Sample sample;
+  memcpy(&sample, contents.data() + sizeof(header) +
+             header[0] * sizeof(profiler::Symbol), sizeof(sample));
+  EXPECT_EQ(profiler::STATIC_MARKER_RealCompositor_Draw, sample.symbol_id);
+  EXPECT_EQ(profiler::MARK_FLAG_BEGIN, sample.flag);
+  EXPECT_STREQ("RealCompositor_Draw", symbols[sample.symbol_id].name);
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
@@ -0,0 +1,230 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/region.h"
+
+#include <ostream>
+
+#include "base/logging.h"
+
+using std::vector;
+
+namespace window_manager {
+
+// Returns true if |a| and |b| share at least one pixel.
+static bool RectsIntersect(const Rect& a, const Rect& b) {
+  Rect intersection = a;
+  intersection.intersect(b);
+  return !intersection.empty();
+}
+
+unsigned Region::area() const {
+  unsigned total = 0;
+  for (vector<Rect>::const_iterator it = rects_.begin();
+       it != rects_.end(); ++it) {
+    total += it->area();
+  }
+  return total;
+}
+
+Rect Region::bounds() const {
+  Rect bounds;
+  for (vector<Rect>::const_iterator it = rects_.begin();
+       it != rects_.end(); ++it) {
+    bounds.merge(*it);
+  }
+  return bounds;
+}
+
+bool Region::contains_rect(const Rect& rect) const {
+  if (rect.empty())
+    return false;
+
+  vector<Rect> remaining(1, rect);
+  for (vector<Rect>::const_iterator it = rects_.begin();
+       it != rects_.end() && !remaining.empty(); ++it) {
+    vector<Rect> pieces;
+    for (vector<Rect>::const_iterator piece = remaining.begin();
+         piece != remaining.end(); ++piece) {
+      AppendDifference(*piece, *it, &pieces);
+    }
+    remaining.swap(pieces);
+  }
+  return remaining.empty();
+}
+
+bool Region::intersects_rect(const Rect& rect) const {
+  for (vector<Rect>::const_iterator it = rects_.begin();
+       it != rects_.end(); ++it) {
+    if (RectsIntersect(*it, rect))
+      return true;
+  }
+  return false;
+}
+
+void Region::merge(const Rect& rect) {
+  if (rect.empty())
+    return;
+
+  // Drop any existing rectangles that the new one swallows, and clip the new
+  // one against the rest so that everything stays disjoint.
+  vector<Rect> pieces(1, rect);
+  for (size_t i = 0; i < rects_.size(); ) {
+    const Rect& existing = rects_[i];
+    if (rect.contains_rect(existing)) {
+      rects_[i] = rects_.back();
+      rects_.pop_back();
+      continue;
+    }
+    if (RectsIntersect(existing, rect)) {
+      vector<Rect> clipped;
+      for (vector<Rect>::const_iterator piece = pieces.begin();
+           piece != pieces.end(); ++piece) {
+        AppendDifference(*piece, existing, &clipped);
+      }
+      pieces.swap(clipped);
+      if (pieces.empty())
+        return;
+    }
+    ++i;
+  }
+  rects_.insert(rects_.end(), pieces.begin(), pieces.end());
+}
+
+void Region::merge(const Region& other) {
+  for (vector<Rect>::const_iterator it = other.rects_.begin();
+       it != other.rects_.end(); ++it) {
+    merge(*it);
+  }
+}
+
+void Region::intersect(const Rect& rect) {
+  vector<Rect> clipped;
+  clipped.reserve(rects_.size());
+  for (vector<Rect>::const_iterator it = rects_.begin();
+       it != rects_.end(); ++it) {
+    Rect intersection = *it;
+    intersection.intersect(rect);
+    if (!intersection.empty())
+      clipped.push_back(intersection);
+  }
+  rects_.swap(clipped);
+}
+
+void Region::subtract(const Rect& rect) {
+  if (rect.empty() || !intersects_rect(rect))
+    return;
+
+  vector<Rect> remaining;
+  remaining.reserve(rects_.size());
+  for (vector<Rect>::const_iterator it = rects_.begin();
+       it != rects_.end(); ++it) {
+    AppendDifference(*it, rect, &remaining);
+  }
+  rects_.swap(remaining);
+}
+
+void Region::simplify(size_t max_rects) {
+  DCHECK_GT(max_rects, static_cast<size_t>(0));
+  while (rects_.size() > max_rects) {
+    size_t best_a = 0, best_b = 1;
+    unsigned best_waste = 0;
+    bool found = false;
+    for (size_t a = 0; a < rects_.size(); ++a) {
+      for (size_t b = a + 1; b < rects_.size(); ++b) {
+        Rect box = rects_[a];
+        box.merge(rects_[b]);
+        const unsigned waste =
+            box.area() - rects_[a].area() - rects_[b].area();
+        if (!found || waste < best_waste) {
+          best_a = a;
+          best_b = b;
+          best_waste = waste;
+          found = true;
+        }
+      }
+    }
+    CombineRects(best_a, best_b);
+  }
+}
+
+bool Region::operator==(const Region& o) const {
+  if (area() != o.area())
+    return false;
+  // Both regions are disjoint, so equal areas plus containment of each of
+  // |o|'s rectangles means that they cover exactly the same pixels.
+  for (vector<Rect>::const_iterator it = o.rects_.begin();
+       it != o.rects_.end(); ++it) {
+    if (!contains_rect(*it))
+      return false;
+  }
+  return true;
+}
+
+// static
+void Region::AppendDifference(const Rect& rect,
+                              const Rect& hole,
+                              vector<Rect>* out) {
+  DCHECK(out);
+  Rect overlap = rect;
+  overlap.intersect(hole);
+  if (overlap.empty()) {
+    out->push_back(rect);
+    return;
+  }
+
+  // Full-width strips above and below the overlap, then the pieces to its
+  // left and right.
+  if (overlap.y > rect.y)
+    out->push_back(Rect(rect.x, rect.y, rect.width, overlap.y - rect.y));
+  if (overlap.bottom() < rect.bottom()) {
+    out->push_back(Rect(rect.x, overlap.bottom(),
+                        rect.width, rect.bottom() - overlap.bottom()));
+  }
+  if (overlap.x > rect.x) {
+    out->push_back(Rect(rect.x, overlap.y,
+                        overlap.x - rect.x, overlap.height));
+  }
+  if (overlap.right() < rect.right()) {
+    out->push_back(Rect(overlap.right(), overlap.y,
+                        rect.right() - overlap.right(), overlap.height));
+  }
+}
+
+void Region::CombineRects(size_t index_a, size_t index_b) {
+  DCHECK_LT(index_a, index_b);
+  DCHECK_LT(index_b, rects_.size());
+
+  Rect box = rects_[index_a];
+  box.merge(rects_[index_b]);
+  rects_.erase(rects_.begin() + index_b);
+  rects_.erase(rects_.begin() + index_a);
+
+  // Growing the box may make it overlap rectangles that it didn't overlap
+  // before, so keep absorbing until nothing else intersects it.
+  bool absorbed = true;
+  while (absorbed) {
+    absorbed = false;
+    for (size_t i = 0; i < rects_.size(); ++i) {
+      if (RectsIntersect(rects_[i], box)) {
+        box.merge(rects_[i]);
+        rects_.erase(rects_.begin() + i);
+        absorbed = true;
+        break;
+      }
+    }
+  }
+  rects_.push_back(box);
+}
+
+}  // namespace window_manager
+
+std::ostream& operator<<(std::ostream& out,
+                         const window_manager::Region& region) {
+  out << "[";
+  const std::vector<window_manager::Rect>& rects = region.rects();
+  for (size_t i = 0; i < rects.size(); ++i)
+    out << (i ? ", " : "") << rects[i];
+  return out << "]";
+}
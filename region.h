@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_REGION_H_
+#define WINDOW_MANAGER_REGION_H_
+
+#include <iosfwd>
+#include <vector>
+
+#include "window_manager/geometry.h"
+
+namespace window_manager {
+
+// A region is an area made up of a set of disjoint rectangles.  It's used to
+// track damage so that two small, distant damaged areas don't get collapsed
+// into a single huge bounding box.  Methods follow the naming used by Rect.
+class Region {
+ public:
+  Region() {}
+  explicit Region(const Rect& rect) { merge(rect); }
+
+  // The disjoint rectangles making up the region, in no particular order.
+  const std::vector<Rect>& rects() const { return rects_; }
+  size_t num_rects() const { return rects_.size(); }
+
+  bool empty() const { return rects_.empty(); }
+  void clear() { rects_.clear(); }
+
+  // Total area covered by the region.
+  unsigned area() const;
+
+  // Smallest rectangle containing the whole region.
+  Rect bounds() const;
+
+  // Does the region completely cover |rect|?
+  bool contains_rect(const Rect& rect) const;
+
+  // Does the region overlap |rect| at all?
+  bool intersects_rect(const Rect& rect) const;
+
+  // Add |rect| (or all of |other|) to the region.
+  void merge(const Rect& rect);
+  void merge(const Region& other);
+
+  // Clip the region to |rect|.
+  void intersect(const Rect& rect);
+
+  // Remove |rect| from the region.
+  void subtract(const Rect& rect);
+
+  // Reduce the region to at most |max_rects| rectangles by repeatedly
+  // replacing the pair of rectangles whose bounding box wastes the least
+  // area with that bounding box.  The result always covers the original
+  // region.  |max_rects| must be at least 1.
+  void simplify(size_t max_rects);
+
+  bool operator==(const Region& o) const;
+  bool operator!=(const Region& o) const { return !(*this == o); }
+
+ private:
+  // Append the parts of |rect| that aren't covered by |hole| to |out|.
+  static void AppendDifference(const Rect& rect,
+                               const Rect& hole,
+                               std::vector<Rect>* out);
+
+  // Replace the rectangles at |index_a| and |index_b| with their bounding
+  // box, also absorbing any other rectangles that the box overlaps so that
+  // |rects_| stays disjoint.
+  void CombineRects(size_t index_a, size_t index_b);
+
+  std::vector<Rect> rects_;
+};
+
+}  // namespace window_manager
+
+std::ostream& operator<<(std::ostream& out,
+                         const window_manager::Region& region);
+
+#endif  // WINDOW_MANAGER_REGION_H_
@@ -0,0 +1,201 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "base/logging.h"
+#include "window_manager/geometry.h"
+#include "window_manager/region.h"
+#include "window_manager/test_lib.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using std::vector;
+
+namespace window_manager {
+
+class RegionTest : public ::testing::Test {
+ protected:
+  // Check that none of |region|'s rectangles overlap each other.
+  void CheckDisjoint(const Region& region) {
+    const vector<Rect>& rects = region.rects();
+    for (size_t i = 0; i < rects.size(); ++i) {
+      EXPECT_FALSE(rects[i].empty()) << "rect " << i << " in " << region;
+      for (size_t j = i + 1; j < rects.size(); ++j) {
+        Rect overlap = rects[i];
+        overlap.intersect(rects[j]);
+        EXPECT_TRUE(overlap.empty())
+            << rects[i] << " overlaps " << rects[j] << " in " << region;
+      }
+    }
+  }
+};
+
+TEST_F(RegionTest, Basic) {
+  Region region;
+  EXPECT_TRUE(region.empty());
+  EXPECT_EQ(0U, region.area());
+  EXPECT_EQ(Rect(), region.bounds());
+
+  // Empty rectangles should be ignored.
+  region.merge(Rect(10, 10, 0, 5));
+  EXPECT_TRUE(region.empty());
+
+  region.merge(Rect(10, 20, 30, 40));
+  EXPECT_FALSE(region.empty());
+  EXPECT_EQ(1U, region.num_rects());
+  EXPECT_EQ(1200U, region.area());
+  EXPECT_EQ(Rect(10, 20, 30, 40), region.bounds());
+
+  region.clear();
+  EXPECT_TRUE(region.empty());
+}
+
+TEST_F(RegionTest, MergeDistantRects) {
+  // Two small rectangles in opposite corners should stay separate instead of
+  // being collapsed into their bounding box.
+  Region region;
+  region.merge(Rect(0, 0, 10, 10));
+  region.merge(Rect(1000, 700, 20, 10));
+  EXPECT_EQ(2U, region.num_rects());
+  EXPECT_EQ(300U, region.area());
+  EXPECT_EQ(Rect(0, 0, 1020, 710), region.bounds());
+  EXPECT_TRUE(region.contains_rect(Rect(2, 2, 5, 5)));
+  EXPECT_FALSE(region.contains_rect(Rect(5, 5, 10, 10)));
+  EXPECT_TRUE(region.intersects_rect(Rect(5, 5, 10, 10)));
+  EXPECT_FALSE(region.intersects_rect(Rect(100, 100, 10, 10)));
+}
+
+TEST_F(RegionTest, MergeOverlappingRects) {
+  Region region;
+  region.merge(Rect(0, 0, 20, 20));
+
+  // A rect that's already covered shouldn't change anything.
+  region.merge(Rect(5, 5, 5, 5));
+  EXPECT_EQ(1U, region.num_rects());
+  EXPECT_EQ(400U, region.area());
+
+  // Partially-overlapping rects should only add their uncovered area.
+  region.merge(Rect(10, 10, 20, 20));
+  CheckDisjoint(region);
+  EXPECT_EQ(400U + 400U - 100U, region.area());
+  EXPECT_TRUE(region.contains_rect(Rect(0, 0, 20, 20)));
+  EXPECT_TRUE(region.contains_rect(Rect(10, 10, 20, 20)));
+  EXPECT_FALSE(region.contains_rect(Rect(0, 0, 30, 30)));
+
+  // A rect that covers everything should swallow the existing ones.
+  region.merge(Rect(-5, -5, 50, 50));
+  EXPECT_EQ(1U, region.num_rects());
+  EXPECT_EQ(Rect(-5, -5, 50, 50), region.bounds());
+
+  // Merging regions should behave the same as merging their rects.
+  Region a(Rect(0, 0, 10, 10));
+  Region b(Rect(5, 0, 10, 10));
+  b.merge(Rect(100, 100, 1, 1));
+  a.merge(b);
+  CheckDisjoint(a);
+  EXPECT_EQ(151U, a.area());
+}
+
+TEST_F(RegionTest, Intersect) {
+  Region region;
+  region.merge(Rect(0, 0, 10, 10));
+  region.merge(Rect(50, 50, 10, 10));
+  region.intersect(Rect(5, 5, 50, 50));
+  CheckDisjoint(region);
+  EXPECT_EQ(2U, region.num_rects());
+  EXPECT_EQ(50U, region.area());
+  EXPECT_TRUE(region.contains_rect(Rect(5, 5, 5, 5)));
+  EXPECT_TRUE(region.contains_rect(Rect(50, 50, 5, 5)));
+
+  // Rects that fall entirely outside should be dropped.
+  region.intersect(Rect(0, 0, 20, 20));
+  EXPECT_EQ(1U, region.num_rects());
+  EXPECT_EQ(Rect(5, 5, 5, 5), region.bounds());
+
+  region.intersect(Rect(100, 100, 5, 5));
+  EXPECT_TRUE(region.empty());
+}
+
+TEST_F(RegionTest, Subtract) {
+  Region region(Rect(0, 0, 30, 30));
+
+  // Punch a hole in the middle.
+  region.subtract(Rect(10, 10, 10, 10));
+  CheckDisjoint(region);
+  EXPECT_EQ(800U, region.area());
+  EXPECT_FALSE(region.intersects_rect(Rect(10, 10, 10, 10)));
+  EXPECT_TRUE(region.contains_rect(Rect(0, 0, 30, 10)));
+  EXPECT_TRUE(region.contains_rect(Rect(20, 0, 10, 30)));
+
+  // Subtracting something that doesn't overlap is a no-op.
+  Region copy = region;
+  region.subtract(Rect(100, 100, 10, 10));
+  EXPECT_EQ(copy, region);
+
+  region.subtract(Rect(-10, -10, 100, 100));
+  EXPECT_TRUE(region.empty());
+}
+
+TEST_F(RegionTest, Simplify) {
+  // Three rects: two close together in the top-left and one far away.
+  Region region;
+  region.merge(Rect(0, 0, 10, 10));
+  region.merge(Rect(12, 0, 10, 10));
+  region.merge(Rect(500, 500, 10, 10));
+
+  // Simplifying to the current count or more shouldn't change anything.
+  Region original = region;
+  region.simplify(3);
+  EXPECT_EQ(original, region);
+
+  // The two nearby rects should get combined, leaving the distant one alone.
+  region.simplify(2);
+  CheckDisjoint(region);
+  EXPECT_EQ(2U, region.num_rects());
+  EXPECT_TRUE(region.contains_rect(Rect(0, 0, 22, 10)));
+  EXPECT_TRUE(region.contains_rect(Rect(500, 500, 10, 10)));
+  EXPECT_EQ(320U, region.area());
+
+  region.simplify(1);
+  EXPECT_EQ(1U, region.num_rects());
+  EXPECT_EQ(Rect(0, 0, 510, 510), region.bounds());
+  EXPECT_EQ(510U * 510U, region.area());
+}
+
+TEST_F(RegionTest, SimplifyKeepsRegionDisjoint) {
+  // Combining the two top rects produces a box that overlaps the rect in the
+  // middle, which must get absorbed rather than double-counted.
+  Region region;
+  region.merge(Rect(0, 0, 10, 10));
+  region.merge(Rect(40, 0, 10, 10));
+  region.merge(Rect(20, 5, 10, 100));
+  region.merge(Rect(0, 300, 10, 10));
+  region.simplify(2);
+  CheckDisjoint(region);
+  EXPECT_TRUE(region.contains_rect(Rect(0, 0, 50, 10)));
+  EXPECT_TRUE(region.contains_rect(Rect(20, 5, 10, 100)));
+  EXPECT_TRUE(region.contains_rect(Rect(0, 300, 10, 10)));
+}
+
+TEST_F(RegionTest, Equality) {
+  // The same area split up differently should still compare equal.
+  Region a;
+  a.merge(Rect(0, 0, 20, 10));
+  Region b;
+  b.merge(Rect(0, 0, 10, 10));
+  b.merge(Rect(10, 0, 10, 10));
+  EXPECT_EQ(a, b);
+
+  b.merge(Rect(50, 50, 1, 1));
+  EXPECT_NE(a, b);
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
@@ -8,50 +8,13 @@
 #include <iostream>
 #include <ostream>
 #include <stack>
+#include "profile.h"
+#include "stats.h"
 #include "tree.h"
 #include "profiler_data.h"  // part of window_manager
 
 namespace profiler = window_manager::profiler;
 
-struct Profile {
-  profiler::Symbol* symbols;
-  profiler::Sample* samples;
-  int num_symbols;
-  int num_samples;
-};
-
-bool LoadProfileFromFile(const char* filename, Profile* pf) {
-  FILE* fp = fopen(filename, "rb");
-  if (fp == NULL) {
-    return false;
-  }
-
-  int result = 0;
-  int max_num_symbols;
-  result += fread(&max_num_symbols, sizeof(max_num_symbols), 1, fp);
-  result += fread(&pf->num_symbols, sizeof(pf->num_symbols), 1, fp);
-  result += fread(&pf->num_samples, sizeof(pf->num_samples), 1, fp);
-
-  pf->symbols = new profiler::Symbol[pf->num_symbols];
-  pf->samples = new profiler::Sample[pf->num_samples];
-  if (pf->symbols == NULL || pf->samples == NULL) {
-    return false;
-  }
-
-  result += fread(pf->symbols, sizeof(pf->symbols[0]), pf->num_symbols, fp);
-  result += fseek(fp,
-                  sizeof(pf->symbols[0]) * (max_num_symbols - pf->num_symbols),
-                  SEEK_CUR);
-  result += fread(pf->samples, sizeof(pf->samples[0]), pf->num_samples, fp);
-
-  fclose(fp);
-
-  if (result != 3 + pf->num_symbols + pf->num_samples) {
-    return false;
-  }
-  return true;
-}
-
 int BuildTreeFromProfile(const Profile& pf, TreeNode* current) {
   using std::stack;
   stack<TreeNode*> tree_stack;
@@ -62,6 +25,12 @@ int BuildTreeFromProfile(const Profile& pf, TreeNode* current) {
     const profiler::Sample& sample = pf.samples[i];
     const profiler::Symbol& symbol = pf.symbols[sample.symbol_id];
 
+    // The tree only describes the thread that recorded the first sample
+    // (normally the main thread); use prof_trace to look at other threads.
+    if (sample.thread_id != pf.samples[0].thread_id) {
+      continue;
+    }
+
     switch (sample.flag) {
       case profiler::MARK_FLAG_BEGIN: {
         TreeNode* node = current->GetChild(sample.symbol_id);
@@ -114,11 +83,21 @@ int BuildTreeFromProfile(const Profile& pf, TreeNode* current) {
   return frame;
 }
 
+void PrintUsage(const char* program) {
+  using namespace std;
+  cerr << "Usage: " << program << " profile-filename [detail|stats]" << endl
+       << "       " << program << " profile-filename diff profile-filename"
+       << endl;
+}
+
 // Filename of the profile should be passed in argv[1].
 int main(int argc, char** argv) {
   using namespace std;
-  if (argc != 2 && (argc != 3 || strcmp(argv[2], "detail") != 0)) {
-    cerr << "Usage: " << argv[0] << " profile-filename [detail]" << endl;
+  const bool detail = argc == 3 && strcmp(argv[2], "detail") == 0;
+  const bool stats = argc == 3 && strcmp(argv[2], "stats") == 0;
+  const bool diff = argc == 4 && strcmp(argv[2], "diff") == 0;
+  if (argc != 2 && !detail && !stats && !diff) {
+    PrintUsage(argv[0]);
     return -1;
   }
 
@@ -133,11 +112,30 @@ int main(int argc, char** argv) {
   output << "number of symbols: " << pf.num_symbols << endl;
   output << "number of samples: " << pf.num_samples << endl;
 
+  if (stats || diff) {
+    MarkerOccurrences occurrences;
+    CollectOccurrences(pf, &occurrences);
+    if (stats) {
+      WriteStatsReport(occurrences, output);
+      return 0;
+    }
+
+    Profile other_pf;
+    if (!LoadProfileFromFile(argv[3], &other_pf)) {
+      cerr << "Failed to load profile " << argv[3] << endl;
+      return -1;
+    }
+    MarkerOccurrences other_occurrences;
+    CollectOccurrences(other_pf, &other_occurrences);
+    WriteComparisonReport(occurrences, other_occurrences, output);
+    return 0;
+  }
+
   TreeNode root("");
   int frame = BuildTreeFromProfile(pf, &root);
   TreeVisitor* visitor = NULL;
 
-  if (argc == 3) {
+  if (detail) {
     visitor = new DetailTreeVisitor(output);
   } else {
     visitor = new TreeVisitor(output);
@@ -0,0 +1,106 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Converts a profile written by the window manager's profiler to the
+// Chrome trace event JSON format, which can be loaded into about:tracing
+// or other trace viewers.
+
+#include <iostream>
+#include <ostream>
+#include <string>
+#include "profile.h"
+#include "profiler_data.h"  // part of window_manager
+
+namespace profiler = window_manager::profiler;
+
+// Returns |str| quoted and escaped for use as a JSON string.
+std::string QuoteJsonString(const char* str) {
+  std::string quoted = "\"";
+  for (const char* ch = str; *ch; ++ch) {
+    if (*ch == '"' || *ch == '\\') {
+      quoted += '\\';
+      quoted += *ch;
+    } else if (static_cast<unsigned char>(*ch) < 0x20) {
+      quoted += ' ';
+    } else {
+      quoted += *ch;
+    }
+  }
+  quoted += '"';
+  return quoted;
+}
+
+// Writes |sample| as a trace event.  Taps become instant events, unless
+// they have an argument, in which case they become counter events so that
+// the argument's value can be graphed over time.
+void WriteTraceEvent(const Profile& pf,
+                     const profiler::Sample& sample,
+                     int pid,
+                     std::ostream& output) {
+  const char* phase = "i";
+  switch (sample.flag) {
+    case profiler::MARK_FLAG_BEGIN:
+      phase = "B";
+      break;
+    case profiler::MARK_FLAG_END:
+      phase = "E";
+      break;
+    case profiler::MARK_FLAG_TAP:
+      phase = sample.has_arg ? "C" : "i";
+      break;
+  }
+
+  // Sample times are in microseconds, as are trace event timestamps.
+  output << "{\"name\":" << QuoteJsonString(pf.symbols[sample.symbol_id].name)
+         << ",\"cat\":\"wm\",\"ph\":\"" << phase << "\""
+         << ",\"ts\":" << sample.time
+         << ",\"pid\":" << pid
+         << ",\"tid\":" << sample.thread_id;
+  if (sample.flag == profiler::MARK_FLAG_TAP && !sample.has_arg) {
+    output << ",\"s\":\"t\"";
+  }
+  if (sample.has_arg) {
+    output << ",\"args\":{\"value\":" << sample.arg << "}";
+  }
+  output << "}";
+}
+
+// Filename of the profile should be passed in argv[1].
+int main(int argc, char** argv) {
+  using namespace std;
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " profile-filename" << endl;
+    return -1;
+  }
+
+  Profile pf;
+  bool result = LoadProfileFromFile(argv[1], &pf);
+  if (!result) {
+    cerr << "Failed to load profile " << argv[1] << endl;
+    return -1;
+  }
+
+  // The profile doesn't record the process ID, but the main thread's ID is
+  // the same as the process's, and the main thread records the first
+  // sample in practice.
+  const int pid = pf.num_samples > 0 ? pf.samples[0].thread_id : 0;
+
+  ostream& output = cout;
+  output << "{\"traceEvents\":[" << endl;
+  bool first = true;
+  for (int i = 0; i < pf.num_samples; i++) {
+    const profiler::Sample& sample = pf.samples[i];
+    if (sample.symbol_id < 0 || sample.symbol_id >= pf.num_symbols) {
+      continue;
+    }
+    if (!first) {
+      output << "," << endl;
+    }
+    WriteTraceEvent(pf, sample, pid, output);
+    first = false;
+  }
+  output << endl << "]}" << endl;
+
+  return 0;
+}
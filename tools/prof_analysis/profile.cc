@@ -0,0 +1,41 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "profile.h"
+
+#include <stdio.h>
+
+namespace profiler = window_manager::profiler;
+
+bool LoadProfileFromFile(const char* filename, Profile* pf) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return false;
+  }
+
+  int result = 0;
+  int max_num_symbols;
+  result += fread(&max_num_symbols, sizeof(max_num_symbols), 1, fp);
+  result += fread(&pf->num_symbols, sizeof(pf->num_symbols), 1, fp);
+  result += fread(&pf->num_samples, sizeof(pf->num_samples), 1, fp);
+
+  pf->symbols = new profiler::Symbol[pf->num_symbols];
+  pf->samples = new profiler::Sample[pf->num_samples];
+  if (pf->symbols == NULL || pf->samples == NULL) {
+    return false;
+  }
+
+  result += fread(pf->symbols, sizeof(pf->symbols[0]), pf->num_symbols, fp);
+  result += fseek(fp,
+                  sizeof(pf->symbols[0]) * (max_num_symbols - pf->num_symbols),
+                  SEEK_CUR);
+  result += fread(pf->samples, sizeof(pf->samples[0]), pf->num_samples, fp);
+
+  fclose(fp);
+
+  if (result != 3 + pf->num_symbols + pf->num_samples) {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,20 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PROF_ANALYSIS_PROFILE_H_
+#define PROF_ANALYSIS_PROFILE_H_
+
+#include "profiler_data.h"  // part of window_manager
+
+struct Profile {
+  window_manager::profiler::Symbol* symbols;
+  window_manager::profiler::Sample* samples;
+  int num_symbols;
+  int num_samples;
+};
+
+// Loads a profile written by the window manager's profiler.
+bool LoadProfileFromFile(const char* filename, Profile* pf);
+
+#endif  // PROF_ANALYSIS_PROFILE_H_
@@ -0,0 +1,299 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <stack>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace profiler = window_manager::profiler;
+
+using std::endl;
+using std::make_pair;
+using std::map;
+using std::ostream;
+using std::pair;
+using std::sort;
+using std::stack;
+using std::string;
+using std::vector;
+
+// |z| values above this are significant at the 1% level (two-tailed).
+static const double kSignificantZ = 2.576;
+
+// Medians need to change by at least this fraction to count as regressions,
+// so that tiny but consistent changes in long profiles aren't flagged.
+static const double kMinMedianChange = 0.05;
+
+// Maximum number of outliers listed for each marker.
+static const size_t kMaxOutliers = 5;
+
+static bool CompareDurationsDescending(const Occurrence& a,
+                                       const Occurrence& b) {
+  return a.duration > b.duration;
+}
+
+// Returns the value at |fraction| through |sorted| (nearest-rank method).
+static int64_t GetPercentile(const vector<int64_t>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(ceil(fraction * sorted.size()));
+  if (rank < 1) {
+    rank = 1;
+  }
+  return sorted[rank - 1];
+}
+
+static vector<int64_t> GetSortedDurations(
+    const vector<Occurrence>& occurrences) {
+  vector<int64_t> durations;
+  for (size_t i = 0; i < occurrences.size(); i++) {
+    durations.push_back(occurrences[i].duration);
+  }
+  sort(durations.begin(), durations.end());
+  return durations;
+}
+
+MarkerStats::MarkerStats()
+    : count(0),
+      min(0),
+      median(0),
+      p95(0),
+      p99(0),
+      max(0),
+      mean(0.0) {
+}
+
+MarkerComparison::MarkerComparison()
+    : median_change(0.0),
+      z(0.0),
+      regression(false) {
+}
+
+void CollectOccurrences(const Profile& pf, MarkerOccurrences* occurrences) {
+  if (pf.num_samples == 0) {
+    return;
+  }
+  const int32_t main_thread_id = pf.samples[0].thread_id;
+  const int64_t start_time = pf.samples[0].time;
+  map<int32_t, stack<const profiler::Sample*> > thread_stacks;
+  int frame = 0;
+
+  for (int i = 0; i < pf.num_samples; i++) {
+    const profiler::Sample& sample = pf.samples[i];
+    if (sample.symbol_id < 0 || sample.symbol_id >= pf.num_symbols) {
+      continue;
+    }
+    stack<const profiler::Sample*>& begin_samples =
+        thread_stacks[sample.thread_id];
+
+    if (sample.flag == profiler::MARK_FLAG_BEGIN) {
+      begin_samples.push(&sample);
+    } else if (sample.flag == profiler::MARK_FLAG_END) {
+      // The user might start profiling somewhere in the middle, so an end
+      // marker might appear before a start.
+      if (begin_samples.empty()) {
+        continue;
+      }
+      const profiler::Sample* begin_sample = begin_samples.top();
+      begin_samples.pop();
+
+      Occurrence occurrence;
+      occurrence.duration = sample.time - begin_sample->time;
+      occurrence.start_time = begin_sample->time - start_time;
+      occurrence.frame = frame;
+      (*occurrences)[pf.symbols[sample.symbol_id].name].push_back(occurrence);
+
+      if (sample.thread_id == main_thread_id && begin_samples.empty()) {
+        frame++;
+      }
+    }
+  }
+}
+
+MarkerStats ComputeStats(const vector<Occurrence>& occurrences) {
+  MarkerStats stats;
+  if (occurrences.empty()) {
+    return stats;
+  }
+  vector<int64_t> durations = GetSortedDurations(occurrences);
+  double total = 0.0;
+  for (size_t i = 0; i < durations.size(); i++) {
+    total += durations[i];
+  }
+  stats.count = durations.size();
+  stats.min = durations.front();
+  stats.median = GetPercentile(durations, 0.5);
+  stats.p95 = GetPercentile(durations, 0.95);
+  stats.p99 = GetPercentile(durations, 0.99);
+  stats.max = durations.back();
+  stats.mean = total / durations.size();
+  return stats;
+}
+
+vector<Occurrence> FindOutliers(const vector<Occurrence>& occurrences,
+                                size_t max_outliers) {
+  vector<Occurrence> outliers;
+  vector<int64_t> durations = GetSortedDurations(occurrences);
+  if (durations.empty()) {
+    return outliers;
+  }
+  const int64_t q1 = GetPercentile(durations, 0.25);
+  const int64_t q3 = GetPercentile(durations, 0.75);
+  const int64_t fence = q3 + 3 * (q3 - q1);
+
+  for (size_t i = 0; i < occurrences.size(); i++) {
+    if (occurrences[i].duration > fence) {
+      outliers.push_back(occurrences[i]);
+    }
+  }
+  sort(outliers.begin(), outliers.end(), CompareDurationsDescending);
+  if (outliers.size() > max_outliers) {
+    outliers.resize(max_outliers);
+  }
+  return outliers;
+}
+
+vector<int> ComputeHistogram(const vector<Occurrence>& occurrences) {
+  vector<int> histogram;
+  for (size_t i = 0; i < occurrences.size(); i++) {
+    size_t bucket = 0;
+    for (int64_t duration = occurrences[i].duration; duration >= 2;
+         duration /= 2) {
+      bucket++;
+    }
+    if (histogram.size() <= bucket) {
+      histogram.resize(bucket + 1, 0);
+    }
+    histogram[bucket]++;
+  }
+  return histogram;
+}
+
+MarkerComparison CompareOccurrences(const vector<Occurrence>& before,
+                                    const vector<Occurrence>& after) {
+  MarkerComparison comparison;
+  comparison.before = ComputeStats(before);
+  comparison.after = ComputeStats(after);
+  if (before.empty() || after.empty()) {
+    return comparison;
+  }
+  if (comparison.before.median > 0) {
+    comparison.median_change =
+        static_cast<double>(comparison.after.median -
+                            comparison.before.median) /
+        comparison.before.median;
+  }
+
+  // Mann-Whitney U test, using the normal approximation with a correction
+  // for ties.  Frame times are rarely normally distributed, so this is
+  // more trustworthy than comparing means.
+  // Each duration is paired with whether it came from |after|.
+  vector<pair<int64_t, bool> > all;
+  for (size_t i = 0; i < before.size(); i++) {
+    all.push_back(make_pair(before[i].duration, false));
+  }
+  for (size_t i = 0; i < after.size(); i++) {
+    all.push_back(make_pair(after[i].duration, true));
+  }
+  sort(all.begin(), all.end());
+
+  const double n1 = before.size();
+  const double n2 = after.size();
+  const double n = n1 + n2;
+  double after_rank_sum = 0.0;
+  double tie_correction = 0.0;
+  for (size_t i = 0; i < all.size();) {
+    size_t j = i;
+    while (j < all.size() && all[j].first == all[i].first) {
+      j++;
+    }
+    // Durations i through j - 1 are tied and share the average rank.
+    const double rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; k++) {
+      if (all[k].second) {
+        after_rank_sum += rank;
+      }
+    }
+    const double num_tied = j - i;
+    tie_correction += num_tied * num_tied * num_tied - num_tied;
+    i = j;
+  }
+
+  const double u = after_rank_sum - n2 * (n2 + 1) / 2.0;
+  const double mean_u = n1 * n2 / 2.0;
+  const double variance_u =
+      n1 * n2 / 12.0 * ((n + 1) - tie_correction / (n * (n - 1)));
+  if (variance_u > 0.0) {
+    comparison.z = (u - mean_u) / sqrt(variance_u);
+  }
+  comparison.regression = comparison.z > kSignificantZ &&
+                          comparison.median_change > kMinMedianChange;
+  return comparison;
+}
+
+void WriteStatsReport(const MarkerOccurrences& occurrences, ostream& output) {
+  output << "\"marker\",count,min,median,p95,p99,max,mean" << endl;
+  for (MarkerOccurrences::const_iterator it = occurrences.begin();
+       it != occurrences.end(); it++) {
+    const MarkerStats stats = ComputeStats(it->second);
+    output << "\"" << it->first << "\"," << stats.count << "," << stats.min
+           << "," << stats.median << "," << stats.p95 << "," << stats.p99
+           << "," << stats.max << "," << stats.mean << endl;
+  }
+
+  output << endl << "\"marker\",bucket_start,bucket_end,count" << endl;
+  for (MarkerOccurrences::const_iterator it = occurrences.begin();
+       it != occurrences.end(); it++) {
+    const vector<int> histogram = ComputeHistogram(it->second);
+    for (size_t i = 0; i < histogram.size(); i++) {
+      if (histogram[i] == 0) {
+        continue;
+      }
+      const int64_t start = i == 0 ? 0 : (static_cast<int64_t>(1) << i);
+      const int64_t end = static_cast<int64_t>(1) << (i + 1);
+      output << "\"" << it->first << "\"," << start << "," << end << ","
+             << histogram[i] << endl;
+    }
+  }
+
+  output << endl << "\"marker\",duration,frame,start_time_ms" << endl;
+  for (MarkerOccurrences::const_iterator it = occurrences.begin();
+       it != occurrences.end(); it++) {
+    const vector<Occurrence> outliers = FindOutliers(it->second, kMaxOutliers);
+    for (size_t i = 0; i < outliers.size(); i++) {
+      output << "\"" << it->first << "\"," << outliers[i].duration << ","
+             << outliers[i].frame << ","
+             << outliers[i].start_time / 1000.0 << endl;
+    }
+  }
+}
+
+void WriteComparisonReport(const MarkerOccurrences& before,
+                           const MarkerOccurrences& after,
+                           ostream& output) {
+  output << "\"marker\",before_count,before_median,before_p95,"
+         << "after_count,after_median,after_p95,median_change_pct,z,"
+         << "regression" << endl;
+  for (MarkerOccurrences::const_iterator it = before.begin();
+       it != before.end(); it++) {
+    MarkerOccurrences::const_iterator after_it = after.find(it->first);
+    if (after_it == after.end()) {
+      continue;
+    }
+    const MarkerComparison comparison =
+        CompareOccurrences(it->second, after_it->second);
+    output << "\"" << it->first << "\"," << comparison.before.count << ","
+           << comparison.before.median << "," << comparison.before.p95 << ","
+           << comparison.after.count << "," << comparison.after.median << ","
+           << comparison.after.p95 << ","
+           << comparison.median_change * 100.0 << "," << comparison.z << ","
+           << (comparison.regression ? "REGRESSION" : "") << endl;
+  }
+}
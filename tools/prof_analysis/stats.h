@@ -0,0 +1,87 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PROF_ANALYSIS_STATS_H_
+#define PROF_ANALYSIS_STATS_H_
+
+#include <stdint.h>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "profile.h"
+
+// A single matched pair of begin and end samples.
+struct Occurrence {
+  int64_t duration;    // microseconds
+  int64_t start_time;  // microseconds since the profile's first sample
+  int frame;
+};
+
+// Occurrences of each marker, keyed by marker name so that profiles with
+// different symbol tables can be compared.
+typedef std::map<std::string, std::vector<Occurrence> > MarkerOccurrences;
+
+// Summary of a marker's durations, in microseconds.
+struct MarkerStats {
+  int count;
+  int64_t min;
+  int64_t median;
+  int64_t p95;
+  int64_t p99;
+  int64_t max;
+  double mean;
+
+  MarkerStats();
+};
+
+// Result of comparing a marker's durations in two profiles.
+struct MarkerComparison {
+  MarkerStats before;
+  MarkerStats after;
+
+  // Relative change in the median, e.g. 0.1 for 10% slower.
+  double median_change;
+
+  // Mann-Whitney U test statistic, normalized so that positive values mean
+  // that the durations in the second profile tend to be longer.
+  double z;
+
+  // True if the second profile is significantly slower.
+  bool regression;
+
+  MarkerComparison();
+};
+
+// Matches begin and end samples in |pf| (separately for each thread) and
+// collects their durations.  Frames are counted the same way as by the call
+// tree: each time that the first thread leaves its outermost marker.
+void CollectOccurrences(const Profile& pf, MarkerOccurrences* occurrences);
+
+MarkerStats ComputeStats(const std::vector<Occurrence>& occurrences);
+
+// Occurrences that are far slower than the rest, using Tukey's outer fence
+// (more than three interquartile ranges above the third quartile), slowest
+// first and limited to |max_outliers|.
+std::vector<Occurrence> FindOutliers(
+    const std::vector<Occurrence>& occurrences, size_t max_outliers);
+
+// Counts of occurrences in power-of-two duration buckets: bucket 0 holds
+// durations under 2 us and bucket i > 0 holds [2^i, 2^(i+1)) us.
+std::vector<int> ComputeHistogram(const std::vector<Occurrence>& occurrences);
+
+MarkerComparison CompareOccurrences(const std::vector<Occurrence>& before,
+                                    const std::vector<Occurrence>& after);
+
+// Write a CSV report of the statistics, histogram and outliers for each
+// marker.
+void WriteStatsReport(const MarkerOccurrences& occurrences,
+                      std::ostream& output);
+
+// Write a CSV report comparing each marker that appears in both profiles.
+void WriteComparisonReport(const MarkerOccurrences& before,
+                           const MarkerOccurrences& after,
+                           std::ostream& output);
+
+#endif  // PROF_ANALYSIS_STATS_H_
@@ -0,0 +1,168 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/unredirect_policy.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/string_util.h"
+
+using base::TimeDelta;
+using base::TimeTicks;
+using std::deque;
+using std::min;
+using std::string;
+
+namespace window_manager {
+
+// Period over which candidates' damage rates are measured.
+static const int kDamageRateWindowMs = 1000;
+
+UnredirectPolicy::Params::Params()
+    : enter_delay_ms(250),
+      max_enter_delay_ms(4000),
+      flap_threshold_ms(1000),
+      min_damage_rate_hz(0.0) {
+}
+
+UnredirectPolicy::UnredirectPolicy(const Params& params)
+    : params_(params),
+      candidate_xid_(0),
+      blocked_(false),
+      unredirected_xid_(0),
+      current_enter_delay_ms_(params.enter_delay_ms),
+      num_unredirections_(0),
+      num_flaps_(0) {
+  DCHECK_GE(params_.enter_delay_ms, 0);
+  DCHECK_GE(params_.max_enter_delay_ms, params_.enter_delay_ms);
+}
+
+UnredirectPolicy::~UnredirectPolicy() {}
+
+TimeDelta UnredirectPolicy::GetTimeUnredirected(const TimeTicks& now) const {
+  TimeDelta total = total_unredirected_time_;
+  if (unredirected_xid_)
+    total += now - unredirected_start_time_;
+  return total;
+}
+
+double UnredirectPolicy::GetDamageRate(const TimeTicks& now) const {
+  if (!candidate_xid_)
+    return 0.0;
+
+  const TimeDelta window = TimeDelta::FromMilliseconds(kDamageRateWindowMs);
+  const TimeDelta interval = min(window, now - damage_start_time_);
+  if (interval <= TimeDelta())
+    return 0.0;
+
+  int num_events = 0;
+  for (deque<TimeTicks>::const_reverse_iterator it = damage_times_.rbegin();
+       it != damage_times_.rend() && now - *it <= window; ++it) {
+    num_events++;
+  }
+  return num_events / interval.InSecondsF();
+}
+
+string UnredirectPolicy::GetSummary(const TimeTicks& now) const {
+  return StringPrintf(
+      "%.1f s unredirected in %lld period(s), %lld flap(s), "
+      "current enter delay %d ms",
+      GetTimeUnredirected(now).InSecondsF(),
+      static_cast<long long>(num_unredirections_),
+      static_cast<long long>(num_flaps_),
+      current_enter_delay_ms_);
+}
+
+bool UnredirectPolicy::HandleDamage(XWindow xid, const TimeTicks& now) {
+  if (!xid || xid != candidate_xid_ || unredirected_xid_)
+    return false;
+  damage_times_.push_back(now);
+  PruneDamageTimes(now);
+  return params_.min_damage_rate_hz > 0.0 &&
+         !blocked_ &&
+         EnterDelayElapsed(now) &&
+         GetDamageRate(now) >= params_.min_damage_rate_hz;
+}
+
+XWindow UnredirectPolicy::Update(XWindow candidate_xid,
+                                 bool blocked,
+                                 const TimeTicks& now) {
+  if (candidate_xid != candidate_xid_) {
+    candidate_xid_ = candidate_xid;
+    candidate_start_time_ = now;
+    damage_start_time_ = now;
+    damage_times_.clear();
+  }
+  blocked_ = blocked;
+
+  // Anything that disqualifies the unredirected window needs to be
+  // composited right away.
+  if (unredirected_xid_ && unredirected_xid_ != candidate_xid_)
+    EndUnredirection(now);
+
+  if (!candidate_xid_ || unredirected_xid_)
+    return unredirected_xid_;
+
+  if (blocked_) {
+    candidate_start_time_ = now;
+    return 0;
+  }
+  if (!EnterDelayElapsed(now))
+    return 0;
+  PruneDamageTimes(now);
+  if (params_.min_damage_rate_hz > 0.0 &&
+      GetDamageRate(now) < params_.min_damage_rate_hz) {
+    return 0;
+  }
+
+  StartUnredirection(now);
+  return unredirected_xid_;
+}
+
+int UnredirectPolicy::GetRecheckDelayMs(const TimeTicks& now) const {
+  if (!candidate_xid_ || unredirected_xid_ || blocked_)
+    return -1;
+
+  const int64_t remaining_ms =
+      current_enter_delay_ms_ - (now - candidate_start_time_).InMilliseconds();
+  return remaining_ms > 0 ? static_cast<int>(remaining_ms) : -1;
+}
+
+void UnredirectPolicy::StartUnredirection(const TimeTicks& now) {
+  DCHECK(candidate_xid_);
+  DCHECK(!unredirected_xid_);
+  unredirected_xid_ = candidate_xid_;
+  unredirected_start_time_ = now;
+  num_unredirections_++;
+  damage_times_.clear();
+}
+
+void UnredirectPolicy::EndUnredirection(const TimeTicks& now) {
+  DCHECK(unredirected_xid_);
+  const TimeDelta duration = now - unredirected_start_time_;
+  total_unredirected_time_ += duration;
+  unredirected_xid_ = 0;
+
+  if (duration < TimeDelta::FromMilliseconds(params_.flap_threshold_ms)) {
+    num_flaps_++;
+    current_enter_delay_ms_ =
+        min(current_enter_delay_ms_ * 2, params_.max_enter_delay_ms);
+  } else {
+    current_enter_delay_ms_ = params_.enter_delay_ms;
+  }
+}
+
+bool UnredirectPolicy::EnterDelayElapsed(const TimeTicks& now) const {
+  return now - candidate_start_time_ >=
+         TimeDelta::FromMilliseconds(current_enter_delay_ms_);
+}
+
+void UnredirectPolicy::PruneDamageTimes(const TimeTicks& now) {
+  const TimeDelta window = TimeDelta::FromMilliseconds(kDamageRateWindowMs);
+  while (!damage_times_.empty() && now - damage_times_.front() > window)
+    damage_times_.pop_front();
+}
+
+}  // namespace window_manager
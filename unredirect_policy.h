@@ -0,0 +1,145 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_UNREDIRECT_POLICY_H_
+#define WINDOW_MANAGER_UNREDIRECT_POLICY_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/time.h"
+#include "window_manager/x11/x_types.h"
+
+namespace window_manager {
+
+// Decides when the topmost fullscreen window should be unredirected (and
+// compositing turned off) so that it's drawn directly by the X server.
+//
+// WindowManager tells the policy which window (if any) is currently a
+// candidate for unredirection, i.e. the top fullscreen window when it's
+// drawn at its client position and nothing is overlaid on it.  Losing the
+// candidate ends unredirection immediately, but a candidate must stay
+// stable for a while before it's unredirected, so that brief gaps between
+// overlaid actors don't make us flap between the two modes.  Windows that
+// give up unredirection soon after getting it make the delay grow.
+//
+// The policy doesn't talk to the X server or the compositor; it just
+// tracks state and keeps counters describing how much time has been spent
+// unredirected.
+class UnredirectPolicy {
+ public:
+  struct Params {
+    Params();
+
+    // Time in milliseconds that a window must be a candidate (without
+    // being blocked) before it's unredirected.
+    int enter_delay_ms;
+
+    // Upper bound for the delay after it's been increased by flapping.
+    int max_enter_delay_ms;
+
+    // Unredirected periods shorter than this many milliseconds count as
+    // flaps and double the current enter delay.  Longer periods reset it.
+    int flap_threshold_ms;
+
+    // Minimum rate of damage events per second that a candidate must
+    // receive before it's unredirected.  Compositing a window that's
+    // rarely updated is cheap, so there's little point in paying for the
+    // transitions.  0 disables this check.
+    double min_damage_rate_hz;
+  };
+
+  explicit UnredirectPolicy(const Params& params);
+  ~UnredirectPolicy();
+
+  XWindow unredirected_xid() const { return unredirected_xid_; }
+  int current_enter_delay_ms() const { return current_enter_delay_ms_; }
+  int64_t num_unredirections() const { return num_unredirections_; }
+  int64_t num_flaps() const { return num_flaps_; }
+
+  // Total time spent unredirected, including the current period.
+  base::TimeDelta GetTimeUnredirected(const base::TimeTicks& now) const;
+
+  // Get the candidate's damage rate in events per second, measured over
+  // the last second (or over the time that it's been a candidate, if
+  // that's shorter).
+  double GetDamageRate(const base::TimeTicks& now) const;
+
+  // Get a human-readable summary of the counters, e.g. for logging.
+  std::string GetSummary(const base::TimeTicks& now) const;
+
+  // Record a damage event for a window.  Damage to windows other than the
+  // current candidate is ignored.  Returns true if the candidate was only
+  // waiting for its damage rate to get high enough and it now has, in
+  // which case Update() should be called.
+  bool HandleDamage(XWindow xid, const base::TimeTicks& now);
+
+  // Update the policy's state and return the window that should be
+  // unredirected, or 0 if everything should be composited.
+  // |candidate_xid| is the window that's currently eligible for
+  // unredirection (0 if none); |blocked| indicates that something that we
+  // don't want to unredirect in the middle of, like an animation, is in
+  // progress.  Being blocked delays unredirection but doesn't end it.
+  XWindow Update(XWindow candidate_xid,
+                 bool blocked,
+                 const base::TimeTicks& now);
+
+  // Get the number of milliseconds after which Update() should be called
+  // again even if nothing changes in the meantime, or -1 if it doesn't
+  // need to be.  This only covers the enter delay: callers should instead
+  // call Update() when whatever blocked the candidate goes away and when
+  // HandleDamage() asks them to.
+  int GetRecheckDelayMs(const base::TimeTicks& now) const;
+
+ private:
+  // Start or end unredirection of |candidate_xid_|.
+  void StartUnredirection(const base::TimeTicks& now);
+  void EndUnredirection(const base::TimeTicks& now);
+
+  // Has the current candidate been unblocked for long enough to be
+  // unredirected?
+  bool EnterDelayElapsed(const base::TimeTicks& now) const;
+
+  // Drop damage times that are too old to affect GetDamageRate().
+  void PruneDamageTimes(const base::TimeTicks& now);
+
+  Params params_;
+
+  // Current candidate, and the time since which it's been continuously
+  // eligible and unblocked.
+  XWindow candidate_xid_;
+  base::TimeTicks candidate_start_time_;
+
+  // Was the most recent call to Update() blocked?
+  bool blocked_;
+
+  // Times of recent damage events to |candidate_xid_|, oldest first, and
+  // the time at which we started recording them.
+  std::deque<base::TimeTicks> damage_times_;
+  base::TimeTicks damage_start_time_;
+
+  // Currently-unredirected window (0 if none) and the time at which it
+  // was unredirected.
+  XWindow unredirected_xid_;
+  base::TimeTicks unredirected_start_time_;
+
+  // Delay currently required before unredirecting a candidate.  This is
+  // |params_.enter_delay_ms| unless we've been flapping.
+  int current_enter_delay_ms_;
+
+  // Time spent in completed unredirected periods.
+  base::TimeDelta total_unredirected_time_;
+
+  int64_t num_unredirections_;
+  int64_t num_flaps_;
+
+  DISALLOW_COPY_AND_ASSIGN(UnredirectPolicy);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_UNREDIRECT_POLICY_H_
@@ -0,0 +1,154 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "base/memory/scoped_ptr.h"
+#include "base/time.h"
+#include "window_manager/test_lib.h"
+#include "window_manager/unredirect_policy.h"
+#include "window_manager/util.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using window_manager::util::CreateTimeTicksFromMs;
+
+namespace window_manager {
+
+class UnredirectPolicyTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    params_.enter_delay_ms = 100;
+    params_.max_enter_delay_ms = 300;
+    params_.flap_threshold_ms = 1000;
+    params_.min_damage_rate_hz = 0.0;
+    policy_.reset(new UnredirectPolicy(params_));
+  }
+
+  XWindow Update(XWindow candidate_xid, bool blocked, int64_t now_ms) {
+    return policy_->Update(
+        candidate_xid, blocked, CreateTimeTicksFromMs(now_ms));
+  }
+
+  UnredirectPolicy::Params params_;
+  scoped_ptr<UnredirectPolicy> policy_;
+};
+
+TEST_F(UnredirectPolicyTest, EnterDelay) {
+  const XWindow kXid = 10;
+
+  // Nothing needs to happen when there's no candidate.
+  EXPECT_EQ(0U, Update(0, false, 1000));
+  EXPECT_EQ(-1, policy_->GetRecheckDelayMs(CreateTimeTicksFromMs(1000)));
+
+  // A candidate should only be unredirected after the enter delay, and
+  // the policy should ask to be rechecked once the delay is up.
+  EXPECT_EQ(0U, Update(kXid, false, 1000));
+  EXPECT_EQ(100, policy_->GetRecheckDelayMs(CreateTimeTicksFromMs(1000)));
+  EXPECT_EQ(0U, Update(kXid, false, 1060));
+  EXPECT_EQ(40, policy_->GetRecheckDelayMs(CreateTimeTicksFromMs(1060)));
+  EXPECT_EQ(kXid, Update(kXid, false, 1100));
+  EXPECT_EQ(kXid, policy_->unredirected_xid());
+  EXPECT_EQ(-1, policy_->GetRecheckDelayMs(CreateTimeTicksFromMs(1100)));
+  EXPECT_EQ(1, policy_->num_unredirections());
+
+  // Blocking shouldn't end unredirection.
+  EXPECT_EQ(kXid, Update(kXid, true, 1200));
+
+  // Losing the candidate should end it immediately.
+  EXPECT_EQ(0U, Update(0, false, 2500));
+  EXPECT_EQ(0, policy_->num_flaps());
+  EXPECT_EQ(1400,
+            policy_->GetTimeUnredirected(CreateTimeTicksFromMs(3000))
+                .InMilliseconds());
+}
+
+TEST_F(UnredirectPolicyTest, Blocked) {
+  const XWindow kXid = 10;
+
+  // While blocked, we shouldn't poll; the caller tells us when whatever
+  // was blocking us is done.
+  EXPECT_EQ(0U, Update(kXid, true, 1000));
+  EXPECT_EQ(0U, Update(kXid, true, 1200));
+  EXPECT_EQ(-1, policy_->GetRecheckDelayMs(CreateTimeTicksFromMs(1200)));
+
+  // The enter delay should be measured from the last time that we were
+  // blocked.
+  EXPECT_EQ(0U, Update(kXid, false, 1250));
+  EXPECT_EQ(50, policy_->GetRecheckDelayMs(CreateTimeTicksFromMs(1250)));
+  EXPECT_EQ(kXid, Update(kXid, false, 1300));
+}
+
+TEST_F(UnredirectPolicyTest, Flapping) {
+  const XWindow kXid = 10;
+
+  EXPECT_EQ(0U, Update(kXid, false, 1000));
+  EXPECT_EQ(kXid, Update(kXid, false, 1100));
+
+  // Giving up unredirection quickly should double the enter delay.
+  EXPECT_EQ(0U, Update(0, false, 1200));
+  EXPECT_EQ(1, policy_->num_flaps());
+  EXPECT_EQ(200, policy_->current_enter_delay_ms());
+  EXPECT_EQ(0U, Update(kXid, false, 1200));
+  EXPECT_EQ(0U, Update(kXid, false, 1300));
+  EXPECT_EQ(kXid, Update(kXid, false, 1400));
+
+  // The delay shouldn't grow past the maximum.
+  EXPECT_EQ(0U, Update(0, false, 1500));
+  EXPECT_EQ(300, policy_->current_enter_delay_ms());
+
+  // Switching directly to a different window also ends unredirection.
+  const XWindow kOtherXid = 20;
+  EXPECT_EQ(0U, Update(kXid, false, 1500));
+  EXPECT_EQ(kXid, Update(kXid, false, 1800));
+  EXPECT_EQ(0U, Update(kOtherXid, false, 1900));
+  EXPECT_EQ(300, policy_->current_enter_delay_ms());
+  EXPECT_EQ(kOtherXid, Update(kOtherXid, false, 2200));
+
+  // Staying unredirected for a while should reset the delay.
+  EXPECT_EQ(0U, Update(0, false, 5000));
+  EXPECT_EQ(100, policy_->current_enter_delay_ms());
+  EXPECT_EQ(3, policy_->num_flaps());
+  EXPECT_EQ(4, policy_->num_unredirections());
+}
+
+TEST_F(UnredirectPolicyTest, DamageRate) {
+  params_.min_damage_rate_hz = 20.0;
+  policy_.reset(new UnredirectPolicy(params_));
+  const XWindow kXid = 10;
+
+  // A window that's rarely updated shouldn't be unredirected.  We don't
+  // need to poll while waiting for its damage rate to increase.
+  EXPECT_EQ(0U, Update(kXid, false, 1000));
+  EXPECT_FALSE(policy_->HandleDamage(kXid, CreateTimeTicksFromMs(1050)));
+  EXPECT_EQ(0U, Update(kXid, false, 1200));
+  EXPECT_EQ(-1, policy_->GetRecheckDelayMs(CreateTimeTicksFromMs(1200)));
+
+  // Damage to other windows should be ignored.
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_FALSE(policy_->HandleDamage(
+        kXid + 1, CreateTimeTicksFromMs(1200 + i * 10)));
+  }
+  EXPECT_EQ(0U, Update(kXid, false, 1300));
+
+  // Once the window is updated frequently enough, HandleDamage() should
+  // ask to be updated, and the window should be unredirected.
+  bool should_update = false;
+  for (int i = 0; i < 10; ++i) {
+    should_update =
+        policy_->HandleDamage(kXid, CreateTimeTicksFromMs(1310 + i * 10));
+  }
+  EXPECT_TRUE(should_update);
+  EXPECT_DOUBLE_EQ(11.0 / 0.4,
+                   policy_->GetDamageRate(CreateTimeTicksFromMs(1400)));
+  EXPECT_EQ(kXid, Update(kXid, false, 1400));
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}
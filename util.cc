@@ -8,9 +8,12 @@
 #include <cstring>
 #include <ctime>
 
+#include <signal.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "base/eintr_wrapper.h"
 #include "base/string_util.h"
 #include "base/time.h"
 
@@ -175,8 +178,29 @@ void RunCommandInBackground(string command) {
 
   command += " &";
   DLOG(INFO) << "Running command \"" << command << "\"";
-  if (system(command.c_str()) < 0)
+
+  // This is system() without the signal handling, plus clearing the signal
+  // mask: we block signals that we read from signalfds, and children would
+  // otherwise inherit that.
+  const pid_t pid = fork();
+  if (pid < 0) {
+    PLOG(WARNING) << "Unable to fork to run \"" << command << "\"";
+    return;
+  }
+  if (pid == 0) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigprocmask(SIG_SETMASK, &signals, NULL);
+    execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(NULL));
+    _exit(127);
+  }
+
+  // The shell exits as soon as it's started the backgrounded command.
+  int status = 0;
+  if (HANDLE_EINTR(waitpid(pid, &status, 0)) < 0 ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
     LOG(WARNING) << "Got error while running \"" << command << "\"";
+  }
 }
 
 }  // namespace util
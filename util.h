@@ -281,7 +281,8 @@ bool SetUpLogSymlink(const std::string& symlink_path,
 // Get the machine's hostname, as returned by gethostname().
 std::string GetHostname();
 
-// Run a command using system().  '&' is appended.
+// Run a command using /bin/sh, the same way that system() does but with an
+// empty signal mask.  '&' is appended.
 // Ideally we'd just use LaunchApp() from Chrome's process_util.h instead,
 // but that method expects a pre-parsed argv and we're running commands
 // specified on the command line (and don't want to do shell-style
@@ -4,9 +4,14 @@
 
 #include <vector>
 
+#include <signal.h>
+#include <unistd.h>
+
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
 
+#include "base/file_path.h"
+#include "base/file_util.h"
 #include "base/logging.h"
 #include "base/string_split.h"
 #include "base/string_util.h"
@@ -202,6 +207,30 @@ TEST_F(UtilTest, ByteMap) {
   bytemap.Copy(empty);
 }
 
+// Test that commands don't inherit our blocked signals (we block the ones
+// that we read from signalfds).
+TEST_F(UtilTest, RunCommandInBackgroundUnblocksSignals) {
+  sigset_t signals, old_signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGUSR1);
+  ASSERT_EQ(0, sigprocmask(SIG_BLOCK, &signals, &old_signals));
+
+  ScopedTempDirectory temp_dir;
+  const FilePath path = temp_dir.path().Append("status");
+  const FilePath temp_path = temp_dir.path().Append("status.tmp");
+  util::RunCommandInBackground(
+      "grep SigBlk: /proc/self/status > " + temp_path.value() +
+      " && mv " + temp_path.value() + " " + path.value());
+  ASSERT_EQ(0, sigprocmask(SIG_SETMASK, &old_signals, NULL));
+
+  // The command runs asynchronously, so wait for its output to show up.
+  string contents;
+  for (int i = 0; i < 1000 && !file_util::PathExists(path); ++i)
+    usleep(10 * 1000);
+  ASSERT_TRUE(file_util::ReadFileToString(path, &contents));
+  EXPECT_EQ("SigBlk:\t0000000000000000\n", contents);
+}
+
 }  // namespace window_manager
 
 int main(int argc, char** argv) {
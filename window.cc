@@ -8,11 +8,16 @@
 
 #include <gflags/gflags.h>
 
+extern "C" {
+#include <X11/Xatom.h>
+}
+
 #include "base/logging.h"
 #include "base/string_util.h"
 #include "cros/chromeos_wm_ipc_enums.h"
 #include "window_manager/atom_cache.h"
 #include "window_manager/compositor/animation.h"
+#include "window_manager/counters.h"
 #include "window_manager/focus_manager.h"
 #include "window_manager/geometry.h"
 #include "window_manager/shadow.h"
@@ -37,6 +42,8 @@ DEFINE_bool(load_window_shapes, false,
             "using these regions to mask windows, and we favor RGBA windows "
             "instead.");
 
+DEFINE_COUNTER(Window_DamageEvents);
+
 namespace window_manager {
 
 // We could technically just move windows to (XConnection::kMaxPosition,
@@ -107,7 +114,8 @@ Window::Window(WindowManager* wm,
       updates_frozen_(false),
       client_pid_(-1),
       num_video_damage_events_(0),
-      video_damage_start_time_(-1) {
+      video_damage_start_time_(-1),
+      num_damage_events_(0) {
   DCHECK(xid_);
   DLOG(INFO) << "Constructing object to track "
              << (override_redirect_ ? "override-redirect " : "")
@@ -144,7 +152,9 @@ Window::Window(WindowManager* wm,
 
   // Various properties could've been set on this window after it was
   // created but before we selected PropertyChangeMask, so we need to query
-  // them here.
+  // them here.  Send all of the requests up front so we don't need to wait
+  // for a round trip to the server for each one.
+  SendPropertyRequests();
   FetchAndApplyTitle();
   FetchAndApplyWindowType();
   FetchAndApplyShape();
@@ -159,6 +169,7 @@ Window::Window(WindowManager* wm,
   FetchAndApplyWmClientMachine();
   FetchAndApplyWmPid();
   FetchAndApplyChromeFreezeUpdates();
+  DiscardPropertyRequests();
 }
 
 Window::~Window() {
@@ -178,8 +189,8 @@ void Window::FetchAndApplyTitle() {
   DCHECK(actor_.get());
 
   title_.clear();
-  wm_->xconn()->GetStringProperty(
-      xid_, wm_->GetXAtom(ATOM_NET_WM_NAME), &title_);
+  wm_->xconn()->GetStringPropertyReply(
+      TakePropertyRequest(wm_->GetXAtom(ATOM_NET_WM_NAME)), &title_);
 
   if (title_.empty())
     actor_->SetName(string("window ") + xid_str_);
@@ -189,8 +200,10 @@ void Window::FetchAndApplyTitle() {
 
 bool Window::FetchAndApplySizeHints() {
   DCHECK(xid_);
-  if (!wm_->xconn()->GetSizeHintsForWindow(xid_, &size_hints_))
+  if (!wm_->xconn()->GetSizeHintsReply(
+          TakePropertyRequest(XA_WM_NORMAL_HINTS), &size_hints_)) {
     return false;
+  }
 
   const XConnection::SizeHints& h = size_hints_;
   DLOG(INFO) << "Got size hints for " << xid_str_ << ":"
@@ -216,8 +229,10 @@ bool Window::FetchAndApplySizeHints() {
 bool Window::FetchAndApplyTransientHint() {
   DCHECK(xid_);
   XWindow prev_transient_for_xid = transient_for_xid_;
-  if (!wm_->xconn()->GetTransientHintForWindow(xid_, &transient_for_xid_))
+  if (!wm_->xconn()->GetTransientHintReply(
+          TakePropertyRequest(XA_WM_TRANSIENT_FOR), &transient_for_xid_)) {
     return false;
+  }
   if (transient_for_xid_ != prev_transient_for_xid) {
     DLOG(INFO) << "Window " << xid_str_ << " is transient for "
                << XidStr(transient_for_xid_);
@@ -227,7 +242,9 @@ bool Window::FetchAndApplyTransientHint() {
 
 bool Window::FetchAndApplyWindowType() {
   DCHECK(xid_);
-  bool result = wm_->wm_ipc()->GetWindowType(xid_, &type_, &type_params_);
+  bool result = wm_->wm_ipc()->GetWindowTypeReply(
+      TakePropertyRequest(wm_->GetXAtom(ATOM_CHROME_WINDOW_TYPE)),
+      &type_, &type_params_);
   DLOG(INFO) << "Window " << xid_str_ << " has type " << type_
              << " (" << type_str() << ")";
   return result;
@@ -238,9 +255,8 @@ void Window::FetchAndApplyWindowOpacity() {
   static const uint32 kMaxOpacity = 0xffffffffU;
 
   uint32 opacity = kMaxOpacity;
-  wm_->xconn()->GetIntProperty(
-      xid_,
-      wm_->GetXAtom(ATOM_NET_WM_WINDOW_OPACITY),
+  wm_->xconn()->GetIntPropertyReply(
+      TakePropertyRequest(wm_->GetXAtom(ATOM_NET_WM_WINDOW_OPACITY)),
       reinterpret_cast<int32*>(&opacity));
   client_opacity_ = (opacity == kMaxOpacity) ?
       1.0 : static_cast<double>(opacity) / kMaxOpacity;
@@ -253,8 +269,8 @@ void Window::FetchAndApplyWindowOpacity() {
 void Window::FetchAndApplyWmHints() {
   DCHECK(xid_);
   vector<int> wm_hints;
-  if (!wm_->xconn()->GetIntArrayProperty(
-          xid_, wm_->GetXAtom(ATOM_WM_HINTS), &wm_hints)) {
+  if (!wm_->xconn()->GetIntArrayPropertyReply(
+          TakePropertyRequest(wm_->GetXAtom(ATOM_WM_HINTS)), &wm_hints)) {
     return;
   }
 
@@ -270,8 +286,9 @@ void Window::FetchAndApplyWmProtocols() {
   bool supports_wm_sync_request = false;
 
   vector<int> wm_protocols;
-  if (!wm_->xconn()->GetIntArrayProperty(
-          xid_, wm_->GetXAtom(ATOM_WM_PROTOCOLS), &wm_protocols)) {
+  if (!wm_->xconn()->GetIntArrayPropertyReply(
+          TakePropertyRequest(wm_->GetXAtom(ATOM_WM_PROTOCOLS)),
+          &wm_protocols)) {
     return;
   }
 
@@ -340,8 +357,9 @@ void Window::FetchAndApplyWmState() {
   wm_state_modal_ = false;
 
   vector<int> state_atoms;
-  if (!wm_->xconn()->GetIntArrayProperty(
-          xid_, wm_->GetXAtom(ATOM_NET_WM_STATE), &state_atoms)) {
+  if (!wm_->xconn()->GetIntArrayPropertyReply(
+          TakePropertyRequest(wm_->GetXAtom(ATOM_NET_WM_STATE)),
+          &state_atoms)) {
     return;
   }
 
@@ -374,8 +392,9 @@ void Window::FetchAndApplyWmWindowType() {
   wm_window_type_xatoms_.clear();
 
   vector<int> window_type_ints;
-  if (!wm_->xconn()->GetIntArrayProperty(
-          xid_, wm_->GetXAtom(ATOM_NET_WM_WINDOW_TYPE), &window_type_ints)) {
+  if (!wm_->xconn()->GetIntArrayPropertyReply(
+          TakePropertyRequest(wm_->GetXAtom(ATOM_NET_WM_WINDOW_TYPE)),
+          &window_type_ints)) {
     return;
   }
 
@@ -390,8 +409,10 @@ void Window::FetchAndApplyChromeState() {
   XAtom state_xatom = wm_->GetXAtom(ATOM_CHROME_STATE);
   chrome_state_xatoms_.clear();
   vector<int> state_xatoms;
-  if (!wm_->xconn()->GetIntArrayProperty(xid_, state_xatom, &state_xatoms))
+  if (!wm_->xconn()->GetIntArrayPropertyReply(
+          TakePropertyRequest(state_xatom), &state_xatoms)) {
     return;
+  }
 
   string debug_str;
   for (vector<int>::const_iterator it = state_xatoms.begin();
@@ -408,8 +429,9 @@ void Window::FetchAndApplyChromeState() {
 void Window::FetchAndApplyWmClientMachine() {
   DCHECK(xid_);
   client_hostname_.clear();
-  wm_->xconn()->GetStringProperty(
-      xid_, wm_->GetXAtom(ATOM_WM_CLIENT_MACHINE), &client_hostname_);
+  wm_->xconn()->GetStringPropertyReply(
+      TakePropertyRequest(wm_->GetXAtom(ATOM_WM_CLIENT_MACHINE)),
+      &client_hostname_);
   if (!client_hostname_.empty()) {
     DLOG(INFO) << "Client owning window " << xid_str_ << " is running on "
                << "host \"" << client_hostname_ << "\"";
@@ -419,8 +441,8 @@ void Window::FetchAndApplyWmClientMachine() {
 void Window::FetchAndApplyWmPid() {
   DCHECK(xid_);
   client_pid_ = -1;
-  wm_->xconn()->GetIntProperty(
-      xid_, wm_->GetXAtom(ATOM_NET_WM_PID), &client_pid_);
+  wm_->xconn()->GetIntPropertyReply(
+      TakePropertyRequest(wm_->GetXAtom(ATOM_NET_WM_PID)), &client_pid_);
   DLOG(INFO) << "Client owning window " << xid_str_ << " has PID "
              << client_pid_;
 }
@@ -429,8 +451,9 @@ void Window::FetchAndApplyChromeFreezeUpdates() {
   DCHECK(xid_);
   int dummy_value = 0;
   bool property_exists =
-      wm_->xconn()->GetIntProperty(
-          xid_, wm_->GetXAtom(ATOM_CHROME_FREEZE_UPDATES), &dummy_value);
+      wm_->xconn()->GetIntPropertyReply(
+          TakePropertyRequest(wm_->GetXAtom(ATOM_CHROME_FREEZE_UPDATES)),
+          &dummy_value);
   HandleFreezeUpdatesPropertyChange(property_exists);
 }
 
@@ -1036,9 +1059,12 @@ void Window::HandleConfigureNotify(const Rect& bounds, XWindow above_xid) {
 
 void Window::HandleDamageNotify(const Rect& bounding_box) {
   DCHECK(actor_.get());
+  num_damage_events_++;
+  COUNTER_INCREMENT(Window_DamageEvents);
   wm_->xconn()->ClearDamage(damage_);
-  actor_->UpdateTexture();
+  // Merge the damage first so that the texture update can be limited to it.
   actor_->MergeDamagedRegion(bounding_box);
+  actor_->UpdateTexture();
 
   if (wm_->damage_debugging_enabled())
     UpdateDamageDebugging(bounding_box);
@@ -1380,6 +1406,60 @@ bool Window::UpdateChromeStateProperty() {
   }
 }
 
+void Window::SendPropertyRequests() {
+  DCHECK(property_requests_.empty());
+  static const Atom kAtoms[] = {
+    ATOM_NET_WM_NAME,
+    ATOM_CHROME_WINDOW_TYPE,
+    ATOM_NET_WM_WINDOW_OPACITY,
+    ATOM_WM_PROTOCOLS,
+    ATOM_NET_WM_STATE,
+    ATOM_CHROME_STATE,
+    ATOM_WM_HINTS,
+    ATOM_NET_WM_WINDOW_TYPE,
+    ATOM_WM_CLIENT_MACHINE,
+    ATOM_NET_WM_PID,
+    ATOM_CHROME_FREEZE_UPDATES,
+  };
+  vector<XAtom> xatoms;
+  for (size_t i = 0; i < arraysize(kAtoms); ++i)
+    xatoms.push_back(wm_->GetXAtom(kAtoms[i]));
+  xatoms.push_back(XA_WM_NORMAL_HINTS);
+  xatoms.push_back(XA_WM_TRANSIENT_FOR);
+
+  for (vector<XAtom>::const_iterator it = xatoms.begin();
+       it != xatoms.end(); ++it) {
+    property_requests_[*it] = SendPropertyRequest(*it);
+  }
+}
+
+XConnection::RequestCookie Window::SendPropertyRequest(XAtom xatom) {
+  if (xatom == XA_WM_NORMAL_HINTS)
+    return wm_->xconn()->SendGetSizeHintsRequest(xid_);
+  if (xatom == XA_WM_TRANSIENT_FOR)
+    return wm_->xconn()->SendGetTransientHintRequest(xid_);
+  return wm_->xconn()->SendGetPropertyRequest(xid_, xatom);
+}
+
+XConnection::RequestCookie Window::TakePropertyRequest(XAtom xatom) {
+  map<XAtom, XConnection::RequestCookie>::iterator it =
+      property_requests_.find(xatom);
+  if (it == property_requests_.end())
+    return SendPropertyRequest(xatom);
+  XConnection::RequestCookie cookie = it->second;
+  property_requests_.erase(it);
+  return cookie;
+}
+
+void Window::DiscardPropertyRequests() {
+  for (map<XAtom, XConnection::RequestCookie>::const_iterator it =
+           property_requests_.begin();
+       it != property_requests_.end(); ++it) {
+    wm_->xconn()->DiscardReply(it->second);
+  }
+  property_requests_.clear();
+}
+
 void Window::DestroyWmSyncRequestAlarm() {
   if (!wm_sync_request_alarm_)
     return;
@@ -149,6 +149,7 @@ class Window {
   bool wm_hint_urgent() const { return wm_hint_urgent_; }
   const std::string& client_hostname() const { return client_hostname_; }
   int client_pid() const { return client_pid_; }
+  int64_t num_damage_events() const { return num_damage_events_; }
 
   // Have we received a pixmap for this window yet?  If not, it won't be
   // drawn onscreen.
@@ -496,6 +497,7 @@ class Window {
   FRIEND_TEST(WindowTest, DeferFetchingPixmapUntilPainted);
   FRIEND_TEST(WindowTest, FreezeUpdates);
   FRIEND_TEST(WindowTest, AvoidMovingActorDuringResize);
+  FRIEND_TEST(WindowTest, PipelinePropertyRequests);
   FRIEND_TEST(WindowManagerTest, VideoTimeProperty);
   FRIEND_TEST(WindowManagerTest, HandleLateSyncRequestCounter);
 
@@ -576,6 +578,23 @@ class Window {
   // contents of |chrome_state_atoms_|.
   bool UpdateChromeStateProperty();
 
+  // Send requests for all of the properties that the c'tor fetches to the X
+  // server at once and save their cookies in |property_requests_|, so that
+  // the FetchAndApply*() methods only need to wait for a single round trip
+  // instead of one per property.
+  void SendPropertyRequests();
+
+  // Send a request for a property.  WM_NORMAL_HINTS and WM_TRANSIENT_FOR are
+  // requested using the XConnection methods that parse them.
+  XConnection::RequestCookie SendPropertyRequest(XAtom xatom);
+
+  // Remove and return the cookie saved by SendPropertyRequests() for
+  // |xatom|, or send a new request if there isn't one.
+  XConnection::RequestCookie TakePropertyRequest(XAtom xatom);
+
+  // Discard the replies to any requests remaining in |property_requests_|.
+  void DiscardPropertyRequests();
+
   // Destroys |wm_sync_request_alarm_| if non-NULL, unregisters our
   // interest in it in the WindowManager, and resets
   // |client_has_redrawn_after_last_resize_| to true.
@@ -757,6 +776,9 @@ class Window {
   int num_video_damage_events_;
   time_t video_damage_start_time_;
 
+  // Total number of damage events that we've received for this window.
+  int64_t num_damage_events_;
+
   // Group containing actors that we display to visualize damage events for
   // this window.  Stacked directly above |actor_| (but lazily initialized and
   // NULL until the first time we need it).
@@ -767,6 +789,10 @@ class Window {
   std::deque<std::tr1::shared_ptr<Compositor::ColoredBoxActor> >
       damage_debug_actors_;
 
+  // Outstanding property requests sent by SendPropertyRequests(), keyed by
+  // property atom.  Only non-empty while the c'tor is running.
+  std::map<XAtom, XConnection::RequestCookie> property_requests_;
+
   DISALLOW_COPY_AND_ASSIGN(Window);
 };
 
@@ -4,8 +4,10 @@
 
 #include "window_manager/window_manager.h"
 
+#include <algorithm>
 #include <cstring>
 #include <ctime>
+#include <functional>
 #include <list>
 #include <queue>
 
@@ -25,6 +27,8 @@ extern "C" {
 #include "metrics/metrics_library.h"
 #include "window_manager/callback.h"
 #include "window_manager/chrome_watchdog.h"
+#include "window_manager/compositor/frame_stats.h"
+#include "window_manager/counters.h"
 #include "window_manager/dbus_interface.h"
 #include "window_manager/event_consumer.h"
 #include "window_manager/event_loop.h"
@@ -40,9 +44,11 @@ extern "C" {
 #include "window_manager/profiler.h"
 #include "window_manager/screen_locker_handler.h"
 #include "window_manager/stacking_manager.h"
+#include "window_manager/unredirect_policy.h"
 #include "window_manager/util.h"
 #include "window_manager/window.h"
 #include "window_manager/x11/x_connection.h"
+#include "window_manager/x_event_coalescer.h"
 
 DEFINE_string(background_color, "#000", "Background color");
 DEFINE_string(screenshot_binary,
@@ -63,15 +69,36 @@ DEFINE_bool(unredirect_fullscreen_window,
             false,
             "Enable/disable compositing optimization that automatically turns"
             "off compositing if a topmost fullscreen window is present");
+DEFINE_int32(unredirect_enter_delay_ms,
+             250,
+             "Time that a fullscreen window must stay on top (with nothing "
+             "animating) before it's unredirected");
+DEFINE_int32(unredirect_max_enter_delay_ms,
+             4000,
+             "Maximum value that --unredirect_enter_delay_ms can grow to when "
+             "windows are repeatedly unredirected and redirected");
+DEFINE_int32(unredirect_flap_threshold_ms,
+             1000,
+             "Unredirected periods shorter than this make us wait twice as "
+             "long before unredirecting again");
+DEFINE_double(unredirect_min_damage_hz,
+              0.0,
+              "Minimum rate of damage events that a fullscreen window must "
+              "receive before it's unredirected (0 to disable)");
 DEFINE_bool(report_metrics, false, "Report user action metrics via Chrome");
 
 using base::hash_map;
 using base::TimeDelta;
 using base::TimeTicks;
 using chromeos::WmIpcMessageType;
+using std::greater;
 using std::list;
 using std::make_pair;
 using std::map;
+using std::max;
+using std::min;
+using std::pair;
+using std::partial_sort;
 using std::set;
 using std::string;
 using std::tr1::shared_ptr;
@@ -104,6 +131,10 @@ static const int kPingChromeTimeoutMs = 4000;
 COMPILE_ASSERT(kPingChromeFrequencyMs > kPingChromeTimeoutMs,
                ping_timeout_is_greater_than_ping_frequency);
 
+// Maximum number of windows whose damage event counts are reported by
+// DumpCounters().
+static const size_t kMaxDumpedDamagedWindows = 5;
+
 // Names of key binding actions that we register.
 #ifndef NDEBUG
 static const char* kToggleClientWindowDebuggingAction =
@@ -112,10 +143,13 @@ static const char* kToggleDamageDebuggingAction = "toggle-damage-debugging";
 static const char* kToggleProfilerAction = "toggle-profiler";
 #endif
 
+static const char* kDumpCountersAction = "dump-counters";
+static const char* kDumpFrameStatsAction = "dump-frame-stats";
 static const char* kTakeRootScreenshotAction = "take-root-screenshot";
 static const char* kTakeWindowScreenshotAction = "take-window-screenshot";
 
 const int WindowManager::kVideoTimePropertyUpdateSec = 5;
+const int WindowManager::kIdleTimeoutMs = 10000;
 
 // Invoke |function_call| for each event consumer in |consumers| (a set).
 #define FOR_EACH_EVENT_CONSUMER(consumers, function_call)                      \
@@ -223,12 +257,16 @@ WindowManager::WindowManager(EventLoop* event_loop,
       active_window_xid_(0),
       query_keyboard_state_timeout_id_(-1),
       unredirected_fullscreen_xid_(0),
+      top_fullscreen_xid_(0),
+      unredirect_policy_timeout_id_(-1),
       disable_compositing_task_is_pending_(false),
       wm_ipc_version_(1),
       logged_in_(false),
       initialize_logging_(false),
       hide_unaccelerated_graphics_actor_timeout_id_(-1),
       chrome_watchdog_timeout_id_(-1),
+      idle_timeout_id_(-1),
+      saw_activity_since_idle_timeout_(false),
       num_compositing_requests_(0) {
   CHECK(event_loop_);
   CHECK(xconn_);
@@ -241,6 +279,9 @@ WindowManager::~WindowManager() {
 
   event_loop_->RemoveTimeoutIfSet(&query_keyboard_state_timeout_id_);
   event_loop_->RemoveTimeoutIfSet(&chrome_watchdog_timeout_id_);
+  event_loop_->RemoveTimeoutIfSet(&unredirect_policy_timeout_id_);
+  event_loop_->RemoveTimeoutIfSet(&idle_timeout_id_);
+  event_loop_->SetIdle(false);
   event_loop_->RemoveTimeoutIfSet(
       &hide_unaccelerated_graphics_actor_timeout_id_);
 
@@ -256,80 +297,16 @@ void WindowManager::HandlePanelManagerAreaChange() {
 
 void WindowManager::HandleTopFullscreenActorChange(
     const Compositor::TexturePixmapActor* top_fullscreen_actor) {
-  const bool was_compositing = unredirected_fullscreen_xid_ == 0;
-  bool should_composite = true;
-  XWindow window_to_unredirect = 0;
-
-  // If we're debugging damage events, trying to unredirect a window puts us in
-  // a flickery loop:
-  //
-  // 10 We unredirect the browser window, causing a redraw.
-  // 20 We display a debugging actor to visualize the redraw.
-  // 30 We redirect the browser window since there's another actor onscreen.
-  // 40 The debugging actor fades away, leaving us with only the browser window
-  //    onscreen.
-  // 50 GOTO 10
-  const bool unredirection_permitted =
-      FLAGS_unredirect_fullscreen_window &&
-      !damage_debugging_enabled_ &&
-      !num_compositing_requests_;
-
-  if (unredirection_permitted && top_fullscreen_actor) {
-    Window* win = GetWindowOwningActor(*top_fullscreen_actor);
-    if (win != NULL &&
-        win->client_x() == win->composited_x() &&
-        win->client_y() == win->composited_y() &&
-        win->composited_scale_x() == 1.0 &&
-        win->composited_scale_y() == 1.0 &&
-        // If we're waiting for the window to be repainted so we can fetch a
-        // resized pixmap for it, we don't want to turn off compositing.
-        win->client_has_redrawn_after_last_resize()) {
-      window_to_unredirect = win->xid();
-      should_composite = false;
-    }
-  }
-
-  if (unredirected_fullscreen_xid_) {
-    if (unredirected_fullscreen_xid_ == window_to_unredirect) {
-      window_to_unredirect = 0;
-    } else {
-      Window* win = GetWindow(unredirected_fullscreen_xid_);
-      if (win) {
-        // Grab the server here to avoid a race condition between Chrome and
-        // window manager that result in window been reset while Chrome is
-        // writing into it.
-        scoped_ptr<XConnection::ScopedServerGrab> grab(
-            xconn_->CreateScopedServerGrab());
-        xconn_->RedirectWindowForCompositing(unredirected_fullscreen_xid_);
-        win->HandleRedirect();
-      } else {
-        DLOG(WARNING) << "The previously unredirected window with XID="
-                      << unredirected_fullscreen_xid_ << " no longer exists";
-      }
-      unredirected_fullscreen_xid_ = 0;
-      // Force the frame to draw when changing from one fullscreen actor to
-      // another fullscreen actor in case X does not redraw the entire
-      // screen and we get a partially updated frame.
-    }
-  }
-
-  if (window_to_unredirect) {
-    // Don't update should_draw_frame here; we want to draw the current frame
-    // before we disable compositing.  The flag is updated in the
-    // DisableCompositing callback, which does the actual disabling.
-    unredirected_fullscreen_xid_ = window_to_unredirect;
-    if (!disable_compositing_task_is_pending_) {
-      event_loop_->PostTask(
-          NewPermanentCallback(this, &WindowManager::DisableCompositing));
-      disable_compositing_task_is_pending_ = true;
-    }
-  }
+  Window* win = top_fullscreen_actor ?
+      GetWindowOwningActor(*top_fullscreen_actor) :
+      NULL;
+  top_fullscreen_xid_ = win ? win->xid() : 0;
+  UpdateFullscreenUnredirection();
+}
 
-  if (!was_compositing && should_composite) {
-    xconn_->ResetWindowBoundingRegionToDefault(overlay_xid_);
-    DLOG(INFO) << "Turned compositing on";
-    compositor_->set_should_draw_frame(true);
-  }
+void WindowManager::HandleAnimationsFinished() {
+  if (FLAGS_unredirect_fullscreen_window && top_fullscreen_xid_)
+    UpdateFullscreenUnredirection();
 }
 
 bool WindowManager::Init() {
@@ -341,6 +318,8 @@ bool WindowManager::Init() {
   CHECK(xconn_->GetWindowGeometry(root_, &root_geometry));
   root_bounds_ = root_geometry.bounds;
   root_depth_ = root_geometry.depth;
+  event_coalescer_.reset(
+      new XEventCoalescer(xconn_->damage_event_base() + XDamageNotify));
 
   if (FLAGS_unredirect_fullscreen_window) {
     // Disable automatic background painting for the root window.  It
@@ -352,6 +331,14 @@ bool WindowManager::Init() {
   // Create the atom cache first; RegisterExistence() needs it.
   atom_cache_.reset(new AtomCache(xconn_));
 
+  UnredirectPolicy::Params unredirect_params;
+  unredirect_params.enter_delay_ms = FLAGS_unredirect_enter_delay_ms;
+  unredirect_params.max_enter_delay_ms =
+      max(FLAGS_unredirect_max_enter_delay_ms, FLAGS_unredirect_enter_delay_ms);
+  unredirect_params.flap_threshold_ms = FLAGS_unredirect_flap_threshold_ms;
+  unredirect_params.min_damage_rate_hz = FLAGS_unredirect_min_damage_hz;
+  unredirect_policy_.reset(new UnredirectPolicy(unredirect_params));
+
   CHECK(RegisterExistence());
   SetEwmhGeneralProperties();
   SetEwmhSizeProperties();
@@ -451,6 +438,14 @@ bool WindowManager::Init() {
       event_loop_->AddTimeout(
           NewPermanentCallback(this, &WindowManager::PingChrome),
           kPingChromeFrequencyMs, kPingChromeFrequencyMs);
+  // There's no point in checking whether Chrome is hung while nobody is
+  // using it; we'll ping it as soon as something happens instead.
+  event_loop_->SetTimeoutDeferrable(chrome_watchdog_timeout_id_, true);
+
+  idle_timeout_id_ =
+      event_loop_->AddTimeout(
+          NewPermanentCallback(this, &WindowManager::HandleIdleTimeout),
+          kIdleTimeoutMs, 0);
 
   // Select window management events before we look up existing windows --
   // we want to make sure that we eventually hear about any resizes that we
@@ -533,11 +528,41 @@ void WindowManager::SetLoggedInState(bool logged_in, bool initial) {
 }
 
 void WindowManager::ProcessPendingEvents() {
+  // Cap the size of each batch so that we don't starve the rest of the
+  // event loop if the X server is flooding us.
+  static const size_t kMaxBatchedEvents = 1024;
+
+  vector<XEvent> events;
   while (xconn_->IsEventPending()) {
-    XEvent event;
-    xconn_->GetNextEvent(&event);
-    HandleEvent(&event);
+    while (event_coalescer_->num_events() < kMaxBatchedEvents &&
+           xconn_->IsEventPending()) {
+      XEvent event;
+      xconn_->GetNextEvent(&event);
+      event_coalescer_->AddEvent(event);
+    }
+    event_coalescer_->TakeEvents(&events);
+#ifndef NDEBUG
+    // Atom names are only used in DLOG() messages, so don't request them
+    // in release builds.
+    PrefetchAtomNames(events);
+#endif
+    for (vector<XEvent>::iterator it = events.begin();
+         it != events.end(); ++it) {
+      HandleEvent(&(*it));
+    }
+  }
+}
+
+void WindowManager::PrefetchAtomNames(const vector<XEvent>& events) {
+  vector<XAtom> xatoms;
+  for (vector<XEvent>::const_iterator it = events.begin();
+       it != events.end(); ++it) {
+    if (it->type == PropertyNotify)
+      xatoms.push_back(it->xproperty.atom);
+    else if (it->type == ClientMessage)
+      xatoms.push_back(it->xclient.message_type);
   }
+  atom_cache_->PrefetchNames(xatoms);
 }
 
 void WindowManager::HandleEvent(XEvent* event) {
@@ -555,6 +580,9 @@ void WindowManager::HandleEvent(XEvent* event) {
 //  static int randr_notify = xconn_->randr_event_base() + RRScreenChangeNotify;
   static int sync_alarm_notify = xconn_->sync_event_base() + XSyncAlarmNotify;
 
+  if (!IsPingReply(*event))
+    HandleActivity();
+
   switch (event->type) {
     case ButtonPress:
       HandleButtonPress(event->xbutton); break;
@@ -722,6 +750,53 @@ bool WindowManager::SetVideoTimeProperty(time_t video_time) {
   return true;
 }
 
+void WindowManager::DumpFrameStats() {
+  const FrameStats* stats = compositor_->GetFrameStats();
+  DCHECK(stats);
+  LOG(INFO) << "Frame stats: " << stats->GetSummary();
+  if (FLAGS_unredirect_fullscreen_window) {
+    LOG(INFO) << "Unredirection: "
+              << unredirect_policy_->GetSummary(GetMonotonicTime());
+  }
+
+  vector<int> values;
+  stats->GetPropertyValues(&values);
+  xconn_->SetIntArrayProperty(
+      root_, GetXAtom(ATOM_CHROME_FRAME_STATS), XA_CARDINAL, values);
+}
+
+void WindowManager::DumpCounters() {
+  Counter::Snapshot snapshot;
+  Counter::GetSnapshot(&snapshot);
+
+  // Window_DamageEvents only has the total across all windows, so also
+  // report the windows that are responsible for most of it.
+  vector<pair<int64_t, XWindow> > damaged_windows;
+  for (WindowMap::const_iterator it = client_windows_.begin();
+       it != client_windows_.end(); ++it) {
+    if (it->second->num_damage_events() > 0) {
+      damaged_windows.push_back(
+          make_pair(it->second->num_damage_events(), it->first));
+    }
+  }
+  const size_t num_damaged_windows =
+      min(damaged_windows.size(), kMaxDumpedDamagedWindows);
+  partial_sort(damaged_windows.begin(),
+               damaged_windows.begin() + num_damaged_windows,
+               damaged_windows.end(),
+               greater<pair<int64_t, XWindow> >());
+  for (size_t i = 0; i < num_damaged_windows; ++i) {
+    snapshot.push_back(
+        make_pair("Window_DamageEvents[" +
+                      XidStr(damaged_windows[i].second) + "]",
+                  damaged_windows[i].first));
+  }
+
+  const string value = Counter::FormatSnapshot(snapshot);
+  LOG(INFO) << "Counters:\n" << value;
+  xconn_->SetStringProperty(root_, GetXAtom(ATOM_CHROME_WM_COUNTERS), value);
+}
+
 void WindowManager::HandleWindowPixmapFetch(Window* win) {
   DCHECK(win);
   FOR_EACH_INTERESTED_EVENT_CONSUMER(
@@ -1135,6 +1210,30 @@ void WindowManager::RegisterKeyBindings() {
       kToggleProfilerAction);
 #endif
 
+  key_bindings_actions_->AddAction(
+      kDumpFrameStatsAction,
+      NewPermanentCallback(this, &WindowManager::DumpFrameStats),
+      NULL, NULL);
+  key_bindings_->AddBinding(
+      KeyBindings::KeyCombo(
+          XK_f,
+          KeyBindings::kControlMask |
+          KeyBindings::kAltMask |
+          KeyBindings::kShiftMask),
+      kDumpFrameStatsAction);
+
+  key_bindings_actions_->AddAction(
+      kDumpCountersAction,
+      NewPermanentCallback(this, &WindowManager::DumpCounters),
+      NULL, NULL);
+  key_bindings_->AddBinding(
+      KeyBindings::KeyCombo(
+          XK_c,
+          KeyBindings::kControlMask |
+          KeyBindings::kAltMask |
+          KeyBindings::kShiftMask),
+      kDumpCountersAction);
+
   key_bindings_actions_->AddAction(
       kTakeRootScreenshotAction,
       NewPermanentCallback(this, &WindowManager::TakeScreenshot, false),
@@ -1171,12 +1270,25 @@ bool WindowManager::ManageExistingWindows() {
 
   LOG(INFO) << "Taking ownership of " << windows.size() << " window"
             << (windows.size() == 1 ? "" : "s");
+
+  // Ask for all of the windows' attributes and geometries up front so that
+  // we only need to wait for a single round trip to the X server.
+  vector<XConnection::RequestCookie> attr_requests, geometry_requests;
+  for (size_t i = 0; i < windows.size(); ++i) {
+    attr_requests.push_back(xconn_->SendGetWindowAttributesRequest(windows[i]));
+    geometry_requests.push_back(
+        xconn_->SendGetWindowGeometryRequest(windows[i]));
+  }
+
   for (size_t i = 0; i < windows.size(); ++i) {
     XWindow xid = windows[i];
     XConnection::WindowAttributes attr;
     XConnection::WindowGeometry geometry;
-    if (!xconn_->GetWindowAttributes(xid, &attr) ||
-        !xconn_->GetWindowGeometry(xid, &geometry))
+    const bool got_attr =
+        xconn_->GetWindowAttributesReply(attr_requests[i], &attr);
+    const bool got_geometry =
+        xconn_->GetWindowGeometryReply(geometry_requests[i], &geometry);
+    if (!got_attr || !got_geometry)
       continue;
 
     // XQueryTree() returns child windows in bottom-to-top stacking order.
@@ -1447,6 +1559,11 @@ void WindowManager::HandleClientMessage(const XClientMessageEvent& e) {
       }
       return;
     }
+    if (static_cast<XAtom>(e.message_type) ==
+        GetXAtom(ATOM_CHROME_WM_COUNTERS)) {
+      DumpCounters();
+      return;
+    }
     if (e.format == XConnection::kLongFormat) {
       FOR_EACH_INTERESTED_EVENT_CONSUMER(
           window_event_consumers_,
@@ -1634,6 +1751,9 @@ void WindowManager::HandleDamageNotify(const XDamageNotifyEvent& e) {
     return;
   win->HandleDamageNotify(
       Rect(e.area.x, e.area.y, e.area.width, e.area.height));
+  if (FLAGS_unredirect_fullscreen_window &&
+      unredirect_policy_->HandleDamage(e.drawable, GetMonotonicTime()))
+    UpdateFullscreenUnredirection();
 }
 
 void WindowManager::HandleDestroyNotify(const XDestroyWindowEvent& e) {
@@ -1972,13 +2092,10 @@ void WindowManager::TakeScreenshot(bool use_active_window) {
 
   string filename = StringPrintf("%s/screenshot-%s.png", dir.c_str(),
                                  GetTimeAsString(GetCurrentTimeSec()).c_str());
-  command += " " + filename + " &";
+  command += " " + filename;
 
-  if (system(command.c_str()) < 0) {
-    LOG(ERROR) << "Taking screenshot via \"" << command << "\" failed";
-  } else {
-    LOG(INFO) << "Saved screenshot to " << filename;
-  }
+  LOG(INFO) << "Saving screenshot to " << filename;
+  RunCommandInBackground(command);
 }
 
 void WindowManager::CreateStartupBackground() {
@@ -2008,6 +2125,128 @@ void WindowManager::HideUnacceleratedGraphicsActor() {
   hide_unaccelerated_graphics_actor_timeout_id_ = 0;
 }
 
+void WindowManager::UpdateFullscreenUnredirection() {
+  event_loop_->RemoveTimeoutIfSet(&unredirect_policy_timeout_id_);
+  const bool was_compositing = unredirected_fullscreen_xid_ == 0;
+  XWindow candidate_xid = 0;
+
+  // If we're debugging damage events, trying to unredirect a window puts us in
+  // a flickery loop:
+  //
+  // 10 We unredirect the browser window, causing a redraw.
+  // 20 We display a debugging actor to visualize the redraw.
+  // 30 We redirect the browser window since there's another actor onscreen.
+  // 40 The debugging actor fades away, leaving us with only the browser window
+  //    onscreen.
+  // 50 GOTO 10
+  const bool unredirection_permitted =
+      FLAGS_unredirect_fullscreen_window &&
+      !damage_debugging_enabled_ &&
+      !num_compositing_requests_;
+
+  if (unredirection_permitted && top_fullscreen_xid_) {
+    Window* win = GetWindow(top_fullscreen_xid_);
+    if (win != NULL &&
+        win->client_x() == win->composited_x() &&
+        win->client_y() == win->composited_y() &&
+        win->composited_scale_x() == 1.0 &&
+        win->composited_scale_y() == 1.0 &&
+        // If we're waiting for the window to be repainted so we can fetch a
+        // resized pixmap for it, we don't want to turn off compositing.
+        win->client_has_redrawn_after_last_resize()) {
+      candidate_xid = win->xid();
+    }
+  }
+
+  // Let the policy decide whether the candidate has been stable for long
+  // enough; it wants to hear about it even when there isn't one so that it
+  // can keep track of how long windows stay unredirected.
+  const TimeTicks now = GetMonotonicTime();
+  XWindow window_to_unredirect = unredirect_policy_->Update(
+      candidate_xid, compositor_->HasActiveAnimations(), now);
+  const bool should_composite = window_to_unredirect == 0;
+
+  if (unredirected_fullscreen_xid_) {
+    if (unredirected_fullscreen_xid_ == window_to_unredirect) {
+      window_to_unredirect = 0;
+    } else {
+      Window* win = GetWindow(unredirected_fullscreen_xid_);
+      if (win) {
+        // Grab the server here to avoid a race condition between Chrome and
+        // window manager that result in window been reset while Chrome is
+        // writing into it.
+        scoped_ptr<XConnection::ScopedServerGrab> grab(
+            xconn_->CreateScopedServerGrab());
+        xconn_->RedirectWindowForCompositing(unredirected_fullscreen_xid_);
+        win->HandleRedirect();
+      } else {
+        DLOG(WARNING) << "The previously unredirected window with XID="
+                      << unredirected_fullscreen_xid_ << " no longer exists";
+      }
+      unredirected_fullscreen_xid_ = 0;
+      // Force the frame to draw when changing from one fullscreen actor to
+      // another fullscreen actor in case X does not redraw the entire
+      // screen and we get a partially updated frame.
+    }
+  }
+
+  if (window_to_unredirect) {
+    // Don't update should_draw_frame here; we want to draw the current frame
+    // before we disable compositing.  The flag is updated in the
+    // DisableCompositing callback, which does the actual disabling.
+    unredirected_fullscreen_xid_ = window_to_unredirect;
+    if (!disable_compositing_task_is_pending_) {
+      event_loop_->PostTask(
+          NewPermanentCallback(this, &WindowManager::DisableCompositing));
+      disable_compositing_task_is_pending_ = true;
+    }
+  }
+
+  if (!was_compositing && should_composite) {
+    xconn_->ResetWindowBoundingRegionToDefault(overlay_xid_);
+    DLOG(INFO) << "Turned compositing on";
+    compositor_->set_should_draw_frame(true);
+  }
+
+  const int recheck_delay_ms = unredirect_policy_->GetRecheckDelayMs(now);
+  if (recheck_delay_ms >= 0) {
+    unredirect_policy_timeout_id_ = event_loop_->AddTimeout(
+        NewPermanentCallback(
+            this, &WindowManager::UpdateFullscreenUnredirection),
+        recheck_delay_ms, 0);
+  }
+}
+
+bool WindowManager::IsPingReply(const XEvent& event) {
+  return event.type == ClientMessage &&
+         event.xclient.window == root_ &&
+         event.xclient.message_type == GetXAtom(ATOM_WM_PROTOCOLS) &&
+         static_cast<XAtom>(event.xclient.data.l[0]) ==
+             GetXAtom(ATOM_NET_WM_PING);
+}
+
+void WindowManager::HandleActivity() {
+  saw_activity_since_idle_timeout_ = true;
+  if (event_loop_->idle()) {
+    DLOG(INFO) << "Leaving idle mode";
+    event_loop_->SetIdle(false);
+    event_loop_->ResetTimeout(idle_timeout_id_, kIdleTimeoutMs, 0);
+  }
+}
+
+void WindowManager::HandleIdleTimeout() {
+  // Check again later if anything happened since the last time that we
+  // were called.  This is cheaper than pushing the timeout back every time
+  // that we get an event.
+  if (saw_activity_since_idle_timeout_ || compositor_->HasActiveAnimations()) {
+    saw_activity_since_idle_timeout_ = false;
+    event_loop_->ResetTimeout(idle_timeout_id_, kIdleTimeoutMs, 0);
+    return;
+  }
+  DLOG(INFO) << "Entering idle mode";
+  event_loop_->SetIdle(true);
+}
+
 void WindowManager::DisableCompositing() {
   DCHECK(disable_compositing_task_is_pending_);
   disable_compositing_task_is_pending_ = false;
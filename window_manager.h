@@ -52,8 +52,10 @@ class LoginController;
 class ModalityHandler;
 class ScreenLockerHandler;
 class StackingManager;
+class UnredirectPolicy;
 class Window;
 class WmIpc;
+class XEventCoalescer;
 template<class T> class Stacker;
 
 class WindowManager : public PanelManagerAreaChangeListener,
@@ -134,6 +136,9 @@ class WindowManager : public PanelManagerAreaChangeListener,
   // there's a single actor covering the entire screen or not.
   virtual void HandleTopFullscreenActorChange(
       const Compositor::TexturePixmapActor* top_fullscreen_actor);
+  // Unredirection is put off while animations are running, so check again
+  // when they're done.
+  virtual void HandleAnimationsFinished();
   // End CompositionChangeListener implementation.
 
   // Perform initial setup.  This must be called immediately after the
@@ -145,7 +150,10 @@ class WindowManager : public PanelManagerAreaChangeListener,
   // it is invoked later in response to a property change.
   void SetLoggedInState(bool logged_in, bool initial);
 
-  // Process all pending events from |x_conn_|, invoking HandleEvent() for each.
+  // Process all pending events from |x_conn_|, invoking HandleEvent() for
+  // each.  Events are drained in batches so that redundant ones (e.g.
+  // repeated ConfigureNotify or DamageNotify events for the same window)
+  // can be dropped first; see XEventCoalescer.
   void ProcessPendingEvents();
 
   // Handle an event from the X server.
@@ -204,6 +212,20 @@ class WindowManager : public PanelManagerAreaChangeListener,
   // the property but failed and true otherwise.
   bool SetVideoTimeProperty(time_t video_time);
 
+  // Log a summary of the compositor's recent frame timings and publish them
+  // in the _CHROME_FRAME_STATS property on the root window (see
+  // FrameStats::GetPropertyValues() for the format).  Invoked via a key
+  // binding, and by main() when we receive SIGUSR1.
+  void DumpFrameStats();
+
+  // Log the values of all counters (see counters.h), along with the
+  // windows that have received the most damage events, and publish them as
+  // "name value" lines in the _CHROME_WM_COUNTERS property on the root
+  // window.  Invoked via a key binding, by main() when we receive SIGUSR1,
+  // and when a client sends a _CHROME_WM_COUNTERS message to the root
+  // window.
+  void DumpCounters();
+
   // Handle notification from a window that a new pixmap has been fetched.
   // We notify all of the event consumers that are interested in this
   // window.
@@ -324,8 +346,11 @@ class WindowManager : public PanelManagerAreaChangeListener,
   FRIEND_TEST(WindowManagerTest, ConfigureBackground);
   FRIEND_TEST(WindowManagerTest, VideoTimeProperty);
   FRIEND_TEST(WindowManagerTest, HandleTopFullscreenActorChange);
+  FRIEND_TEST(WindowManagerTest, UnredirectionHysteresis);
+  FRIEND_TEST(WindowManagerTest, UnredirectionDamageRate);
   FRIEND_TEST(WindowManagerTest, ForceCompositing);
   FRIEND_TEST(WindowManagerTest, ResizeScreenWhileCompositing);
+  FRIEND_TEST(WindowManagerTest, NoWakeupsWhileIdle);
 
   typedef std::map<XWindow, std::set<EventConsumer*> > WindowEventConsumerMap;
   typedef std::map<std::pair<XWindow, XAtom>, std::set<EventConsumer*> >
@@ -337,6 +362,10 @@ class WindowManager : public PanelManagerAreaChangeListener,
   // _CHROME_VIDEO_TIME property on the root window.
   static const int kVideoTimePropertyUpdateSec;
 
+  // Number of milliseconds without any activity after which we put the
+  // event loop into idle mode.
+  static const int kIdleTimeoutMs;
+
   // Is this one of our internally-created windows?
   bool IsInternalWindow(XWindow xid) {
     return (xid == stage_xid_ || xid == overlay_xid_ || xid == wm_xid_);
@@ -409,6 +438,11 @@ class WindowManager : public PanelManagerAreaChangeListener,
   bool UpdateClientListProperty();
   bool UpdateClientListStackingProperty();
 
+  // Ask |atom_cache_| to fetch the names of atoms referenced by a batch of
+  // events before the events are handled, so that logging them won't
+  // require a round trip per atom.  Only called in debug builds.
+  void PrefetchAtomNames(const std::vector<XEvent>& events);
+
   // Handlers for various X events.
   void HandleButtonPress(const XButtonEvent& e);
   void HandleButtonRelease(const XButtonEvent& e);
@@ -451,6 +485,26 @@ class WindowManager : public PanelManagerAreaChangeListener,
   // Callback that fades out |unaccelerated_graphics_actor_|.
   void HideUnacceleratedGraphicsActor();
 
+  // Is |event| a reply to a ping that we sent?  These are sent in response
+  // to our own timeouts, so they don't count as activity.
+  bool IsPingReply(const XEvent& event);
+
+  // Record that something has happened, taking the event loop out of idle
+  // mode if needed.
+  void HandleActivity();
+
+  // Invoked by |idle_timeout_id_|.  Puts the event loop into idle mode if
+  // nothing has happened since the last time that this was called.
+  void HandleIdleTimeout();
+
+  // Ask |unredirect_policy_| whether the window owning the top fullscreen
+  // actor should be unredirected and redirect or unredirect windows
+  // accordingly.  Schedules |unredirect_policy_timeout_id_| if the policy
+  // needs to be consulted again once the enter delay is up; it's also
+  // consulted again when the compositor's animations finish and when the
+  // candidate's damage rate gets high enough.
+  void UpdateFullscreenUnredirection();
+
   // Reshape |overlay_xid_| to be transparent, redirect
   // |unredirected_fullscreen_xid_|, and tell the compositor to stop drawing.
   // We want Compositor::Draw() to finish drawing the current frame before we
@@ -570,6 +624,9 @@ class WindowManager : public PanelManagerAreaChangeListener,
   scoped_ptr<ScreenLockerHandler> screen_locker_handler_;
   scoped_ptr<ChromeWatchdog> chrome_watchdog_;
 
+  // Used by ProcessPendingEvents() to drop redundant events.
+  scoped_ptr<XEventCoalescer> event_coalescer_;
+
   // ID for the timeout that calls QueryKeyboardState().
   int query_keyboard_state_timeout_id_;
 
@@ -579,6 +636,17 @@ class WindowManager : public PanelManagerAreaChangeListener,
   // whenever compositing is enabled, non-zero otherwise.
   XWindow unredirected_fullscreen_xid_;
 
+  // Window owning the compositor's top fullscreen actor, or 0 if there
+  // isn't one.
+  XWindow top_fullscreen_xid_;
+
+  // Decides when |top_fullscreen_xid_| gets unredirected.
+  scoped_ptr<UnredirectPolicy> unredirect_policy_;
+
+  // ID for the timeout that calls UpdateFullscreenUnredirection() when
+  // |unredirect_policy_|'s enter delay is up, or -1.
+  int unredirect_policy_timeout_id_;
+
   // Is there a task currently posted to the event loop to run
   // DisableCompositing()?
   bool disable_compositing_task_is_pending_;
@@ -615,9 +683,16 @@ class WindowManager : public PanelManagerAreaChangeListener,
   // ID for the timeout that calls HideUnacceleratedGraphicsActor().
   int hide_unaccelerated_graphics_actor_timeout_id_;
 
-  // ID for the timeout that calls PingChrome().
+  // ID for the timeout that calls PingChrome().  Deferred while idle.
   int chrome_watchdog_timeout_id_;
 
+  // ID for the timeout that calls HandleIdleTimeout().  Only scheduled
+  // while we're not idle.
+  int idle_timeout_id_;
+
+  // Has there been any activity since the last HandleIdleTimeout() call?
+  bool saw_activity_since_idle_timeout_;
+
   // Number of outstanding requests to force compositing.
   int num_compositing_requests_;
 
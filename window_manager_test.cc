@@ -18,8 +18,11 @@
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/string_util.h"
 #include "cros/chromeos_wm_ipc_enums.h"
 #include "window_manager/compositor/compositor.h"
+#include "window_manager/compositor/frame_stats.h"
+#include "window_manager/counters.h"
 #include "window_manager/event_consumer.h"
 #include "window_manager/event_loop.h"
 #include "window_manager/geometry.h"
@@ -29,6 +32,7 @@
 #include "window_manager/panels/panel_manager.h"
 #include "window_manager/shadow.h"
 #include "window_manager/test_lib.h"
+#include "window_manager/unredirect_policy.h"
 #include "window_manager/util.h"
 #include "window_manager/window.h"
 #include "window_manager/window_manager.h"
@@ -40,6 +44,8 @@ DEFINE_bool(logtostderr, false,
 
 // From window_manager.cc.
 DECLARE_bool(unredirect_fullscreen_window);
+DECLARE_int32(unredirect_enter_delay_ms);
+DECLARE_double(unredirect_min_damage_hz);
 DECLARE_string(logged_in_log_dir);
 DECLARE_string(logged_out_log_dir);
 
@@ -55,6 +61,7 @@ using window_manager::util::GetCurrentTimeSec;
 using window_manager::util::GetMonotonicTime;
 using window_manager::util::SetCurrentTimeForTest;
 using window_manager::util::SetMonotonicTimeForTest;
+using window_manager::util::XidStr;
 
 namespace window_manager {
 
@@ -463,6 +470,41 @@ TEST_F(WindowManagerTest, OverrideRedirectConfigureNotify) {
   EXPECT_EQ(kNewBounds, win->actor()->GetBounds());
 }
 
+// Check that bursts of events for the same window are coalesced by
+// ProcessPendingEvents() before they're handled.
+TEST_F(WindowManagerTest, CoalesceEvents) {
+  XEvent event;
+  XWindow xid = xconn_->CreateWindow(
+      xconn_->GetRootWindow(),
+      Rect(10, 20, 30, 40),
+      true,    // override redirect
+      false,   // input only
+      0, 0);   // event mask, visual
+  xconn_->MapWindow(xid);
+  SendInitialEventsForWindow(xid);
+  Window* win = wm_->GetWindowOrDie(xid);
+  MockCompositor::TexturePixmapActor* actor = GetMockActorForWindow(win);
+  const int initial_num_moves = actor->num_moves();
+  const int initial_num_texture_updates = actor->num_texture_updates();
+
+  // Queue a series of moves and damage events and check that only the
+  // last move is applied and that the damage is only handled once.
+  for (int i = 1; i <= 5; ++i) {
+    xconn_->ConfigureWindow(xid, Rect(10 * i, 20 * i, 30, 40));
+    xconn_->InitConfigureNotifyEvent(&event, xid);
+    xconn_->AppendEventToQueue(event, false);
+  }
+  for (int i = 0; i < 5; ++i) {
+    xconn_->InitDamageNotifyEvent(&event, xid, Rect(i, i, 10, 10));
+    xconn_->AppendEventToQueue(event, false);
+  }
+  wm_->ProcessPendingEvents();
+  EXPECT_FALSE(xconn_->IsEventPending());
+  EXPECT_EQ(Rect(50, 100, 30, 40), actor->GetBounds());
+  EXPECT_EQ(initial_num_moves + 1, actor->num_moves());
+  EXPECT_EQ(initial_num_texture_updates + 1, actor->num_texture_updates());
+}
+
 TEST_F(WindowManagerTest, StackOverrideRedirectWindowsAboveLayers) {
   MockCompositor::StageActor* stage = compositor_->GetDefaultStage();
   XEvent event;
@@ -1104,6 +1146,87 @@ TEST_F(WindowManagerTest, OverrideRedirectShadows) {
   EXPECT_TRUE(rgba_win->shadow() == NULL);
 }
 
+// Check that the compositor's frame statistics are published in the
+// _CHROME_FRAME_STATS property when the dump key binding is pressed.
+TEST_F(WindowManagerTest, DumpFrameStats) {
+  const XAtom atom = xconn_->GetAtomOrDie("_CHROME_FRAME_STATS");
+  vector<int> values;
+  EXPECT_FALSE(xconn_->GetIntArrayProperty(xconn_->GetRootWindow(),
+                                           atom, &values));
+
+  FrameStats::FrameTiming timing;
+  timing.start_time = CreateTimeTicksFromMs(1000);
+  timing.durations_us[FrameStats::PHASE_RENDER] = 20000;
+  timing.durations_us[FrameStats::PHASE_TOTAL] = 20000;
+  compositor_->frame_stats()->RecordFrame(timing, false);
+
+  SendKey(xconn_->GetRootWindow(),
+          KeyBindings::KeyCombo(
+              XK_f,
+              KeyBindings::kControlMask |
+              KeyBindings::kAltMask |
+              KeyBindings::kShiftMask),
+          1000, 1001);
+  ASSERT_TRUE(xconn_->GetIntArrayProperty(xconn_->GetRootWindow(),
+                                          atom, &values));
+  vector<int> expected_values;
+  compositor_->frame_stats()->GetPropertyValues(&expected_values);
+  EXPECT_TRUE(values == expected_values);
+  ASSERT_GE(values.size(), 2U);
+  EXPECT_EQ(1, values[0]);  // frames
+  EXPECT_EQ(1, values[1]);  // missed deadlines
+}
+
+// Check that counters are published in the _CHROME_WM_COUNTERS property
+// when the dump key binding is pressed or a client asks for them.
+TEST_F(WindowManagerTest, DumpCounters) {
+  const XWindow root = xconn_->GetRootWindow();
+  const XAtom atom = xconn_->GetAtomOrDie("_CHROME_WM_COUNTERS");
+  string value;
+  EXPECT_FALSE(xconn_->GetStringProperty(root, atom, &value));
+
+  Counter::ResetAllCounters();
+  XWindow xid = CreateSimpleWindow();
+  SendInitialEventsForWindow(xid);
+  XWindow other_xid = CreateSimpleWindow();
+  SendInitialEventsForWindow(other_xid);
+
+  XEvent event;
+  xconn_->InitDamageNotifyEvent(&event, xid, Rect(0, 0, 10, 10));
+  for (int i = 0; i < 3; ++i)
+    wm_->HandleEvent(&event);
+  xconn_->InitDamageNotifyEvent(&event, other_xid, Rect(0, 0, 10, 10));
+  wm_->HandleEvent(&event);
+  EXPECT_EQ(3, wm_->GetWindowOrDie(xid)->num_damage_events());
+
+  SendKey(root,
+          KeyBindings::KeyCombo(
+              XK_c,
+              KeyBindings::kControlMask |
+              KeyBindings::kAltMask |
+              KeyBindings::kShiftMask),
+          1000, 1001);
+  ASSERT_TRUE(xconn_->GetStringProperty(root, atom, &value));
+
+  // The total should be listed along with the windows, busiest first.
+  vector<string> lines;
+  SplitString(value, '\n', &lines);
+  EXPECT_TRUE(find(lines.begin(), lines.end(), "Window_DamageEvents 4") !=
+              lines.end()) << value;
+  ASSERT_GE(lines.size(), 2U);
+  EXPECT_EQ("Window_DamageEvents[" + XidStr(xid) + "] 3",
+            lines[lines.size() - 2]);
+  EXPECT_EQ("Window_DamageEvents[" + XidStr(other_xid) + "] 1",
+            lines[lines.size() - 1]);
+
+  // A client message should also refresh the property.
+  wm_->HandleEvent(&event);
+  xconn_->InitClientMessageEvent(&event, root, atom, 0, 0, 0, 0, 0);
+  wm_->HandleEvent(&event);
+  ASSERT_TRUE(xconn_->GetStringProperty(root, atom, &value));
+  EXPECT_NE(string::npos, value.find("Window_DamageEvents 5")) << value;
+}
+
 // Check that we try to guess when is a video is playing by looking at the
 // rate and size of damage events, and that we set the _CHROME_VIDEO_TIME
 // property on the root window accordingly.
@@ -1223,6 +1346,9 @@ TEST_F(WindowManagerTest, VideoTimeProperty) {
 TEST_F(WindowManagerTest, HandleTopFullscreenActorChange) {
   AutoReset<bool> unredirect_flag_resetter(
       &FLAGS_unredirect_fullscreen_window, true);
+  AutoReset<int32> unredirect_delay_flag_resetter(
+      &FLAGS_unredirect_enter_delay_ms, 0);
+  CreateAndInitNewWm();
 
   XWindow xwin1 = xconn_->CreateWindow(
         xconn_->GetRootWindow(),
@@ -1308,6 +1434,149 @@ TEST_F(WindowManagerTest, HandleTopFullscreenActorChange) {
   EXPECT_TRUE(compositor_->should_draw_frame());
 }
 
+// Check that fullscreen windows need to stay on top for a while before
+// they're unredirected, and that they have to wait longer after giving up
+// unredirection quickly.
+TEST_F(WindowManagerTest, UnredirectionHysteresis) {
+  AutoReset<bool> unredirect_flag_resetter(
+      &FLAGS_unredirect_fullscreen_window, true);
+  AutoReset<int32> unredirect_delay_flag_resetter(
+      &FLAGS_unredirect_enter_delay_ms, 200);
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1000));
+  CreateAndInitNewWm();
+
+  XWindow xid = CreateSimpleWindow();
+  SendInitialEventsForWindow(xid);
+  Window* win = wm_->GetWindowOrDie(xid);
+  win->Resize(wm_->root_size(), GRAVITY_NORTHWEST);
+  MockCompositor::TexturePixmapActor* actor = GetMockActorForWindow(win);
+
+  // The window shouldn't be unredirected right away.
+  wm_->HandleTopFullscreenActorChange(actor);
+  EXPECT_EQ(static_cast<XWindow>(0), wm_->unredirected_fullscreen_xid_);
+  ASSERT_GE(wm_->unredirect_policy_timeout_id_, 0);
+
+  // Animations postpone unredirection until the compositor tells us that
+  // they're done; we shouldn't poll in the meantime.
+  compositor_->set_has_active_animations(true);
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1300));
+  event_loop_->RunTimeoutForTesting(wm_->unredirect_policy_timeout_id_);
+  EXPECT_EQ(static_cast<XWindow>(0), wm_->unredirected_fullscreen_xid_);
+  EXPECT_EQ(-1, wm_->unredirect_policy_timeout_id_);
+  compositor_->set_has_active_animations(false);
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1400));
+  wm_->HandleAnimationsFinished();
+  EXPECT_EQ(static_cast<XWindow>(0), wm_->unredirected_fullscreen_xid_);
+  ASSERT_GE(wm_->unredirect_policy_timeout_id_, 0);
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1500));
+  event_loop_->RunTimeoutForTesting(wm_->unredirect_policy_timeout_id_);
+  EXPECT_EQ(xid, wm_->unredirected_fullscreen_xid_);
+  EXPECT_EQ(-1, wm_->unredirect_policy_timeout_id_);
+  wm_->DisableCompositing();
+  EXPECT_FALSE(compositor_->should_draw_frame());
+
+  // When something is briefly overlaid on the window, we should start
+  // compositing immediately and then wait twice as long as before to
+  // unredirect the window again.
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1600));
+  wm_->HandleTopFullscreenActorChange(NULL);
+  EXPECT_EQ(static_cast<XWindow>(0), wm_->unredirected_fullscreen_xid_);
+  EXPECT_TRUE(compositor_->should_draw_frame());
+  wm_->HandleTopFullscreenActorChange(actor);
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1900));
+  event_loop_->RunTimeoutForTesting(wm_->unredirect_policy_timeout_id_);
+  EXPECT_EQ(static_cast<XWindow>(0), wm_->unredirected_fullscreen_xid_);
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(2000));
+  event_loop_->RunTimeoutForTesting(wm_->unredirect_policy_timeout_id_);
+  EXPECT_EQ(xid, wm_->unredirected_fullscreen_xid_);
+  EXPECT_EQ(2, wm_->unredirect_policy_->num_unredirections());
+  EXPECT_EQ(1, wm_->unredirect_policy_->num_flaps());
+
+  SetMonotonicTimeForTest(base::TimeTicks());
+}
+
+// Check that with --unredirect_min_damage_hz, fullscreen windows are
+// unredirected as soon as they're damaged often enough, without polling for
+// their damage rate.
+TEST_F(WindowManagerTest, UnredirectionDamageRate) {
+  AutoReset<bool> unredirect_flag_resetter(
+      &FLAGS_unredirect_fullscreen_window, true);
+  AutoReset<int32> unredirect_delay_flag_resetter(
+      &FLAGS_unredirect_enter_delay_ms, 0);
+  AutoReset<double> unredirect_damage_flag_resetter(
+      &FLAGS_unredirect_min_damage_hz, 20.0);
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1000));
+  CreateAndInitNewWm();
+
+  XWindow xid = CreateSimpleWindow();
+  SendInitialEventsForWindow(xid);
+  Window* win = wm_->GetWindowOrDie(xid);
+  win->Resize(wm_->root_size(), GRAVITY_NORTHWEST);
+  MockCompositor::TexturePixmapActor* actor = GetMockActorForWindow(win);
+
+  // A static window shouldn't be unredirected, and we shouldn't keep
+  // checking whether it's being updated.
+  wm_->HandleTopFullscreenActorChange(actor);
+  EXPECT_EQ(static_cast<XWindow>(0), wm_->unredirected_fullscreen_xid_);
+  EXPECT_EQ(-1, wm_->unredirect_policy_timeout_id_);
+
+  // Once the window is damaged frequently enough, it should be
+  // unredirected.
+  XEvent event;
+  xconn_->InitDamageNotifyEvent(&event, xid, Rect(0, 0, 10, 10));
+  for (int i = 1; i <= 10 && !wm_->unredirected_fullscreen_xid_; ++i) {
+    SetMonotonicTimeForTest(CreateTimeTicksFromMs(1000 + i * 10));
+    wm_->HandleEvent(&event);
+  }
+  EXPECT_EQ(xid, wm_->unredirected_fullscreen_xid_);
+  EXPECT_EQ(-1, wm_->unredirect_policy_timeout_id_);
+
+  SetMonotonicTimeForTest(base::TimeTicks());
+}
+
+// Simulate a minute during which nothing happens and check that we don't
+// wake up at all once the event loop has gone idle.
+TEST_F(WindowManagerTest, NoWakeupsWhileIdle) {
+  // Include a static fullscreen window that's a candidate for
+  // unredirection but isn't updated often enough to be unredirected.
+  AutoReset<bool> unredirect_flag_resetter(
+      &FLAGS_unredirect_fullscreen_window, true);
+  AutoReset<double> unredirect_damage_flag_resetter(
+      &FLAGS_unredirect_min_damage_hz, 20.0);
+  event_loop_->UseFakeClockForTesting();
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1000));
+  CreateAndInitNewWm();
+  XWindow xid = CreateSimpleWindow();
+  SendInitialEventsForWindow(xid);
+  Window* win = wm_->GetWindowOrDie(xid);
+  win->Resize(wm_->root_size(), GRAVITY_NORTHWEST);
+  wm_->HandleTopFullscreenActorChange(GetMockActorForWindow(win));
+
+  // The window manager's clock doesn't follow the event loop's fake clock,
+  // so move it past the unredirection delay by hand.
+  SetMonotonicTimeForTest(CreateTimeTicksFromMs(1000 + 60 * 1000));
+
+  // Wait for the idle timeout to notice that nothing is happening.  Any
+  // activity that happened during setup can delay this by an extra period.
+  event_loop_->AdvanceFakeClockForTesting(2 * WindowManager::kIdleTimeoutMs);
+  EXPECT_TRUE(event_loop_->idle());
+  EXPECT_EQ(0, event_loop_->AdvanceFakeClockForTesting(60 * 1000));
+
+  // An event should take us out of idle mode and the watchdog's overdue
+  // ping should run right away.
+  XEvent event;
+  xconn_->InitPropertyNotifyEvent(&event, xconn_->GetRootWindow(), 1);
+  wm_->HandleEvent(&event);
+  EXPECT_FALSE(event_loop_->idle());
+  EXPECT_EQ(1, event_loop_->AdvanceFakeClockForTesting(0));
+
+  // We should go idle again afterwards.
+  event_loop_->AdvanceFakeClockForTesting(2 * WindowManager::kIdleTimeoutMs);
+  EXPECT_TRUE(event_loop_->idle());
+  EXPECT_EQ(0, event_loop_->AdvanceFakeClockForTesting(60 * 1000));
+  EXPECT_EQ(static_cast<XWindow>(0), wm_->unredirected_fullscreen_xid_);
+}
+
 // Check that WindowManager passes ownership of destroyed windows to
 // EventConsumers who asked for them.
 TEST_F(WindowManagerTest, DestroyedWindows) {
@@ -1463,6 +1732,9 @@ TEST_F(WindowManagerTest, WindowDestroyedWhileBeingMapped) {
 TEST_F(WindowManagerTest, ForceCompositing) {
   AutoReset<bool> unredirect_flag_resetter(
       &FLAGS_unredirect_fullscreen_window, true);
+  AutoReset<int32> unredirect_delay_flag_resetter(
+      &FLAGS_unredirect_enter_delay_ms, 0);
+  CreateAndInitNewWm();
 
   // Create a window.
   XWindow xid = CreateSimpleWindow();
@@ -1537,6 +1809,9 @@ TEST_F(WindowManagerTest, MissingUnmapNotify) {
 TEST_F(WindowManagerTest, ResizeScreenWhileCompositing) {
   AutoReset<bool> unredirect_flag_resetter(
       &FLAGS_unredirect_fullscreen_window, true);
+  AutoReset<int32> unredirect_delay_flag_resetter(
+      &FLAGS_unredirect_enter_delay_ms, 0);
+  CreateAndInitNewWm();
 
   // Create a fullscreen window and check that we disable compositing.
   XWindow xid = CreateSimpleWindow();
@@ -1214,6 +1214,42 @@ TEST_F(WindowTest, AvoidMovingActorDuringResize) {
   EXPECT_EQ(kBounds5, actor->GetBounds());
 }
 
+// Test that the Window c'tor sends all of its property requests at once
+// instead of waiting for a reply to each one before sending the next.
+TEST_F(WindowTest, PipelinePropertyRequests) {
+  XWindow xid = CreateSimpleWindow();
+  MockXConnection::WindowInfo* info = xconn_->GetWindowInfoOrDie(xid);
+  info->transient_for = 1234;  // arbitrary ID
+  info->size_hints.min_size.reset(100, 200);
+  xconn_->SetStringProperty(
+      xid, xconn_->GetAtomOrDie("_NET_WM_NAME"), "title");
+  xconn_->SetIntProperty(
+      xid, xconn_->GetAtomOrDie("_NET_WM_PID"),
+      xconn_->GetAtomOrDie("CARDINAL"), 123);
+
+  XConnection::WindowGeometry geometry;
+  ASSERT_TRUE(xconn_->GetWindowGeometry(xid, &geometry));
+  const int initial_round_trips = xconn_->num_round_trips();
+  Window win(wm_.get(), xid, false, geometry);
+  EXPECT_EQ(initial_round_trips + 1, xconn_->num_round_trips());
+  EXPECT_EQ(0U, xconn_->num_pending_requests());
+  EXPECT_TRUE(win.property_requests_.empty());
+
+  EXPECT_EQ("title", win.title());
+  EXPECT_EQ(123, win.client_pid());
+  EXPECT_EQ(static_cast<XWindow>(1234), win.transient_for_xid());
+  EXPECT_EQ(Size(100, 200), win.size_hints().min_size);
+
+  // Properties fetched later in response to PropertyNotify events should
+  // still be loaded.
+  xconn_->SetIntProperty(
+      xid, xconn_->GetAtomOrDie("_NET_WM_PID"),
+      xconn_->GetAtomOrDie("CARDINAL"), 456);
+  win.FetchAndApplyWmPid();
+  EXPECT_EQ(456, win.client_pid());
+  EXPECT_EQ(initial_round_trips + 2, xconn_->num_round_trips());
+}
+
 }  // namespace window_manager
 
 int main(int argc, char** argv) {
@@ -28,15 +28,22 @@ WmIpc::WmIpc(XConnection* xconn, AtomCache* cache)
 bool WmIpc::GetWindowType(XWindow xid,
                           WmIpcWindowType* type,
                           vector<int>* params) {
+  return GetWindowTypeReply(
+      xconn_->SendGetPropertyRequest(
+          xid, atom_cache_->GetXAtom(ATOM_CHROME_WINDOW_TYPE)),
+      type, params);
+}
+
+bool WmIpc::GetWindowTypeReply(const XConnection::RequestCookie& cookie,
+                               WmIpcWindowType* type,
+                               vector<int>* params) {
   CHECK(type);
   CHECK(params);
 
   params->clear();
   vector<int> values;
-  if (!xconn_->GetIntArrayProperty(
-          xid, atom_cache_->GetXAtom(ATOM_CHROME_WINDOW_TYPE), &values)) {
+  if (!xconn_->GetIntArrayPropertyReply(cookie, &values))
     return false;
-  }
   CHECK(!values.empty());
   *type = static_cast<WmIpcWindowType>(values[0]);
   for (size_t i = 1; i < values.size(); ++i)
@@ -11,12 +11,12 @@
 #include "base/basictypes.h"
 #include "base/logging.h"
 #include "cros/chromeos_wm_ipc_enums.h"
+#include "window_manager/x11/x_connection.h"
 #include "window_manager/x11/x_types.h"
 
 namespace window_manager {
 
 class AtomCache;
-class XConnection;
 
 // This class simplifies window-manager-to-client-app communication.  It
 // consists primarily of utility methods to set and read properties on
@@ -38,6 +38,13 @@ class WmIpc {
   bool GetWindowType(XWindow xid,
                      chromeos::WmIpcWindowType* type,
                      std::vector<int>* params);
+
+  // Like GetWindowType(), but reads the reply to a request for the
+  // window's _CHROME_WINDOW_TYPE property that was already sent via
+  // XConnection::SendGetPropertyRequest().
+  bool GetWindowTypeReply(const XConnection::RequestCookie& cookie,
+                          chromeos::WmIpcWindowType* type,
+                          std::vector<int>* params);
   bool SetWindowType(XWindow xid,
                      chromeos::WmIpcWindowType type,
                      const std::vector<int>* params);
@@ -12,6 +12,7 @@
 extern "C" {
 #include <X11/extensions/sync.h>
 #include <X11/extensions/Xdamage.h>
+#include <X11/Xatom.h>
 }
 
 #include "base/logging.h"
@@ -63,7 +64,10 @@ MockXConnection::MockXConnection()
       cursor_shown_(true),
       using_detectable_keyboard_auto_repeat_(false),
       connection_pipe_has_data_(false),
-      num_pointer_ungrabs_with_replayed_events_(0) {
+      num_pointer_ungrabs_with_replayed_events_(0),
+      next_request_sequence_(1),
+      num_round_trips_(0),
+      last_round_trip_sequence_(0) {
   PCHECK(HANDLE_EINTR(pipe(connection_pipe_fds_)) != -1);
   PCHECK(HANDLE_EINTR(
              fcntl(connection_pipe_fds_[0], F_SETFL, O_NONBLOCK)) != -1);
@@ -81,8 +85,16 @@ MockXConnection::~MockXConnection() {
   PCHECK(HANDLE_EINTR(close(connection_pipe_fds_[1])) != -1);
 }
 
-bool MockXConnection::GetWindowGeometry(XWindow xid, WindowGeometry* geom_out) {
+XConnection::RequestCookie MockXConnection::SendGetWindowGeometryRequest(
+    XDrawable xid) {
+  return SendRequest(RequestCookie::TYPE_GEOMETRY, xid, 0);
+}
+
+bool MockXConnection::GetWindowGeometryReply(const RequestCookie& cookie,
+                                             WindowGeometry* geom_out) {
   CHECK(geom_out);
+  TakeReply(cookie, RequestCookie::TYPE_GEOMETRY);
+  const XID xid = cookie.xid;
   if (WindowInfo* window_info = GetWindowInfo(xid)) {
     geom_out->bounds = window_info->bounds;
     geom_out->border_width = window_info->border_width;
@@ -263,29 +275,49 @@ bool MockXConnection::GrabKeyboard(XWindow xid, XTime timestamp) {
   return true;
 }
 
-bool MockXConnection::GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out) {
+XConnection::RequestCookie MockXConnection::SendGetSizeHintsRequest(
+    XWindow xid) {
+  return SendRequest(RequestCookie::TYPE_SIZE_HINTS, xid, XA_WM_NORMAL_HINTS);
+}
+
+bool MockXConnection::GetSizeHintsReply(const RequestCookie& cookie,
+                                        SizeHints* hints_out) {
   CHECK(hints_out);
-  WindowInfo* info = GetWindowInfo(xid);
+  TakeReply(cookie, RequestCookie::TYPE_SIZE_HINTS);
+  WindowInfo* info = GetWindowInfo(cookie.xid);
   if (!info)
     return false;
   *hints_out = info->size_hints;
   return true;
 }
 
-bool MockXConnection::GetTransientHintForWindow(XWindow xid,
-                                                XWindow* owner_out) {
+XConnection::RequestCookie MockXConnection::SendGetTransientHintRequest(
+    XWindow xid) {
+  return SendRequest(
+      RequestCookie::TYPE_TRANSIENT_HINT, xid, XA_WM_TRANSIENT_FOR);
+}
+
+bool MockXConnection::GetTransientHintReply(const RequestCookie& cookie,
+                                            XWindow* owner_out) {
   CHECK(owner_out);
-  WindowInfo* info = GetWindowInfo(xid);
+  TakeReply(cookie, RequestCookie::TYPE_TRANSIENT_HINT);
+  WindowInfo* info = GetWindowInfo(cookie.xid);
   if (!info)
     return false;
   *owner_out = info->transient_for;
   return true;
 }
 
-bool MockXConnection::GetWindowAttributes(XWindow xid,
-                                          WindowAttributes* attr_out) {
+XConnection::RequestCookie MockXConnection::SendGetWindowAttributesRequest(
+    XWindow xid) {
+  return SendRequest(RequestCookie::TYPE_ATTRIBUTES, xid, 0);
+}
+
+bool MockXConnection::GetWindowAttributesReply(const RequestCookie& cookie,
+                                               WindowAttributes* attr_out) {
   CHECK(attr_out);
-  WindowInfo* info = GetWindowInfo(xid);
+  TakeReply(cookie, RequestCookie::TYPE_ATTRIBUTES);
+  WindowInfo* info = GetWindowInfo(cookie.xid);
   if (!info)
     return false;
 
@@ -482,14 +514,20 @@ bool MockXConnection::GetAtoms(const vector<string>& names,
   return true;
 }
 
-bool MockXConnection::GetIntArrayProperty(XWindow xid,
-                                          XAtom xatom,
-                                          vector<int>* values) {
-  WindowInfo* info = GetWindowInfo(xid);
+XConnection::RequestCookie MockXConnection::SendGetPropertyRequest(
+    XWindow xid, XAtom xatom) {
+  return SendRequest(RequestCookie::TYPE_PROPERTY, xid, xatom);
+}
+
+bool MockXConnection::GetIntArrayPropertyReply(const RequestCookie& cookie,
+                                               vector<int>* values) {
+  CHECK(values);
+  TakeReply(cookie, RequestCookie::TYPE_PROPERTY);
+  WindowInfo* info = GetWindowInfo(cookie.xid);
   if (!info)
     return false;
   map<XAtom, vector<int> >::const_iterator it =
-      info->int_properties.find(xatom);
+      info->int_properties.find(cookie.xatom);
   if (it == info->int_properties.end())
     return false;
   *values = it->second;
@@ -514,11 +552,15 @@ bool MockXConnection::SetIntArrayProperty(XWindow xid,
   return true;
 }
 
-bool MockXConnection::GetStringProperty(XWindow xid, XAtom xatom, string* out) {
-  WindowInfo* info = GetWindowInfo(xid);
+bool MockXConnection::GetStringPropertyReply(const RequestCookie& cookie,
+                                             string* out) {
+  CHECK(out);
+  TakeReply(cookie, RequestCookie::TYPE_PROPERTY);
+  WindowInfo* info = GetWindowInfo(cookie.xid);
   if (!info)
     return false;
-  map<XAtom, string>::const_iterator it = info->string_properties.find(xatom);
+  map<XAtom, string>::const_iterator it =
+      info->string_properties.find(cookie.xatom);
   if (it == info->string_properties.end())
     return false;
   *out = it->second;
@@ -550,6 +592,13 @@ bool MockXConnection::DeletePropertyIfExists(XWindow xid, XAtom xatom) {
   return true;
 }
 
+void MockXConnection::DiscardReply(const RequestCookie& cookie) {
+  if (cookie.is_null())
+    return;
+  CHECK(pending_requests_.erase(cookie.sequence))
+      << "Discarding unknown request " << cookie.sequence;
+}
+
 bool MockXConnection::IsEventPending() {
   return !queued_events_.empty();
 }
@@ -595,9 +644,16 @@ bool MockXConnection::SendConfigureNotifyEvent(XWindow xid,
   return true;
 }
 
-bool MockXConnection::GetAtomName(XAtom atom, string* name) {
+XConnection::RequestCookie MockXConnection::SendGetAtomNameRequest(
+    XAtom atom) {
+  return SendRequest(RequestCookie::TYPE_ATOM_NAME, 0, atom);
+}
+
+bool MockXConnection::GetAtomNameReply(const RequestCookie& cookie,
+                                       string* name) {
   CHECK(name);
-  map<XAtom, string>::const_iterator it = atom_to_name_.find(atom);
+  TakeReply(cookie, RequestCookie::TYPE_ATOM_NAME);
+  map<XAtom, string>::const_iterator it = atom_to_name_.find(cookie.xatom);
   if (it == atom_to_name_.end())
     return false;
   *name = it->second;
@@ -622,8 +678,7 @@ bool MockXConnection::GetImage(XID drawable,
                                ImageFormat* format_out) {
   CHECK(data_out);
   CHECK(format_out);
-  WindowInfo* info = GetWindowInfo(drawable);
-  if (!info)
+  if (!GetWindowInfo(drawable) && !GetPixmapInfo(drawable))
     return false;
 
   // TODO: Make data settable in the WindowInfo so it can be tested.
@@ -1056,4 +1111,22 @@ void MockXConnection::GetEventInternal(XEvent* event, bool remove_from_queue) {
   }
 }
 
+XConnection::RequestCookie MockXConnection::SendRequest(
+    RequestCookie::Type type, XID xid, XAtom xatom) {
+  const unsigned int sequence = next_request_sequence_++;
+  pending_requests_.insert(sequence);
+  return RequestCookie(type, sequence, xid, xatom);
+}
+
+void MockXConnection::TakeReply(const RequestCookie& cookie,
+                                RequestCookie::Type type) {
+  CHECK_EQ(cookie.type, type);
+  CHECK(pending_requests_.erase(cookie.sequence))
+      << "Reading reply for unknown request " << cookie.sequence;
+  if (cookie.sequence > last_round_trip_sequence_) {
+    num_round_trips_++;
+    last_round_trip_sequence_ = next_request_sequence_ - 1;
+  }
+}
+
 }  // namespace window_manager
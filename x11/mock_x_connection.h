@@ -36,7 +36,6 @@ class MockXConnection : public XConnection {
   ~MockXConnection();
 
   // Begin XConnection methods.
-  virtual bool GetWindowGeometry(XWindow xid, WindowGeometry* geom_out);
   virtual bool MapWindow(XWindow xid);
   virtual bool UnmapWindow(XWindow xid);
   virtual bool MoveWindow(XWindow xid, const Point& pos);
@@ -74,9 +73,6 @@ class MockXConnection : public XConnection {
   virtual bool SetInputRegionForWindow(XWindow xid, const Rect& rect) {
     return true;
   }
-  virtual bool GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out);
-  virtual bool GetTransientHintForWindow(XWindow xid, XWindow* owner_out);
-  virtual bool GetWindowAttributes(XWindow xid, WindowAttributes* attr_out);
   virtual bool RedirectSubwindowsForCompositing(XWindow xid);
   virtual bool RedirectWindowForCompositing(XWindow xid);
   virtual bool UnredirectWindowForCompositing(XWindow xid);
@@ -104,19 +100,35 @@ class MockXConnection : public XConnection {
   virtual bool SelectRandREventsOnWindow(XWindow xid);
   virtual bool GetAtoms(const std::vector<std::string>& names,
                         std::vector<XAtom>* atoms_out);
-  virtual bool GetAtomName(XAtom atom, std::string* name);
-  virtual bool GetIntArrayProperty(XWindow xid,
-                                   XAtom xatom,
-                                   std::vector<int>* values);
   virtual bool SetIntArrayProperty(XWindow xid,
                                    XAtom xatom,
                                    XAtom type,
                                    const std::vector<int>& values);
-  virtual bool GetStringProperty(XWindow xid, XAtom xatom, std::string* out);
   virtual bool SetStringProperty(XWindow xid,
                                  XAtom xatom,
                                  const std::string& value);
   virtual bool DeletePropertyIfExists(XWindow xid, XAtom xatom);
+  virtual RequestCookie SendGetWindowGeometryRequest(XDrawable xid);
+  virtual bool GetWindowGeometryReply(const RequestCookie& cookie,
+                                      WindowGeometry* geom_out);
+  virtual RequestCookie SendGetWindowAttributesRequest(XWindow xid);
+  virtual bool GetWindowAttributesReply(const RequestCookie& cookie,
+                                        WindowAttributes* attr_out);
+  virtual RequestCookie SendGetSizeHintsRequest(XWindow xid);
+  virtual bool GetSizeHintsReply(const RequestCookie& cookie,
+                                 SizeHints* hints_out);
+  virtual RequestCookie SendGetTransientHintRequest(XWindow xid);
+  virtual bool GetTransientHintReply(const RequestCookie& cookie,
+                                     XWindow* owner_out);
+  virtual RequestCookie SendGetPropertyRequest(XWindow xid, XAtom xatom);
+  virtual bool GetIntArrayPropertyReply(const RequestCookie& cookie,
+                                        std::vector<int>* values);
+  virtual bool GetStringPropertyReply(const RequestCookie& cookie,
+                                      std::string* out);
+  virtual RequestCookie SendGetAtomNameRequest(XAtom atom);
+  virtual bool GetAtomNameReply(const RequestCookie& cookie,
+                                std::string* name);
+  virtual void DiscardReply(const RequestCookie& cookie);
   virtual int GetConnectionFileDescriptor() { return connection_pipe_fds_[0]; }
   virtual bool IsEventPending();
   virtual void GetNextEvent(void* event) {
@@ -206,6 +218,8 @@ class MockXConnection : public XConnection {
                                    float blue,
                                    const Point& pos,
                                    const Size& size) {}
+  virtual void RenderSetPictureClipRectangles(
+      XPicture pict, const std::vector<Rect>& rects) {}
 
   // End XConnection methods.
 
@@ -350,6 +364,8 @@ class MockXConnection : public XConnection {
   int num_pointer_ungrabs_with_replayed_events() const {
     return num_pointer_ungrabs_with_replayed_events_;
   }
+  int num_round_trips() const { return num_round_trips_; }
+  size_t num_pending_requests() const { return pending_requests_.size(); }
 
   bool KeyIsGrabbed(KeyCode keycode, uint32 modifiers) {
     return grabbed_keys_.count(std::make_pair(keycode, modifiers)) > 0;
@@ -482,6 +498,13 @@ class MockXConnection : public XConnection {
   // |remove_from_queue| is true.
   void GetEventInternal(XEvent* event, bool remove_from_queue);
 
+  // Helper methods used by the asynchronous request methods.
+  // SendRequest() returns a cookie for a new request.  TakeReply() dies if
+  // |cookie| doesn't refer to an outstanding request of type |type|,
+  // removes it from |pending_requests_|, and updates |num_round_trips_|.
+  RequestCookie SendRequest(RequestCookie::Type type, XID xid, XAtom xatom);
+  void TakeReply(const RequestCookie& cookie, RequestCookie::Type type);
+
   // Map from IDs to info about the corresponding windows or pixmaps.
   std::map<XWindow, std::tr1::shared_ptr<WindowInfo> > windows_;
   std::map<XPixmap, std::tr1::shared_ptr<PixmapInfo> > pixmaps_;
@@ -562,6 +585,19 @@ class MockXConnection : public XConnection {
   std::map<XID, std::tr1::shared_ptr<SyncCounterAlarmInfo> >
       sync_counter_alarms_;
 
+  // Sequence number to use for the next asynchronous request.
+  unsigned int next_request_sequence_;
+
+  // Sequence numbers of requests whose replies haven't been read yet.
+  std::set<unsigned int> pending_requests_;
+
+  // Number of times that we've simulated blocking on a reply from the
+  // server.  Reading a reply flushes all earlier requests, so replies to
+  // requests with sequence numbers up to |last_round_trip_sequence_| can
+  // be read without waiting again.
+  int num_round_trips_;
+  unsigned int last_round_trip_sequence_;
+
   DISALLOW_COPY_AND_ASSIGN(MockXConnection);
 };
 
@@ -4,6 +4,12 @@
 
 #include "window_manager/x11/real_x_connection.h"
 
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <cstdlib>
+#include <cstring>
+
 extern "C" {
 #include <xcb/composite.h>
 #include <xcb/damage.h>
@@ -24,6 +30,7 @@ extern "C" {
 
 #include "base/string_util.h"
 #include "base/stringprintf.h"
+#include "window_manager/counters.h"
 #include "window_manager/geometry.h"
 #include "window_manager/util.h"
 #include "window_manager/x11/x_connection_internal.h"
@@ -34,8 +41,18 @@ using std::vector;
 using window_manager::util::FindWithDefault;
 using window_manager::util::XidStr;
 
+// Number of times that we've waited for replies from the X server (either to
+// requests or to XSync()).  Replies to pipelined requests are counted
+// separately even though they may have arrived together.
+DEFINE_COUNTER(XConnection_RoundTrips);
+
 namespace window_manager {
 
+// Shared memory segments used by GetImage() are allocated in multiples of
+// this many bytes so that a window that's being resized a little at a time
+// doesn't force a new segment to be allocated for each frame.
+static const size_t kShmSegmentGranularity = 1024 * 1024;
+
 // Used by RealXConnection's constructor to negotiate the version of an X
 // extension that we'll be using with the X server.  |name| is the
 // extension's name as it appears in XCB, e.g. "damage" for
@@ -100,8 +117,11 @@ RealXConnection::RealXConnection(XDisplay* display)
     : display_(display),
       xcb_conn_(NULL),
       root_(XCB_NONE),
-      utf8_string_atom_(XCB_NONE) {
+      utf8_string_atom_(XCB_NONE),
+      shm_supported_(false),
+      shm_size_(0) {
   CHECK(display_);
+  memset(&shm_info_, 0, sizeof(shm_info_));
 
   // Install our own Xlib error handler to avoid crashing (the default
   // behavior when Xlib sees an error in the event queue).
@@ -130,26 +150,40 @@ RealXConnection::RealXConnection(XDisplay* display)
   INIT_XCB_EXTENSION(damage, query_version, 1, 1);
   INIT_XCB_EXTENSION(xfixes, query_version, 4, 0);
   INIT_XCB_EXTENSION(sync, initialize, 3, 0);
+
+  // MIT-SHM is optional; GetImage() falls back to XGetImage() without it.
+  shm_supported_ = XShmQueryExtension(display_);
+  LOG(INFO) << "MIT-SHM extension is "
+            << (shm_supported_ ? "available" : "unavailable");
 }
 
 RealXConnection::~RealXConnection() {
+  DestroyShmSegment();
   CHECK(XSetErrorHandler(old_error_handler) == &HandleXError)
       << "Our error handler was replaced with someone else's";
 }
 
-bool RealXConnection::GetWindowGeometry(XDrawable xid,
-                                        WindowGeometry* geom_out) {
-  CHECK(geom_out);
+XConnection::RequestCookie RealXConnection::SendGetWindowGeometryRequest(
+    XDrawable xid) {
   xcb_get_geometry_cookie_t cookie = xcb_get_geometry(xcb_conn_, xid);
+  return RequestCookie(RequestCookie::TYPE_GEOMETRY, cookie.sequence, xid, 0);
+}
+
+bool RealXConnection::GetWindowGeometryReply(const RequestCookie& cookie,
+                                             WindowGeometry* geom_out) {
+  CHECK(geom_out);
+  DCHECK_EQ(cookie.type, RequestCookie::TYPE_GEOMETRY);
+  xcb_get_geometry_cookie_t xcb_cookie = { cookie.sequence };
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_get_geometry_reply_t> reply(
-      xcb_get_geometry_reply(xcb_conn_, cookie, &error));
+      xcb_get_geometry_reply(xcb_conn_, xcb_cookie, &error));
   scoped_ptr_malloc<xcb_generic_error_t> scoped_error(error);
   if (error || !reply.get()) {
     // XCB sometimes returns a NULL reply without reporting an error;
     // no idea why.
     LOG(WARNING) << "Got X error while getting geometry for drawable "
-                 << XidStr(xid);
+                 << XidStr(cookie.xid);
     return false;
   }
 
@@ -238,6 +272,7 @@ bool RealXConnection::SelectInputOnWindow(
   TrapErrors();
   if (preserve_existing) {
     XWindowAttributes attr;
+    COUNTER_INCREMENT(XConnection_RoundTrips);
     XGetWindowAttributes(display_, xid, &attr);
     event_mask |= attr.your_event_mask;
   }
@@ -257,6 +292,7 @@ bool RealXConnection::SelectInputOnWindow(
 bool RealXConnection::DeselectInputOnWindow(XWindow xid, int event_mask) {
   TrapErrors();
   XWindowAttributes attr;
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   XGetWindowAttributes(display_, xid, &attr);
   attr.your_event_mask &= ~event_mask;
   if (!GetLastErrorCode()) {
@@ -312,6 +348,7 @@ bool RealXConnection::GrabPointer(XWindow xid,
                        XCB_NONE,             // confine_to
                        cursor,
                        timestamp);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_grab_pointer_reply_t> reply(
       xcb_grab_pointer_reply(xcb_conn_, cookie, &error));
@@ -345,6 +382,7 @@ bool RealXConnection::GrabKeyboard(XWindow xid, XTime timestamp) {
                         timestamp,
                         XCB_GRAB_MODE_ASYNC,   // pointer_mode
                         XCB_GRAB_MODE_ASYNC);  // keyboard_mode
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_grab_keyboard_reply_t> reply(
       xcb_grab_keyboard_reply(xcb_conn_, cookie, &error));
@@ -394,12 +432,21 @@ bool RealXConnection::SetInputRegionForWindow(XWindow xid,
   return true;
 }
 
-bool RealXConnection::GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out) {
+XConnection::RequestCookie RealXConnection::SendGetSizeHintsRequest(
+    XWindow xid) {
+  return SendGetPropertyRequestInternal(
+      xid, XA_WM_NORMAL_HINTS, RequestCookie::TYPE_SIZE_HINTS);
+}
+
+bool RealXConnection::GetSizeHintsReply(const RequestCookie& cookie,
+                                        SizeHints* hints_out) {
   CHECK(hints_out);
+  DCHECK_EQ(cookie.type, RequestCookie::TYPE_SIZE_HINTS);
   hints_out->reset();
 
+  const XWindow xid = cookie.xid;
   vector<int> values;
-  if (!GetIntArrayProperty(xid, XA_WM_NORMAL_HINTS, &values))
+  if (!GetIntArrayPropertyReplyInternal(cookie, &values))
     return false;
 
   // Contents of the WM_NORMAL_HINTS property (15-18 32-bit values):
@@ -457,24 +504,42 @@ bool RealXConnection::GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out) {
   return true;
 }
 
-bool RealXConnection::GetTransientHintForWindow(XWindow xid,
-                                                XWindow* owner_out) {
-  int owner = XCB_NONE;
-  if (!GetIntProperty(xid, XA_WM_TRANSIENT_FOR, &owner))
+XConnection::RequestCookie RealXConnection::SendGetTransientHintRequest(
+    XWindow xid) {
+  return SendGetPropertyRequestInternal(
+      xid, XA_WM_TRANSIENT_FOR, RequestCookie::TYPE_TRANSIENT_HINT);
+}
+
+bool RealXConnection::GetTransientHintReply(const RequestCookie& cookie,
+                                            XWindow* owner_out) {
+  CHECK(owner_out);
+  DCHECK_EQ(cookie.type, RequestCookie::TYPE_TRANSIENT_HINT);
+  vector<int> values;
+  if (!GetIntArrayPropertyReplyInternal(cookie, &values) || values.empty())
     return false;
-  *owner_out = static_cast<XWindow>(owner);
+  *owner_out = static_cast<XWindow>(values[0]);
   return true;
 }
 
-bool RealXConnection::GetWindowAttributes(
-    XWindow xid, WindowAttributes* attr_out) {
-  CHECK(attr_out);
-
+XConnection::RequestCookie RealXConnection::SendGetWindowAttributesRequest(
+    XWindow xid) {
   xcb_get_window_attributes_cookie_t cookie =
       xcb_get_window_attributes(xcb_conn_, xid);
+  return RequestCookie(
+      RequestCookie::TYPE_ATTRIBUTES, cookie.sequence, xid, 0);
+}
+
+bool RealXConnection::GetWindowAttributesReply(const RequestCookie& cookie,
+                                               WindowAttributes* attr_out) {
+  CHECK(attr_out);
+  DCHECK_EQ(cookie.type, RequestCookie::TYPE_ATTRIBUTES);
+
+  const XWindow xid = cookie.xid;
+  xcb_get_window_attributes_cookie_t xcb_cookie = { cookie.sequence };
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_get_window_attributes_reply_t> reply(
-      xcb_get_window_attributes_reply(xcb_conn_, cookie, &error));
+      xcb_get_window_attributes_reply(xcb_conn_, xcb_cookie, &error));
   scoped_ptr_malloc<xcb_generic_error_t> scoped_error(error);
   if (error || !reply.get()) {
     LOG(WARNING) << "Getting attributes for window " << XidStr(xid)
@@ -675,6 +740,7 @@ bool RealXConnection::DestroyWindow(XWindow xid) {
 bool RealXConnection::IsWindowShaped(XWindow xid) {
   xcb_shape_query_extents_cookie_t cookie =
       xcb_shape_query_extents(xcb_conn_, xid);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_shape_query_extents_reply_t> reply(
       xcb_shape_query_extents_reply(xcb_conn_, cookie, &error));
@@ -697,6 +763,7 @@ bool RealXConnection::SelectShapeEventsOnWindow(XWindow xid) {
 bool RealXConnection::GetWindowBoundingRegion(XWindow xid, ByteMap* bytemap) {
   TrapErrors();
   int count = 0, ordering = 0;
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   XRectangle* rects =
       XShapeGetRectangles(display_, xid, ShapeBounding, &count, &ordering);
   if (int error = UntrapErrors()) {
@@ -795,6 +862,7 @@ bool RealXConnection::GetAtoms(
   }
 
   // ... and then wait for the replies.
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   for (size_t i = 0; i < names.size(); ++i) {
     xcb_generic_error_t* error = NULL;
     scoped_ptr_malloc<xcb_intern_atom_reply_t> reply(
@@ -809,17 +877,27 @@ bool RealXConnection::GetAtoms(
   return true;
 }
 
-bool RealXConnection::GetAtomName(XAtom atom, string* name) {
+XConnection::RequestCookie RealXConnection::SendGetAtomNameRequest(
+    XAtom atom) {
+  xcb_get_atom_name_cookie_t cookie = xcb_get_atom_name(xcb_conn_, atom);
+  return RequestCookie(RequestCookie::TYPE_ATOM_NAME, cookie.sequence, 0, atom);
+}
+
+bool RealXConnection::GetAtomNameReply(const RequestCookie& cookie,
+                                       string* name) {
   CHECK(name);
+  DCHECK_EQ(cookie.type, RequestCookie::TYPE_ATOM_NAME);
   name->clear();
 
-  xcb_get_atom_name_cookie_t cookie = xcb_get_atom_name(xcb_conn_, atom);
+  xcb_get_atom_name_cookie_t xcb_cookie = { cookie.sequence };
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_get_atom_name_reply_t> reply(
-      xcb_get_atom_name_reply(xcb_conn_, cookie, &error));
+      xcb_get_atom_name_reply(xcb_conn_, xcb_cookie, &error));
   scoped_ptr_malloc<xcb_generic_error_t> scoped_error(error);
   if (error || !reply.get()) {
-    LOG(WARNING) << "Unable to look up name for X atom " << XidStr(atom);
+    LOG(WARNING) << "Unable to look up name for X atom "
+                 << XidStr(cookie.xatom);
     return false;
   }
   name->assign(xcb_get_atom_name_name(reply.get()),
@@ -827,14 +905,28 @@ bool RealXConnection::GetAtomName(XAtom atom, string* name) {
   return true;
 }
 
-bool RealXConnection::GetIntArrayProperty(
-    XWindow xid, XAtom xatom, vector<int>* values) {
+XConnection::RequestCookie RealXConnection::SendGetPropertyRequest(
+    XWindow xid, XAtom xatom) {
+  return SendGetPropertyRequestInternal(
+      xid, xatom, RequestCookie::TYPE_PROPERTY);
+}
+
+bool RealXConnection::GetIntArrayPropertyReply(const RequestCookie& cookie,
+                                               vector<int>* values) {
+  DCHECK_EQ(cookie.type, RequestCookie::TYPE_PROPERTY);
+  return GetIntArrayPropertyReplyInternal(cookie, values);
+}
+
+bool RealXConnection::GetIntArrayPropertyReplyInternal(
+    const RequestCookie& cookie, vector<int>* values) {
   CHECK(values);
   values->clear();
 
+  const XWindow xid = cookie.xid;
+  const XAtom xatom = cookie.xatom;
   string str_value;
   int format = 0;
-  if (!GetPropertyInternal(xid, xatom, &str_value, &format, NULL))
+  if (!GetPropertyReplyInternal(cookie, &str_value, &format, NULL))
     return false;
 
   if (format != kLongFormat) {
@@ -879,13 +971,17 @@ bool RealXConnection::SetIntArrayProperty(
   return true;
 }
 
-bool RealXConnection::GetStringProperty(XWindow xid, XAtom xatom, string* out) {
+bool RealXConnection::GetStringPropertyReply(const RequestCookie& cookie,
+                                             string* out) {
   CHECK(out);
+  DCHECK_EQ(cookie.type, RequestCookie::TYPE_PROPERTY);
   out->clear();
 
+  const XWindow xid = cookie.xid;
+  const XAtom xatom = cookie.xatom;
   int format = 0;
   XAtom type = XCB_NONE;
-  if (!GetPropertyInternal(xid, xatom, out, &format, &type))
+  if (!GetPropertyReplyInternal(cookie, out, &format, &type))
     return false;
 
   if (format != kByteFormat) {
@@ -923,6 +1019,11 @@ bool RealXConnection::DeletePropertyIfExists(XWindow xid, XAtom xatom) {
   return true;
 }
 
+void RealXConnection::DiscardReply(const RequestCookie& cookie) {
+  if (!cookie.is_null())
+    xcb_discard_reply(xcb_conn_, cookie.sequence);
+}
+
 int RealXConnection::GetConnectionFileDescriptor() {
   return XConnectionNumber(display_);
 }
@@ -1029,6 +1130,7 @@ bool RealXConnection::WaitForPropertyChange(XWindow xid, XTime* timestamp_out) {
 XWindow RealXConnection::GetSelectionOwner(XAtom atom) {
   xcb_get_selection_owner_cookie_t cookie =
       xcb_get_selection_owner(xcb_conn_, atom);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_get_selection_owner_reply_t> reply(
       xcb_get_selection_owner_reply(xcb_conn_, cookie, &error));
@@ -1055,16 +1157,29 @@ bool RealXConnection::GetImage(XID drawable,
   DCHECK(data_out);
   DCHECK(format_out);
 
+  XImage* image =
+      shm_supported_ ? CreateShmImage(bounds.size(), drawable_depth) : NULL;
+  const bool using_shm = (image != NULL);
+
   TrapErrors();
-  XImage* image = XGetImage(display_,
-                            drawable,
-                            bounds.x, bounds.y,
-                            bounds.width, bounds.height,
-                            AllPlanes,
-                            ZPixmap);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
+  if (using_shm) {
+    XShmGetImage(display_, drawable, image, bounds.x, bounds.y, AllPlanes);
+  } else {
+    image = XGetImage(display_,
+                      drawable,
+                      bounds.x, bounds.y,
+                      bounds.width, bounds.height,
+                      AllPlanes,
+                      ZPixmap);
+  }
   if (int error = UntrapErrors()) {
     DLOG(WARNING) << "Got X error while getting image for drawable "
                   << XidStr(drawable) << ": " << GetErrorText(error);
+    if (using_shm)
+      DestroyShmImage(image);
+    else if (image)
+      XDestroyImage(image);
     return false;
   }
 
@@ -1077,7 +1192,10 @@ bool RealXConnection::GetImage(XID drawable,
                   << " drawable_depth=" << drawable_depth
                   << " image_depth=" << image->bits_per_pixel
                   << " lsb_first=" << (image->byte_order == LSBFirst);
-    XDestroyImage(image);
+    if (using_shm)
+      DestroyShmImage(image);
+    else
+      XDestroyImage(image);
     return false;
   }
 
@@ -1088,13 +1206,25 @@ bool RealXConnection::GetImage(XID drawable,
     DLOG(WARNING) << "Expected " << expected_size << " bytes in image from "
                   << XidStr(drawable) << " (" << bounds.size() << " at "
                   << format_bpp << " bpp) " << " but got " << data_size;
-    XDestroyImage(image);
+    if (using_shm)
+      DestroyShmImage(image);
+    else
+      XDestroyImage(image);
     return false;
   }
 
-  data_out->reset(reinterpret_cast<uint8_t*>(image->data));
-  image->data = NULL;  // Take ownership so Xlib doesn't free it.
-  XDestroyImage(image);
+  if (using_shm) {
+    // The segment gets reused by the next call, so copy the data out.
+    uint8_t* data = static_cast<uint8_t*>(malloc(data_size));
+    CHECK(data) << "Unable to allocate " << data_size << " bytes";
+    memcpy(data, image->data, data_size);
+    data_out->reset(data);
+    DestroyShmImage(image);
+  } else {
+    data_out->reset(reinterpret_cast<uint8_t*>(image->data));
+    image->data = NULL;  // Take ownership so Xlib doesn't free it.
+    XDestroyImage(image);
+  }
   return true;
 }
 
@@ -1164,6 +1294,7 @@ bool RealXConnection::GetParentWindow(XWindow xid, XWindow* parent_out) {
   }
 
   xcb_query_tree_cookie_t cookie = xcb_query_tree(xcb_conn_, xid);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_query_tree_reply_t> reply(
       xcb_query_tree_reply(xcb_conn_, cookie, &error));
@@ -1180,6 +1311,7 @@ bool RealXConnection::GetChildWindows(XWindow xid,
                                       vector<XWindow>* children_out) {
   DCHECK(children_out);
   xcb_query_tree_cookie_t cookie = xcb_query_tree(xcb_conn_, xid);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_query_tree_reply_t> reply(
       xcb_query_tree_reply(xcb_conn_, cookie, &error));
@@ -1320,6 +1452,7 @@ bool RealXConnection::SetDetectableKeyboardAutoRepeat(bool detectable) {
 bool RealXConnection::QueryKeyboardState(vector<uint8_t>* keycodes_out) {
   CHECK(keycodes_out);
   xcb_query_keymap_cookie_t cookie = xcb_query_keymap(xcb_conn_);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_query_keymap_reply_t> reply(
       xcb_query_keymap_reply(xcb_conn_, cookie, &error));
@@ -1336,6 +1469,7 @@ bool RealXConnection::QueryKeyboardState(vector<uint8_t>* keycodes_out) {
 bool RealXConnection::QueryPointerPosition(Point* absolute_pos_out) {
   DCHECK(absolute_pos_out);
   xcb_query_pointer_cookie_t cookie = xcb_query_pointer(xcb_conn_, root_);
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_query_pointer_reply_t> reply(
       xcb_query_pointer_reply(xcb_conn_, cookie, &error));
@@ -1479,6 +1613,26 @@ void RealXConnection::RenderFillRectangle(XPicture dst,
                        size.width, size.height);
 }
 
+void RealXConnection::RenderSetPictureClipRectangles(
+    XPicture pict, const vector<Rect>& rects) {
+  if (rects.empty()) {
+    XRenderPictureAttributes pa;
+    pa.clip_mask = None;
+    XRenderChangePicture(display_, pict, CPClipMask, &pa);
+    return;
+  }
+
+  vector<XRectangle> xrects(rects.size());
+  for (size_t i = 0; i < rects.size(); ++i) {
+    xrects[i].x = rects[i].x;
+    xrects[i].y = rects[i].y;
+    xrects[i].width = rects[i].width;
+    xrects[i].height = rects[i].height;
+  }
+  XRenderSetPictureClipRectangles(
+      display_, pict, 0, 0, &xrects[0], xrects.size());
+}
+
 void RealXConnection::Free(void* item) {
   XFree(item);
 }
@@ -1492,6 +1646,7 @@ XVisualInfo* RealXConnection::GetVisualInfo(long mask,
 void RealXConnection::TrapErrors() {
   DCHECK(!trapping_errors) << "X errors are already being trapped";
   // Sync to process any errors in the queue from XCB requests.
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   XSync(display_, False);
   trapping_errors = true;
   last_error_code = 0;
@@ -1502,6 +1657,7 @@ void RealXConnection::TrapErrors() {
 int RealXConnection::UntrapErrors() {
   DCHECK(trapping_errors) << "X errors aren't being trapped";
   // Sync in case we sent a request that didn't generate a reply.
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   XSync(display_, False);
   trapping_errors = false;
   return last_error_code;
@@ -1517,6 +1673,105 @@ string RealXConnection::GetErrorText(int error_code) {
   return string(str);
 }
 
+XImage* RealXConnection::CreateShmImage(const Size& size, int depth) {
+  DCHECK(shm_supported_);
+  // The visual is only used to fill in the image's color masks, which we
+  // don't look at.
+  XImage* image = XShmCreateImage(display_,
+                                  NULL,  // visual
+                                  depth,
+                                  ZPixmap,
+                                  NULL,  // data
+                                  &shm_info_,
+                                  size.width,
+                                  size.height);
+  if (!image) {
+    LOG(WARNING) << "Unable to create " << size << " shared memory image at "
+                 << "depth " << depth;
+    return NULL;
+  }
+
+  if (!EnsureShmSegment(image->bytes_per_line * image->height)) {
+    XDestroyImage(image);
+    return NULL;
+  }
+  image->data = shm_info_.shmaddr;
+  return image;
+}
+
+void RealXConnection::DestroyShmImage(XImage* image) {
+  DCHECK(image);
+  // XDestroyImage() free()s the image's data, but this image's data is
+  // |shm_info_|'s segment, which is reused by later calls.
+  DCHECK(image->data == shm_info_.shmaddr)
+      << "Image doesn't point into the shared memory segment";
+  image->data = NULL;
+  XDestroyImage(image);
+}
+
+bool RealXConnection::EnsureShmSegment(size_t size) {
+  DCHECK(shm_supported_);
+  if (shm_info_.shmaddr && shm_size_ >= size)
+    return true;
+
+  DestroyShmSegment();
+  size = ((size + kShmSegmentGranularity - 1) / kShmSegmentGranularity) *
+         kShmSegmentGranularity;
+
+  const int shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+  if (shmid < 0) {
+    PLOG(WARNING) << "Unable to create " << size << "-byte shared memory "
+                  << "segment; disabling MIT-SHM";
+    shm_supported_ = false;
+    return false;
+  }
+
+  void* addr = shmat(shmid, NULL, 0);
+  if (addr == reinterpret_cast<void*>(-1)) {
+    PLOG(WARNING) << "Unable to attach to shared memory segment " << shmid
+                  << "; disabling MIT-SHM";
+    shmctl(shmid, IPC_RMID, NULL);
+    shm_supported_ = false;
+    return false;
+  }
+
+  shm_info_.shmid = shmid;
+  shm_info_.shmaddr = static_cast<char*>(addr);
+  shm_info_.readOnly = False;
+
+  TrapErrors();
+  XShmAttach(display_, &shm_info_);
+  const int error = UntrapErrors();
+
+  // Mark the segment for deletion now so that it won't leak if we crash;
+  // it'll stick around until both we and the server have detached from it.
+  shmctl(shmid, IPC_RMID, NULL);
+
+  if (error) {
+    // This is expected when the server is on a different machine.
+    LOG(WARNING) << "Unable to attach shared memory segment to X server ("
+                 << GetErrorText(error) << "); disabling MIT-SHM";
+    shmdt(addr);
+    memset(&shm_info_, 0, sizeof(shm_info_));
+    shm_supported_ = false;
+    return false;
+  }
+
+  DLOG(INFO) << "Allocated " << size << "-byte shared memory segment for "
+             << "image transfers";
+  shm_size_ = size;
+  return true;
+}
+
+void RealXConnection::DestroyShmSegment() {
+  if (!shm_info_.shmaddr)
+    return;
+  XShmDetach(display_, &shm_info_);
+  shmdt(shm_info_.shmaddr);
+  memset(&shm_info_, 0, sizeof(shm_info_));
+  shm_size_ = 0;
+}
+
 // static
 bool RealXConnection::GetImageFormat(bool lsb_first,
                                      int image_depth,
@@ -1567,6 +1822,7 @@ bool RealXConnection::QueryExtension(const string& name,
                                      int* first_error_out) {
   xcb_query_extension_cookie_t cookie =
       xcb_query_extension(xcb_conn_, name.size(), name.data());
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_query_extension_reply_t> reply(
       xcb_query_extension_reply(xcb_conn_, cookie, &error));
@@ -1587,14 +1843,8 @@ bool RealXConnection::QueryExtension(const string& name,
   return true;
 }
 
-bool RealXConnection::GetPropertyInternal(XWindow xid,
-                                          XAtom xatom,
-                                          string* value_out,
-                                          int* format_out,
-                                          XAtom* type_out) {
-  CHECK(value_out);
-  value_out->clear();
-
+XConnection::RequestCookie RealXConnection::SendGetPropertyRequestInternal(
+    XWindow xid, XAtom xatom, RequestCookie::Type type) {
   xcb_get_property_cookie_t cookie =
       xcb_get_property(xcb_conn_,
                        0,     // delete
@@ -1603,9 +1853,23 @@ bool RealXConnection::GetPropertyInternal(XWindow xid,
                        XCB_GET_PROPERTY_TYPE_ANY,
                        0,     // offset
                        kMaxPropertySize);
+  return RequestCookie(type, cookie.sequence, xid, xatom);
+}
+
+bool RealXConnection::GetPropertyReplyInternal(const RequestCookie& cookie,
+                                               string* value_out,
+                                               int* format_out,
+                                               XAtom* type_out) {
+  CHECK(value_out);
+  value_out->clear();
+
+  const XWindow xid = cookie.xid;
+  const XAtom xatom = cookie.xatom;
+  xcb_get_property_cookie_t xcb_cookie = { cookie.sequence };
+  COUNTER_INCREMENT(XConnection_RoundTrips);
   xcb_generic_error_t* error = NULL;
   scoped_ptr_malloc<xcb_get_property_reply_t> reply(
-      xcb_get_property_reply(xcb_conn_, cookie, &error));
+      xcb_get_property_reply(xcb_conn_, xcb_cookie, &error));
   scoped_ptr_malloc<xcb_generic_error_t> scoped_error(error);
   if (error || !reply.get()) {
     LOG(WARNING) << "Got X error while getting property " << XidStr(xatom)
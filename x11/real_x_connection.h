@@ -12,6 +12,8 @@
 extern "C" {
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+// XShm.h depends on Xlib.h but doesn't include it itself.
+#include <X11/extensions/XShm.h>
 }
 #include <gtest/gtest_prod.h>  // for FRIEND_TEST() macro
 #include <xcb/xcb.h>
@@ -33,7 +35,6 @@ class RealXConnection : public XConnection {
   virtual ~RealXConnection();
 
   // Begin XConnection methods.
-  virtual bool GetWindowGeometry(XWindow xid, WindowGeometry* geom_out);
   virtual bool MapWindow(XWindow xid);
   virtual bool UnmapWindow(XWindow xid);
   virtual bool MoveWindow(XWindow xid, const Point& pos);
@@ -62,9 +63,6 @@ class RealXConnection : public XConnection {
   virtual bool GrabKeyboard(XWindow xid, XTime timestamp);
   virtual bool RemoveInputRegionFromWindow(XWindow xid);
   virtual bool SetInputRegionForWindow(XWindow xid, const Rect& rect);
-  virtual bool GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out);
-  virtual bool GetTransientHintForWindow(XWindow xid, XWindow* owner_out);
-  virtual bool GetWindowAttributes(XWindow xid, WindowAttributes* attr_out);
   virtual bool RedirectSubwindowsForCompositing(XWindow xid);
   virtual bool RedirectWindowForCompositing(XWindow xid);
   virtual bool UnredirectWindowForCompositing(XWindow xid);
@@ -95,19 +93,35 @@ class RealXConnection : public XConnection {
   virtual bool SelectRandREventsOnWindow(XWindow xid);
   virtual bool GetAtoms(const std::vector<std::string>& names,
                         std::vector<XAtom>* atoms_out);
-  virtual bool GetAtomName(XAtom atom, std::string* name);
-  virtual bool GetIntArrayProperty(XWindow xid,
-                                   XAtom xatom,
-                                   std::vector<int>* values);
   virtual bool SetIntArrayProperty(XWindow xid,
                                    XAtom xatom,
                                    XAtom type,
                                    const std::vector<int>& values);
-  virtual bool GetStringProperty(XWindow xid, XAtom xatom, std::string* out);
   virtual bool SetStringProperty(XWindow xid,
                                  XAtom xatom,
                                  const std::string& value);
   virtual bool DeletePropertyIfExists(XWindow xid, XAtom xatom);
+  virtual RequestCookie SendGetWindowGeometryRequest(XDrawable xid);
+  virtual bool GetWindowGeometryReply(const RequestCookie& cookie,
+                                      WindowGeometry* geom_out);
+  virtual RequestCookie SendGetWindowAttributesRequest(XWindow xid);
+  virtual bool GetWindowAttributesReply(const RequestCookie& cookie,
+                                        WindowAttributes* attr_out);
+  virtual RequestCookie SendGetSizeHintsRequest(XWindow xid);
+  virtual bool GetSizeHintsReply(const RequestCookie& cookie,
+                                 SizeHints* hints_out);
+  virtual RequestCookie SendGetTransientHintRequest(XWindow xid);
+  virtual bool GetTransientHintReply(const RequestCookie& cookie,
+                                     XWindow* owner_out);
+  virtual RequestCookie SendGetPropertyRequest(XWindow xid, XAtom xatom);
+  virtual bool GetIntArrayPropertyReply(const RequestCookie& cookie,
+                                        std::vector<int>* values);
+  virtual bool GetStringPropertyReply(const RequestCookie& cookie,
+                                      std::string* out);
+  virtual RequestCookie SendGetAtomNameRequest(XAtom atom);
+  virtual bool GetAtomNameReply(const RequestCookie& cookie,
+                                std::string* name);
+  virtual void DiscardReply(const RequestCookie& cookie);
   virtual int GetConnectionFileDescriptor();
   virtual bool IsEventPending();
   virtual void GetNextEvent(void* event);
@@ -176,6 +190,8 @@ class RealXConnection : public XConnection {
                                    float blue,
                                    const Point& pos,
                                    const Size& size);
+  virtual void RenderSetPictureClipRectangles(
+      XPicture pict, const std::vector<Rect>& rects);
   // End XConnection methods.
 
   // This convenience function is ONLY available for a real X
@@ -230,13 +246,22 @@ class RealXConnection : public XConnection {
                       int* first_event_out,
                       int* first_error_out);
 
-  // Read a property set on a window.  Returns false on error or if the
+  // Send a request for a property on a window.  |type| is the type to use
+  // for the returned cookie.
+  RequestCookie SendGetPropertyRequestInternal(XWindow xid,
+                                               XAtom xatom,
+                                               RequestCookie::Type type);
+
+  // Read the reply to a property request.  Returns false on error or if the
   // property isn't set.  |format_out| and |type_out| may be NULL.
-  bool GetPropertyInternal(XWindow xid,
-                           XAtom xatom,
-                           std::string* value_out,
-                           int* format_out,
-                           XAtom* type_out);
+  bool GetPropertyReplyInternal(const RequestCookie& cookie,
+                                std::string* value_out,
+                                int* format_out,
+                                XAtom* type_out);
+
+  // Read the reply to a property request as an array of 32-bit integers.
+  bool GetIntArrayPropertyReplyInternal(const RequestCookie& cookie,
+                                        std::vector<int>* values);
 
   // Check for an error caused by the XCB request using the passed-in
   // cookie.  If found, logs a warning of the form "Got XCB error while
@@ -244,6 +269,24 @@ class RealXConnection : public XConnection {
   // returns false.
   bool CheckForXcbError(xcb_void_cookie_t cookie, const char* format, ...);
 
+  // Create an XImage of the passed-in size and depth whose data points into
+  // |shm_info_|'s segment, growing the segment if needed.  The image must
+  // be freed with DestroyShmImage().  Returns NULL (and clears
+  // |shm_supported_|) if the segment couldn't be set up.
+  XImage* CreateShmImage(const Size& size, int depth);
+
+  // Free an image returned by CreateShmImage(), leaving the segment alone.
+  // Calling XDestroyImage() directly would free() the segment's address.
+  void DestroyShmImage(XImage* image);
+
+  // Make sure that |shm_info_| refers to a segment of at least |size|
+  // bytes that's attached to the X server.  The segment is reused across
+  // calls and only reallocated when a larger one is needed.
+  bool EnsureShmSegment(size_t size);
+
+  // Detach and release |shm_info_|'s segment, if any.
+  void DestroyShmSegment();
+
   // The actual connection to the X server.
   XDisplay* display_;
 
@@ -260,6 +303,17 @@ class RealXConnection : public XConnection {
   // a circular dependency with AtomCache).
   XAtom utf8_string_atom_;
 
+  // Is the MIT-SHM extension usable?  If so, GetImage() transfers image
+  // data through a shared memory segment instead of the X socket.  This is
+  // cleared if we fail to set up a segment (e.g. because the server is
+  // remote).
+  bool shm_supported_;
+
+  // Shared memory segment used by GetImage() and its size in bytes.
+  // |shm_info_.shmaddr| is NULL if no segment has been allocated yet.
+  XShmSegmentInfo shm_info_;
+  size_t shm_size_;
+
   DISALLOW_COPY_AND_ASSIGN(RealXConnection);
 };
 
@@ -23,16 +23,53 @@ XAtom XConnection::GetAtomOrDie(const std::string& name) {
   return atom;
 }
 
+bool XConnection::GetWindowGeometry(XWindow xid, WindowGeometry* geom_out) {
+  return GetWindowGeometryReply(SendGetWindowGeometryRequest(xid), geom_out);
+}
+
+bool XConnection::GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out) {
+  return GetSizeHintsReply(SendGetSizeHintsRequest(xid), hints_out);
+}
+
+bool XConnection::GetTransientHintForWindow(XWindow xid, XWindow* owner_out) {
+  return GetTransientHintReply(SendGetTransientHintRequest(xid), owner_out);
+}
+
+bool XConnection::GetWindowAttributes(XWindow xid,
+                                      WindowAttributes* attr_out) {
+  return GetWindowAttributesReply(SendGetWindowAttributesRequest(xid),
+                                  attr_out);
+}
+
 bool XConnection::GetIntProperty(XWindow xid, XAtom xatom, int* value) {
+  return GetIntPropertyReply(SendGetPropertyRequest(xid, xatom), value);
+}
+
+bool XConnection::GetIntArrayProperty(XWindow xid,
+                                      XAtom xatom,
+                                      vector<int>* values) {
+  return GetIntArrayPropertyReply(SendGetPropertyRequest(xid, xatom), values);
+}
+
+bool XConnection::GetStringProperty(XWindow xid, XAtom xatom, string* out) {
+  return GetStringPropertyReply(SendGetPropertyRequest(xid, xatom), out);
+}
+
+bool XConnection::GetAtomName(XAtom atom, string* name) {
+  return GetAtomNameReply(SendGetAtomNameRequest(atom), name);
+}
+
+bool XConnection::GetIntPropertyReply(const RequestCookie& cookie,
+                                      int* value) {
   CHECK(value);
   vector<int> values;
-  if (!GetIntArrayProperty(xid, xatom, &values)) {
+  if (!GetIntArrayPropertyReply(cookie, &values)) {
     return false;
   }
 
-  CHECK(!values.empty());  // guaranteed by GetIntArrayProperty()
+  CHECK(!values.empty());  // guaranteed by GetIntArrayPropertyReply()
   if (values.size() > 1) {
-    LOG(WARNING) << "GetIntProperty() called for property " << xatom
+    LOG(WARNING) << "GetIntProperty() called for property " << cookie.xatom
                  << " with " << values.size() << " values; just returning "
                  << "the first";
   }
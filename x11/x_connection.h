@@ -154,6 +154,46 @@ class XConnection {
     DAMAGE_REPORT_LEVEL_NON_EMPTY = 3,
   };
 
+  // Handle for a request sent by one of the Send*Request() methods.  See
+  // the comment above those methods for details.
+  struct RequestCookie {
+    // Type of request that the cookie refers to.
+    enum Type {
+      TYPE_NONE = 0,
+      TYPE_GEOMETRY,
+      TYPE_ATTRIBUTES,
+      TYPE_PROPERTY,
+      TYPE_SIZE_HINTS,
+      TYPE_TRANSIENT_HINT,
+      TYPE_ATOM_NAME,
+    };
+
+    RequestCookie()
+        : type(TYPE_NONE),
+          sequence(0),
+          xid(0),
+          xatom(0) {
+    }
+    RequestCookie(Type type, unsigned int sequence, XID xid, XAtom xatom)
+        : type(type),
+          sequence(sequence),
+          xid(xid),
+          xatom(xatom) {
+    }
+
+    bool is_null() const { return type == TYPE_NONE; }
+
+    Type type;
+
+    // Sequence number of the request on the connection.
+    unsigned int sequence;
+
+    // Window or drawable that the request is about, and the property's
+    // atom for property requests.
+    XID xid;
+    XAtom xatom;
+  };
+
   // Get the base event ID for extension events.
   int damage_event_base() const { return damage_event_base_; }
   int shape_event_base() const { return shape_event_base_; }
@@ -168,7 +208,7 @@ class XConnection {
   // that you're calling waits for a reply from the X server.
 
   // Get a window's geometry.
-  virtual bool GetWindowGeometry(XWindow xid, WindowGeometry* geom_out) = 0;
+  bool GetWindowGeometry(XWindow xid, WindowGeometry* geom_out);
 
   // Map or unmap a window.  MapWindow() returns false if the request fails.
   virtual bool MapWindow(XWindow xid) = 0;
@@ -270,13 +310,13 @@ class XConnection {
   virtual bool SetInputRegionForWindow(XWindow xid, const Rect& region) = 0;
 
   // Get the size hints for a window.
-  virtual bool GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out) = 0;
+  bool GetSizeHintsForWindow(XWindow xid, SizeHints* hints_out);
 
   // Get the transient-for hint for a window.
-  virtual bool GetTransientHintForWindow(XWindow xid, XWindow* owner_out) = 0;
+  bool GetTransientHintForWindow(XWindow xid, XWindow* owner_out);
 
   // Get a window's attributes.
-  virtual bool GetWindowAttributes(XWindow xid, WindowAttributes* attr_out) = 0;
+  bool GetWindowAttributes(XWindow xid, WindowAttributes* attr_out);
 
   // Redirect all of a window's present and future child windows to
   // offscreen pixmaps so they can be composited.
@@ -360,7 +400,7 @@ class XConnection {
 
   // Get the name of the passed-in atom, saving it to |name|.  Returns
   // false if the atom isn't present in the server.
-  virtual bool GetAtomName(XAtom atom, std::string* name) = 0;
+  bool GetAtomName(XAtom atom, std::string* name);
 
   // Get or set a property consisting of a single 32-bit integer.
   // Calls the corresponding abstract {Get,Set}IntArrayProperty() method.
@@ -368,9 +408,7 @@ class XConnection {
   bool SetIntProperty(XWindow xid, XAtom xatom, XAtom type, int value);
 
   // Get or set a property consisting of one or more 32-bit integers.
-  virtual bool GetIntArrayProperty(XWindow xid,
-                                   XAtom xatom,
-                                   std::vector<int>* values) = 0;
+  bool GetIntArrayProperty(XWindow xid, XAtom xatom, std::vector<int>* values);
   virtual bool SetIntArrayProperty(XWindow xid,
                                    XAtom xatom,
                                    XAtom type,
@@ -378,9 +416,7 @@ class XConnection {
 
   // Get or set a string property (of type STRING or UTF8_STRING when
   // getting and UTF8_STRING when setting).
-  virtual bool GetStringProperty(XWindow xid,
-                                 XAtom xatom,
-                                 std::string* out) = 0;
+  bool GetStringProperty(XWindow xid, XAtom xatom, std::string* out);
   virtual bool SetStringProperty(XWindow xid,
                                  XAtom xatom,
                                  const std::string& value) = 0;
@@ -388,6 +424,46 @@ class XConnection {
   // Delete a property on a window if it exists.
   virtual bool DeletePropertyIfExists(XWindow xid, XAtom xatom) = 0;
 
+  // Asynchronous versions of the above methods that need to wait for
+  // replies from the X server.  Each Send*Request() method sends a request
+  // without waiting for its reply and returns a cookie that must later be
+  // passed to exactly one matching Get*Reply() method (which blocks until
+  // the reply arrives) or to DiscardReply().  Sending several requests
+  // before collecting any of their replies costs a single round trip to the
+  // server rather than one per request.  The synchronous methods are
+  // implemented on top of these.
+  virtual RequestCookie SendGetWindowGeometryRequest(XDrawable xid) = 0;
+  virtual bool GetWindowGeometryReply(const RequestCookie& cookie,
+                                      WindowGeometry* geom_out) = 0;
+
+  virtual RequestCookie SendGetWindowAttributesRequest(XWindow xid) = 0;
+  virtual bool GetWindowAttributesReply(const RequestCookie& cookie,
+                                        WindowAttributes* attr_out) = 0;
+
+  virtual RequestCookie SendGetSizeHintsRequest(XWindow xid) = 0;
+  virtual bool GetSizeHintsReply(const RequestCookie& cookie,
+                                 SizeHints* hints_out) = 0;
+
+  virtual RequestCookie SendGetTransientHintRequest(XWindow xid) = 0;
+  virtual bool GetTransientHintReply(const RequestCookie& cookie,
+                                     XWindow* owner_out) = 0;
+
+  // The reply to a property request can be read as either an int array or a
+  // string.
+  virtual RequestCookie SendGetPropertyRequest(XWindow xid, XAtom xatom) = 0;
+  virtual bool GetIntArrayPropertyReply(const RequestCookie& cookie,
+                                        std::vector<int>* values) = 0;
+  virtual bool GetStringPropertyReply(const RequestCookie& cookie,
+                                      std::string* out) = 0;
+  bool GetIntPropertyReply(const RequestCookie& cookie, int* value);
+
+  virtual RequestCookie SendGetAtomNameRequest(XAtom atom) = 0;
+  virtual bool GetAtomNameReply(const RequestCookie& cookie,
+                                std::string* name) = 0;
+
+  // Throw away the reply to a request that we're no longer interested in.
+  virtual void DiscardReply(const RequestCookie& cookie) = 0;
+
   // Get the X connection's file descriptor.
   virtual int GetConnectionFileDescriptor() = 0;
 
@@ -438,7 +514,9 @@ class XConnection {
   virtual XWindow GetSelectionOwner(XAtom atom) = 0;
   virtual bool SetSelectionOwner(XAtom atom, XWindow xid, XTime timestamp) = 0;
 
-  // Get the contents of a drawable.
+  // Get the contents of the |bounds| region of a drawable (which needn't
+  // cover the whole drawable).  Implementations may transfer the data
+  // through shared memory when the X server supports it.
   // Returns false for unsupported formats or X errors.
   virtual bool GetImage(XID drawable,
                         const Rect& bounds,
@@ -577,6 +655,11 @@ class XConnection {
                                    const Point& pos,
                                    const Size& size) = 0;
 
+  // Restrict rendering into |pict| to |rects|.  Passing an empty vector
+  // removes the clip.
+  virtual void RenderSetPictureClipRectangles(
+      XPicture pict, const std::vector<Rect>& rects) = 0;
+
   // Value that should be used in event and property |format| fields for
   // byte and long arguments.
   static const int kByteFormat;
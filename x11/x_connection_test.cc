@@ -9,12 +9,15 @@
 #include <gtest/gtest.h>
 
 #include "base/logging.h"
+#include "window_manager/geometry.h"
 #include "window_manager/test_lib.h"
+#include "window_manager/x11/mock_x_connection.h"
 #include "window_manager/x11/x_connection.h"
 
 DEFINE_bool(logtostderr, false,
             "Print debugging messages to stderr (suppressed otherwise)");
 
+using std::string;
 using std::vector;
 
 namespace window_manager {
@@ -39,6 +42,56 @@ TEST_F(XConnectionTest, GetKeyCodeState) {
   }
 }
 
+// Check that the synchronous getters are implemented in terms of the
+// asynchronous request methods and that requests can be pipelined.
+TEST_F(XConnectionTest, AsyncRequests) {
+  MockXConnection xconn;
+  const XWindow xid = xconn.CreateWindow(
+      xconn.GetRootWindow(), Rect(10, 20, 30, 40),
+      false,  // override_redirect
+      false,  // input_only
+      0, 0);  // event_mask, visual
+  const XAtom int_atom = 500, string_atom = 501;  // arbitrary
+  xconn.SetIntProperty(xid, int_atom, int_atom, 7);
+  xconn.SetStringProperty(xid, string_atom, "foo");
+
+  // Send several requests and then read their replies.  Only the first
+  // reply should require a round trip.
+  XConnection::RequestCookie geometry_cookie =
+      xconn.SendGetWindowGeometryRequest(xid);
+  XConnection::RequestCookie int_cookie =
+      xconn.SendGetPropertyRequest(xid, int_atom);
+  XConnection::RequestCookie string_cookie =
+      xconn.SendGetPropertyRequest(xid, string_atom);
+  XConnection::RequestCookie missing_cookie =
+      xconn.SendGetPropertyRequest(xid, 502);
+  EXPECT_FALSE(geometry_cookie.is_null());
+  EXPECT_EQ(4U, xconn.num_pending_requests());
+  EXPECT_EQ(0, xconn.num_round_trips());
+
+  XConnection::WindowGeometry geometry;
+  EXPECT_TRUE(xconn.GetWindowGeometryReply(geometry_cookie, &geometry));
+  EXPECT_EQ(Rect(10, 20, 30, 40), geometry.bounds);
+  int int_value = 0;
+  EXPECT_TRUE(xconn.GetIntPropertyReply(int_cookie, &int_value));
+  EXPECT_EQ(7, int_value);
+  string string_value;
+  EXPECT_TRUE(xconn.GetStringPropertyReply(string_cookie, &string_value));
+  EXPECT_EQ("foo", string_value);
+  EXPECT_EQ(1, xconn.num_round_trips());
+
+  // We should be able to throw away a reply without reading it.
+  xconn.DiscardReply(missing_cookie);
+  EXPECT_EQ(0U, xconn.num_pending_requests());
+
+  // Each synchronous call should cost a separate round trip.
+  EXPECT_TRUE(xconn.GetIntProperty(xid, int_atom, &int_value));
+  EXPECT_TRUE(xconn.GetStringProperty(xid, string_atom, &string_value));
+  EXPECT_FALSE(xconn.GetIntProperty(xid, 502, &int_value));
+  EXPECT_EQ(4, xconn.num_round_trips());
+  EXPECT_EQ(0U, xconn.num_pending_requests());
+}
+
 }  // namespace window_manager
 
 int main(int argc, char** argv) {
@@ -0,0 +1,108 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "window_manager/x_event_coalescer.h"
+
+extern "C" {
+#include <X11/extensions/Xdamage.h>
+}
+
+#include "base/logging.h"
+#include "window_manager/geometry.h"
+
+using std::make_pair;
+using std::pair;
+using std::vector;
+
+namespace window_manager {
+
+XEventCoalescer::XEventCoalescer(int damage_event_type)
+    : damage_event_type_(damage_event_type),
+      num_dropped_events_(0),
+      last_configure_index_(-1),
+      num_coalesced_events_(0) {
+}
+
+XEventCoalescer::~XEventCoalescer() {}
+
+void XEventCoalescer::AddEvent(const XEvent& event) {
+  const size_t index = events_.size();
+  events_.push_back(event);
+  dropped_.push_back(false);
+
+  if (event.type == ConfigureNotify) {
+    const XWindow xid = event.xconfigure.window;
+    if (last_configure_index_ >= 0 &&
+        events_[last_configure_index_].xconfigure.window == xid) {
+      DropEvent(last_configure_index_);
+    }
+    last_configure_index_ = index;
+
+    // Damage from before a resize refers to the old pixmap.
+    damage_indices_.erase(xid);
+  } else if (event.type == damage_event_type_) {
+    XDamageNotifyEvent* damage_event =
+        reinterpret_cast<XDamageNotifyEvent*>(&events_[index]);
+    WindowIndexMap::iterator it = damage_indices_.find(damage_event->drawable);
+    if (it != damage_indices_.end()) {
+      const XDamageNotifyEvent& prev_event =
+          *(reinterpret_cast<XDamageNotifyEvent*>(&events_[it->second]));
+      Rect area(damage_event->area.x, damage_event->area.y,
+                damage_event->area.width, damage_event->area.height);
+      area.merge(Rect(prev_event.area.x, prev_event.area.y,
+                      prev_event.area.width, prev_event.area.height));
+      damage_event->area.x = area.x;
+      damage_event->area.y = area.y;
+      damage_event->area.width = area.width;
+      damage_event->area.height = area.height;
+      DropEvent(it->second);
+      it->second = index;
+    } else {
+      damage_indices_.insert(make_pair(damage_event->drawable, index));
+    }
+  } else if (event.type == PropertyNotify) {
+    const pair<XWindow, XAtom> key(event.xproperty.window,
+                                   event.xproperty.atom);
+    PropertyIndexMap::iterator it = property_indices_.find(key);
+    if (it != property_indices_.end()) {
+      DropEvent(it->second);
+      it->second = index;
+    } else {
+      property_indices_.insert(make_pair(key, index));
+    }
+  } else {
+    ResetMergeState();
+  }
+}
+
+void XEventCoalescer::TakeEvents(vector<XEvent>* events_out) {
+  DCHECK(events_out);
+  events_out->clear();
+  events_out->reserve(num_events());
+  for (size_t i = 0; i < events_.size(); ++i) {
+    if (!dropped_[i])
+      events_out->push_back(events_[i]);
+  }
+
+  events_.clear();
+  dropped_.clear();
+  num_dropped_events_ = 0;
+  ResetMergeState();
+}
+
+void XEventCoalescer::DropEvent(size_t index) {
+  DCHECK_LT(index, events_.size());
+  DCHECK(!dropped_[index]);
+  dropped_[index] = true;
+  num_dropped_events_++;
+  num_coalesced_events_++;
+}
+
+void XEventCoalescer::ResetMergeState() {
+  last_configure_index_ = -1;
+  damage_indices_.clear();
+  property_indices_.clear();
+}
+
+}  // namespace window_manager
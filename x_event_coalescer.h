@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WINDOW_MANAGER_X_EVENT_COALESCER_H_
+#define WINDOW_MANAGER_X_EVENT_COALESCER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include "base/basictypes.h"
+#include "window_manager/x11/x_types.h"
+
+namespace window_manager {
+
+// Collects a batch of X events and drops the ones that are made redundant
+// by later events in the same batch, so that bursts of notifications
+// about the same window (e.g. while a window is being resized or playing
+// video) only get handled once:
+//
+// - ConfigureNotify: only the last event for a window is kept, as long as
+//   no other window was configured in between (the events describe
+//   stacking relative to other windows, so we can't reorder them).
+// - DamageNotify: damaged areas for a drawable are merged into the last
+//   event, unless the drawable was configured in between.
+// - PropertyNotify: only the last event for each window/property pair is
+//   kept; the handlers refetch the property's current value anyway.
+//
+// Any other type of event acts as a barrier: events before it are never
+// merged with events after it.
+class XEventCoalescer {
+ public:
+  // |damage_event_type| is the type used for damage notify events (the
+  // damage extension's event base plus XDamageNotify).
+  explicit XEventCoalescer(int damage_event_type);
+  ~XEventCoalescer();
+
+  // Number of events in the current batch, not counting dropped ones.
+  size_t num_events() const { return events_.size() - num_dropped_events_; }
+
+  // Number of events that have been dropped since we were created.
+  int64_t num_coalesced_events() const { return num_coalesced_events_; }
+
+  // Add an event to the end of the batch, dropping any earlier events that
+  // it makes redundant.
+  void AddEvent(const XEvent& event);
+
+  // Copy the remaining events into |events_out| in the order in which they
+  // were added and start a new batch.
+  void TakeEvents(std::vector<XEvent>* events_out);
+
+ private:
+  typedef std::map<XWindow, size_t> WindowIndexMap;
+  typedef std::map<std::pair<XWindow, XAtom>, size_t> PropertyIndexMap;
+
+  // Mark the event at |index| in |events_| as dropped.
+  void DropEvent(size_t index);
+
+  // Forget about all earlier events so that they won't be merged with
+  // later ones.
+  void ResetMergeState();
+
+  // Type used for damage notify events.
+  int damage_event_type_;
+
+  // Events in the current batch, and whether each has been dropped.
+  std::vector<XEvent> events_;
+  std::vector<bool> dropped_;
+  size_t num_dropped_events_;
+
+  // Index in |events_| of the last ConfigureNotify event, or -1 if there
+  // isn't one that can be merged with later events.
+  int last_configure_index_;
+
+  // Indices in |events_| of the last mergeable damage notify event for each
+  // drawable and property notify event for each window/property pair.
+  WindowIndexMap damage_indices_;
+  PropertyIndexMap property_indices_;
+
+  int64_t num_coalesced_events_;
+
+  DISALLOW_COPY_AND_ASSIGN(XEventCoalescer);
+};
+
+}  // namespace window_manager
+
+#endif  // WINDOW_MANAGER_X_EVENT_COALESCER_H_
@@ -0,0 +1,162 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <cstring>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include <X11/extensions/Xdamage.h>
+#include <X11/Xlib.h>
+}
+
+#include "window_manager/geometry.h"
+#include "window_manager/test_lib.h"
+#include "window_manager/x11/mock_x_connection.h"
+#include "window_manager/x_event_coalescer.h"
+
+DEFINE_bool(logtostderr, false,
+            "Print debugging messages to stderr (suppressed otherwise)");
+
+using std::vector;
+
+namespace window_manager {
+
+class XEventCoalescerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    xconn_.reset(new MockXConnection);
+    coalescer_.reset(
+        new XEventCoalescer(xconn_->damage_event_base() + XDamageNotify));
+  }
+
+  void AddConfigureNotifyEvent(XWindow xid, const Rect& bounds) {
+    XEvent event;
+    memset(&event, 0, sizeof(event));
+    event.xconfigure.type = ConfigureNotify;
+    event.xconfigure.window = xid;
+    event.xconfigure.x = bounds.x;
+    event.xconfigure.y = bounds.y;
+    event.xconfigure.width = bounds.width;
+    event.xconfigure.height = bounds.height;
+    coalescer_->AddEvent(event);
+  }
+
+  void AddDamageNotifyEvent(XWindow xid, const Rect& bounds) {
+    XEvent event;
+    xconn_->InitDamageNotifyEvent(&event, xid, bounds);
+    coalescer_->AddEvent(event);
+  }
+
+  void AddPropertyNotifyEvent(XWindow xid, XAtom xatom) {
+    XEvent event;
+    xconn_->InitPropertyNotifyEvent(&event, xid, xatom);
+    coalescer_->AddEvent(event);
+  }
+
+  void AddMapNotifyEvent(XWindow xid) {
+    XEvent event;
+    memset(&event, 0, sizeof(event));
+    event.xmap.type = MapNotify;
+    event.xmap.window = xid;
+    coalescer_->AddEvent(event);
+  }
+
+  scoped_ptr<MockXConnection> xconn_;
+  scoped_ptr<XEventCoalescer> coalescer_;
+};
+
+TEST_F(XEventCoalescerTest, MergeConfigureNotify) {
+  AddConfigureNotifyEvent(1, Rect(0, 0, 10, 10));
+  AddConfigureNotifyEvent(1, Rect(0, 0, 20, 20));
+  AddConfigureNotifyEvent(1, Rect(5, 5, 30, 30));
+  EXPECT_EQ(1U, coalescer_->num_events());
+
+  // A ConfigureNotify for a different window can change the stacking
+  // order, so events on either side of it shouldn't be merged.
+  AddConfigureNotifyEvent(2, Rect(0, 0, 10, 10));
+  AddConfigureNotifyEvent(1, Rect(6, 6, 40, 40));
+  EXPECT_EQ(3U, coalescer_->num_events());
+  EXPECT_EQ(2, coalescer_->num_coalesced_events());
+
+  vector<XEvent> events;
+  coalescer_->TakeEvents(&events);
+  ASSERT_EQ(3U, events.size());
+  EXPECT_EQ(1U, events[0].xconfigure.window);
+  EXPECT_EQ(5, events[0].xconfigure.x);
+  EXPECT_EQ(30, events[0].xconfigure.width);
+  EXPECT_EQ(2U, events[1].xconfigure.window);
+  EXPECT_EQ(1U, events[2].xconfigure.window);
+  EXPECT_EQ(40, events[2].xconfigure.width);
+  EXPECT_EQ(0U, coalescer_->num_events());
+
+  // Events from the previous batch shouldn't be merged with new ones.
+  AddConfigureNotifyEvent(1, Rect(0, 0, 10, 10));
+  EXPECT_EQ(1U, coalescer_->num_events());
+  EXPECT_EQ(2, coalescer_->num_coalesced_events());
+}
+
+TEST_F(XEventCoalescerTest, DamageNotify) {
+  AddDamageNotifyEvent(1, Rect(0, 0, 10, 10));
+  AddDamageNotifyEvent(2, Rect(0, 0, 5, 5));
+  AddDamageNotifyEvent(1, Rect(20, 30, 10, 10));
+
+  vector<XEvent> events;
+  coalescer_->TakeEvents(&events);
+  ASSERT_EQ(2U, events.size());
+  const XDamageNotifyEvent& first =
+      *(reinterpret_cast<XDamageNotifyEvent*>(&events[0]));
+  const XDamageNotifyEvent& second =
+      *(reinterpret_cast<XDamageNotifyEvent*>(&events[1]));
+  EXPECT_EQ(2U, first.drawable);
+  EXPECT_EQ(Rect(0, 0, 5, 5), Rect(first.area.x, first.area.y,
+                                   first.area.width, first.area.height));
+  EXPECT_EQ(1U, second.drawable);
+  EXPECT_EQ(Rect(0, 0, 30, 40), Rect(second.area.x, second.area.y,
+                                     second.area.width, second.area.height));
+
+  // Damage from before a ConfigureNotify shouldn't be merged with damage
+  // from after it.
+  AddDamageNotifyEvent(1, Rect(0, 0, 10, 10));
+  AddConfigureNotifyEvent(1, Rect(0, 0, 5, 5));
+  AddDamageNotifyEvent(1, Rect(0, 0, 5, 5));
+  EXPECT_EQ(3U, coalescer_->num_events());
+}
+
+TEST_F(XEventCoalescerTest, DedupPropertyNotify) {
+  AddPropertyNotifyEvent(1, 100);
+  AddPropertyNotifyEvent(1, 101);
+  AddPropertyNotifyEvent(2, 100);
+  AddPropertyNotifyEvent(1, 100);
+  EXPECT_EQ(3U, coalescer_->num_events());
+
+  vector<XEvent> events;
+  coalescer_->TakeEvents(&events);
+  ASSERT_EQ(3U, events.size());
+  EXPECT_EQ(101U, events[0].xproperty.atom);
+  EXPECT_EQ(2U, events[1].xproperty.window);
+  EXPECT_EQ(1U, events[2].xproperty.window);
+  EXPECT_EQ(100U, events[2].xproperty.atom);
+}
+
+// Check that other events act as barriers.
+TEST_F(XEventCoalescerTest, Barriers) {
+  AddConfigureNotifyEvent(1, Rect(0, 0, 10, 10));
+  AddDamageNotifyEvent(1, Rect(0, 0, 10, 10));
+  AddPropertyNotifyEvent(1, 100);
+  AddMapNotifyEvent(1);
+  AddConfigureNotifyEvent(1, Rect(0, 0, 20, 20));
+  AddDamageNotifyEvent(1, Rect(0, 0, 10, 10));
+  AddPropertyNotifyEvent(1, 100);
+  EXPECT_EQ(7U, coalescer_->num_events());
+  EXPECT_EQ(0, coalescer_->num_coalesced_events());
+}
+
+}  // namespace window_manager
+
+int main(int argc, char** argv) {
+  return window_manager::InitAndRunTests(&argc, argv, &FLAGS_logtostderr);
+}